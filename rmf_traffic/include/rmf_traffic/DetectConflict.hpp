@@ -21,6 +21,7 @@
 #include <rmf_traffic/Trajectory.hpp>
 #include <rmf_traffic/Profile.hpp>
 #include <exception>
+#include <vector>
 
 namespace rmf_traffic {
 
@@ -58,6 +59,47 @@ public:
     const Trajectory& trajectory_b,
     Interpolate interpolation = Interpolate::CubicSpline);
 
+  /// A profile and trajectory that a batch of conflict checks should be done
+  /// against. The profile and trajectory must outlive the check.
+  struct Other
+  {
+    const Profile& profile;
+    const Trajectory& trajectory;
+  };
+
+  /// A conflict that was found by a batch of conflict checks
+  struct Hit
+  {
+    /// The index of the Other that is in conflict
+    std::size_t index;
+
+    /// The time of the first conflict with that Other
+    Time time;
+  };
+
+  /// Checks one trajectory against many others. This gives the same results as
+  /// calling between() for each pair, but the profile, splines and bounding
+  /// boxes of `a` only get prepared once for the whole batch. Any Other that
+  /// does not overlap trajectory_a in time, or whose bounding box never comes
+  /// near the bounding box of trajectory_a, gets skipped before any of the
+  /// detailed checks are done.
+  ///
+  /// \param[in] others
+  ///   The profiles and trajectories to check trajectory_a against.
+  ///
+  /// \param[in] stop_at_first
+  ///   If true, the check will stop at the first Other that is in conflict.
+  ///   Otherwise every Other will be checked.
+  ///
+  /// \return a Hit for each Other that is in conflict with trajectory_a, in the
+  /// same order as others.
+  static std::vector<Hit> between(
+    const Profile& profile_a,
+    const Trajectory& trajectory_a,
+    const std::vector<Other>& others,
+    bool stop_at_first = false,
+    Interpolate interpolation = Interpolate::CubicSpline);
+
   class Implementation;
 };
 
@@ -102,9 +102,17 @@ public:
     /// signficantly changes the topology of the Trajectory, because it will
     /// change the order in which the positions are traversed.
     ///
+    /// \warning This Waypoint may be moved to a different place in memory, so
+    /// the reference that this function was called on must not be used again.
+    /// Use the reference that gets returned instead. References to every other
+    /// Waypoint of this Trajectory are invalidated as well, but iterators stay
+    /// valid.
+    ///
     /// \param[in] new_time
     ///   The new timing for this Trajectory Waypoint.
     ///
+    /// \return a reference to this Waypoint in its new place
+    ///
     /// \sa adjust_times(Time new_time)
     Waypoint& change_time(Time new_time);
 
@@ -142,6 +150,12 @@ public:
   // These classes allow users to traverse the contents of the Trajectory.
   // The trajectory operates much like a typical C++ container, but only for
   // Trajectory::Waypoint information.
+  //
+  // Iterators remain valid until the Waypoint they refer to is erased, even
+  // while other Waypoints are inserted or erased. References to a Waypoint
+  // behave like references to the elements of a std::vector: inserting,
+  // erasing, or changing the time of any Waypoint may invalidate them, so
+  // hold onto an iterator instead of a reference across those operations.
   template<typename> class base_iterator;
   using iterator = base_iterator<Waypoint>;
   using const_iterator = base_iterator<const Waypoint>;
@@ -172,12 +186,18 @@ public:
   ///
   /// The Waypoint will be inserted into the Trajectory according to its time,
   /// ensuring correct ordering of all Waypoints.
+  ///
+  /// \warning Inserting a Waypoint invalidates all references to the
+  /// Waypoints of this Trajectory. Iterators stay valid.
   InsertionResult insert(
     Time time,
     Eigen::Vector3d position,
     Eigen::Vector3d velocity);
 
   /// Insert a copy of another Trajectory's Waypoint into this one.
+  ///
+  /// \warning Inserting a Waypoint invalidates all references to the
+  /// Waypoints of this Trajectory. Iterators stay valid.
   InsertionResult insert(const Waypoint& other);
 
   // TODO(MXG): Consider an insert() function that accepts a range of iterators
@@ -217,6 +237,10 @@ public:
 
   /// Erase the specified waypoint.
   ///
+  /// \warning Erasing a Waypoint invalidates all references to the Waypoints
+  /// of this Trajectory. Iterators to the Waypoints that were not erased stay
+  /// valid.
+  ///
   /// \return an iterator following the last removed element
   iterator erase(iterator waypoint);
 
@@ -224,6 +248,10 @@ public:
   ///
   /// \note The `last` element is not included in the range.
   ///
+  /// \warning Erasing Waypoints invalidates all references to the Waypoints
+  /// of this Trajectory. Iterators to the Waypoints that were not erased stay
+  /// valid.
+  ///
   /// \return an iterator following the last removed element
   iterator erase(iterator first, iterator last);
 
@@ -290,6 +318,12 @@ public:
   /// detection, the Trajectory must have a size of at least 2.
   std::size_t size() const;
 
+  /// Reserve space for the given number of Waypoints. Inserting up to that
+  /// many Waypoints afterwards will not need to allocate any more memory.
+  /// This is useful when building a Trajectory whose size is known ahead of
+  /// time.
+  void reserve(std::size_t size);
+
   // TODO(MXG): Add operator[]
 
   /// \internal Used internally by unit and integration tests so we can test
@@ -88,6 +88,55 @@ public:
     /// Get a const reference to the interpolation options
     const Interpolate::Options& interpolation() const;
 
+    /// Set how many bytes of memory the planner may spend on precomputed
+    /// heuristic tables. When a Planner is created with a budget, it will
+    /// search backwards from each waypoint that can be a goal over the whole
+    /// graph, accounting for lane events and for the time it takes to turn,
+    /// and keep the cost of reaching that goal from every waypoint. Plans to
+    /// those goals can then look up their cost estimates directly.
+    ///
+    /// Each table takes 8 bytes for every waypoint in the graph. The goals
+    /// whose tables do not fit within the budget will have their cost
+    /// estimates computed as they are needed, which is also what happens when
+    /// there is no budget. By default there is no budget.
+    ///
+    /// \note Precomputing the tables makes creating the Planner slower.
+    Configuration& heuristic_table_budget(
+      rmf_utils::optional<std::size_t> bytes);
+
+    /// Get the memory budget for precomputed heuristic tables.
+    rmf_utils::optional<std::size_t> heuristic_table_budget() const;
+
+    /// Set a file where the precomputed heuristic tables are saved, so that
+    /// the next Planner that gets created with the same graph, vehicle traits,
+    /// and interpolation options can map the tables into memory instead of
+    /// computing them again. This has no effect unless there is also a
+    /// heuristic_table_budget().
+    ///
+    /// When the file was saved for a different configuration or budget, or by
+    /// a different version of this library, it is ignored and replaced with
+    /// fresh tables. If the file cannot be written, the tables are still used,
+    /// but they will need to be computed again the next time. By default there
+    /// is no file.
+    ///
+    /// \note The file uses the byte order of the machine that wrote it, so it
+    /// should not be shared between machines of different architectures.
+    ///
+    /// \note Only the user that saved the file can read it. Planners that run
+    /// as other users will compute the tables and try to replace the file.
+    ///
+    /// \warning The file is mapped into memory with MAP_SHARED, and every
+    /// Planner that uses it keeps reading from it for as long as the Planner
+    /// exists. Truncating or overwriting the file in place while a Planner is
+    /// using it will crash that Planner with SIGBUS. To replace the file,
+    /// write a new file and rename it over the old one, which is what the
+    /// Planner itself does.
+    Configuration& heuristic_table_file(
+      rmf_utils::optional<std::string> path);
+
+    /// Get the file where the precomputed heuristic tables are saved.
+    const rmf_utils::optional<std::string>& heuristic_table_file() const;
+
     // TODO(MXG): Add a field to specify whether multi-start planning problems
     // should choose the plan that takes the least amount of time (according to
     // plan duration) or the plan that finishes the earliest (according to the
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef RMF_TRAFFIC__SCHEDULE__BUCKETOPTIONS_HPP
+#define RMF_TRAFFIC__SCHEDULE__BUCKETOPTIONS_HPP
+
+#include <rmf_traffic/Time.hpp>
+
+#include <rmf_utils/impl_ptr.hpp>
+#include <rmf_utils/optional.hpp>
+
+namespace rmf_traffic {
+namespace schedule {
+
+//==============================================================================
+/// The schedule sorts its routes into buckets that each cover a range of time,
+/// so that a query only needs to look at the routes which are in the buckets
+/// that overlap the time range of the query. These options determine how wide
+/// the buckets are.
+///
+/// By default every bucket has the same width. A split threshold and a merge
+/// threshold can be set to make the widths adapt to how busy the schedule is.
+/// A bucket that holds more routes than the split threshold will be split in
+/// half, and two neighboring buckets that hold no more routes than the merge
+/// threshold between them will be merged into one.
+class BucketOptions
+{
+public:
+
+  static constexpr Duration DefaultDuration = std::chrono::minutes(1);
+  static constexpr Duration DefaultMinDuration = std::chrono::seconds(5);
+  static constexpr Duration DefaultMaxDuration = std::chrono::minutes(10);
+
+  /// Constructor
+  ///
+  /// \param[in] duration
+  ///   The width of each new bucket. Smaller values will make queries more
+  ///   precise, but routes will be inserted into more buckets.
+  BucketOptions(Duration duration = DefaultDuration);
+
+  /// Set the width of each new bucket.
+  BucketOptions& duration(Duration value);
+
+  /// Get the width of each new bucket.
+  Duration duration() const;
+
+  /// Set the number of routes that a bucket may hold before it gets split in
+  /// half. Use a nullopt to never split buckets. The default is nullopt.
+  BucketOptions& split_threshold(rmf_utils::optional<std::size_t> value);
+
+  /// Get the split threshold.
+  rmf_utils::optional<std::size_t> split_threshold() const;
+
+  /// Set the smallest width that a bucket may be split down to.
+  BucketOptions& min_duration(Duration value);
+
+  /// Get the smallest width that a bucket may be split down to.
+  Duration min_duration() const;
+
+  /// Set the number of routes that two neighboring buckets may hold between
+  /// them while still being merged into one bucket. Use a nullopt to never
+  /// merge buckets. The default is nullopt.
+  ///
+  /// If a split threshold is also set, then this must be less than the split
+  /// threshold. Otherwise buckets would be split and merged back and forth.
+  BucketOptions& merge_threshold(rmf_utils::optional<std::size_t> value);
+
+  /// Get the merge threshold.
+  rmf_utils::optional<std::size_t> merge_threshold() const;
+
+  /// Set the largest width that buckets may be merged up to.
+  BucketOptions& max_duration(Duration value);
+
+  /// Get the largest width that buckets may be merged up to.
+  Duration max_duration() const;
+
+  class Implementation;
+private:
+  rmf_utils::impl_ptr<Implementation> _pimpl;
+};
+
+} // namespace schedule
+} // namespace rmf_traffic
+
+#endif // RMF_TRAFFIC__SCHEDULE__BUCKETOPTIONS_HPP
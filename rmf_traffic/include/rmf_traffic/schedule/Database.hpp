@@ -18,14 +18,18 @@
 #ifndef RMF_TRAFFIC__SCHEDULE__DATABASE_HPP
 #define RMF_TRAFFIC__SCHEDULE__DATABASE_HPP
 
+#include <rmf_traffic/schedule/BucketOptions.hpp>
 #include <rmf_traffic/schedule/Inconsistencies.hpp>
 #include <rmf_traffic/schedule/Viewer.hpp>
 #include <rmf_traffic/schedule/Patch.hpp>
+#include <rmf_traffic/schedule/PersistenceOptions.hpp>
 #include <rmf_traffic/schedule/Writer.hpp>
 #include <rmf_traffic/schedule/Snapshot.hpp>
 
 #include <rmf_utils/macros.hpp>
 
+#include <functional>
+
 namespace rmf_traffic {
 namespace schedule {
 
@@ -131,7 +135,37 @@ public:
   //============================================================================
 
   /// Initialize a Database
-  Database();
+  ///
+  /// \param[in] bucket_options
+  ///   Options for how the Database sorts its routes into buckets of time.
+  Database(const BucketOptions& bucket_options = BucketOptions());
+
+  /// Initialize a Database that keeps a copy of its state on disk. If the
+  /// directory of the persistence options holds the files of an earlier
+  /// Database, then that Database will be recovered, including its schedule
+  /// version, its participants, their itineraries, and their itinerary
+  /// versions. After that, every change that this Database accepts will be
+  /// appended to a write-ahead log before it gets applied.
+  ///
+  /// Some things are not recovered:
+  /// * Snapshots only contain the current itineraries, not the history of how
+  ///   they changed. Patches that start from a version older than the snapshot
+  ///   that the Database was recovered from will not mention the routes that
+  ///   were erased before that snapshot, so mirrors that are that far behind
+  ///   should be rebuilt from scratch.
+  /// * Changes that were waiting for a missing itinerary version only reach the
+  ///   log once they get applied. If the Database stops before then, the
+  ///   participant will need to send them again after it is told about the
+  ///   inconsistency.
+  ///
+  /// \param[in] persistence
+  ///   Options for where and how the state of the Database is kept on disk.
+  ///
+  /// \param[in] bucket_options
+  ///   Options for how the Database sorts its routes into buckets of time.
+  Database(
+    const PersistenceOptions& persistence,
+    const BucketOptions& bucket_options = BucketOptions());
 
   /// A description of all inconsistencies currently present in the database.
   /// Inconsistencies are isolated between Participants.
@@ -193,23 +227,159 @@ public:
   /// this version number will remain the same.
   Version cull(Time time);
 
+  /// Do part of the work of cull(Time), so that culling a large schedule can
+  /// be spread across many short calls, for example whenever the owner of the
+  /// Database is idle, instead of holding up the writers for one long call.
+  ///
+  /// Each call removes at most max_routes of the routes that finished before
+  /// the specified time. The routes that finish earliest get removed first.
+  /// When a call finds no more of those routes, the cull gets finished the
+  /// same way that cull(Time) finishes, and mirrors will be told about it.
+  /// Until then, mirrors keep the routes that have been removed so far.
+  ///
+  /// \param[in] time
+  ///   All Trajectories that finish before this time will be culled from the
+  ///   Database once the cull is finished.
+  ///
+  /// \param[in] max_routes
+  ///   The largest number of routes to remove during this call. This must be
+  ///   at least 1, or else a call could never make progress, so a value of 0
+  ///   will cause an std::invalid_argument exception to be thrown.
+  ///
+  /// If nothing has finished before the specified time, and no cull has been
+  /// left unfinished by an earlier call, then nothing will happen. The version
+  /// of the schedule will stay the same and mirrors will not be told anything.
+  ///
+  /// \return The new version of the schedule database once the cull is
+  /// finished, or a nullopt if more calls are needed to finish it or if there
+  /// was nothing to cull. Use latest_version() to tell those apart, because it
+  /// only changes when some routes were removed.
+  rmf_utils::optional<Version> cull(Time time, std::size_t max_routes);
+
   /// Set the current time on the database. This should be used immediately
   /// before calling unregister_participant() so that the database can cull the
   /// existence of the participant at an appropriate time. There's no need to
   /// call this function for any other purpose.
   void set_current_time(Time time);
 
+  /// Apply a batch of itinerary changes, which may come from many
+  /// participants, as a single transaction. Every set(), extend(), delay(),
+  /// and erase() that gets applied to this Database while the batch function
+  /// is running will share one schedule version, so mirrors will receive all
+  /// of them in one update.
+  ///
+  /// Registering or unregistering a participant, or culling the Database,
+  /// during a batch will give that operation its own schedule version, and any
+  /// itinerary changes that come after it will share a new version.
+  ///
+  /// If the batch function throws an exception, the changes that were already
+  /// applied will remain in the Database.
+  ///
+  /// \param[in] changes
+  ///   A function that applies the changes of the batch to this Database.
+  ///
+  /// \return The schedule version after the batch. If the batch did not change
+  /// anything, this will be the same as the version before the batch.
+  Version batch(const std::function<void(Database&)>& changes);
+
   /// Get the curret itinerary version for the specified participant.
   //
   // TODO(MXG): This function needs unit testing
   ItineraryVersion itinerary_version(ParticipantId participant) const;
 
+  /// Write a snapshot of this Database to disk and start a new write-ahead log.
+  /// This happens automatically according to
+  /// PersistenceOptions::checkpoint_interval(), but it can also be triggered
+  /// sooner, for example right before shutting down.
+  ///
+  /// If the write-ahead log ever fails, the Database will refuse to accept
+  /// changes until a checkpoint succeeds.
+  ///
+  /// This may only be used if the Database was created with PersistenceOptions,
+  /// and it may not be used while a batch is running.
+  void checkpoint();
+
+  class Published;
+
+  /// Begin publishing the state of this Database after every change, so that
+  /// other threads can read it using published(). This must be called before
+  /// any other thread calls published().
+  ///
+  /// Publishing is off by default, because it makes changes more expensive.
+  /// After a state is published, the next change needs to copy the parts of the
+  /// schedule that it modifies instead of modifying them in place. The routes
+  /// of each bucket of time are copied in small fixed-size chunks, so this cost
+  /// depends mostly on how many routes change rather than on how many routes
+  /// share their buckets. Use batch() to apply many changes while only
+  /// publishing once.
+  ///
+  /// While publishing is on, snapshot(), changes() and query() reuse the latest
+  /// published state instead of creating a new one.
+  void enable_publishing();
+
+  /// Get the state of this Database as it was after the last change that was
+  /// completed. A batch counts as one change, so the changes of a batch will
+  /// only be published once the whole batch is finished.
+  ///
+  /// Unlike every other function of the Database, this function may be called
+  /// by any number of threads while one thread is modifying the Database. It
+  /// never waits for the modification to finish, and the published state that
+  /// it returns will never be changed, so the reader threads can query it and
+  /// generate patches from it without locking anything.
+  ///
+  /// \return the latest published state, or a nullptr if enable_publishing()
+  /// has not been called.
+  std::shared_ptr<const Published> published() const;
+
   class Implementation;
   class Debug;
 private:
   rmf_utils::unique_impl_ptr<Implementation> _pimpl;
 };
 
+//==============================================================================
+/// An immutable state of a Database which can be read by many threads at once.
+/// Use Database::published() to get the latest state of a Database.
+class Database::Published : public Snapshot
+{
+public:
+
+  // Documentation inherited from Viewer
+  View query(const Query& parameters) const final;
+
+  // Documentation inherited from Viewer
+  View query(
+    const Query::Spacetime& spacetime,
+    const Query::Participants& participants) const final;
+
+  // Documentation inherited from Viewer
+  const std::unordered_set<ParticipantId>& participant_ids() const final;
+
+  // Documentation inherited from Viewer
+  std::shared_ptr<const ParticipantDescription> get_participant(
+    std::size_t participant_id) const final;
+
+  // Documentation inherited from Viewer
+  Version latest_version() const final;
+
+  /// Same as Database::changes(), but the Patch will only go up to the version
+  /// of this published state.
+  Patch changes(
+    const Query& parameters,
+    rmf_utils::optional<Version> after) const;
+
+  /// Same as Database::query(const Query&, Version), but only the routes that
+  /// changed up to the version of this published state will be viewed.
+  View query(
+    const Query& parameters,
+    Version after) const;
+
+  class Implementation;
+private:
+  Published();
+  rmf_utils::impl_ptr<Implementation> _pimpl;
+};
+
 } // namespace schedule
 
 } // namespace rmf_traffic
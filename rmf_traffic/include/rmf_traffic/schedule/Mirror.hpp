@@ -72,7 +72,10 @@ public:
   //============================================================================
 
   /// Create a database mirror
-  Mirror();
+  ///
+  /// \param[in] bucket_options
+  ///   Options for how the Mirror sorts its routes into buckets of time.
+  Mirror(const BucketOptions& bucket_options = BucketOptions());
 
   /// Update this mirror.
   ///
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#ifndef RMF_TRAFFIC__SCHEDULE__PERSISTENCEOPTIONS_HPP
+#define RMF_TRAFFIC__SCHEDULE__PERSISTENCEOPTIONS_HPP
+
+#include <rmf_utils/impl_ptr.hpp>
+#include <rmf_utils/optional.hpp>
+
+#include <string>
+
+namespace rmf_traffic {
+namespace schedule {
+
+//==============================================================================
+/// A Database can keep a copy of its state on disk so that it can be recovered
+/// after the process that owns it restarts. Every change that the Database
+/// accepts gets appended to a write-ahead log, and every so often the whole
+/// state of the Database gets written into a compact snapshot file, after which
+/// the log starts over. These options determine where those files are kept and
+/// how often the snapshots are taken.
+///
+/// Times are stored as they are given by rmf_traffic::Time, which is a steady
+/// clock. The files can only be recovered by a process that runs on the same
+/// machine without it having rebooted in between.
+class PersistenceOptions
+{
+public:
+
+  static constexpr std::size_t DefaultCheckpointInterval = 10000;
+
+  /// Constructor
+  ///
+  /// \param[in] directory
+  ///   The directory where the log and snapshot files are kept. It will be
+  ///   created if it does not exist yet. Only one Database may use a directory
+  ///   at a time.
+  PersistenceOptions(std::string directory);
+
+  /// Set the directory where the log and snapshot files are kept.
+  PersistenceOptions& directory(std::string value);
+
+  /// Get the directory where the log and snapshot files are kept.
+  const std::string& directory() const;
+
+  /// Set whether the log gets synced to the disk at the end of every write
+  /// operation. A batch counts as one operation. When this is false, the
+  /// operating system decides when the log reaches the disk, so a power
+  /// failure may lose the most recent changes, but a crash of the process will
+  /// not. The default is true.
+  PersistenceOptions& sync(bool value);
+
+  /// Get whether the log gets synced to the disk after every operation.
+  bool sync() const;
+
+  /// Set how many changes may be appended to the log before a new snapshot is
+  /// taken. Recovering a Database needs to replay every change in the log, so
+  /// smaller values make recovery faster while larger values make it less
+  /// common for a change to pay the cost of writing a snapshot. Use a nullopt
+  /// to only take snapshots when Database::checkpoint() is called.
+  PersistenceOptions& checkpoint_interval(
+    rmf_utils::optional<std::size_t> value);
+
+  /// Get how many changes may be appended to the log before a new snapshot is
+  /// taken.
+  rmf_utils::optional<std::size_t> checkpoint_interval() const;
+
+  class Implementation;
+private:
+  rmf_utils::impl_ptr<Implementation> _pimpl;
+};
+
+} // namespace schedule
+} // namespace rmf_traffic
+
+#endif // RMF_TRAFFIC__SCHEDULE__PERSISTENCEOPTIONS_HPP
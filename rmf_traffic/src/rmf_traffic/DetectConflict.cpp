@@ -20,9 +20,12 @@
 #include "ProfileInternal.hpp"
 #include "Spline.hpp"
 #include "StaticMotion.hpp"
+#include "TrajectoryMotionCache.hpp"
 
 #include "DetectConflictInternal.hpp"
 
+#include <rmf_traffic/geometry/Circle.hpp>
+
 #include <fcl/continuous_collision.h>
 #include <fcl/ccd/motion.h>
 #include <fcl/collision.h>
@@ -86,44 +89,6 @@ invalid_trajectory_error::invalid_trajectory_error()
 }
 
 namespace {
-//==============================================================================
-bool have_time_overlap(
-  const Trajectory& trajectory_a,
-  const Trajectory& trajectory_b)
-{
-  const auto* t_a0 = trajectory_a.start_time();
-  const auto* t_bf = trajectory_b.finish_time();
-
-  // Neither of these can be null, because both trajectories should have at
-  // least two elements.
-  assert(t_a0 != nullptr);
-  assert(t_bf != nullptr);
-
-  if (*t_bf < *t_a0)
-  {
-    // If Trajectory `b` finishes before Trajectory `a` starts, then there
-    // cannot be any conflict.
-    return false;
-  }
-
-  const auto* t_b0 = trajectory_b.start_time();
-  const auto* t_af = trajectory_a.finish_time();
-
-  // Neither of these can be null, because both trajectories should have at
-  // least two elements.
-  assert(t_b0 != nullptr);
-  assert(t_af != nullptr);
-
-  if (*t_af < *t_b0)
-  {
-    // If Trajectory `a` finished before Trajectory `b` starts, then there
-    // cannot be any conflict.
-    return false;
-  }
-
-  return true;
-}
-
 //==============================================================================
 std::tuple<Trajectory::const_iterator, Trajectory::const_iterator>
 get_initial_iterators(
@@ -162,11 +127,8 @@ get_initial_iterators(
 }
 
 //==============================================================================
-struct BoundingBox
-{
-  Eigen::Vector2d min;
-  Eigen::Vector2d max;
-};
+using internal::BoundingBox;
+using internal::overlap;
 
 //==============================================================================
 struct BoundingProfile
@@ -244,6 +206,9 @@ std::array<double, 2> get_local_extrema(
   return extrema;
 }
 
+} // anonymous namespace
+
+namespace internal {
 //==============================================================================
 BoundingBox get_bounding_box(const rmf_traffic::Spline& spline)
 {
@@ -280,13 +245,19 @@ BoundingBox adjust_bounding_box(
   return box;
 }
 
+} // namespace internal
+
+namespace {
+//==============================================================================
+using internal::adjust_bounding_box;
+using internal::get_bounding_box;
+using internal::void_box;
+
 //==============================================================================
 BoundingProfile get_bounding_profile(
-  const rmf_traffic::Spline& spline,
+  const BoundingBox& base_box,
   const Profile::Implementation& profile)
 {
-  BoundingBox base_box = get_bounding_box(spline);
-
   const auto& footprint = profile.footprint;
   const auto f_box = footprint ?
     adjust_bounding_box(base_box, footprint->get_characteristic_length()) :
@@ -300,23 +271,6 @@ BoundingProfile get_bounding_profile(
   return BoundingProfile{f_box, v_box};
 }
 
-//==============================================================================
-bool overlap(
-  const BoundingBox& box_a,
-  const BoundingBox& box_b)
-{
-  for (int i = 0; i < 2; ++i)
-  {
-    if (box_a.max[i] < box_b.min[i])
-      return false;
-
-    if (box_b.max[i] < box_a.min[i])
-      return false;
-  }
-
-  return true;
-}
-
 //==============================================================================
 std::shared_ptr<fcl::SplineMotion> make_uninitialized_fcl_spline_motion()
 {
@@ -378,6 +332,44 @@ Profile::Implementation convert_profile(const Profile& profile)
   return output;
 }
 
+//==============================================================================
+/// If every shape of both profiles is a circle, get the distances between the
+/// centers of the profiles at which the footprint of `a` touches the vicinity
+/// of `b`, and at which the vicinity of `a` touches the footprint of `b`.
+/// Conflicts between circles can be found from the distance between the
+/// splines alone, without going through FCL.
+rmf_utils::optional<std::array<double, 2>> get_circle_distances(
+  const Profile::Implementation& profile_a,
+  const Profile::Implementation& profile_b)
+{
+  const auto radius = [](const geometry::ConstFinalConvexShapePtr& shape)
+    -> rmf_utils::optional<double>
+    {
+      // A missing footprint never gets checked, so any radius will do
+      if (!shape)
+        return 0.0;
+
+      const auto* circle =
+        dynamic_cast<const geometry::Circle*>(&shape->source());
+      if (!circle)
+        return rmf_utils::nullopt;
+
+      return circle->get_radius();
+    };
+
+  const auto footprint_a = radius(profile_a.footprint);
+  const auto vicinity_a = radius(profile_a.vicinity);
+  const auto footprint_b = radius(profile_b.footprint);
+  const auto vicinity_b = radius(profile_b.vicinity);
+  if (!footprint_a || !vicinity_a || !footprint_b || !vicinity_b)
+    return rmf_utils::nullopt;
+
+  return std::array<double, 2>{
+    *footprint_a + *vicinity_b,
+    *vicinity_a + *footprint_b
+  };
+}
+
 //==============================================================================
 Time compute_time(
   const fcl::FCL_REAL scaled_time,
@@ -454,34 +446,141 @@ bool check_overlap(
 //==============================================================================
 bool close_start(
   const Profile::Implementation& profile_a,
-  const Trajectory::const_iterator& a_it,
+  const Spline& spline_a,
   const Profile::Implementation& profile_b,
-  const Trajectory::const_iterator& b_it)
+  const Spline& spline_b)
 {
   // If two trajectories start very close to each other, then we do not consider
   // it a conflict for them to be in each other's vicinities. This gives robots
   // an opportunity to back away from each other without it being considered a
   // schedule conflict.
-  Spline spline_a(a_it);
-  Spline spline_b(b_it);
   const auto start_time =
     std::max(spline_a.start_time(), spline_b.start_time());
 
   return check_overlap(profile_a, spline_a, profile_b, spline_b, start_time);
 }
 
+//==============================================================================
+/// Get the index of the segment that finishes at the waypoint of `it`
+std::size_t segment_index(
+  const Trajectory& trajectory,
+  const Trajectory::const_iterator& it)
+{
+  const auto begin = internal::get_raw_iterator(trajectory.begin());
+  const auto raw = internal::get_raw_iterator(it);
+  assert(begin < raw);
+  return static_cast<std::size_t>(raw - begin) - 1;
+}
+
+//==============================================================================
+/// Check whether the footprint of either profile could reach the vicinity of
+/// the other while they stay inside of these boxes.
+bool may_overlap(
+  const Profile::Implementation& profile_a,
+  const BoundingBox& box_a,
+  const Profile::Implementation& profile_b,
+  const BoundingBox& box_b,
+  const bool test_complement)
+{
+  const auto bound_a = get_bounding_profile(box_a, profile_a);
+  const auto bound_b = get_bounding_profile(box_b, profile_b);
+
+  if (overlap(bound_a.footprint, bound_b.vicinity))
+    return true;
+
+  return test_complement && overlap(bound_a.vicinity, bound_b.footprint);
+}
+
+//==============================================================================
+/// Find how far both trajectories can jump ahead while staying too far apart
+/// to conflict. Segment a_index of trajectory `a` must be one that is already
+/// known to stay apart from segment b_index of `b`.
+///
+/// This gallops forward over the segments of `a`, doubling the number of
+/// segments each time, and compares the box of that range against the box of
+/// every segment of `b` that overlaps it in time. The boxes come from the
+/// segment trees of the caches, so each test is O(log N).
+///
+/// \return the indices of the segments to resume from. These will be equal to
+/// a_index and b_index if nothing can be skipped beyond the current pair.
+std::array<std::size_t, 2> skip_apart(
+  const Profile::Implementation& profile_a,
+  const internal::TrajectoryMotionCache& cache_a,
+  const std::size_t a_index,
+  const Profile::Implementation& profile_b,
+  const internal::TrajectoryMotionCache& cache_b,
+  const std::size_t b_index,
+  const bool test_complement)
+{
+  const auto& segments_a = cache_a.segments();
+  const auto& segments_b = cache_b.segments();
+  const std::size_t N_a = segments_a.size();
+  const std::size_t N_b = segments_b.size();
+
+  std::array<std::size_t, 2> skip_to = {a_index, b_index};
+  for (std::size_t step = 1; ; step *= 2)
+  {
+    const std::size_t a_end = std::min(a_index + step, N_a);
+    const Time until = segments_a[a_end-1].spline.finish_time();
+
+    // The last segment of b that is active before `until` ends. When segments
+    // of a and b finish at exactly the same time, the segment that find_segment
+    // picks may come before b_index, so we clamp it to keep the range of b
+    // from being inverted.
+    const std::size_t b_last = std::max(
+      b_index, std::min(cache_b.find_segment(until), N_b-1));
+
+    if (may_overlap(
+        profile_a, cache_a.box(a_index, a_end),
+        profile_b, cache_b.box(b_index, b_last+1),
+        test_complement))
+      break;
+
+    // Segment b_last may continue after `until`, in which case it still needs
+    // to be checked against the segments of `a` that come next.
+    skip_to[0] = a_end;
+    skip_to[1] = segments_b[b_last].spline.finish_time() <= until ?
+      b_last + 1 : b_last;
+
+    if (a_end == N_a || skip_to[1] == N_b)
+      break;
+  }
+
+  return skip_to;
+}
+
 //==============================================================================
 rmf_utils::optional<rmf_traffic::Time> detect_invasion(
     const Profile::Implementation& profile_a,
-    Trajectory::const_iterator a_it,
-    const Trajectory::const_iterator& a_end,
+    const Trajectory& trajectory_a,
+    const internal::TrajectoryMotionCache& cache_a,
+    const Trajectory::const_iterator& a_it,
     const Profile::Implementation& profile_b,
-    Trajectory::const_iterator b_it,
-    const Trajectory::const_iterator& b_end,
+    const Trajectory& trajectory_b,
+    const internal::TrajectoryMotionCache& cache_b,
+    const Trajectory::const_iterator& b_it,
     std::vector<DetectConflict::Implementation::Conflict>* output_conflicts)
 {
-  rmf_utils::optional<Spline> spline_a;
-  rmf_utils::optional<Spline> spline_b;
+  const auto& segments_a = cache_a.segments();
+  const auto& segments_b = cache_b.segments();
+
+  // We march through the segments by their indices, since the broad phase may
+  // jump over many segments at once. Iterators only get made for conflicts.
+  const std::size_t a_end = segments_a.size();
+  const std::size_t b_end = segments_b.size();
+  std::size_t a_index =
+    a_it == trajectory_a.end() ? a_end : segment_index(trajectory_a, a_it);
+  std::size_t b_index =
+    b_it == trajectory_b.end() ? b_end : segment_index(trajectory_b, b_it);
+
+  const auto make_conflict = [&](const Time time)
+    {
+      return DetectConflict::Implementation::Conflict{
+        internal::get_iterator(trajectory_a, a_index+1),
+        internal::get_iterator(trajectory_b, b_index+1),
+        time
+      };
+    };
 
   std::shared_ptr<fcl::SplineMotion> motion_a =
     make_uninitialized_fcl_spline_motion();
@@ -496,76 +595,110 @@ rmf_utils::optional<rmf_traffic::Time> detect_invasion(
     (profile_a.vicinity != profile_a.footprint)
     || (profile_b.vicinity != profile_b.footprint);
 
+  const auto circle_distances = get_circle_distances(profile_a, profile_b);
+
   if (output_conflicts)
     output_conflicts->clear();
 
-  while (a_it != a_end && b_it != b_end)
+  while (a_index < a_end && b_index < b_end)
   {
-    if (!spline_a)
-      spline_a = Spline(a_it);
-
-    if (!spline_b)
-      spline_b = Spline(b_it);
+    const auto& segment_a = segments_a[a_index];
+    const auto& segment_b = segments_b[b_index];
+    const Spline& spline_a = segment_a.spline;
+    const Spline& spline_b = segment_b.spline;
 
     const Time start_time =
-      std::max(spline_a->start_time(), spline_b->start_time());
+      std::max(spline_a.start_time(), spline_b.start_time());
 
     const Time finish_time =
-      std::min(spline_a->finish_time(), spline_b->finish_time());
+      std::min(spline_a.finish_time(), spline_b.finish_time());
 
-    *motion_a = spline_a->to_fcl(start_time, finish_time);
-    *motion_b = spline_b->to_fcl(start_time, finish_time);
+    const auto bound_a = get_bounding_profile(segment_a.box, profile_a);
+    const auto bound_b = get_bounding_profile(segment_b.box, profile_b);
 
-    const auto bound_a = get_bounding_profile(*spline_a, profile_a);
-    const auto bound_b = get_bounding_profile(*spline_b, profile_b);
+    const bool check_a_footprint =
+      overlap(bound_a.footprint, bound_b.vicinity);
+    const bool check_b_footprint =
+      test_complement && overlap(bound_a.vicinity, bound_b.footprint);
 
-    if (overlap(bound_a.footprint, bound_b.vicinity))
+    rmf_utils::optional<DistanceDifferential> D;
+    if (check_a_footprint || check_b_footprint)
+    {
+      if (circle_distances)
+      {
+        D = DistanceDifferential(spline_a, spline_b);
+      }
+      else
+      {
+        *motion_a = spline_a.to_fcl(start_time, finish_time);
+        *motion_b = spline_b.to_fcl(start_time, finish_time);
+      }
+    }
+    else
     {
-      if (const auto collision = check_collision(
+      // These segments are far apart, so see if the segments that follow them
+      // are also far apart, and skip over as many of them as we can.
+      const auto skip_to = skip_apart(
+        profile_a, cache_a, a_index,
+        profile_b, cache_b, b_index,
+        test_complement);
+
+      if (skip_to[0] != a_index || skip_to[1] != b_index)
+      {
+        a_index = skip_to[0];
+        b_index = skip_to[1];
+        continue;
+      }
+    }
+
+    if (check_a_footprint)
+    {
+      const auto collision = D ?
+        D->first_contact((*circle_distances)[0]) :
+        check_collision(
           *profile_a.footprint, motion_a,
-          *profile_b.vicinity, motion_b, request))
+          *profile_b.vicinity, motion_b, request);
+
+      if (collision)
       {
         const auto time = compute_time(*collision, start_time, finish_time);
         if (!output_conflicts)
           return time;
 
-        output_conflicts->emplace_back(
-          DetectConflict::Implementation::Conflict{a_it, b_it, time});
+        output_conflicts->emplace_back(make_conflict(time));
       }
     }
 
-    if (test_complement && overlap(bound_a.vicinity, bound_b.footprint))
+    if (check_b_footprint)
     {
-      if (const auto collision = check_collision(
+      const auto collision = D ?
+        D->first_contact((*circle_distances)[1]) :
+        check_collision(
           *profile_a.vicinity, motion_a,
-          *profile_b.footprint, motion_b, request))
+          *profile_b.footprint, motion_b, request);
+
+      if (collision)
       {
         const auto time = compute_time(*collision, start_time, finish_time);
         if (!output_conflicts)
           return time;
 
-        output_conflicts->emplace_back(
-          DetectConflict::Implementation::Conflict{a_it, b_it, time});
+        output_conflicts->emplace_back(make_conflict(time));
       }
     }
 
-    if (spline_a->finish_time() < spline_b->finish_time())
+    if (spline_a.finish_time() < spline_b.finish_time())
     {
-      spline_a = rmf_utils::nullopt;
-      ++a_it;
+      ++a_index;
     }
-    else if (spline_b->finish_time() < spline_a->finish_time())
+    else if (spline_b.finish_time() < spline_a.finish_time())
     {
-      spline_b = rmf_utils::nullopt;
-      ++b_it;
+      ++b_index;
     }
     else
     {
-      spline_a = rmf_utils::nullopt;
-      ++a_it;
-
-      spline_b = rmf_utils::nullopt;
-      ++b_it;
+      ++a_index;
+      ++b_index;
     }
   }
 
@@ -600,25 +733,29 @@ Trajectory slice_trajectory(
 //==============================================================================
 rmf_utils::optional<rmf_traffic::Time> detect_approach(
     const Profile::Implementation& profile_a,
+    const Trajectory& trajectory_a,
+    const internal::TrajectoryMotionCache& cache_a,
     Trajectory::const_iterator a_it,
-    const Trajectory::const_iterator& a_end,
     const Profile::Implementation& profile_b,
+    const Trajectory& trajectory_b,
+    const internal::TrajectoryMotionCache& cache_b,
     Trajectory::const_iterator b_it,
-    const Trajectory::const_iterator& b_end,
     std::vector<DetectConflict::Implementation::Conflict>* output_conflicts)
 {
-  rmf_utils::optional<Spline> spline_a;
-  rmf_utils::optional<Spline> spline_b;
+  const auto& segments_a = cache_a.segments();
+  const auto& segments_b = cache_b.segments();
+
+  const auto a_end = trajectory_a.end();
+  const auto b_end = trajectory_b.end();
+  std::size_t a_index = segment_index(trajectory_a, a_it);
+  std::size_t b_index = segment_index(trajectory_b, b_it);
 
   while (a_it != a_end && b_it != b_end)
   {
-    if (!spline_a)
-      spline_a = Spline(a_it);
+    const Spline& spline_a = segments_a[a_index].spline;
+    const Spline& spline_b = segments_b[b_index].spline;
 
-    if (!spline_b)
-      spline_b = Spline(b_it);
-
-    const DistanceDifferential D(*spline_a, *spline_b);
+    const DistanceDifferential D(spline_a, spline_b);
 
     if (D.initially_approaching())
     {
@@ -633,7 +770,7 @@ rmf_utils::optional<rmf_traffic::Time> detect_approach(
     const auto approach_times = D.approach_times();
     for (const auto t : approach_times)
     {
-      if (!check_overlap(profile_a, *spline_a, profile_b, *spline_b, t))
+      if (!check_overlap(profile_a, spline_a, profile_b, spline_b, t))
       {
         // If neither vehicle is in the vicinity of the other, then we should
         // revert to the normal invasion detection approach to identifying
@@ -642,14 +779,18 @@ rmf_utils::optional<rmf_traffic::Time> detect_approach(
         // TODO(MXG): Consider an approach that does not require making copies
         // of the trajectories.
         const Trajectory sliced_trajectory_a =
-            slice_trajectory(t, *spline_a, a_it, a_end);
+            slice_trajectory(t, spline_a, a_it, a_end);
 
         const Trajectory sliced_trajectory_b =
-            slice_trajectory(t, *spline_b, b_it, b_end);
+            slice_trajectory(t, spline_b, b_it, b_end);
 
         return detect_invasion(
-          profile_a, ++sliced_trajectory_a.begin(), sliced_trajectory_a.end(),
-          profile_b, ++sliced_trajectory_b.begin(), sliced_trajectory_b.end(),
+          profile_a, sliced_trajectory_a,
+          *internal::get_motion_cache(sliced_trajectory_a),
+          ++sliced_trajectory_a.begin(),
+          profile_b, sliced_trajectory_b,
+          *internal::get_motion_cache(sliced_trajectory_b),
+          ++sliced_trajectory_b.begin(),
           output_conflicts);
       }
 
@@ -663,32 +804,32 @@ rmf_utils::optional<rmf_traffic::Time> detect_approach(
     }
 
     const bool still_close = check_overlap(
-          profile_a, *spline_a, profile_b, *spline_b, D.finish_time());
+          profile_a, spline_a, profile_b, spline_b, D.finish_time());
 
-    if (spline_a->finish_time() < spline_b->finish_time())
+    if (spline_a.finish_time() < spline_b.finish_time())
     {
-      spline_a = rmf_utils::nullopt;
       ++a_it;
+      ++a_index;
     }
-    else if (spline_b->finish_time() < spline_a->finish_time())
+    else if (spline_b.finish_time() < spline_a.finish_time())
     {
-      spline_b = rmf_utils::nullopt;
       ++b_it;
+      ++b_index;
     }
     else
     {
-      spline_a = rmf_utils::nullopt;
       ++a_it;
+      ++a_index;
 
-      spline_b = rmf_utils::nullopt;
       ++b_it;
+      ++b_index;
     }
 
     if (!still_close)
     {
       return detect_invasion(
-        profile_a, a_it, a_end,
-        profile_b, b_it, b_end,
+        profile_a, trajectory_a, cache_a, a_it,
+        profile_b, trajectory_b, cache_b, b_it,
         output_conflicts);
     }
   }
@@ -702,33 +843,70 @@ rmf_utils::optional<rmf_traffic::Time> detect_approach(
   return output_conflicts->front().time;
 }
 
-} // anonymous namespace
+//==============================================================================
+/// The parts of a conflict check that only depend on one of the participants.
+/// When one trajectory gets checked against many others, this only needs to be
+/// made once for it.
+struct Prepared
+{
+  Profile::Implementation profile;
+  const Trajectory& trajectory;
+  Time start_time;
+  Time finish_time;
+  internal::ConstTrajectoryMotionCachePtr cache;
+
+  /// The footprint and vicinity boxes of the whole trajectory
+  BoundingProfile bound;
+};
 
 //==============================================================================
-rmf_utils::optional<rmf_traffic::Time> DetectConflict::Implementation::between(
-  const Profile& input_profile_a,
-  const Trajectory& trajectory_a,
-  const Profile& input_profile_b,
-  const Trajectory& trajectory_b,
-  Interpolate /*interpolation*/,
-  std::vector<Conflict>* output_conflicts)
+Prepared prepare(const Profile& profile, const Trajectory& trajectory)
 {
-  if (trajectory_a.size() < 2)
+  if (trajectory.size() < 2)
   {
     throw invalid_trajectory_error::Implementation
         ::make_segment_num_error(
-          trajectory_a.size(), __LINE__, __FUNCTION__);
+          trajectory.size(), __LINE__, __FUNCTION__);
   }
 
-  if (trajectory_b.size() < 2)
-  {
-    throw invalid_trajectory_error::Implementation
-        ::make_segment_num_error(
-          trajectory_b.size(), __LINE__, __FUNCTION__);
-  }
+  auto profile_impl = convert_profile(profile);
+  auto cache = internal::get_motion_cache(trajectory);
+  const auto bound = get_bounding_profile(cache->box(), profile_impl);
+
+  return Prepared{
+    std::move(profile_impl),
+    trajectory,
+    *trajectory.start_time(),
+    *trajectory.finish_time(),
+    std::move(cache),
+    bound
+  };
+}
+
+//==============================================================================
+/// Get a box that contains the segments of the cache that are active at any
+/// time in [lower, upper].
+BoundingBox get_window_box(
+  const internal::TrajectoryMotionCache& cache,
+  const Time lower,
+  const Time upper)
+{
+  const std::size_t N = cache.segments().size();
+  const std::size_t begin = std::min(cache.find_segment(lower), N-1);
+  const std::size_t end = std::min(cache.find_segment(upper), N-1) + 1;
+  return cache.box(begin, end);
+}
 
-  const Profile::Implementation profile_a = convert_profile(input_profile_a);
-  const Profile::Implementation profile_b = convert_profile(input_profile_b);
+//==============================================================================
+rmf_utils::optional<rmf_traffic::Time> detect_conflict(
+  const Prepared& a,
+  const Prepared& b,
+  std::vector<DetectConflict::Implementation::Conflict>* output_conflicts)
+{
+  const auto& profile_a = a.profile;
+  const auto& profile_b = b.profile;
+  const auto& trajectory_a = a.trajectory;
+  const auto& trajectory_b = b.trajectory;
 
   // Return early if there is no geometry in the profiles
   // TODO(MXG): Should this produce an exception? Is this an okay scenario?
@@ -744,40 +922,149 @@ rmf_utils::optional<rmf_traffic::Time> DetectConflict::Implementation::between(
     return rmf_utils::nullopt;
 
   // Return early if there is no time overlap between the trajectories
-  if (!have_time_overlap(trajectory_a, trajectory_b))
+  if (b.finish_time < a.start_time || a.finish_time < b.start_time)
+    return rmf_utils::nullopt;
+
+  const auto& cache_a = *a.cache;
+  const auto& cache_b = *b.cache;
+
+  // Return early if the trajectories stay too far apart to conflict for as long
+  // as they overlap in time
+  const Time lower = std::max(a.start_time, b.start_time);
+  const Time upper = std::min(a.finish_time, b.finish_time);
+  if (!may_overlap(
+      profile_a, get_window_box(cache_a, lower, upper),
+      profile_b, get_window_box(cache_b, lower, upper),
+      true))
     return rmf_utils::nullopt;
 
   Trajectory::const_iterator a_it;
   Trajectory::const_iterator b_it;
   std::tie(a_it, b_it) = get_initial_iterators(trajectory_a, trajectory_b);
 
-  if (close_start(profile_a, a_it, profile_b, b_it))
+  const Spline& start_spline_a =
+    cache_a.segments()[segment_index(trajectory_a, a_it)].spline;
+  const Spline& start_spline_b =
+    cache_b.segments()[segment_index(trajectory_b, b_it)].spline;
+
+  if (close_start(profile_a, start_spline_a, profile_b, start_spline_b))
   {
     // If the vehicles are already starting in close proximity, then we consider
     // it a conflict if they get any closer while within that proximity.
     return detect_approach(
-          profile_a,
-          std::move(a_it),
-          trajectory_a.end(),
-          profile_b,
-          std::move(b_it),
-          trajectory_b.end(),
+          profile_a, trajectory_a, cache_a, std::move(a_it),
+          profile_b, trajectory_b, cache_b, std::move(b_it),
           output_conflicts);
   }
 
   // If the vehicles are starting an acceptable distance from each other, then
   // check if either one invades the vicinity of the other.
   return detect_invasion(
-        profile_a,
-        std::move(a_it),
-        trajectory_a.end(),
-        profile_b,
-        std::move(b_it),
-        trajectory_b.end(),
+        profile_a, trajectory_a, cache_a, a_it,
+        profile_b, trajectory_b, cache_b, b_it,
         output_conflicts);
 }
 
+} // anonymous namespace
+
+//==============================================================================
+rmf_utils::optional<rmf_traffic::Time> DetectConflict::Implementation::between(
+  const Profile& profile_a,
+  const Trajectory& trajectory_a,
+  const Profile& profile_b,
+  const Trajectory& trajectory_b,
+  Interpolate /*interpolation*/,
+  std::vector<Conflict>* output_conflicts)
+{
+  const Prepared a = prepare(profile_a, trajectory_a);
+  const Prepared b = prepare(profile_b, trajectory_b);
+  return detect_conflict(a, b, output_conflicts);
+}
+
+//==============================================================================
+std::vector<DetectConflict::Hit> DetectConflict::between(
+  const Profile& profile_a,
+  const Trajectory& trajectory_a,
+  const std::vector<Other>& others,
+  const bool stop_at_first,
+  Interpolate /*interpolation*/)
+{
+  const Prepared a = prepare(profile_a, trajectory_a);
+
+  std::vector<Hit> hits;
+  for (std::size_t i = 0; i < others.size(); ++i)
+  {
+    const Other& other = others[i];
+    const Trajectory& trajectory_b = other.trajectory;
+
+    // Skip anything that does not overlap trajectory_a in time before paying
+    // for its profile and motion cache. Invalid trajectories still go through
+    // prepare() so that they throw the same error as a pairwise check.
+    if (trajectory_b.size() >= 2
+      && (*trajectory_b.finish_time() < a.start_time
+      || a.finish_time < *trajectory_b.start_time()))
+      continue;
+
+    const Prepared b = prepare(other.profile, trajectory_b);
+
+    // Skip anything that stays too far from trajectory_a for its whole
+    // duration before narrowing down to the time window that they share.
+    if (!overlap(a.bound.footprint, b.bound.vicinity)
+      && !overlap(a.bound.vicinity, b.bound.footprint))
+      continue;
+
+    if (const auto time = detect_conflict(a, b, nullptr))
+    {
+      hits.push_back({i, *time});
+      if (stop_at_first)
+        break;
+    }
+  }
+
+  return hits;
+}
+
 namespace internal {
+//==============================================================================
+bool overlap(
+  const BoundingBox& box_a,
+  const BoundingBox& box_b)
+{
+  for (int i = 0; i < 2; ++i)
+  {
+    if (box_a.max[i] < box_b.min[i])
+      return false;
+
+    if (box_b.max[i] < box_a.min[i])
+      return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+BoundingBox get_vicinity_bounding_box(
+  const Profile& profile,
+  const Trajectory& trajectory)
+{
+  const auto& vicinity = profile.vicinity();
+  if (!vicinity || trajectory.size() < 2)
+    return void_box();
+
+  return adjust_bounding_box(
+    get_motion_cache(trajectory)->box(),
+    vicinity->get_characteristic_length());
+}
+
+//==============================================================================
+BoundingBox get_region_bounding_box(const Spacetime& region)
+{
+  assert(region.shape);
+  const Eigen::Vector2d p = region.pose.translation();
+  return adjust_bounding_box(
+    BoundingBox{p, p}, region.shape->get_characteristic_length());
+}
+
 //==============================================================================
 bool detect_conflicts(
   const Profile& profile,
@@ -844,9 +1131,21 @@ bool detect_conflicts(
   if (output_conflicts)
     output_conflicts->clear();
 
-  for (auto it = begin_it; it != end_it; ++it)
+  const double vicinity_length = vicinity->get_characteristic_length();
+  const BoundingBox region_box = get_region_bounding_box(region);
+
+  const auto cache = get_motion_cache(trajectory);
+  const auto& segments = cache->segments();
+  std::size_t index = segment_index(trajectory, begin_it);
+  for (auto it = begin_it; it != end_it; ++it, ++index)
   {
-    Spline spline_trajectory{it};
+    // Broadphase: If the vicinity of this segment cannot reach the region at
+    // any point along the spline, then there is no need to ask fcl.
+    if (!overlap(
+        adjust_bounding_box(segments[index].box, vicinity_length), region_box))
+      continue;
+
+    const Spline& spline_trajectory = segments[index].spline;
 
     const Time spline_start_time =
       std::max(spline_trajectory.start_time(), start_time);
@@ -867,9 +1166,6 @@ bool detect_conflicts(
       const auto obj_region = fcl::ContinuousCollisionObject(
         region_shape, motion_region);
 
-      // TODO(MXG): We should do a broadphase test here before using
-      // fcl::collide
-
       fcl::ContinuousCollisionResult result;
       fcl::collide(&obj_trajectory, &obj_region, request, result);
       if (result.is_collide)
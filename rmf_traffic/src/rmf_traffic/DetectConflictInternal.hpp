@@ -29,6 +29,8 @@
 
 namespace rmf_traffic {
 
+class Spline;
+
 class DetectConflict::Implementation
 {
 public:
@@ -64,6 +66,40 @@ struct Spacetime
   geometry::ConstFinalShapePtr shape;
 };
 
+//==============================================================================
+struct BoundingBox
+{
+  Eigen::Vector2d min;
+  Eigen::Vector2d max;
+};
+
+//==============================================================================
+bool overlap(const BoundingBox& box_a, const BoundingBox& box_b);
+
+//==============================================================================
+/// Get a box that contains every position along a spline.
+BoundingBox get_bounding_box(const Spline& spline);
+
+//==============================================================================
+/// Create a bounding box which will never overlap with any other BoundingBox
+BoundingBox void_box();
+
+//==============================================================================
+/// Grow a bounding box by the given value in every direction.
+BoundingBox adjust_bounding_box(const BoundingBox& input, double value);
+
+//==============================================================================
+/// Get a box that contains every point that the vicinity of the profile can
+/// reach while following the trajectory. If the profile has no vicinity, the
+/// box that gets returned will never overlap with any other box.
+BoundingBox get_vicinity_bounding_box(
+  const Profile& profile,
+  const Trajectory& trajectory);
+
+//==============================================================================
+/// Get a box that contains the shape of the spacetime region.
+BoundingBox get_region_bounding_box(const Spacetime& region);
+
 //==============================================================================
 bool detect_conflicts(
   const Profile& profile,
@@ -37,7 +37,7 @@ std::unique_ptr<Motion> Motion::compute_cubic_splines(
   const const_iterator begin = internal::get_raw_iterator(input_begin);
   const const_iterator end = internal::get_raw_iterator(input_end);
 
-  if (++const_iterator(begin) == end)
+  if (begin + 1 == end)
   {
     const auto& point = *begin;
     return std::make_unique<SinglePointMotion>(
@@ -45,7 +45,7 @@ std::unique_ptr<Motion> Motion::compute_cubic_splines(
   }
 
   std::vector<Spline> splines;
-  for (auto it = ++const_iterator(begin); it != end; ++it)
+  for (auto it = begin + 1; it != end; ++it)
     splines.emplace_back(Spline(it));
 
   if (splines.size() == 1)
@@ -22,6 +22,8 @@
 
 #include "Spline.hpp"
 
+#include <map>
+
 namespace rmf_traffic {
 
 //==============================================================================
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__SMALLVECTOR_HPP
+#define SRC__RMF_TRAFFIC__SMALLVECTOR_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rmf_traffic {
+namespace internal {
+
+//==============================================================================
+/// A vector that keeps up to N elements inside of itself, and only allocates
+/// from the heap once it grows beyond that. This only provides the parts of the
+/// std::vector interface that rmf_traffic needs.
+///
+/// Like std::vector, inserting or erasing elements invalidates the iterators
+/// that come after the change, and growing the capacity invalidates all of
+/// them. Moving a SmallVector whose elements are stored inline will move each
+/// element individually.
+template<typename T, std::size_t N>
+class SmallVector
+{
+public:
+
+  // Moving a vector whose elements are inline needs to move each element, so
+  // it can only promise not to throw if the elements promise the same thing.
+  static constexpr bool NothrowMove =
+    std::is_nothrow_move_constructible<T>::value;
+
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  SmallVector()
+  : _data(inline_data()),
+    _size(0),
+    _capacity(N)
+  {
+    // Do nothing
+  }
+
+  SmallVector(const SmallVector& other)
+  : SmallVector()
+  {
+    *this = other;
+  }
+
+  SmallVector(SmallVector&& other) noexcept(NothrowMove)
+  : SmallVector()
+  {
+    *this = std::move(other);
+  }
+
+  SmallVector& operator=(const SmallVector& other)
+  {
+    if (this == &other)
+      return *this;
+
+    clear();
+    reserve(other._size);
+    std::uninitialized_copy(other.begin(), other.end(), _data);
+    _size = other._size;
+    return *this;
+  }
+
+  SmallVector& operator=(SmallVector&& other) noexcept(NothrowMove)
+  {
+    if (this == &other)
+      return *this;
+
+    clear();
+    if (!other.is_inline())
+    {
+      // Take over the heap buffer of the other vector
+      release();
+      _data = other._data;
+      _size = other._size;
+      _capacity = other._capacity;
+
+      other._data = other.inline_data();
+      other._size = 0;
+      other._capacity = N;
+      return *this;
+    }
+
+    reserve(other._size);
+    std::uninitialized_move(other.begin(), other.end(), _data);
+    _size = other._size;
+    other.clear();
+    return *this;
+  }
+
+  ~SmallVector()
+  {
+    clear();
+    release();
+  }
+
+  std::size_t size() const
+  {
+    return _size;
+  }
+
+  bool empty() const
+  {
+    return _size == 0;
+  }
+
+  std::size_t capacity() const
+  {
+    return _capacity;
+  }
+
+  /// True if the elements are being stored inside of this object instead of
+  /// on the heap.
+  bool is_inline() const
+  {
+    return _data == inline_data();
+  }
+
+  iterator begin()
+  {
+    return _data;
+  }
+
+  const_iterator begin() const
+  {
+    return _data;
+  }
+
+  iterator end()
+  {
+    return _data + _size;
+  }
+
+  const_iterator end() const
+  {
+    return _data + _size;
+  }
+
+  T& operator[](const std::size_t i)
+  {
+    assert(i < _size);
+    return _data[i];
+  }
+
+  const T& operator[](const std::size_t i) const
+  {
+    assert(i < _size);
+    return _data[i];
+  }
+
+  T& front()
+  {
+    return (*this)[0];
+  }
+
+  const T& front() const
+  {
+    return (*this)[0];
+  }
+
+  T& back()
+  {
+    return (*this)[_size-1];
+  }
+
+  const T& back() const
+  {
+    return (*this)[_size-1];
+  }
+
+  void reserve(const std::size_t new_capacity)
+  {
+    if (new_capacity <= _capacity)
+      return;
+
+    T* const new_data = static_cast<T*>(
+      ::operator new(new_capacity * sizeof(T)));
+
+    // If the elements might throw while being moved, they get copied instead,
+    // so that this vector is left unchanged when something does throw.
+    std::size_t constructed = 0;
+    try
+    {
+      for (; constructed < _size; ++constructed)
+      {
+        T& element = _data[constructed];
+        new (new_data + constructed) T(std::move_if_noexcept(element));
+      }
+    }
+    catch (...)
+    {
+      std::destroy(new_data, new_data + constructed);
+      ::operator delete(new_data);
+      throw;
+    }
+
+    std::destroy(begin(), end());
+    release();
+
+    _data = new_data;
+    _capacity = new_capacity;
+  }
+
+  template<typename... Args>
+  T& emplace_back(Args&& ... args)
+  {
+    if (_size == _capacity)
+    {
+      // Construct the value first in case the arguments refer to an element
+      // that is about to be moved.
+      T value(std::forward<Args>(args)...);
+      grow();
+      new (_data + _size) T(std::move(value));
+    }
+    else
+    {
+      new (_data + _size) T(std::forward<Args>(args)...);
+    }
+
+    ++_size;
+    return back();
+  }
+
+  void push_back(T value)
+  {
+    emplace_back(std::move(value));
+  }
+
+  void pop_back()
+  {
+    assert(_size > 0);
+    --_size;
+    std::destroy_at(_data + _size);
+  }
+
+  template<typename... Args>
+  iterator emplace(const_iterator position, Args&& ... args)
+  {
+    const std::size_t index = static_cast<std::size_t>(position - _data);
+    assert(index <= _size);
+
+    if (index == _size)
+    {
+      emplace_back(std::forward<Args>(args)...);
+      return _data + index;
+    }
+
+    T value(std::forward<Args>(args)...);
+    if (_size == _capacity)
+      grow();
+
+    new (_data + _size) T(std::move(_data[_size-1]));
+    std::move_backward(_data + index, _data + _size - 1, _data + _size);
+    _data[index] = std::move(value);
+    ++_size;
+
+    return _data + index;
+  }
+
+  iterator erase(const_iterator first, const_iterator last)
+  {
+    T* const begin_it = _data + (first - _data);
+    T* const end_it = _data + (last - _data);
+    if (begin_it == end_it)
+      return begin_it;
+
+    T* const new_end = std::move(end_it, end(), begin_it);
+    std::destroy(new_end, end());
+    _size = static_cast<std::size_t>(new_end - _data);
+
+    return begin_it;
+  }
+
+  iterator erase(const_iterator position)
+  {
+    return erase(position, position + 1);
+  }
+
+  void clear()
+  {
+    std::destroy(begin(), end());
+    _size = 0;
+  }
+
+private:
+
+  T* inline_data()
+  {
+    return std::launder(reinterpret_cast<T*>(_inline));
+  }
+
+  const T* inline_data() const
+  {
+    return std::launder(reinterpret_cast<const T*>(_inline));
+  }
+
+  void grow()
+  {
+    reserve(2*_capacity);
+  }
+
+  void release()
+  {
+    if (!is_inline())
+      ::operator delete(_data);
+
+    _data = inline_data();
+    _capacity = N;
+  }
+
+  alignas(T) unsigned char _inline[N * sizeof(T)];
+  T* _data;
+  std::size_t _size;
+  std::size_t _capacity;
+};
+
+} // namespace internal
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__SMALLVECTOR_HPP
@@ -17,6 +17,7 @@
 
 #include "Spline.hpp"
 
+#include <algorithm>
 #include <unordered_set>
 
 namespace rmf_traffic {
@@ -97,8 +98,7 @@ Spline::Parameters compute_parameters(
 Spline::Parameters compute_parameters(
   const internal::WaypointList::const_iterator& finish_it)
 {
-  const internal::WaypointList::const_iterator start_it =
-    --internal::WaypointList::const_iterator(finish_it);
+  const internal::WaypointList::const_iterator start_it = finish_it - 1;
 
   const internal::WaypointElement::Data& start = start_it->data;
   const internal::WaypointElement::Data& finish = finish_it->data;
@@ -631,6 +631,105 @@ std::vector<Time> DistanceDifferential::approach_times() const
   return output;
 }
 
+namespace {
+//==============================================================================
+/// The coefficients of a polynomial of degree six in Bernstein form
+using Bernstein6 = std::array<double, 7>;
+
+//==============================================================================
+/// The number of times that the root search may halve the time range of the
+/// differential before it settles on an answer
+const int max_contact_depth = 24;
+
+//==============================================================================
+Bernstein6 compute_squared_distance(
+  const Spline::Parameters& params,
+  const double distance)
+{
+  // The power basis coefficients of dx^2 + dy^2 - distance^2
+  std::array<double, 7> a;
+  a.fill(0.0);
+  for (int i = 0; i < 4; ++i)
+  {
+    for (int j = 0; j < 4; ++j)
+    {
+      a[static_cast<std::size_t>(i+j)] +=
+        params.coeffs[0][i]*params.coeffs[0][j]
+        + params.coeffs[1][i]*params.coeffs[1][j];
+    }
+  }
+  a[0] -= distance*distance;
+
+  // b_k = sum_{i=0}^{k} [ C(k, i) / C(6, i) ] a_i
+  const std::array<double, 7> C6 = {1.0, 6.0, 15.0, 20.0, 15.0, 6.0, 1.0};
+  Bernstein6 b;
+  for (std::size_t k = 0; k < b.size(); ++k)
+  {
+    double C_ki = 1.0;
+    b[k] = 0.0;
+    for (std::size_t i = 0; i <= k; ++i)
+    {
+      b[k] += C_ki / C6[i] * a[i];
+      C_ki = C_ki * static_cast<double>(k - i) / static_cast<double>(i + 1);
+    }
+  }
+
+  return b;
+}
+
+//==============================================================================
+/// Split a Bernstein polynomial at the middle of its range
+std::array<Bernstein6, 2> split(Bernstein6 b)
+{
+  std::array<Bernstein6, 2> output;
+  const std::size_t N = b.size();
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    output[0][i] = b[0];
+    output[1][N-1-i] = b[N-1-i];
+    for (std::size_t j = 0; j < N-1-i; ++j)
+      b[j] = 0.5*(b[j] + b[j+1]);
+  }
+
+  return output;
+}
+
+//==============================================================================
+rmf_utils::optional<double> find_first_negative(
+  const Bernstein6& b,
+  const double lower,
+  const double upper,
+  const int depth)
+{
+  if (b.front() < 0.0)
+    return lower;
+
+  // A Bernstein polynomial stays inside the convex hull of its coefficients,
+  // so if none of them are negative, neither is the polynomial.
+  if (*std::min_element(b.begin(), b.end()) >= 0.0)
+    return rmf_utils::nullopt;
+
+  const double middle = 0.5*(lower + upper);
+  if (depth >= max_contact_depth)
+    return middle;
+
+  const auto halves = split(b);
+  if (const auto t = find_first_negative(halves[0], lower, middle, depth+1))
+    return t;
+
+  return find_first_negative(halves[1], middle, upper, depth+1);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+rmf_utils::optional<double> DistanceDifferential::first_contact(
+  const double distance) const
+{
+  return find_first_negative(
+    compute_squared_distance(_params, distance), 0.0, 1.0, 0);
+}
+
 //==============================================================================
 Time DistanceDifferential::start_time() const
 {
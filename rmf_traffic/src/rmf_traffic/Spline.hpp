@@ -22,6 +22,8 @@
 
 #include <rmf_traffic/Trajectory.hpp>
 
+#include <rmf_utils/optional.hpp>
+
 #include <fcl/ccd/motion.h>
 
 #include <array>
@@ -99,6 +101,16 @@ public:
   /// they should.
   std::vector<Time> approach_times() const;
 
+  /// Find the first moment when the splines are closer together than the
+  /// given distance. The squared distance between the splines is a polynomial
+  /// of degree six, so its first root gets isolated by subdividing it in
+  /// Bernstein form, which cannot miss a root.
+  ///
+  /// \return the time of the first contact, scaled to the range [0, 1] from
+  /// start_time() to finish_time(), or nullopt if the splines never get that
+  /// close.
+  rmf_utils::optional<double> first_contact(double distance) const;
+
   Time start_time() const;
   Time finish_time() const;
 
@@ -20,8 +20,11 @@
 #include "debug_Trajectory.hpp"
 #include "MotionInternal.hpp"
 #include "TrajectoryInternal.hpp"
+#include "TrajectoryMotionCache.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <string>
 
 namespace rmf_traffic {
@@ -32,15 +35,17 @@ class TrajectoryIteratorImplementation
 {
 public:
 
-  WaypointList::iterator raw_iterator;
+  // The ID of the waypoint that the iterator refers to, or npos for the end
+  std::size_t id;
   const Trajectory::Implementation* parent;
 
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
   template<typename SegT>
-  Trajectory::base_iterator<SegT> make_iterator(
-    internal::WaypointList::iterator it) const
+  Trajectory::base_iterator<SegT> make_iterator(std::size_t waypoint) const
   {
     Trajectory::base_iterator<SegT> result;
-    result._pimpl->raw_iterator = it;
+    result._pimpl->id = waypoint;
     result._pimpl->parent = parent;
 
     return result;
@@ -49,10 +54,8 @@ public:
   template<typename SegT>
   Trajectory::base_iterator<SegT> post_increment()
   {
-    const Trajectory::base_iterator<SegT> old_it =
-      make_iterator<SegT>(raw_iterator);
-
-    ++raw_iterator;
+    const Trajectory::base_iterator<SegT> old_it = make_iterator<SegT>(id);
+    increment();
 
     return old_it;
   }
@@ -60,84 +63,79 @@ public:
   template<typename SegT>
   Trajectory::base_iterator<SegT> post_decrement()
   {
-    const Trajectory::base_iterator<SegT> old_it =
-      make_iterator<SegT>(raw_iterator);
-
-    --raw_iterator;
+    const Trajectory::base_iterator<SegT> old_it = make_iterator<SegT>(id);
+    decrement();
 
     return old_it;
   }
 
-  static WaypointList::const_iterator raw(
-    const Trajectory::const_iterator& iterator)
-  {
-    return iterator._pimpl->raw_iterator;
-  }
-};
-
-//==============================================================================
-WaypointList::const_iterator get_raw_iterator(
-  const Trajectory::const_iterator& iterator)
-{
-  return TrajectoryIteratorImplementation::raw(iterator);
-}
-
-} // namespace internal
+  /// The position of the waypoint in the trajectory. The end iterator has the
+  /// position that comes after the last waypoint.
+  std::size_t index() const;
 
-//==============================================================================
-class Trajectory::Waypoint::Implementation
-{
-public:
+  WaypointElement& element() const;
 
-  // Note: these fields will be filled in by the
-  // Trajectory::Implementation::insert() function.
-  internal::WaypointList::iterator myself;
-  Trajectory::Implementation* parent;
+  void increment();
 
-  internal::WaypointElement::Data& data()
-  {
-    return myself->data;
-  }
+  void decrement();
 
-  const internal::WaypointElement::Data& data() const
-  {
-    return myself->data;
-  }
+  static WaypointList::const_iterator raw(
+    const Trajectory::const_iterator& iterator);
 
-  Time time() const
-  {
-    return data().time;
-  }
+  static ConstTrajectoryMotionCachePtr motion_cache(
+    const Trajectory& trajectory);
 
+  static Trajectory::const_iterator iterator_at(
+    const Trajectory& trajectory, std::size_t index);
 };
 
+} // namespace internal
+
 //==============================================================================
 class Trajectory::Implementation
 {
 public:
 
-  internal::OrderMap ordering;
+  static constexpr std::size_t npos =
+    internal::TrajectoryIteratorImplementation::npos;
+
   internal::WaypointList segments;
 
+  // The index of each waypoint within segments, looked up by its ID. Unused
+  // IDs map to npos.
+  internal::SmallVector<std::size_t, internal::InlineWaypoints> indices;
+
+  // IDs that are not being used by any waypoint
+  internal::SmallVector<std::size_t, internal::InlineWaypoints> free_ids;
+
+  // The splines of this trajectory, if they have been computed since the last
+  // time the trajectory was modified. This is loaded and stored atomically so
+  // that concurrent conflict checks can fill it in.
+  mutable internal::ConstTrajectoryMotionCachePtr motion_cache;
+
+  /// Discard anything that was computed from the waypoints. This must be
+  /// called whenever a waypoint gets modified.
+  void changed()
+  {
+    motion_cache = nullptr;
+  }
+
   template<typename SegT>
-  base_iterator<SegT> make_iterator(
-    internal::WaypointList::iterator iterator) const
+  base_iterator<SegT> make_iterator(std::size_t id) const
   {
     base_iterator<SegT> it;
-    it._pimpl->raw_iterator = std::move(iterator);
+    it._pimpl->id = id;
     it._pimpl->parent = this;
 
     return it;
   }
 
-  std::unique_ptr<Waypoint> make_segment(
-    internal::WaypointList::iterator iterator)
+  /// Make an iterator for the waypoint at the given index
+  template<typename SegT>
+  base_iterator<SegT> iterator_at(std::size_t index) const
   {
-    std::unique_ptr<Waypoint> seg(new Waypoint);
-    seg->_pimpl->myself = std::move(iterator);
-    seg->_pimpl->parent = this;
-
-    return seg;
+    return make_iterator<SegT>(
+      index < segments.size() ? segments[index].id : npos);
   }
 
   Implementation()
@@ -152,274 +150,367 @@ public:
 
   Implementation& operator=(const Implementation& other)
   {
-    // Start by making a normal copy
-    ordering = other.ordering;
     segments = other.segments;
+    indices = other.indices;
+    free_ids = other.free_ids;
+    motion_cache = std::atomic_load(&other.motion_cache);
 
-    // Now correct all the iterators to point to the freshly copied container
-    internal::WaypointList::iterator sit = segments.begin();
-    internal::OrderMap::iterator oit = ordering.begin();
-    for ( ; sit != segments.end(); ++sit, ++oit)
+    // The copied elements still refer to the other trajectory
+    for (auto& element : segments)
+      element.parent = this;
+
+    return *this;
+  }
+
+  /// Find the first waypoint whose time is not less than the given time
+  internal::WaypointList::iterator lower_bound_element(const Time time)
+  {
+    return std::lower_bound(
+      segments.begin(), segments.end(), time,
+      [](const internal::WaypointElement& element, const Time t)
+      {
+        return element.data.time < t;
+      });
+  }
+
+  std::size_t index_of(const internal::WaypointList::const_iterator it) const
+  {
+    return static_cast<std::size_t>(it - segments.begin());
+  }
+
+  /// Update the indices of the waypoints in the range [begin, end)
+  void reindex(const std::size_t begin, const std::size_t end)
+  {
+    for (std::size_t i = begin; i < end; ++i)
+      indices[segments[i].id] = i;
+  }
+
+  std::size_t acquire_id()
+  {
+    if (free_ids.empty())
     {
-      sit->myself = make_segment(sit);
-      oit->second = sit;
+      indices.push_back(npos);
+      return indices.size() - 1;
     }
 
-    return *this;
+    const std::size_t id = free_ids.back();
+    free_ids.pop_back();
+    return id;
+  }
+
+  void release_id(const std::size_t id)
+  {
+    indices[id] = npos;
+    free_ids.push_back(id);
+  }
+
+  void reserve(const std::size_t size)
+  {
+    segments.reserve(size);
+    indices.reserve(size);
   }
 
   InsertionResult insert(internal::WaypointElement::Data data)
   {
-    const internal::OrderMap::iterator hint = ordering.lower_bound(data.time);
-    if (hint != ordering.end() && hint->first == data.time)
+    const auto hint = lower_bound_element(data.time);
+    if (hint != segments.end() && hint->data.time == data.time)
     {
       // We already have a Waypoint in the Trajectory that ends at this same
       // exact moment in time, so we will return the existing iterator along
       // with inserted==false.
       assert(segments.size() > 0);
-      return InsertionResult{make_iterator<Waypoint>(hint->second), false};
+      return InsertionResult{make_iterator<Waypoint>(hint->id), false};
     }
 
-    const internal::WaypointList::const_iterator list_destination =
-      (hint == ordering.end()) ? segments.end() : hint->second;
+    const std::size_t index = index_of(hint);
+    const std::size_t id = acquire_id();
+    segments.emplace(hint, std::move(data), id, this);
+    reindex(index, segments.size());
+    changed();
 
-    const internal::WaypointList::iterator result =
-      segments.emplace(list_destination, std::move(data));
-    result->myself = make_segment(result);
     assert(segments.size() > 0);
-
-    ordering.emplace_hint(hint, data.time, result);
-    assert(ordering.size() > 0);
-
-    return InsertionResult{make_iterator<Waypoint>(result), true};
+    return InsertionResult{make_iterator<Waypoint>(id), true};
   }
 
   iterator find(Time time)
   {
-    const auto it = ordering.lower_bound(time);
-    if (it == ordering.end())
-      return make_iterator<Waypoint>(segments.end());
-
     // If the time comes before the start of the Trajectory, then we return
     // the end() iterator
-    if (time < segments.begin()->data.time)
-      return make_iterator<Waypoint>(segments.end());
+    if (segments.empty() || time < segments.front().data.time)
+      return end();
 
-    return make_iterator<Waypoint>(it->second);
+    return iterator_at<Waypoint>(index_of(lower_bound_element(time)));
   }
 
   iterator lower_bound(Time time)
   {
-    const auto it = ordering.lower_bound(time);
-    if (it == ordering.end())
-      return make_iterator<Waypoint>(segments.end());
-
-    return make_iterator<Waypoint>(it->second);
+    return iterator_at<Waypoint>(index_of(lower_bound_element(time)));
   }
 
   iterator erase(iterator waypoint)
   {
-    ordering.erase(waypoint->_pimpl->myself->data.time);
-    return make_iterator<Waypoint>(segments.erase(waypoint->_pimpl->myself));
+    const std::size_t index = waypoint._pimpl->index();
+    return erase(index, index + 1);
   }
 
   iterator erase(iterator first, iterator last)
   {
-    const auto seg_begin = first->_pimpl->myself;
-    const auto seg_end = last._pimpl->raw_iterator == segments.end() ?
-      segments.end() : last->_pimpl->myself;
+    return erase(first._pimpl->index(), last._pimpl->index());
+  }
+
+  iterator erase(const std::size_t first, const std::size_t last)
+  {
+    for (std::size_t i = first; i < last; ++i)
+      release_id(segments[i].id);
 
-    const auto order_start = ordering.find(seg_begin->data.time);
-    const auto order_end = seg_end == segments.end() ?
-      ordering.end() : ordering.find(seg_end->data.time);
+    segments.erase(
+      segments.begin() + static_cast<std::ptrdiff_t>(first),
+      segments.begin() + static_cast<std::ptrdiff_t>(last));
+    reindex(first, segments.size());
+    changed();
 
-    ordering.erase(order_start, order_end);
-    return make_iterator<Waypoint>(segments.erase(seg_begin, seg_end));
+    return iterator_at<Waypoint>(first);
+  }
+
+  Waypoint& change_time(const std::size_t index, const Time new_time)
+  {
+    const auto current_it =
+      segments.begin() + static_cast<std::ptrdiff_t>(index);
+
+    const auto hint = lower_bound_element(new_time);
+    if (hint != segments.end() && hint->data.time == new_time)
+    {
+      // The new time conflicts with an existing time, so we will throw an
+      // exception.
+      // *INDENT-OFF*
+      throw std::invalid_argument(
+        "[Trajectory::Waypoint::change_time] Attempted to set time to "
+        + std::to_string(new_time.time_since_epoch().count())
+        + "ns, but a waypoint already exists at that timestamp.");
+      // *INDENT-ON*
+    }
+
+    // Rotate the waypoint into its new place. The waypoints in between each
+    // shift over by one.
+    auto destination = current_it;
+    if (hint < current_it)
+    {
+      std::rotate(hint, current_it, current_it + 1);
+      destination = hint;
+      reindex(index_of(hint), index + 1);
+    }
+    else if (current_it + 1 < hint)
+    {
+      std::rotate(current_it, current_it + 1, hint);
+      destination = hint - 1;
+      reindex(index, index_of(hint));
+    }
+
+    destination->data.time = new_time;
+    changed();
+    return destination->myself;
+  }
+
+  void adjust_times(const std::size_t index, const Duration delta_t)
+  {
+    const auto begin_it =
+      segments.begin() + static_cast<std::ptrdiff_t>(index);
+
+    if (delta_t.count() < 0 && begin_it != segments.begin())
+    {
+      // If delta_t is negative and this is not the first Waypoint in the
+      // Trajectory, make sure the change in time does not make it dip beneath
+      // its predecessor Waypoint.
+      const auto predecessor_it = begin_it - 1;
+      const auto new_time = begin_it->data.time + delta_t;
+      if (new_time <= predecessor_it->data.time)
+      {
+        const auto tp = predecessor_it->data.time
+          .time_since_epoch().count();
+        const auto tc = (new_time).time_since_epoch().count();
+
+        const std::string error =
+          std::string("[Trajectory::Waypoint::adjust_times] ")
+          + "The given negative change in time: "
+          + std::to_string(delta_t.count()) + "ns caused the Waypoint's new "
+          + "time window [" + std::to_string(tc)
+          + "] to overlap with its precedessor's [" + std::to_string(tp)
+          + "]";
+
+        throw std::invalid_argument(error);
+      }
+    }
+
+    // Every waypoint from this one onwards moves by the same amount, so their
+    // order does not change.
+    for (auto it = begin_it; it != segments.end(); ++it)
+      it->data.time += delta_t;
+
+    changed();
   }
 
   iterator begin()
   {
-    return make_iterator<Waypoint>(segments.begin());
+    return iterator_at<Waypoint>(0);
   }
 
   iterator end()
   {
-    return make_iterator<Waypoint>(segments.end());
+    return make_iterator<Waypoint>(npos);
   }
 
 };
 
+namespace internal {
 //==============================================================================
-Eigen::Vector3d Trajectory::Waypoint::position() const
+std::size_t TrajectoryIteratorImplementation::index() const
 {
-  return _pimpl->data().position;
+  if (id == npos)
+    return parent->segments.size();
+
+  return parent->indices[id];
 }
 
 //==============================================================================
-Trajectory::Waypoint& Trajectory::Waypoint::position(
-  Eigen::Vector3d new_position)
+WaypointElement& TrajectoryIteratorImplementation::element() const
 {
-  _pimpl->data().position = std::move(new_position);
-  return *this;
+  const std::size_t i = index();
+  assert(i < parent->segments.size());
+  return const_cast<WaypointElement&>(parent->segments[i]);
 }
 
 //==============================================================================
-Eigen::Vector3d Trajectory::Waypoint::velocity() const
+void TrajectoryIteratorImplementation::increment()
 {
-  return _pimpl->data().velocity;
+  const std::size_t next = index() + 1;
+  id = next < parent->segments.size() ? parent->segments[next].id : npos;
 }
 
 //==============================================================================
-Trajectory::Waypoint& Trajectory::Waypoint::velocity(
-  Eigen::Vector3d new_velocity)
+void TrajectoryIteratorImplementation::decrement()
 {
-  _pimpl->data().velocity = std::move(new_velocity);
-  return *this;
+  const std::size_t previous = index() - 1;
+  id = parent->segments[previous].id;
 }
 
 //==============================================================================
-Time Trajectory::Waypoint::time() const
+WaypointList::const_iterator TrajectoryIteratorImplementation::raw(
+  const Trajectory::const_iterator& iterator)
 {
-  return _pimpl->time();
+  const auto& impl = *iterator._pimpl;
+  return impl.parent->segments.begin()
+    + static_cast<std::ptrdiff_t>(impl.index());
 }
 
 //==============================================================================
-Trajectory::Waypoint& Trajectory::Waypoint::change_time(const Time new_time)
+ConstTrajectoryMotionCachePtr TrajectoryIteratorImplementation::motion_cache(
+  const Trajectory& trajectory)
 {
-  internal::WaypointList::iterator data_it = _pimpl->myself;
-  internal::WaypointElement::Data& current_data = data_it->data;
-  const Time current_time = current_data.time;
+  const auto& impl = *trajectory._pimpl;
+  if (auto cache = std::atomic_load(&impl.motion_cache))
+    return cache;
 
-  if (current_time == new_time)
-  {
-    // Short-circuit, since nothing is changing. The erase and re-insertion
-    // would be a waste of time in this case.
-    return *this;
-  }
+  ConstTrajectoryMotionCachePtr expected = nullptr;
+  ConstTrajectoryMotionCachePtr cache =
+    std::make_shared<TrajectoryMotionCache>(trajectory);
 
-  internal::OrderMap& ordering = _pimpl->parent->ordering;
-  internal::WaypointList& segments = _pimpl->parent->segments;
-  const internal::OrderMap::const_iterator current_order_it =
-    ordering.find(current_time);
-  assert(current_order_it != ordering.end());
+  // If another thread filled in the cache first, then use its copy instead.
+  if (!std::atomic_compare_exchange_strong(
+      &impl.motion_cache, &expected, cache))
+    return expected;
 
-  const internal::OrderMap::const_iterator hint =
-    ordering.lower_bound(new_time);
+  return cache;
+}
 
-  if (current_order_it == hint)
-  {
-    // The Waypoint is already in the correct location within the list, so it
-    // does not need to be moved. We can just update its entry in the OrderMap.
-
-    // We need to create a new_hint iterator which points to the iterator after
-    // hint because the hint iterator will be invalidated when we erase
-    // current_order_it (because they are iterators to the same element).
-    const internal::OrderMap::const_iterator new_hint =
-      ++internal::OrderMap::const_iterator(hint);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(new_hint, new_time, std::move(data_it));
-  }
-  else if (hint == ordering.end())
-  {
-    // This Waypoint must be moved to the end of the list.
-    segments.splice(segments.end(), segments, data_it);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(hint, new_time, std::move(data_it));
-  }
-  else
-  {
-    const internal::WaypointList::const_iterator destination = hint->second;
-    assert(destination != segments.end());
+//==============================================================================
+Trajectory::const_iterator TrajectoryIteratorImplementation::iterator_at(
+  const Trajectory& trajectory, const std::size_t index)
+{
+  return trajectory._pimpl->iterator_at<const Trajectory::Waypoint>(index);
+}
 
-    if (destination->data.time == new_time)
-    {
-      // The new time conflicts with an existing time, so we will throw an
-      // exception.
-      // *INDENT-OFF*
-      throw std::invalid_argument(
-        "[Trajectory::Waypoint::change_time] Attempted to set time to "
-        + std::to_string(new_time.time_since_epoch().count())
-        + "ns, but a waypoint already exists at that timestamp.");
-      // *INDENT-ON*
-    }
+//==============================================================================
+WaypointList::const_iterator get_raw_iterator(
+  const Trajectory::const_iterator& iterator)
+{
+  return TrajectoryIteratorImplementation::raw(iterator);
+}
 
-    segments.splice(destination, segments, data_it);
-    ordering.erase(current_order_it);
-    ordering.emplace_hint(hint, new_time, std::move(data_it));
-  }
+//==============================================================================
+Trajectory::const_iterator get_iterator(
+  const Trajectory& trajectory, const std::size_t index)
+{
+  return TrajectoryIteratorImplementation::iterator_at(trajectory, index);
+}
+
+//==============================================================================
+ConstTrajectoryMotionCachePtr get_motion_cache(const Trajectory& trajectory)
+{
+  return TrajectoryIteratorImplementation::motion_cache(trajectory);
+}
 
-  // Update the time value in the data field.
-  current_data.time = new_time;
+} // namespace internal
 
+//==============================================================================
+Eigen::Vector3d Trajectory::Waypoint::position() const
+{
+  return _pimpl->data.position;
+}
+
+//==============================================================================
+Trajectory::Waypoint& Trajectory::Waypoint::position(
+  Eigen::Vector3d new_position)
+{
+  _pimpl->data.position = std::move(new_position);
+  _pimpl->parent->changed();
   return *this;
 }
 
 //==============================================================================
-void Trajectory::Waypoint::adjust_times(Duration delta_t)
+Eigen::Vector3d Trajectory::Waypoint::velocity() const
 {
-  internal::WaypointList& segments = _pimpl->parent->segments;
-  const internal::WaypointList::iterator begin_it = _pimpl->myself;
-  const Time original_begin_time = begin_it->data.time;
+  return _pimpl->data.velocity;
+}
 
-  if (delta_t.count() < 0 && begin_it != segments.begin())
-  {
-    // If delta_t is negative and this is not the first Waypoint in the
-    // Trajectory, make sure the change in time does not make it dip beneath its
-    // predecessor Waypoint.
-    const internal::WaypointList::const_iterator predecessor_it =
-      --internal::WaypointList::iterator(begin_it);
-    const auto new_time = begin_it->data.time + delta_t;
-    if (new_time <= predecessor_it->data.time)
-    {
-      const auto tp = predecessor_it->data.time
-        .time_since_epoch().count();
-      const auto tc = (new_time).time_since_epoch().count();
-
-      const std::string error =
-        std::string("[Trajectory::Waypoint::adjust_times] ")
-        + "The given negative change in time: "
-        + std::to_string(delta_t.count()) + "ns caused the Waypoint's new "
-        + "time window [" + std::to_string(tc)
-        + "] to overlap with its precedessor's [" + std::to_string(tp)
-        + "]";
-
-      throw std::invalid_argument(error);
-    }
-  }
+//==============================================================================
+Trajectory::Waypoint& Trajectory::Waypoint::velocity(
+  Eigen::Vector3d new_velocity)
+{
+  _pimpl->data.velocity = std::move(new_velocity);
+  _pimpl->parent->changed();
+  return *this;
+}
+
+//==============================================================================
+Time Trajectory::Waypoint::time() const
+{
+  return _pimpl->data.time;
+}
 
-  // Adjust the times for the segments and collect their iterators
-  std::vector<internal::WaypointList::iterator> list_iterators;
-  list_iterators.reserve(segments.size());
-  for (internal::WaypointList::iterator it = begin_it; it != segments.end();
-    ++it)
+//==============================================================================
+Trajectory::Waypoint& Trajectory::Waypoint::change_time(const Time new_time)
+{
+  if (_pimpl->data.time == new_time)
   {
-    it->data.time += delta_t;
-    list_iterators.push_back(it);
+    // Short-circuit, since nothing is changing.
+    return *this;
   }
 
-  internal::OrderMap& ordering = _pimpl->parent->ordering;
-  const internal::OrderMap::iterator order_it =
-    ordering.find(original_begin_time);
-  assert(order_it != ordering.end());
-
-  // Erase the existing ordering entries for all the modified Trajectory
-  // Waypoints.
-  ordering.erase(order_it, ordering.end());
+  Trajectory::Implementation& parent = *_pimpl->parent;
+  return parent.change_time(parent.indices[_pimpl->id], new_time);
+}
 
-  // Add new entries one at a time, supplying the emplacement operator with the
-  // hint that it can always append the entry to the end of the map.
-  for (internal::WaypointList::iterator& it : list_iterators)
-  {
-    const Time new_time = it->data.time;
-    ordering.emplace_hint(ordering.end(), new_time, std::move(it));
-  }
+//==============================================================================
+void Trajectory::Waypoint::adjust_times(Duration delta_t)
+{
+  Trajectory::Implementation& parent = *_pimpl->parent;
+  parent.adjust_times(parent.indices[_pimpl->id], delta_t);
 }
 
 //==============================================================================
 Trajectory::Waypoint::Waypoint()
-: _pimpl(rmf_utils::make_impl<Implementation>())
 {
-  // Do nothing
+  // Do nothing. The element that contains this Waypoint will bind it.
 }
 
 //==============================================================================
@@ -459,7 +550,7 @@ Trajectory::InsertionResult Trajectory::insert(
 //==============================================================================
 Trajectory::InsertionResult Trajectory::insert(const Waypoint& other)
 {
-  return _pimpl->insert(internal::WaypointElement::Data{other._pimpl->data()});
+  return _pimpl->insert(internal::WaypointElement::Data{other._pimpl->data});
 }
 
 //==============================================================================
@@ -537,25 +628,25 @@ Trajectory::const_iterator Trajectory::cend() const
 //==============================================================================
 auto Trajectory::front() -> Waypoint&
 {
-  return *_pimpl->segments.front().myself;
+  return _pimpl->segments.front().myself;
 }
 
 //==============================================================================
 auto Trajectory::front() const -> const Waypoint&
 {
-  return *_pimpl->segments.front().myself;
+  return _pimpl->segments.front().myself;
 }
 
 //==============================================================================
 auto Trajectory::back() -> Waypoint&
 {
-  return *_pimpl->segments.back().myself;
+  return _pimpl->segments.back().myself;
 }
 
 //==============================================================================
 auto Trajectory::back() const -> const Waypoint&
 {
-  return *_pimpl->segments.back().myself;
+  return _pimpl->segments.back().myself;
 }
 
 //==============================================================================
@@ -587,25 +678,31 @@ std::size_t Trajectory::size() const
   return _pimpl->segments.size();
 }
 
+//==============================================================================
+void Trajectory::reserve(const std::size_t size)
+{
+  _pimpl->reserve(size);
+}
+
 //==============================================================================
 template<typename SegT>
 SegT& Trajectory::base_iterator<SegT>::operator*() const
 {
-  return *_pimpl->raw_iterator->myself;
+  return _pimpl->element().myself;
 }
 
 //==============================================================================
 template<typename SegT>
 SegT* Trajectory::base_iterator<SegT>::operator->() const
 {
-  return _pimpl->raw_iterator->myself.get();
+  return &_pimpl->element().myself;
 }
 
 //==============================================================================
 template<typename SegT>
 auto Trajectory::base_iterator<SegT>::operator++() -> base_iterator&
 {
-  ++_pimpl->raw_iterator;
+  _pimpl->increment();
   return *this;
 }
 
@@ -613,7 +710,7 @@ auto Trajectory::base_iterator<SegT>::operator++() -> base_iterator&
 template<typename SegT>
 auto Trajectory::base_iterator<SegT>::operator--() -> base_iterator&
 {
-  --_pimpl->raw_iterator;
+  _pimpl->decrement();
   return *this;
 }
 
@@ -637,57 +734,25 @@ auto Trajectory::base_iterator<SegT>::operator--(int) -> base_iterator
   bool Trajectory::base_iterator<SegT>::operator op( \
     const base_iterator& other) const \
   { \
-    return _pimpl->raw_iterator op other._pimpl->raw_iterator; \
+    return _pimpl->id op other._pimpl->id; \
   }
 
 DEFINE_BASIC_ITERATOR_OP(==)
 DEFINE_BASIC_ITERATOR_OP(!=)
 
-template<typename SegT>
-bool Trajectory::base_iterator<SegT>::operator<(
-  const base_iterator& other) const
-{
-  const bool this_is_end =
-    this->_pimpl->raw_iterator == _pimpl->parent->segments.end();
-  const bool other_is_end =
-    other._pimpl->raw_iterator == _pimpl->parent->segments.end();
-
-  if (this_is_end || other_is_end)
-  {
-    // If the other is the end iterator but this iterator is not, then we return
-    // true, because the end iterator is "larger" than any valid iterator.
-    // If the other is not the end iterator but this iterator is, then we return
-    // false, because this iterator is definitely larger than anything the other
-    // can be.
-    return other_is_end && !this_is_end;
-  }
-
-  // If they are both valid iterators, then we can compare their times.
-  return this->_pimpl->raw_iterator->data.time
-    < other._pimpl->raw_iterator->data.time;
-}
-
-//==============================================================================
-template<typename SegT>
-bool Trajectory::base_iterator<SegT>::operator>(
-  const base_iterator& other) const
-{
-  const bool this_is_end =
-    this->_pimpl->raw_iterator == _pimpl->parent->segments.end();
-  const bool other_is_end =
-    other._pimpl->raw_iterator == _pimpl->parent->segments.end();
-
-  if (this_is_end || other_is_end)
-  {
-    // See the logic above for operator<, but in this case we want the opposite
-    // conclusion.
-    return this_is_end && !other_is_end;
+// NOTE: The waypoints are sorted by time, and the end iterator has the largest
+// index of any iterator, so comparing the indices gives the same answer as
+// comparing the times.
+#define DEFINE_ORDERING_ITERATOR_OP(op) \
+  template<typename SegT> \
+  bool Trajectory::base_iterator<SegT>::operator op( \
+    const base_iterator& other) const \
+  { \
+    return _pimpl->index() op other._pimpl->index(); \
   }
 
-  // If they are both valid iterators, then we can compare their times.
-  return this->_pimpl->raw_iterator->data.time
-    > other._pimpl->raw_iterator->data.time;
-}
+DEFINE_ORDERING_ITERATOR_OP(<)
+DEFINE_ORDERING_ITERATOR_OP(>)
 
 //==============================================================================
 template<typename SegT>
@@ -709,7 +774,7 @@ bool Trajectory::base_iterator<SegT>::operator>=(
 template<typename SegT>
 Trajectory::base_iterator<SegT>::operator const_iterator() const
 {
-  return _pimpl->make_iterator<const SegT>(_pimpl->raw_iterator);
+  return _pimpl->make_iterator<const SegT>(_pimpl->id);
 }
 
 //==============================================================================
@@ -731,55 +796,29 @@ bool Trajectory::Debug::check_iterator_time_consistency(
   assert(trajectory._pimpl);
 
   const internal::WaypointList& segments = trajectory._pimpl->segments;
-  const internal::OrderMap& ordering = trajectory._pimpl->ordering;
 
   bool consistent = true;
-
-  internal::WaypointList::const_iterator s_it = segments.begin();
-  internal::OrderMap::const_iterator o_it = ordering.begin();
-  for ( ; s_it != segments.end() && o_it != ordering.end(); ++s_it, ++o_it)
+  for (std::size_t i = 0; i < segments.size(); ++i)
   {
-    consistent &= s_it->data.time == o_it->first;
+    const auto& element = segments[i];
+    consistent &= element.parent == trajectory._pimpl.get();
+    consistent &= trajectory._pimpl->indices[element.id] == i;
+    consistent &= element.myself._pimpl.get() == &element;
+    if (i > 0)
+      consistent &= segments[i-1].data.time < element.data.time;
   }
 
-  consistent &= s_it == segments.end();
-  consistent &= o_it == ordering.end();
-
   if (print_inconsistency && !consistent)
   {
-    std::size_t index = 0;
-    s_it = segments.begin();
-    o_it = ordering.begin();
-    std::cout << "Trajectory time inconsistency detected: "
-              << "( ordering | segments | difference )\n";
-    for ( ; s_it != segments.end() && o_it != ordering.end();
-      ++s_it, ++o_it, ++index)
-    {
-      const auto difference = o_it->first - s_it->data.time;
-      std::cout << " -- [" << index << "] "
-                << o_it->first.time_since_epoch().count()/1e9 << " | "
-                << s_it->data.time.time_since_epoch().count()/1e9
-                << " | Difference: " << difference.count()/1e9 << "\n";
-    }
-
-    if (s_it != segments.end())
+    std::cout << "Trajectory inconsistency detected: "
+              << "( time | indexed | bound to element )\n";
+    for (std::size_t i = 0; i < segments.size(); ++i)
     {
-      std::cout << " -- more elements in segments\n";
-      for ( ; s_it != segments.end(); ++s_it, ++index)
-      {
-        std::cout << "      -- [" << index << "] "
-                  << s_it->data.time.time_since_epoch().count()/1e9
-                  << "\n";
-      }
-    }
-    if (o_it != ordering.end())
-    {
-      std::cout << " -- more elements in ordering:\n";
-      for ( ; o_it != ordering.end(); ++o_it, ++index)
-      {
-        std::cout << "     -- [" << index << "] "
-                  << o_it->first.time_since_epoch().count()/1e9 << "\n";
-      }
+      const auto& element = segments[i];
+      std::cout << " -- [" << i << "] "
+                << element.data.time.time_since_epoch().count()/1e9 << " | "
+                << (trajectory._pimpl->indices[element.id] == i) << " | "
+                << (element.myself._pimpl.get() == &element) << "\n";
     }
     std::cout << std::endl;
   }
@@ -18,22 +18,41 @@
 #ifndef SRC__RMF_TRAFFIC__TRAJECTORYINTERNAL_HPP
 #define SRC__RMF_TRAFFIC__TRAJECTORYINTERNAL_HPP
 
+#include "SmallVector.hpp"
+
 #include <rmf_traffic/Trajectory.hpp>
 
-#include <list>
-#include <map>
+#include <cassert>
+#include <memory>
+#include <type_traits>
 
 namespace rmf_traffic {
 namespace internal {
 
 //==============================================================================
-struct WaypointElement;
-using WaypointList = std::list<WaypointElement>;
-using OrderMap = std::map<Time, WaypointList::iterator>;
+using WaypointElement = Trajectory::Waypoint::Implementation;
+
+// NOTE: The waypoints of a Trajectory are kept in one contiguous vector which
+// is sorted by time. Each waypoint also has an ID that never changes while the
+// waypoint exists, so that iterators can keep following their waypoint when
+// other waypoints are inserted or erased around it.
+//
+// Most trajectories that get created, especially by the planner, only have a
+// few waypoints, so that many waypoints are stored inside the Trajectory
+// itself before any memory gets allocated for them.
+constexpr std::size_t InlineWaypoints = 4;
+using WaypointList = SmallVector<WaypointElement, InlineWaypoints>;
+
+} // namespace internal
 
 //==============================================================================
-struct WaypointElement
+/// The element that gets stored in the WaypointList of a Trajectory. Each
+/// element carries the Trajectory::Waypoint that refers to it, so that a
+/// reference to a Waypoint can be given out without allocating anything.
+class Trajectory::Waypoint::Implementation
 {
+public:
+
   struct Data
   {
     Time time;
@@ -43,38 +62,111 @@ struct WaypointElement
 
   Data data;
 
-  // We store a Trajectory::Waypoint in this struct so that we can always safely
-  // return a reference to a Trajectory::Waypoint object. As long as this
-  // WaypointData is alive, any Trajectory::Waypoint reference that refers to it
-  // will remain valid.
-  std::unique_ptr<Trajectory::Waypoint> myself;
+  // The ID of this waypoint within its Trajectory
+  std::size_t id;
+
+  // The Trajectory that contains this element
+  Trajectory::Implementation* parent;
+
+  // The public handle of this element. Its _pimpl always points back at the
+  // element that contains it without owning it, so a handle never gets moved
+  // or copied along with its element. Instead, each element binds its own
+  // handle when it gets constructed.
+  Waypoint myself;
+
+  Implementation(
+    Data input_data,
+    const std::size_t input_id,
+    Trajectory::Implementation* input_parent)
+  : data(std::move(input_data)),
+    id(input_id),
+    parent(input_parent)
+  {
+    bind();
+  }
 
-  WaypointElement(Data input_data)
-  : data(std::move(input_data))
+  Implementation(const Implementation& other)
+  : data(other.data),
+    id(other.id),
+    parent(other.parent)
   {
-    // Do nothing
+    bind();
   }
 
-  WaypointElement(const WaypointElement& other)
-  : data(other.data)
+  Implementation(Implementation&& other) noexcept
+  : data(std::move(other.data)),
+    id(other.id),
+    parent(other.parent)
   {
-    // Do nothing
+    bind();
   }
 
-  WaypointElement& operator=(const WaypointElement& other)
+  Implementation& operator=(const Implementation& other)
   {
     data = other.data;
+    id = other.id;
+    parent = other.parent;
+    return *this;
+  }
+
+  Implementation& operator=(Implementation&& other) noexcept
+  {
+    data = std::move(other.data);
+    id = other.id;
+    parent = other.parent;
     return *this;
   }
 
-  WaypointElement(WaypointElement&&) = default;
-  WaypointElement& operator=(WaypointElement&&) = default;
+private:
+
+  static void release(Implementation*)
+  {
+    // Do nothing. The element owns its handle, not the other way around.
+  }
+
+  static Implementation* refuse_copy(const Implementation*)
+  {
+    // Waypoints cannot be copied, so this should never be called
+    assert(false);
+    return nullptr;
+  }
+
+  void bind()
+  {
+    myself._pimpl = rmf_utils::impl_ptr<Implementation>(
+      this, &Implementation::release, &Implementation::refuse_copy);
+  }
 };
 
+namespace internal {
+
+// Growing a WaypointList copies the waypoints instead of moving them unless
+// they can be moved without throwing.
+static_assert(std::is_nothrow_move_constructible<WaypointElement>::value,
+  "The waypoints of a Trajectory must be moved without throwing");
+
 //==============================================================================
 WaypointList::const_iterator get_raw_iterator(
   const Trajectory::const_iterator& iterator);
 
+//==============================================================================
+/// Get an iterator to the waypoint at the given index of a trajectory, or the
+/// end iterator if the index is not less than the size of the trajectory.
+Trajectory::const_iterator get_iterator(
+  const Trajectory& trajectory, std::size_t index);
+
+//==============================================================================
+class TrajectoryMotionCache;
+using ConstTrajectoryMotionCachePtr =
+  std::shared_ptr<const TrajectoryMotionCache>;
+
+//==============================================================================
+/// Get the splines of a trajectory. They will be computed the first time this
+/// is called, and then reused until the trajectory is modified. This is safe
+/// to call from multiple threads at once, as long as nothing is modifying the
+/// trajectory.
+ConstTrajectoryMotionCachePtr get_motion_cache(const Trajectory& trajectory);
+
 } // namespace internal
 } // namespace rmf_traffic
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "TrajectoryMotionCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace rmf_traffic {
+namespace internal {
+
+//==============================================================================
+TrajectoryMotionCache::TrajectoryMotionCache(const Trajectory& trajectory)
+: _box(void_box())
+{
+  if (trajectory.size() < 2)
+    return;
+
+  _segments.reserve(trajectory.size() - 1);
+  for (auto it = ++trajectory.begin(); it != trajectory.end(); ++it)
+  {
+    Spline spline(it);
+    const BoundingBox box = get_bounding_box(spline);
+    _box.min = _box.min.cwiseMin(box.min);
+    _box.max = _box.max.cwiseMax(box.max);
+    _segments.push_back(Segment{std::move(spline), box});
+  }
+
+  const std::size_t N = _segments.size();
+  _tree.resize(N, void_box());
+  for (std::size_t i = N-1; i > 0; --i)
+  {
+    const BoundingBox& left = node(2*i);
+    const BoundingBox& right = node(2*i+1);
+    _tree[i] = BoundingBox{
+      left.min.cwiseMin(right.min),
+      left.max.cwiseMax(right.max)
+    };
+  }
+}
+
+//==============================================================================
+auto TrajectoryMotionCache::segments() const -> const std::vector<Segment>&
+{
+  return _segments;
+}
+
+//==============================================================================
+const BoundingBox& TrajectoryMotionCache::box() const
+{
+  return _box;
+}
+
+//==============================================================================
+BoundingBox TrajectoryMotionCache::box(
+  std::size_t begin, std::size_t end) const
+{
+  assert(begin <= end);
+  assert(end <= _segments.size());
+
+  BoundingBox output = void_box();
+  const std::size_t N = _segments.size();
+  for (begin += N, end += N; begin < end; begin /= 2, end /= 2)
+  {
+    if (begin % 2 == 1)
+    {
+      const BoundingBox& b = node(begin++);
+      output.min = output.min.cwiseMin(b.min);
+      output.max = output.max.cwiseMax(b.max);
+    }
+
+    if (end % 2 == 1)
+    {
+      const BoundingBox& b = node(--end);
+      output.min = output.min.cwiseMin(b.min);
+      output.max = output.max.cwiseMax(b.max);
+    }
+  }
+
+  return output;
+}
+
+//==============================================================================
+std::size_t TrajectoryMotionCache::find_segment(const Time time) const
+{
+  return static_cast<std::size_t>(
+    std::lower_bound(
+      _segments.begin(), _segments.end(), time,
+      [](const Segment& segment, const Time t)
+      {
+        return segment.spline.finish_time() < t;
+      }) - _segments.begin());
+}
+
+//==============================================================================
+const BoundingBox& TrajectoryMotionCache::node(const std::size_t i) const
+{
+  const std::size_t N = _segments.size();
+  if (i < N)
+    return _tree[i];
+
+  return _segments[i - N].box;
+}
+
+} // namespace internal
+} // namespace rmf_traffic
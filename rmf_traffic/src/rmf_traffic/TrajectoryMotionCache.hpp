@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__TRAJECTORYMOTIONCACHE_HPP
+#define SRC__RMF_TRAFFIC__TRAJECTORYMOTIONCACHE_HPP
+
+#include "DetectConflictInternal.hpp"
+#include "Spline.hpp"
+
+#include <vector>
+
+namespace rmf_traffic {
+namespace internal {
+
+//==============================================================================
+/// The splines of every segment of a Trajectory, along with the bounding box of
+/// each spline. A Trajectory computes this the first time a conflict check asks
+/// for it and then keeps it until the Trajectory gets modified, so repeated
+/// conflict checks against the same Trajectory do not need to recompute them.
+///
+/// This class is immutable, so it can be shared between threads and between
+/// copies of the same Trajectory.
+class TrajectoryMotionCache
+{
+public:
+
+  struct Segment
+  {
+    /// The spline from the previous waypoint to this one
+    Spline spline;
+
+    /// A box that contains every position along the spline, without accounting
+    /// for the shape of any profile
+    BoundingBox box;
+  };
+
+  /// Compute the segments of a trajectory
+  TrajectoryMotionCache(const Trajectory& trajectory);
+
+  /// The segments of the trajectory. The segment at index i goes from waypoint
+  /// i to waypoint i+1, so there is one fewer segment than there are
+  /// waypoints.
+  const std::vector<Segment>& segments() const;
+
+  /// A box that contains every segment
+  const BoundingBox& box() const;
+
+  /// A box that contains the segments in the range [begin, end). This takes
+  /// O(log N) time.
+  BoundingBox box(std::size_t begin, std::size_t end) const;
+
+  /// Get the index of the first segment that finishes at or after the given
+  /// time, or the number of segments if every segment finishes before it.
+  std::size_t find_segment(Time time) const;
+
+private:
+
+  /// Get the box of a node in the segment tree
+  const BoundingBox& node(std::size_t i) const;
+
+  std::vector<Segment> _segments;
+  BoundingBox _box;
+
+  // The inner nodes of a segment tree whose leaves are the boxes of the
+  // segments. Node i contains nodes 2i and 2i+1, and node N+i is the leaf of
+  // segment i. Node 0 is not used.
+  std::vector<BoundingBox> _tree;
+};
+
+} // namespace internal
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__TRAJECTORYMOTIONCACHE_HPP
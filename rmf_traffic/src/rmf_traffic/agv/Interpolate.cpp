@@ -90,6 +90,25 @@ States compute_traversal(
 } // anonymous namespace
 
 namespace internal {
+//==============================================================================
+double compute_traversal_time(
+  const double distance,
+  const double v_nom,
+  const double a_nom)
+{
+  if (distance <= 0.0)
+    return 0.0;
+
+  // If the distance is long enough to reach the nominal velocity, then we spend
+  // v_nom/a_nom seconds accelerating and the same amount decelerating, and we
+  // cruise the rest of the way. Otherwise we accelerate for half the distance
+  // and decelerate for the other half.
+  if (distance >= v_nom*v_nom/a_nom)
+    return distance/v_nom + v_nom/a_nom;
+
+  return 2.0*std::sqrt(distance/a_nom);
+}
+
 //==============================================================================
 void interpolate_translation(Trajectory& trajectory,
   const double v_nom,
@@ -68,6 +68,12 @@ bool can_skip_interpolation(
   const Eigen::Vector3d& future_position,
   const Interpolate::Options::Implementation& options);
 
+//==============================================================================
+/// Get the time that it takes to travel a distance, starting and finishing at
+/// rest, with the same motion profile that interpolate_translation() and
+/// interpolate_rotation() use.
+double compute_traversal_time(double distance, double v_nom, double a_nom);
+
 //==============================================================================
 void interpolate_translation(
   Trajectory& trajectory,
@@ -37,6 +37,8 @@ public:
   Graph graph;
   VehicleTraits traits;
   Interpolate::Options interpolation;
+  rmf_utils::optional<std::size_t> heuristic_table_budget = rmf_utils::nullopt;
+  rmf_utils::optional<std::string> heuristic_table_file = rmf_utils::nullopt;
 
 };
 
@@ -115,19 +117,34 @@ const Interpolate::Options& Planner::Configuration::interpolation() const
 }
 
 //==============================================================================
-class Planner::Options::Implementation
+auto Planner::Configuration::heuristic_table_budget(
+  rmf_utils::optional<std::size_t> bytes) -> Configuration&
 {
-public:
+  _pimpl->heuristic_table_budget = bytes;
+  return *this;
+}
 
-  rmf_utils::clone_ptr<RouteValidator> validator;
-  Duration min_hold_time;
-  rmf_utils::optional<double> maximum_cost_estimate;
-  rmf_utils::optional<std::size_t> saturation_limit;
+//==============================================================================
+rmf_utils::optional<std::size_t>
+Planner::Configuration::heuristic_table_budget() const
+{
+  return _pimpl->heuristic_table_budget;
+}
 
-  std::function<bool()> interrupter = nullptr;
-  std::shared_ptr<const bool> interrupt_flag = nullptr;
+//==============================================================================
+auto Planner::Configuration::heuristic_table_file(
+  rmf_utils::optional<std::string> path) -> Configuration&
+{
+  _pimpl->heuristic_table_file = std::move(path);
+  return *this;
+}
 
-};
+//==============================================================================
+const rmf_utils::optional<std::string>&
+Planner::Configuration::heuristic_table_file() const
+{
+  return _pimpl->heuristic_table_file;
+}
 
 //==============================================================================
 Planner::Options::Options(
@@ -525,6 +542,19 @@ Planner::Result Planner::Result::Implementation::setup(
   return result;
 }
 
+//==============================================================================
+auto Planner::Options::Implementation::get(Options& options) -> Implementation&
+{
+  return *options._pimpl;
+}
+
+//==============================================================================
+auto Planner::Options::Implementation::get(const Options& options)
+-> const Implementation&
+{
+  return *options._pimpl;
+}
+
 //==============================================================================
 auto Planner::Result::Implementation::get(const Result& r)
 -> const Implementation&
@@ -109,22 +109,24 @@ ScheduleRouteValidator::find_conflict(const Route& route) const
   const auto view = _pimpl->viewer->query(
         spacetime, schedule::Query::Participants::make_all());
 
+  std::vector<schedule::ParticipantId> participants;
+  std::vector<DetectConflict::Other> others;
   for (const auto& v : view)
   {
     if (v.participant == _pimpl->participant)
       continue;
 
-    if (const auto time = rmf_traffic::DetectConflict::between(
-        _pimpl->profile,
-        route.trajectory(),
-        v.description.profile(),
-        v.route.trajectory()))
-    {
-      return Conflict{v.participant, *time};
-    }
+    participants.push_back(v.participant);
+    others.push_back({v.description.profile(), v.route.trajectory()});
   }
 
-  return rmf_utils::nullopt;
+  const auto hits = rmf_traffic::DetectConflict::between(
+    _pimpl->profile, route.trajectory(), others, true);
+
+  if (hits.empty())
+    return rmf_utils::nullopt;
+
+  return Conflict{participants[hits.front().index], hits.front().time};
 }
 
 //==============================================================================
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "internal_HeuristicTables.hpp"
+#include "InterpolateInternal.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rmf_traffic {
+namespace internal {
+namespace planning {
+
+namespace {
+
+//==============================================================================
+constexpr char Magic[] = "RMFTHEUR";
+constexpr std::size_t MagicSize = sizeof(Magic) - 1;
+
+// Increment this whenever the format of the file or the way that the tables
+// are computed changes, so that older files will be ignored.
+constexpr uint64_t FormatVersion = 1;
+
+//==============================================================================
+struct Header
+{
+  char magic[MagicSize];
+  uint64_t version;
+  uint64_t key;
+  uint64_t num_waypoints;
+  uint64_t num_tables;
+};
+
+//==============================================================================
+/// Builds a 64-bit FNV-1a hash out of a sequence of values
+class KeyBuilder
+{
+public:
+
+  template<typename T>
+  KeyBuilder& add(const T& value)
+  {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+      _hash ^= bytes[i];
+      _hash *= 0x100000001b3ull;
+    }
+
+    return *this;
+  }
+
+  KeyBuilder& add(const std::string& value)
+  {
+    add(static_cast<uint64_t>(value.size()));
+    for (const char c : value)
+      add(c);
+
+    return *this;
+  }
+
+  KeyBuilder& add_event(const agv::Graph::Lane::Event* event)
+  {
+    if (!event)
+      return add(false);
+
+    return add(true).add(event->duration().count());
+  }
+
+  uint64_t get() const
+  {
+    return _hash;
+  }
+
+private:
+  uint64_t _hash = 0xcbf29ce484222325ull;
+};
+
+//==============================================================================
+std::size_t header_size(const std::size_t num_tables)
+{
+  return sizeof(Header) + num_tables*sizeof(uint64_t);
+}
+
+//==============================================================================
+std::size_t file_size(
+  const std::size_t num_waypoints,
+  const std::size_t num_tables)
+{
+  return header_size(num_tables) + num_tables*num_waypoints*sizeof(double);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+uint64_t heuristic_table_key(const agv::Planner::Configuration& config)
+{
+  KeyBuilder key;
+
+  const auto& graph = config.graph();
+  key.add(static_cast<uint64_t>(graph.num_waypoints()));
+  for (std::size_t i = 0; i < graph.num_waypoints(); ++i)
+  {
+    const auto& wp = graph.get_waypoint(i);
+    key.add(wp.get_map_name())
+    .add(wp.get_location()[0])
+    .add(wp.get_location()[1])
+    .add(wp.is_passthrough_point());
+  }
+
+  key.add(static_cast<uint64_t>(graph.num_lanes()));
+  for (std::size_t i = 0; i < graph.num_lanes(); ++i)
+  {
+    const auto& lane = graph.get_lane(i);
+    key.add(static_cast<uint64_t>(lane.entry().waypoint_index()))
+    .add(static_cast<uint64_t>(lane.exit().waypoint_index()))
+    .add_event(lane.entry().event())
+    .add_event(lane.exit().event());
+  }
+
+  const auto& traits = config.vehicle_traits();
+  key.add(traits.linear().get_nominal_velocity())
+  .add(traits.linear().get_nominal_acceleration())
+  .add(traits.rotational().get_nominal_velocity())
+  .add(traits.rotational().get_nominal_acceleration());
+
+  const auto* differential = traits.get_differential();
+  key.add(differential != nullptr);
+  if (differential)
+    key.add(differential->is_reversible());
+
+  const auto& interpolate =
+    agv::Interpolate::Options::Implementation::get(config.interpolation());
+  key.add(interpolate.always_stop)
+  .add(interpolate.translation_thresh)
+  .add(interpolate.rotation_thresh)
+  .add(interpolate.corner_angle_thresh);
+
+  return key.get();
+}
+
+//==============================================================================
+std::shared_ptr<const HeuristicTableFile> HeuristicTableFile::open(
+  const std::string& path,
+  const uint64_t key,
+  const std::size_t num_waypoints,
+  const std::vector<std::size_t>& goals)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat info;
+  const std::size_t expected_size = file_size(num_waypoints, goals.size());
+  if (::fstat(fd, &info) != 0
+    || static_cast<std::size_t>(info.st_size) != expected_size)
+  {
+    ::close(fd);
+    return nullptr;
+  }
+
+  void* const data = ::mmap(
+    nullptr, expected_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping stays valid after the file is closed
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  const char* const bytes = static_cast<const char*>(data);
+  Header header;
+  std::memcpy(&header, bytes, sizeof(Header));
+
+  bool valid = std::memcmp(header.magic, Magic, MagicSize) == 0
+    && header.version == FormatVersion
+    && header.key == key
+    && header.num_waypoints == num_waypoints
+    && header.num_tables == goals.size();
+
+  const auto* const file_goals =
+    reinterpret_cast<const uint64_t*>(bytes + sizeof(Header));
+  for (std::size_t i = 0; valid && i < goals.size(); ++i)
+    valid = file_goals[i] == goals[i];
+
+  if (!valid)
+  {
+    ::munmap(data, expected_size);
+    return nullptr;
+  }
+
+  const auto* const tables =
+    reinterpret_cast<const double*>(bytes + header_size(goals.size()));
+
+  return std::shared_ptr<const HeuristicTableFile>(
+    new HeuristicTableFile(data, expected_size, tables, num_waypoints));
+}
+
+//==============================================================================
+const double* HeuristicTableFile::table(const std::size_t index) const
+{
+  return _tables + index*_num_waypoints;
+}
+
+//==============================================================================
+HeuristicTableFile::~HeuristicTableFile()
+{
+  ::munmap(_data, _size);
+}
+
+//==============================================================================
+HeuristicTableFile::HeuristicTableFile(
+  void* data,
+  const std::size_t size,
+  const double* tables,
+  const std::size_t num_waypoints)
+: _data(data),
+  _size(size),
+  _tables(tables),
+  _num_waypoints(num_waypoints)
+{
+  // Do nothing
+}
+
+//==============================================================================
+bool write_heuristic_table_file(
+  const std::string& path,
+  const uint64_t key,
+  const std::size_t num_waypoints,
+  const std::vector<std::size_t>& goals,
+  const std::vector<std::vector<double>>& tables)
+{
+  Header header;
+  std::memcpy(header.magic, Magic, MagicSize);
+  header.version = FormatVersion;
+  header.key = key;
+  header.num_waypoints = num_waypoints;
+  header.num_tables = goals.size();
+
+  // Each writer gets its own uniquely named temporary file, in case several
+  // planners, in this process or others, are saving the same tables at once.
+  std::string temp_template = path + ".tmp.XXXXXX";
+  const int fd = ::mkstemp(&temp_template[0]);
+  if (fd < 0)
+    return false;
+
+  const std::string temp_path = temp_template;
+
+  // We keep the permissions that mkstemp gives the file, so only the owner can
+  // read or write the saved tables. Widening them here would override the
+  // umask of the process, and reading the umask is not thread-safe. Planners
+  // that run as other users will just compute the tables themselves.
+
+  std::FILE* file = ::fdopen(fd, "wb");
+  if (!file)
+  {
+    ::close(fd);
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  bool written = std::fwrite(&header, sizeof(Header), 1, file) == 1;
+  for (std::size_t i = 0; written && i < goals.size(); ++i)
+  {
+    const uint64_t goal = goals[i];
+    written = std::fwrite(&goal, sizeof(goal), 1, file) == 1;
+  }
+
+  for (std::size_t i = 0; written && i < tables.size(); ++i)
+  {
+    written = tables[i].size() == num_waypoints
+      && std::fwrite(tables[i].data(), sizeof(double), num_waypoints, file)
+      == num_waypoints;
+  }
+
+  written = std::fclose(file) == 0 && written;
+  if (!written || std::rename(temp_path.c_str(), path.c_str()) != 0)
+  {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace planning
+} // namespace internal
+} // namespace rmf_traffic
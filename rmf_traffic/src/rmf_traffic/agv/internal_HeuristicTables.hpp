@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__AGV__INTERNAL_HEURISTICTABLES_HPP
+#define SRC__RMF_TRAFFIC__AGV__INTERNAL_HEURISTICTABLES_HPP
+
+#include <rmf_traffic/agv/Planner.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rmf_traffic {
+namespace internal {
+namespace planning {
+
+//==============================================================================
+/// Get a hash of every part of a planner configuration that the precomputed
+/// heuristic tables depend on. Tables that were computed for a different key
+/// cannot be used.
+uint64_t heuristic_table_key(const agv::Planner::Configuration& config);
+
+//==============================================================================
+/// A set of heuristic tables that were saved to a file. The file is mapped into
+/// memory instead of being read, so the operating system only loads the parts
+/// of it that get used, and processes that open the same file can share them.
+///
+/// The file begins with a header that identifies the format, its version, the
+/// key of the configuration that the tables were computed for, the number of
+/// waypoints, and the goal of each table. The tables follow the header with
+/// one double for each waypoint. Values are stored with the byte order of the
+/// machine that wrote them.
+class HeuristicTableFile
+{
+public:
+
+  /// Map a file of heuristic tables into memory.
+  ///
+  /// \return nullptr if there is no file at the path, if the file is damaged,
+  /// or if it does not have tables for exactly these goals on a graph with this
+  /// key and number of waypoints.
+  static std::shared_ptr<const HeuristicTableFile> open(
+    const std::string& path,
+    uint64_t key,
+    std::size_t num_waypoints,
+    const std::vector<std::size_t>& goals);
+
+  /// Get the table of the goal at this index of the goals that were given to
+  /// open().
+  const double* table(std::size_t index) const;
+
+  HeuristicTableFile(const HeuristicTableFile&) = delete;
+  HeuristicTableFile& operator=(const HeuristicTableFile&) = delete;
+
+  ~HeuristicTableFile();
+
+private:
+  HeuristicTableFile(
+    void* data,
+    std::size_t size,
+    const double* tables,
+    std::size_t num_waypoints);
+
+  void* _data;
+  std::size_t _size;
+  const double* _tables;
+  std::size_t _num_waypoints;
+};
+
+//==============================================================================
+/// Save a set of heuristic tables in the format that HeuristicTableFile reads.
+/// The file is replaced atomically, so a process that is opening it will either
+/// see the old file or the complete new one.
+///
+/// \return false if the file could not be written.
+bool write_heuristic_table_file(
+  const std::string& path,
+  uint64_t key,
+  std::size_t num_waypoints,
+  const std::vector<std::size_t>& goals,
+  const std::vector<std::vector<double>>& tables);
+
+} // namespace planning
+} // namespace internal
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__AGV__INTERNAL_HEURISTICTABLES_HPP
@@ -50,6 +50,30 @@ public:
 
 };
 
+//==============================================================================
+class Planner::Options::Implementation
+{
+public:
+
+  rmf_utils::clone_ptr<RouteValidator> validator;
+  Duration min_hold_time;
+  rmf_utils::optional<double> maximum_cost_estimate;
+  rmf_utils::optional<std::size_t> saturation_limit;
+
+  std::function<bool()> interrupter = nullptr;
+  std::shared_ptr<const bool> interrupt_flag = nullptr;
+
+  /// Skip search nodes that reach a state which an earlier node already
+  /// reached more cheaply. This should never change the cost of a plan, so it
+  /// is only turned off by tests that check that.
+  bool prune_duplicate_states = true;
+
+  static Implementation& get(Options& options);
+
+  static const Implementation& get(const Options& options);
+
+};
+
 //==============================================================================
 class Planner::Result::Implementation
 {
@@ -19,6 +19,7 @@
 #include "internal_Planner.hpp"
 #include "internal_planning.hpp"
 #include "GraphInternal.hpp"
+#include "internal_HeuristicTables.hpp"
 
 #include "../RouteInternal.hpp"
 
@@ -26,6 +27,10 @@
 
 #include <rmf_traffic/DetectConflict.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <unordered_map>
@@ -51,73 +56,83 @@ struct Compare
 };
 
 //==============================================================================
-Cache::Cache(const Cache&)
+/// Owns every node that a search creates. Nodes refer to their parents with
+/// raw pointers, so they are kept in blocks that never get reallocated, and
+/// they all get destroyed together with the arena.
+template<typename Node>
+class NodeArena
 {
-  // Do nothing
-}
+public:
 
-//==============================================================================
-Cache::Cache(Cache&&)
-{
-  // Do nothing
-}
+  NodeArena() = default;
 
-//==============================================================================
-Cache& Cache::operator=(const Cache&)
-{
-  // Do nothing
-  return *this;
-}
+  /// Start an arena that keeps the nodes of another arena alive. The new nodes
+  /// of a copied search go into an arena of their own, so the copy and the
+  /// original can both carry on from the nodes that they share.
+  NodeArena(std::shared_ptr<const NodeArena> previous)
+  : _previous(std::move(previous))
+  {
+    // Do nothing
+  }
 
-//==============================================================================
-Cache& Cache::operator=(Cache&&)
-{
-  // Do nothing
-  return *this;
-}
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+
+  Node* make(Node node)
+  {
+    if (_blocks.empty() || _blocks.back().size() == _blocks.back().capacity())
+    {
+      const std::size_t capacity = _blocks.empty() ?
+        MinBlockSize : std::min(2*_blocks.back().capacity(), MaxBlockSize);
+
+      _blocks.emplace_back();
+      _blocks.back().reserve(capacity);
+    }
+
+    // The block still has spare capacity, so none of its nodes will move
+    auto& block = _blocks.back();
+    block.emplace_back(std::move(node));
+    return &block.back();
+  }
+
+private:
+
+  static constexpr std::size_t MinBlockSize = 32;
+  static constexpr std::size_t MaxBlockSize = 4096;
+
+  std::shared_ptr<const NodeArena> _previous;
+  std::vector<std::vector<Node>> _blocks;
+};
 
 //==============================================================================
-CacheHandle::CacheHandle(CachePtr original)
-: _original(std::move(original))
+CacheHandle::CacheHandle(CachePtr cache)
+: _cache(std::move(cache))
 {
-  std::unique_lock<std::mutex> lock(_original->mutex);
-  _copy = _original->clone();
+  // Do nothing
 }
 
 //==============================================================================
 Cache* CacheHandle::operator->()
 {
-  return _copy.get();
+  return _cache.get();
 }
 
 //==============================================================================
 const Cache* CacheHandle::operator->() const
 {
-  return _copy.get();
+  return _cache.get();
 }
 
 //==============================================================================
 Cache& CacheHandle::operator*() &
 {
-  return *_copy.get();
+  return *_cache.get();
 }
 
 //==============================================================================
 const Cache& CacheHandle::operator*() const&
 {
-  return *_copy.get();
-}
-
-//==============================================================================
-CacheHandle::~CacheHandle()
-{
-  if (!_original || !_copy->has_update())
-    return;
-
-  // We are now done with the copy, so we will update the original cache with
-  // whatever new searches have been accomplished by the copy.
-  std::unique_lock<std::mutex> lock(_original->mutex);
-  _original->update(*_copy);
+  return *_cache.get();
 }
 
 //==============================================================================
@@ -468,7 +483,7 @@ struct EuclideanExpander
   // explicitly expanding to/from the LiftShaft bottlenecks.
 
   struct Node;
-  using NodePtr = std::shared_ptr<Node>;
+  using NodePtr = Node*;
 
   struct Node
   {
@@ -491,6 +506,7 @@ struct EuclideanExpander
   {
     const agv::Graph::Implementation& graph;
     const std::size_t final_waypoint;
+    NodeArena<Node>& arena;
   };
 
   double estimate_remaining_cost(const Eigen::Vector2d& p)
@@ -510,7 +526,7 @@ struct EuclideanExpander
     const Eigen::Vector2d location =
       context.graph.waypoints[args.waypoint].get_location();
 
-    queue.emplace(std::make_shared<Node>(
+    queue.emplace(context.arena.make(
         Node{
           args.waypoint,
           estimate_remaining_cost(location),
@@ -566,7 +582,7 @@ struct EuclideanExpander
       + lane_event_cost(lane)
       + (p_exit - p_start).norm();
 
-    queue.push(std::make_shared<Node>(
+    queue.push(context.arena.make(
         Node{
           exit_waypoint_index,
           estimate_remaining_cost(p_exit),
@@ -663,7 +679,7 @@ const Eigen::Rotation2Dd DifferentialDriveConstraint::R_pi =
 struct DifferentialDriveExpander
 {
   struct Node;
-  using NodePtr = std::shared_ptr<Node>;
+  using NodePtr = Node*;
 
   struct Node
   {
@@ -777,105 +793,205 @@ struct DifferentialDriveExpander
     const agv::Planner::StartSet& starts;
   };
 
-  class Heuristic
+  /// The states that a search has already expanded, keyed by waypoint,
+  /// orientation, and arrival time. A node that reaches the same state as one
+  /// that was already expanded, without doing it more cheaply, has the very
+  /// same options for what to do next, so there is no point in expanding it.
+  ///
+  /// The orientation and arrival time must match exactly. Even a small
+  /// difference in orientation can decide whether the vehicle needs to rotate
+  /// before it enters a lane. Arriving at the same place later is not dominated
+  /// in general, because another participant could block the vehicle from
+  /// waiting there, and the search only waits in increments of the holding
+  /// time. Holding in place keeps the orientation bit-for-bit, so the duplicates
+  /// that holding creates still get caught.
+  class ExpandedStates
   {
   public:
 
-    double estimate_remaining_cost(
-      const Context& context,
-      const std::size_t waypoint)
+    /// Returns true if a node in an equivalent state has already been expanded
+    /// at no greater cost. Otherwise the node is remembered as the cheapest
+    /// way of reaching its state, and false is returned.
+    bool dominated(const Node& node)
     {
-      auto estimate_it = known_costs.insert(
-        {waypoint, std::numeric_limits<double>::infinity()});
-
-      if (estimate_it.second)
-      {
-        // The pair was inserted, which implies that the cost estimate for this
-        // waypoint has never been found before, and we should compute it now.
-        auto euclidean_context = EuclideanExpander::Context{
-          context.graph,
-          context.final_waypoint
-        };
-        EuclideanExpander expander(euclidean_context);
-
-        EuclideanExpander::SearchQueue euclidean_queue;
-        expander.make_initial_nodes(
-              EuclideanExpander::InitialNodeArgs{waypoint},
-              euclidean_queue);
-
-        const EuclideanExpander::NodePtr solution =
-            search<EuclideanExpander>(expander, euclidean_queue, nullptr);
-
-        // TODO(MXG): Instead of asserting that the goal exists, we should
-        // probably take this opportunity to shortcircuit the planner and return
-        // that there is no solution.
-        assert(solution != nullptr);
-
-        std::vector<std::size_t> reverse_waypoints;
-        std::vector<Eigen::Vector3d> positions;
-        EuclideanExpander::NodePtr euclidean_node = solution;
-        // Note: this constructs positions in reverse, but that's okay because
-        // the Interpolate::positions function will produce a trajectory with the
-        // same duration whether it is interpolating forward or backwards.
-        while (euclidean_node)
-        {
-          reverse_waypoints.push_back(euclidean_node->waypoint);
-          const Eigen::Vector2d p = euclidean_node->location;
-          positions.push_back({p[0], p[1], 0.0});
-          euclidean_node = euclidean_node->parent;
-        }
+      assert(node.waypoint.has_value());
+      const Key key{
+        *node.waypoint,
+        orientation_bits(node.orientation),
+        node.route_from_parent.trajectory.back().time().time_since_epoch()
+        .count()
+      };
+
+      const auto insertion = _costs.insert({key, node.current_cost});
+      if (insertion.second)
+        return false;
 
-        // We pass in context.initial_time here because we don't actually care
-        // about the Trajectory's start/end time being correct; we only care
-        // about the difference between the two.
-        const rmf_traffic::Trajectory estimate = agv::Interpolate::positions(
-          context.traits, context.initial_time, positions);
+      double& cost = insertion.first->second;
+      if (cost <= node.current_cost)
+        return true;
 
-        double cost_estimate = time::to_seconds(estimate.duration());
-        const std::size_t N_wp = reverse_waypoints.size();
-        for (std::size_t i = 1; i < N_wp; ++i)
-        {
-          const auto last = reverse_waypoints.at(i);
-          const auto next = reverse_waypoints.at(i-1);
+      cost = node.current_cost;
+      return false;
+    }
 
-          const auto lane_index = context.graph.lane_between.at(last).at(next);
-          const auto& lane = context.graph.lanes.at(lane_index);
+  private:
 
-          const auto* entry = lane.entry().event();
-          if (entry)
-            cost_estimate += time::to_seconds(entry->duration());
+    static uint64_t orientation_bits(const double orientation)
+    {
+      // Treat -0.0 the same as 0.0
+      const double value = orientation == 0.0 ? 0.0 : orientation;
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
 
-          const auto* exit = lane.exit().event();
-          if (exit)
-            cost_estimate += time::to_seconds(exit->duration());
-        }
+    struct Key
+    {
+      std::size_t waypoint;
+      uint64_t orientation;
+      int64_t time;
 
-        estimate_it.first->second = cost_estimate;
-        new_costs[waypoint] = cost_estimate;
+      bool operator==(const Key& other) const
+      {
+        return waypoint == other.waypoint
+          && orientation == other.orientation
+          && time == other.time;
+      }
+    };
 
-        // TODO(MXG): We could get significantly better performance if we
-        // accounted for the cost of rotating when making this estimate, but
-        // that would add considerable complexity to the caching, so we'll leave
-        // that for a future improvement.
+    struct KeyHash
+    {
+      std::size_t operator()(const Key& key) const
+      {
+        std::size_t hash = std::hash<std::size_t>()(key.waypoint);
+        hash = hash*31 + std::hash<uint64_t>()(key.orientation);
+        hash = hash*31 + std::hash<int64_t>()(key.time);
+        return hash;
       }
+    };
+
+    std::unordered_map<Key, double, KeyHash> _costs;
+  };
+
+  /// The estimates of the remaining cost to reach one goal from each waypoint of
+  /// the graph. Every plan to the same goal shares one Heuristic, even when the
+  /// plans run on different threads, so each estimate only needs to be computed
+  /// once.
+  ///
+  /// The estimates are stored in an array of atomics that is indexed by
+  /// waypoint. An estimate never changes once it has been computed, so there is
+  /// nothing to lock. If two threads race to compute the same estimate, they
+  /// will both store the same value.
+  class Heuristic
+  {
+  public:
 
-      return estimate_it.first->second;
+    Heuristic(const std::size_t num_waypoints)
+    : _costs(new std::atomic<double>[num_waypoints])
+    {
+      for (std::size_t i = 0; i < num_waypoints; ++i)
+        _costs[i].store(Unknown, std::memory_order_relaxed);
     }
 
-    bool has_update() const
+    /// Use a table of estimates that has already been computed for every
+    /// waypoint
+    Heuristic(std::shared_ptr<const double> table)
+    : _table(std::move(table))
     {
-      return !new_costs.empty();
+      // Do nothing
     }
 
-    void update(const Heuristic& other)
+    double estimate_remaining_cost(
+      const Context& context,
+      const std::size_t waypoint)
     {
-      for (const auto& wp_costs : other.new_costs)
-        known_costs.insert(wp_costs);
+      if (_table)
+        return _table.get()[waypoint];
+
+      std::atomic<double>& cost = _costs[waypoint];
+      const double known_cost = cost.load(std::memory_order_acquire);
+      if (!std::isnan(known_cost))
+        return known_cost;
+
+      // The cost estimate for this waypoint has never been found before, so
+      // we should compute it now.
+      NodeArena<EuclideanExpander::Node> euclidean_arena;
+      auto euclidean_context = EuclideanExpander::Context{
+        context.graph,
+        context.final_waypoint,
+        euclidean_arena
+      };
+      EuclideanExpander expander(euclidean_context);
+
+      EuclideanExpander::SearchQueue euclidean_queue;
+      expander.make_initial_nodes(
+            EuclideanExpander::InitialNodeArgs{waypoint},
+            euclidean_queue);
+
+      const EuclideanExpander::NodePtr solution =
+          search<EuclideanExpander>(expander, euclidean_queue, nullptr);
+
+      // TODO(MXG): Instead of asserting that the goal exists, we should
+      // probably take this opportunity to shortcircuit the planner and return
+      // that there is no solution.
+      assert(solution != nullptr);
+
+      std::vector<std::size_t> reverse_waypoints;
+      std::vector<Eigen::Vector3d> positions;
+      EuclideanExpander::NodePtr euclidean_node = solution;
+      // Note: this constructs positions in reverse, but that's okay because
+      // the Interpolate::positions function will produce a trajectory with the
+      // same duration whether it is interpolating forward or backwards.
+      while (euclidean_node)
+      {
+        reverse_waypoints.push_back(euclidean_node->waypoint);
+        const Eigen::Vector2d p = euclidean_node->location;
+        positions.push_back({p[0], p[1], 0.0});
+        euclidean_node = euclidean_node->parent;
+      }
+
+      // We pass in context.initial_time here because we don't actually care
+      // about the Trajectory's start/end time being correct; we only care
+      // about the difference between the two.
+      const rmf_traffic::Trajectory estimate = agv::Interpolate::positions(
+        context.traits, context.initial_time, positions);
+
+      double cost_estimate = time::to_seconds(estimate.duration());
+      const std::size_t N_wp = reverse_waypoints.size();
+      for (std::size_t i = 1; i < N_wp; ++i)
+      {
+        const auto last = reverse_waypoints.at(i);
+        const auto next = reverse_waypoints.at(i-1);
+
+        const auto lane_index = context.graph.lane_between.at(last).at(next);
+        const auto& lane = context.graph.lanes.at(lane_index);
+
+        const auto* entry = lane.entry().event();
+        if (entry)
+          cost_estimate += time::to_seconds(entry->duration());
+
+        const auto* exit = lane.exit().event();
+        if (exit)
+          cost_estimate += time::to_seconds(exit->duration());
+      }
+
+      cost.store(cost_estimate, std::memory_order_release);
+
+      // TODO(MXG): We could get significantly better performance if we
+      // accounted for the cost of rotating when making this estimate. The
+      // tables that get precomputed when the Planner::Configuration has a
+      // heuristic_table_budget() do account for it, but this lazy estimate
+      // does not.
+      return cost_estimate;
     }
 
   private:
-    std::unordered_map<std::size_t, double> known_costs;
-    std::unordered_map<std::size_t, double> new_costs;
+
+    // Marks the estimates that have not been computed yet
+    static constexpr double Unknown = std::numeric_limits<double>::quiet_NaN();
+
+    std::unique_ptr<std::atomic<double>[]> _costs;
+    std::shared_ptr<const double> _table;
   };
 
   struct Context
@@ -894,6 +1010,8 @@ struct DifferentialDriveExpander
     Heuristic& heuristic;
     Issues::BlockerMap& blockers;
     const bool simple_lane_expansion; // reduces branching factor when true
+    ExpandedStates* const expanded_states; // nullptr to expand every node
+    NodeArena<Node>& arena;
     const rmf_traffic::Time initial_time = rmf_traffic::Time(rmf_traffic::Duration(0));
   };
 
@@ -1045,7 +1163,7 @@ struct DifferentialDriveExpander
       if (!is_valid(route, start_node))
         continue;
 
-      queue.push(std::make_shared<Node>(
+      queue.push(_context.arena.make(
         Node{
           remaining_cost_estimate,
           current_cost,
@@ -1073,7 +1191,7 @@ struct DifferentialDriveExpander
 
     if (is_valid(wait_route, start_node))
     {
-      queue.push(std::make_shared<Node>(
+      queue.push(_context.arena.make(
         Node{
           start_node->remaining_cost_estimate,
           wait_cost,
@@ -1141,7 +1259,7 @@ struct DifferentialDriveExpander
       if (!start.location() || initial_routes.empty())
         start_node_wp = initial_waypoint;
 
-      queue.push(std::make_shared<Node>(
+      queue.push(_context.arena.make(
         Node{
           shortest_route_cost + remaining_cost_estimate,
           0.0,
@@ -1260,7 +1378,7 @@ struct DifferentialDriveExpander
 
     if (is_valid(route, parent_node))
     {
-      return std::make_shared<Node>(
+      return _context.arena.make(
         Node{
           _context.heuristic.estimate_remaining_cost(_context, waypoint),
           compute_current_cost(parent_node, trajectory),
@@ -1355,7 +1473,7 @@ struct DifferentialDriveExpander
     assert(route.trajectory.size() > 1);
     if (is_valid(route, parent_node))
     {
-      return std::make_shared<Node>(
+      return _context.arena.make(
         Node{
           _context.heuristic.estimate_remaining_cost(_context, waypoint),
           compute_current_cost(parent_node, route.trajectory),
@@ -1472,7 +1590,7 @@ struct DifferentialDriveExpander
           if (!is_valid(route, initial_parent))
             continue;
 
-          parent_to_event = std::make_shared<Node>(
+          parent_to_event = _context.arena.make(
             Node{
               _context.heuristic.estimate_remaining_cost(
                 _context, exit_waypoint_index),
@@ -1661,6 +1779,12 @@ struct DifferentialDriveExpander
   void expand(const NodePtr& parent_node, SearchQueue& queue)
   {
     const bool has_waypoint = parent_node->waypoint.has_value();
+    if (has_waypoint && _context.expanded_states
+      && _context.expanded_states->dominated(*parent_node))
+    {
+      return;
+    }
+
     if (has_waypoint)
     {
       const std::size_t parent_waypoint = *parent_node->waypoint;
@@ -1734,6 +1858,7 @@ public:
   using Heuristic = DifferentialDriveExpander::Heuristic;
   using NodePtr = DifferentialDriveExpander::NodePtr;
   using Node = DifferentialDriveExpander::Node;
+  using Arena = NodeArena<Node>;
 
   DifferentialDriveCache(agv::Planner::Configuration config)
   : _config(std::move(config)),
@@ -1741,43 +1866,43 @@ public:
     _traits(_config.vehicle_traits()),
     _profile(_traits.profile()),
     _interpolate(agv::Interpolate::Options::Implementation::get(
-        _config.interpolation()))
-  {
-    // Do nothing
-  }
-
-  CachePtr clone() const final
+        _config.interpolation())),
+    _heuristics(_graph.waypoints.size())
   {
-    return std::make_shared<DifferentialDriveCache>(*this);
+    if (const auto budget = _config.heuristic_table_budget())
+      precompute_heuristics(*budget);
   }
 
-  bool has_update() const final
-  {
-    for (const auto& h : _heuristics)
-      if (h.second.has_update())
-        return true;
-
-    return false;
-  }
-
-  void update(const Cache& newer_cache) override final
+  class InternalState : public State::Internal
   {
-    const auto& newer = static_cast<const DifferentialDriveCache&>(newer_cache);
+  public:
 
-    for (const auto& h : newer._heuristics)
+    InternalState()
+    : arena(std::make_shared<Arena>())
     {
-      auto& heuristic = _heuristics.insert(
-        std::make_pair(h.first, Heuristic{})).first->second;
+      // Do nothing
+    }
 
-      heuristic.update(h.second);
+    // A copy adds its new nodes to an arena of its own, and keeps the arena of
+    // the original alive for the nodes that are already in its queue.
+    InternalState(const InternalState& other)
+    : queue(other.queue),
+      expanded_states(other.expanded_states),
+      arena(std::make_shared<Arena>(other.arena))
+    {
+      // Do nothing
     }
-  }
 
-  class InternalState : public State::Internal
-  {
-  public:
+    InternalState& operator=(const InternalState&) = delete;
+
     DifferentialDriveExpander::SearchQueue queue;
 
+    DifferentialDriveExpander::ExpandedStates expanded_states;
+
+    // Owns every node of the search, including the blocked nodes in the Issues
+    // of the State
+    std::shared_ptr<Arena> arena;
+
     rmf_utils::optional<double> cost_estimate() const final
     {
       if (queue.empty())
@@ -1809,15 +1934,18 @@ public:
       rmf_utils::make_derived_impl<State::Internal, InternalState>()
     };
 
+    auto& internal = static_cast<InternalState&>(*state.internal);
     auto context = make_context(
           state.conditions.goal,
           state.conditions.options,
           state.issues.blocked_nodes,
           state.popped_count,
-          false);
+          false,
+          &internal.expanded_states,
+          *internal.arena);
 
     DifferentialDriveExpander expander(context);
-    auto& queue = static_cast<InternalState*>(state.internal.get())->queue;
+    auto& queue = internal.queue;
 
     expander.make_initial_nodes(
           DifferentialDriveExpander::InitialNodeArgs{
@@ -1835,15 +1963,18 @@ public:
     if (state.conditions.starts.empty())
       return rmf_utils::nullopt;
 
+    auto& internal = static_cast<InternalState&>(*state.internal);
     auto context = make_context(
           state.conditions.goal,
           state.conditions.options,
           state.issues.blocked_nodes,
           state.popped_count,
-          false);
+          false,
+          &internal.expanded_states,
+          *internal.arena);
 
     DifferentialDriveExpander expander(context);
-    auto& queue = static_cast<InternalState*>(state.internal.get())->queue;
+    auto& queue = internal.queue;
     const auto& interrupter = state.conditions.options.interrupter();
 
     const NodePtr solution =
@@ -1901,8 +2032,7 @@ public:
     for (const auto& void_node : nodes)
     {
       bool skip = false;
-      const auto original_node =
-          std::static_pointer_cast<Node>(void_node.first);
+      const auto original_node = static_cast<NodePtr>(void_node.first);
 
       const auto original_t = void_node.second;
 
@@ -1951,10 +2081,13 @@ public:
     std::unordered_map<NodePtr, ConstRoutePtr> route_map;
     std::vector<schedule::Itinerary> alternatives;
 
+    // The rollout nodes point back to the blocked nodes, which stay in the
+    // arena of the State that found them.
+    Arena arena;
     Issues::BlockerMap temp_blocked_nodes;
     std::size_t popped_count = 0;
     auto context = make_context(goal, options, temp_blocked_nodes,
-                                popped_count, true);
+                                popped_count, true, nullptr, arena);
     DifferentialDriveExpander expander(context);
 
     const auto& interrupter = options.interrupter();
@@ -2108,6 +2241,8 @@ public:
     std::vector<agv::Planner::Start> starts_;
     agv::Planner::Goal goal_;
     agv::Planner::Options options_;
+    DifferentialDriveExpander::ExpandedStates expanded_states_;
+    Arena arena_;
 
     Debugger(
         std::vector<agv::Planner::Start> starts,
@@ -2143,7 +2278,8 @@ public:
     std::size_t popped_count = 0;
     auto context = make_context(
           debugger->goal_, debugger->options_, debugger->blocked_nodes_,
-          popped_count, false);
+          popped_count, false, &debugger->expanded_states_,
+          debugger->arena_);
 
     DifferentialDriveExpander expander(context);
 
@@ -2171,7 +2307,8 @@ public:
     std::size_t popped_count = 0;
     auto context = make_context(
           debugger.goal_, debugger.options_, debugger.blocked_nodes_,
-          popped_count, false);
+          popped_count, false, &debugger.expanded_states_,
+          debugger.arena_);
 
     DifferentialDriveExpander expander(context);
     if (expander.is_finished(top))
@@ -2195,6 +2332,237 @@ public:
 
 private:
 
+  struct LaneInfo
+  {
+    double length;
+    double heading;
+    double event_cost;
+  };
+
+  /// Fill in the heuristic tables of as many goals as the budget allows
+  void precompute_heuristics(const std::size_t budget)
+  {
+    const auto& waypoints = _graph.waypoints;
+    const std::size_t table_size = waypoints.size()*sizeof(double);
+    if (table_size == 0)
+      return;
+
+    std::vector<std::size_t> goals;
+    std::size_t remaining = budget;
+    for (std::size_t goal = 0; goal < waypoints.size(); ++goal)
+    {
+      if (remaining < table_size)
+        break;
+
+      // A vehicle cannot stop at a passthrough point, so it can never be a goal
+      if (waypoints[goal].is_passthrough_point())
+        continue;
+
+      goals.push_back(goal);
+      remaining -= table_size;
+    }
+
+    const auto& path = _config.heuristic_table_file();
+    const uint64_t key = path ? heuristic_table_key(_config) : 0;
+    if (path)
+    {
+      const auto file =
+        HeuristicTableFile::open(*path, key, waypoints.size(), goals);
+
+      if (file)
+      {
+        for (std::size_t i = 0; i < goals.size(); ++i)
+        {
+          _heuristics.insert(
+            goals[i],
+            std::make_shared<Heuristic>(
+              std::shared_ptr<const double>(file, file->table(i))));
+        }
+
+        return;
+      }
+    }
+
+    const auto tables = std::make_shared<std::vector<std::vector<double>>>(
+      compute_heuristic_tables(goals));
+
+    // If the file cannot be written, the tables will simply be computed again
+    // the next time.
+    if (path)
+      write_heuristic_table_file(*path, key, waypoints.size(), goals, *tables);
+
+    for (std::size_t i = 0; i < goals.size(); ++i)
+    {
+      _heuristics.insert(
+        goals[i],
+        std::make_shared<Heuristic>(
+          std::shared_ptr<const double>(tables, (*tables)[i].data())));
+    }
+  }
+
+  std::vector<std::vector<double>> compute_heuristic_tables(
+    const std::vector<std::size_t>& goals) const
+  {
+    const auto& waypoints = _graph.waypoints;
+    const auto& lanes = _graph.lanes;
+
+    std::vector<LaneInfo> lane_info;
+    lane_info.reserve(lanes.size());
+    std::vector<std::vector<std::size_t>> lanes_into(waypoints.size());
+    for (std::size_t l = 0; l < lanes.size(); ++l)
+    {
+      const auto& lane = lanes[l];
+      const std::size_t entry = lane.entry().waypoint_index();
+      const std::size_t exit = lane.exit().waypoint_index();
+      const Eigen::Vector2d course =
+        waypoints[exit].get_location() - waypoints[entry].get_location();
+
+      double event_cost = 0.0;
+      if (const auto* event = lane.entry().event())
+        event_cost += time::to_seconds(event->duration());
+
+      if (const auto* event = lane.exit().event())
+        event_cost += time::to_seconds(event->duration());
+
+      lane_info.push_back(
+        {course.norm(), std::atan2(course[1], course[0]), event_cost});
+      lanes_into[exit].push_back(l);
+    }
+
+    std::vector<std::vector<double>> tables;
+    tables.reserve(goals.size());
+    for (const std::size_t goal : goals)
+      tables.push_back(compute_heuristic_table(goal, lane_info, lanes_into));
+
+    return tables;
+  }
+
+  /// Search backwards from the goal over every lane of the graph to find how
+  /// long it takes to reach the goal from each waypoint.
+  ///
+  /// The search runs over lanes instead of waypoints, because the cost of
+  /// leaving a lane depends on which lane comes next. If the vehicle can keep
+  /// going straight, it only pays for cruising down the lane. Otherwise it has
+  /// to stop at the end of the lane and turn towards the next one.
+  std::vector<double> compute_heuristic_table(
+    const std::size_t goal,
+    const std::vector<LaneInfo>& lane_info,
+    const std::vector<std::vector<std::size_t>>& lanes_into) const
+  {
+    const auto& waypoints = _graph.waypoints;
+    const auto& lanes = _graph.lanes;
+    const double v = _traits.linear().get_nominal_velocity();
+    const double a = _traits.linear().get_nominal_acceleration();
+    const double w = _traits.rotational().get_nominal_velocity();
+    const double alpha = _traits.rotational().get_nominal_acceleration();
+    const auto* differential = _traits.get_differential();
+    const bool reversible = differential && differential->is_reversible();
+    const double inf = std::numeric_limits<double>::infinity();
+
+    const auto stop_cost = [&](const std::size_t l)
+      {
+        return agv::internal::compute_traversal_time(
+          lane_info[l].length, v, a);
+      };
+
+    // The cost of going down lane l when lane `next` comes after it, not
+    // counting the lane events
+    const auto transition_cost = [&](
+      const std::size_t l,
+      const std::size_t next) -> double
+      {
+        const auto& info = lane_info[l];
+        const auto& next_info = lane_info[next];
+        const double thresh = _interpolate.translation_thresh;
+        if (info.length < thresh || next_info.length < thresh)
+        {
+          // We cannot tell which way the vehicle needs to face on a lane that
+          // has no length, like a lift, so we assume it does not need to turn.
+          return stop_cost(l);
+        }
+
+        if (!lanes[l].exit().event() && !lanes[next].entry().event())
+        {
+          const Eigen::Vector2d p0 =
+            waypoints[lanes[l].entry().waypoint_index()].get_location();
+          const Eigen::Vector2d p1 =
+            waypoints[lanes[l].exit().waypoint_index()].get_location();
+          const Eigen::Vector2d p2 =
+            waypoints[lanes[next].exit().waypoint_index()].get_location();
+
+          const double h = info.heading;
+          if (agv::internal::can_skip_interpolation(
+              {p0[0], p0[1], h}, {p1[0], p1[1], h}, {p2[0], p2[1], h},
+              _interpolate))
+          {
+            return info.length/v;
+          }
+        }
+
+        double turn =
+          std::abs(rmf_utils::wrap_to_pi(next_info.heading - info.heading));
+        if (reversible)
+          turn = std::min(turn, M_PI - turn);
+
+        return stop_cost(l)
+          + agv::internal::compute_traversal_time(turn, w, alpha);
+      };
+
+    // The cost of reaching the goal when starting from rest at the entry of
+    // each lane while facing down the lane
+    std::vector<double> lane_cost(lanes.size(), inf);
+    using Element = std::pair<double, std::size_t>;
+    std::priority_queue<Element, std::vector<Element>, std::greater<Element>>
+    queue;
+
+    for (const std::size_t l : lanes_into[goal])
+    {
+      lane_cost[l] = lane_info[l].event_cost + stop_cost(l);
+      queue.push({lane_cost[l], l});
+    }
+
+    while (!queue.empty())
+    {
+      const Element top = queue.top();
+      queue.pop();
+
+      const std::size_t next = top.second;
+      if (lane_cost[next] < top.first)
+        continue;
+
+      // The vehicle stops as soon as it reaches the goal, so we do not search
+      // past it.
+      const std::size_t entry = lanes[next].entry().waypoint_index();
+      if (entry == goal)
+        continue;
+
+      for (const std::size_t l : lanes_into[entry])
+      {
+        const double cost =
+          lane_info[l].event_cost + transition_cost(l, next) + top.first;
+
+        if (cost < lane_cost[l])
+        {
+          lane_cost[l] = cost;
+          queue.push({cost, l});
+        }
+      }
+    }
+
+    // We do not know which way the vehicle will be facing when it reaches a
+    // waypoint, so we do not count the cost of turning onto the first lane.
+    std::vector<double> table(waypoints.size(), inf);
+    table[goal] = 0.0;
+    for (std::size_t l = 0; l < lanes.size(); ++l)
+    {
+      const std::size_t entry = lanes[l].entry().waypoint_index();
+      if (entry != goal)
+        table[entry] = std::min(table[entry], lane_cost[l]);
+    }
+
+    return table;
+  }
+
   Plan make_plan(
       const std::vector<agv::Planner::Start>& starts,
       const NodePtr& solution,
@@ -2218,13 +2586,14 @@ private:
       const agv::Planner::Options& options,
       Issues::BlockerMap& blocked_nodes,
       std::size_t& popped_count,
-      const bool simple_lane_expansion)
+      const bool simple_lane_expansion,
+      DifferentialDriveExpander::ExpandedStates* expanded_states,
+      Arena& arena)
   {
     const std::size_t goal_waypoint = goal.waypoint();
     const auto goal_orientation = rmf_utils::pointer_to_opt(goal.orientation());
 
-    Heuristic& h = _heuristics.insert(
-          std::make_pair(goal_waypoint, Heuristic{})).first->second;
+    Heuristic& h = _heuristics.get(goal_waypoint);
 
     return DifferentialDriveExpander::Context{
       _graph,
@@ -2240,7 +2609,10 @@ private:
       popped_count,
       h,
       blocked_nodes,
-      simple_lane_expansion
+      simple_lane_expansion,
+      agv::Planner::Options::Implementation::get(options)
+        .prune_duplicate_states ? expanded_states : nullptr,
+      arena
     };
   }
 
@@ -2252,8 +2624,47 @@ private:
   const agv::Interpolate::Options::Implementation& _interpolate;
 
   // This maps from a goal waypoint to the cached Heuristic object that tries to
-  // plan to that goal waypoint.
-  using HeuristicDatabase = std::unordered_map<std::size_t, Heuristic>;
+  // plan to that goal waypoint. Each Heuristic gets created the first time
+  // that a plan asks for its goal, and it stays in place after that, so plans
+  // on other threads can keep using it without any locks.
+  class HeuristicDatabase
+  {
+  public:
+
+    HeuristicDatabase(const std::size_t num_waypoints)
+    : _heuristics(num_waypoints)
+    {
+      // Do nothing
+    }
+
+    Heuristic& get(const std::size_t goal_waypoint)
+    {
+      auto& slot = _heuristics.at(goal_waypoint);
+      auto heuristic = std::atomic_load(&slot);
+      if (heuristic)
+        return *heuristic;
+
+      // If another thread creates the Heuristic first, we will use theirs
+      auto fresh = std::make_shared<Heuristic>(_heuristics.size());
+      if (std::atomic_compare_exchange_strong(&slot, &heuristic, fresh))
+        return *fresh;
+
+      return *heuristic;
+    }
+
+    /// Put a Heuristic in place for a goal. This is only safe to use while the
+    /// cache is being built, before any plans can reach it.
+    void insert(
+      const std::size_t goal_waypoint,
+      std::shared_ptr<Heuristic> heuristic)
+    {
+      _heuristics.at(goal_waypoint) = std::move(heuristic);
+    }
+
+  private:
+    std::vector<std::shared_ptr<Heuristic>> _heuristics;
+  };
+
   HeuristicDatabase _heuristics;
 };
 } // anonymous namespace
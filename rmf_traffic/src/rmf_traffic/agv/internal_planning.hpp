@@ -22,7 +22,6 @@
 #include <rmf_traffic/agv/debug/Planner.hpp>
 
 #include <memory>
-#include <mutex>
 
 namespace rmf_traffic {
 namespace internal {
@@ -42,7 +41,9 @@ struct Conditions
 //==============================================================================
 struct Issues
 {
-  using BlockedNodes = std::unordered_map<std::shared_ptr<void>, Time>;
+  // The blocked nodes belong to the search of the State that found them, so
+  // they can only be used while that State is alive.
+  using BlockedNodes = std::unordered_map<void*, Time>;
   using BlockerMap = std::unordered_map<schedule::ParticipantId, BlockedNodes>;
 
   BlockerMap blocked_nodes;
@@ -81,27 +82,14 @@ struct Plan
 };
 
 //==============================================================================
+/// The planning cache keeps everything that can be reused between plans for
+/// the same configuration. A single cache gets shared by every plan that uses
+/// the configuration, including plans that run on different threads, so its
+/// implementations must be safe to use concurrently.
 class Cache
 {
 public:
 
-  // TODO(MXG): Consider using libguarded instead of using mutexes manually
-  std::mutex mutex;
-
-  // We need to explicitly define these because the std::mutex does not have
-  // a copy constructor
-  Cache() = default;
-  Cache(const Cache&);
-  Cache(Cache&&);
-  Cache& operator=(const Cache&);
-  Cache& operator=(Cache&&);
-
-  virtual CachePtr clone() const = 0;
-
-  virtual bool has_update() const = 0;
-
-  virtual void update(const Cache& other) = 0;
-
   virtual State initiate(
     const std::vector<agv::Planner::Start>& starts,
     agv::Planner::Goal goal,
@@ -148,7 +136,7 @@ class CacheHandle
 {
 public:
 
-  CacheHandle(CachePtr original);
+  CacheHandle(CachePtr cache);
 
   // Copying this class does not make sense
   CacheHandle(const CacheHandle&) = delete;
@@ -164,13 +152,9 @@ public:
 
   const Cache& operator*() const&;
 
-  ~CacheHandle();
-
 private:
 
-  CachePtr _copy;
-
-  CachePtr _original;
+  CachePtr _cache;
 
 };
 
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <rmf_traffic/schedule/BucketOptions.hpp>
+
+namespace rmf_traffic {
+namespace schedule {
+
+//==============================================================================
+class BucketOptions::Implementation
+{
+public:
+
+  Duration duration;
+  rmf_utils::optional<std::size_t> split_threshold;
+  Duration min_duration;
+  rmf_utils::optional<std::size_t> merge_threshold;
+  Duration max_duration;
+
+};
+
+//==============================================================================
+BucketOptions::BucketOptions(Duration duration)
+: _pimpl(rmf_utils::make_impl<Implementation>(
+      Implementation{
+        duration,
+        rmf_utils::nullopt,
+        DefaultMinDuration,
+        rmf_utils::nullopt,
+        DefaultMaxDuration
+      }))
+{
+  // Do nothing
+}
+
+//==============================================================================
+BucketOptions& BucketOptions::duration(Duration value)
+{
+  _pimpl->duration = value;
+  return *this;
+}
+
+//==============================================================================
+Duration BucketOptions::duration() const
+{
+  return _pimpl->duration;
+}
+
+//==============================================================================
+BucketOptions& BucketOptions::split_threshold(
+  rmf_utils::optional<std::size_t> value)
+{
+  _pimpl->split_threshold = value;
+  return *this;
+}
+
+//==============================================================================
+rmf_utils::optional<std::size_t> BucketOptions::split_threshold() const
+{
+  return _pimpl->split_threshold;
+}
+
+//==============================================================================
+BucketOptions& BucketOptions::min_duration(Duration value)
+{
+  _pimpl->min_duration = value;
+  return *this;
+}
+
+//==============================================================================
+Duration BucketOptions::min_duration() const
+{
+  return _pimpl->min_duration;
+}
+
+//==============================================================================
+BucketOptions& BucketOptions::merge_threshold(
+  rmf_utils::optional<std::size_t> value)
+{
+  _pimpl->merge_threshold = value;
+  return *this;
+}
+
+//==============================================================================
+rmf_utils::optional<std::size_t> BucketOptions::merge_threshold() const
+{
+  return _pimpl->merge_threshold;
+}
+
+//==============================================================================
+BucketOptions& BucketOptions::max_duration(Duration value)
+{
+  _pimpl->max_duration = value;
+  return *this;
+}
+
+//==============================================================================
+Duration BucketOptions::max_duration() const
+{
+  return _pimpl->max_duration;
+}
+
+} // namespace schedule
+} // namespace rmf_traffic
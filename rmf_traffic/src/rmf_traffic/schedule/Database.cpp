@@ -20,7 +20,7 @@
 #include "Timeline.hpp"
 #include "ViewerInternal.hpp"
 #include "debug_Database.hpp"
-#include "internal_Snapshot.hpp"
+#include "internal_Persistence.hpp"
 
 #include "../detail/internal_bidirectional_iterator.hpp"
 
@@ -30,6 +30,7 @@
 
 #include <algorithm>
 #include <list>
+#include <stdexcept>
 
 namespace rmf_traffic {
 namespace schedule {
@@ -52,6 +53,51 @@ Writer::Input deep_copy_input(Writer::Input input)
   return copy;
 }
 
+//==============================================================================
+/// The types of records in the write-ahead log of a Database
+enum class JournalRecord : uint8_t
+{
+  Register = 1,
+  Unregister,
+  Set,
+  Extend,
+  Delay,
+  EraseAll,
+  EraseRoutes,
+  Cull,
+  BatchBegin,
+  BatchEnd,
+  CullPart
+};
+
+//==============================================================================
+void write_input(
+  persistence::BinaryWriter& record,
+  const Writer::Input& input)
+{
+  record.u64(input.size());
+  for (const auto& item : input)
+  {
+    record.u64(item.id);
+    record.route(*item.route);
+  }
+}
+
+//==============================================================================
+Writer::Input read_input(persistence::BinaryReader& record)
+{
+  Writer::Input input;
+  const uint64_t size = record.u64();
+  input.reserve(size);
+  for (uint64_t i = 0; i < size; ++i)
+  {
+    const RouteId id = record.u64();
+    input.push_back({id, record.route()});
+  }
+
+  return input;
+}
+
 } // anonymous namespace
 
 //==============================================================================
@@ -72,6 +118,9 @@ public:
   {
     RouteEntryPtr entry;
     std::shared_ptr<void> timeline_handle;
+
+    // The timeline handles of the entries that came before this one
+    std::vector<std::shared_ptr<void>> previous_handles;
   };
 
   struct Transition
@@ -84,10 +133,18 @@ public:
     RouteStorage predecessor;
   };
 
+  // NOTE: Route entries are shared with the published states of the database,
+  // which readers may be using from other threads. A published state may be
+  // keeping an entry alive after the database stopped storing it, because its
+  // route was culled or its participant unregistered. The removed field tells
+  // readers which versions of the schedule still contained the entry.
   struct RouteEntry
   {
     // ===== Mandatory fields for a Timeline Entry =====
+    // The trajectory of this entry is the trajectory of route, delayed by the
+    // delay value. Use get_delayed_route() to get the actual route.
     ConstRoutePtr route;
+    Duration delay;
     ParticipantId participant;
     RouteId route_id;
     std::shared_ptr<const ParticipantDescription> description;
@@ -98,11 +155,72 @@ public:
     // fields of the base Entry
     Version schedule_version;
     TransitionPtr transition;
-    std::weak_ptr<RouteEntry> successor;
+
+    // The writer may set the successor and the removal version while readers
+    // are following them, so they must only be accessed through the atomic
+    // functions below.
+    std::shared_ptr<const std::weak_ptr<RouteEntry>> successor;
+
+    // A cache used by get_delayed_route()
+    mutable ConstRoutePtr delayed_route;
+
+    // The schedule version where this entry stopped being stored by the
+    // database because it was culled or its participant was unregistered.
+    std::shared_ptr<const Version> removed;
   };
 
+  static std::shared_ptr<const RouteEntry> get_successor(
+    const RouteEntry& entry)
+  {
+    const auto successor = std::atomic_load(&entry.successor);
+    if (!successor)
+      return nullptr;
+
+    return successor->lock();
+  }
+
+  static void set_successor(RouteEntry& entry, const RouteEntryPtr& successor)
+  {
+    std::atomic_store(
+      &entry.successor,
+      std::make_shared<const std::weak_ptr<RouteEntry>>(successor));
+  }
+
+  /// Move the timeline handle of a predecessor into the storage of its route.
+  ///
+  /// A timeline handle modifies the timeline when it gets released, so the
+  /// handles must never be held by an entry, which a reader thread might be
+  /// the last to release.
+  static void keep_timeline_handles(
+    RouteStorage& storage,
+    RouteStorage& predecessor)
+  {
+    storage.previous_handles = std::move(predecessor.previous_handles);
+    storage.previous_handles.emplace_back(
+      std::move(predecessor.timeline_handle));
+  }
+
+  static void set_removed(RouteEntry& entry, const Version version)
+  {
+    std::atomic_store(&entry.removed, std::make_shared<const Version>(version));
+  }
+
+  /// Check whether the entry had already been removed from the database as of
+  /// the given schedule version.
+  static bool is_removed(const RouteEntry& entry, const Version as_of)
+  {
+    const auto removed = std::atomic_load(&entry.removed);
+    return removed && !rmf_utils::modular(as_of).less_than(*removed);
+  }
+
   Timeline<RouteEntry> timeline;
 
+  Implementation(const BucketOptions& bucket_options)
+  : timeline(bucket_options)
+  {
+    // Do nothing
+  }
+
   using ParticipantStorage = std::unordered_map<RouteId, RouteStorage>;
 
   struct ParticipantState
@@ -167,10 +285,660 @@ public:
 
   rmf_utils::optional<CullInfo> last_cull;
 
+  /// True while an incremental cull has removed some routes but has not been
+  /// finished yet
+  bool cull_pending = false;
+
+  struct ChangeLogRecord;
+  using ConstChangeLogRecordPtr = std::shared_ptr<const ChangeLogRecord>;
+
+  struct ChangeLogRecord
+  {
+    Version version;
+    std::vector<std::weak_ptr<const RouteEntry>> entries;
+
+    // The record of the version that came before this one. Published states
+    // share the records of the change log, so this is a persistent list.
+    mutable ConstChangeLogRecordPtr previous;
+
+    ~ChangeLogRecord()
+    {
+      // Unlink the history one record at a time so that a long change log
+      // cannot overflow the stack while it is being destroyed.
+      ConstChangeLogRecordPtr next = std::move(previous);
+      while (next && next.use_count() == 1)
+        next = std::move(next->previous);
+    }
+  };
+
+  /// Every route entry gets recorded here, grouped by its schedule version, so
+  /// that changes(~) only needs to look at the entries that were created after
+  /// the version that a mirror already has. This points to the latest record.
+  std::shared_ptr<ChangeLogRecord> change_log;
+
+  /// The number of entries that have been recorded in the change log, and how
+  /// many of them were left the last time the entries that no longer exist
+  /// were removed from it
+  std::size_t change_log_size = 0;
+  std::size_t change_log_compacted_size = 0;
+
+  void log_change(const RouteEntryPtr& entry)
+  {
+    if (!change_log || change_log->version != schedule_version)
+    {
+      change_log = std::make_shared<ChangeLogRecord>(
+        ChangeLogRecord{schedule_version, {}, std::move(change_log)});
+    }
+    else if (change_log.use_count() > 1)
+    {
+      // The latest record is being shared with a published state, so we must
+      // not add anything to it.
+      change_log = std::make_shared<ChangeLogRecord>(*change_log);
+    }
+
+    change_log->entries.push_back(entry);
+    ++change_log_size;
+  }
+
+  /// The participant information that gets shared with published states
+  struct PublishedParticipants
+  {
+    std::unordered_set<ParticipantId> ids;
+    ParticipantDescriptions descriptions;
+    ParticipantRegistrationVersions add_participant_version;
+    ParticipantUnregistrationVersion remove_participant_version;
+  };
+
+  /// This gets reset whenever the participant information changes, and then
+  /// gets recreated by the next state that is published.
+  mutable std::shared_ptr<const PublishedParticipants> published_participants;
+
+  std::shared_ptr<const PublishedParticipants> get_published_participants()
+  const
+  {
+    if (!published_participants)
+    {
+      published_participants = std::make_shared<PublishedParticipants>(
+        PublishedParticipants{
+          participant_ids,
+          descriptions,
+          add_participant_version,
+          remove_participant_version
+        });
+    }
+
+    return published_participants;
+  }
+
+  /// Create a published state out of the current state of the database
+  std::shared_ptr<const Published> make_published() const;
+
+  /// Get a published state that matches the current state of the database.
+  /// Between write operations the same state gets reused until something
+  /// changes, so repeated reads do not keep creating new ones.
+  std::shared_ptr<const Published> current_published() const
+  {
+    // A write operation that is still running may have changes that have not
+    // been published yet.
+    if (write_depth > 0)
+      return make_published();
+
+    if (publishing)
+      return std::atomic_load(&published);
+
+    if (!unpublished)
+      unpublished = make_published();
+
+    return unpublished;
+  }
+
+  /// True if the state of the database gets published after every change
+  bool publishing = false;
+
+  /// The latest published state. This must only be accessed with
+  /// std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Published> published;
+
+  /// The state that current_published() hands out while publishing is off.
+  /// This gets released as soon as a write operation begins so that the
+  /// timeline does not need to copy the data that it would be sharing.
+  mutable std::shared_ptr<const Published> unpublished;
+
+  /// How many write operations are currently running. Write operations can be
+  /// nested when a batch is running or when the InconsistencyTracker applies
+  /// changes that were waiting for a missing version.
+  std::size_t write_depth = 0;
+
+  /// Keep one of these alive for the duration of every write operation. The
+  /// state of the database will be published when the outermost operation
+  /// finishes.
+  class WriteGuard
+  {
+  public:
+
+    WriteGuard(Implementation& impl)
+    : _impl(impl)
+    {
+      ++_impl.write_depth;
+      _impl.unpublished = nullptr;
+    }
+
+    ~WriteGuard()
+    {
+      if (--_impl.write_depth > 0)
+        return;
+
+      // The changes must reach the log before anyone can see them
+      if (_impl.journal)
+        _impl.commit_journal();
+
+      if (!_impl.publishing)
+        return;
+
+      // Operations that get ignored or postponed do not need to be published
+      if (_impl.published->latest_version() == _impl.schedule_version)
+        return;
+
+      std::atomic_store(&_impl.published, _impl.make_published());
+    }
+
+  private:
+    Implementation& _impl;
+  };
+
+  /// True while Database::batch(~) is running
+  bool batching = false;
+
+  /// True if the current batch has already created a version for its changes
+  bool batch_has_version = false;
+
+  /// Get the schedule version for a new itinerary change. Every itinerary
+  /// change inside of a batch shares the same version.
+  Version next_change_version()
+  {
+    if (!batching || !batch_has_version)
+    {
+      ++schedule_version;
+      batch_has_version = batching;
+    }
+
+    return schedule_version;
+  }
+
+  /// Get a schedule version that will not be shared with any other change.
+  Version next_unique_version()
+  {
+    batch_has_version = false;
+    return ++schedule_version;
+  }
+
   /// The current time is used to know when participants can be culled after
   /// getting unregistered
   rmf_traffic::Time current_time = rmf_traffic::Time(rmf_traffic::Duration(0));
 
+  /// The files that keep a copy of this database on disk
+  struct Journal
+  {
+    std::string snapshot_path;
+    std::string log_path;
+    bool sync;
+    rmf_utils::optional<std::size_t> checkpoint_interval;
+    std::unique_ptr<persistence::LogWriter> log;
+
+    // The record that is currently being written
+    persistence::BinaryWriter record;
+
+    // How many records have been logged since the last checkpoint
+    std::size_t records = 0;
+
+    // True if the log has records that have not been committed yet
+    bool uncommitted = false;
+
+    // True if a batch has been started in the log but not ended
+    bool batch_open = false;
+
+    // If committing the log failed, this describes what went wrong. No more
+    // changes will be accepted until a checkpoint succeeds.
+    std::string error;
+  };
+
+  /// This is only used when the database was created with PersistenceOptions
+  std::unique_ptr<Journal> journal;
+
+  /// Begin writing a new record for the log. Call finish_record() once all of
+  /// the fields of the change have been written into it.
+  persistence::BinaryWriter& start_record(const JournalRecord type)
+  {
+    assert(journal);
+    if (!journal->error.empty())
+    {
+      // *INDENT-OFF*
+      throw std::runtime_error(
+        "[Database] Changes cannot be accepted because the write-ahead log "
+        "failed: " + journal->error);
+      // *INDENT-ON*
+    }
+
+    journal->record.clear();
+    journal->record.u8(static_cast<uint8_t>(type));
+    return journal->record;
+  }
+
+  /// Append the current record to the log. This must be done before the change
+  /// is applied, so that the change is not applied if the log cannot be
+  /// written.
+  void finish_record()
+  {
+    if (batching && !journal->batch_open)
+    {
+      persistence::BinaryWriter begin;
+      begin.u8(static_cast<uint8_t>(JournalRecord::BatchBegin));
+      journal->log->append(begin.data());
+      journal->batch_open = true;
+    }
+
+    journal->log->append(journal->record.data());
+    ++journal->records;
+    journal->uncommitted = true;
+  }
+
+  /// This gets called at the end of every outermost write operation
+  void commit_journal() noexcept
+  {
+    try
+    {
+      if (journal->batch_open)
+      {
+        persistence::BinaryWriter end;
+        end.u8(static_cast<uint8_t>(JournalRecord::BatchEnd));
+        journal->log->append(end.data());
+        journal->batch_open = false;
+      }
+
+      if (journal->uncommitted)
+      {
+        journal->log->commit();
+        journal->uncommitted = false;
+      }
+
+      const auto& interval = journal->checkpoint_interval;
+      if (interval && journal->records >= *interval)
+        checkpoint();
+    }
+    catch (const std::exception& e)
+    {
+      // This is called from a destructor, so we hold onto the error and report
+      // it when the next change arrives.
+      journal->error = e.what();
+    }
+  }
+
+  /// Write a snapshot of the database and then start a new log after it
+  void checkpoint()
+  {
+    assert(journal);
+    assert(!batching);
+
+    persistence::write_snapshot(
+      journal->snapshot_path, save_snapshot(), journal->sync);
+
+    // NOTE: The new log records the version of the snapshot that it
+    // follows. If we get interrupted before the new log replaces the old one,
+    // recovery will see that the old log does not follow the new snapshot and
+    // ignore it, which is correct because the snapshot already has its changes.
+    journal->log = std::make_unique<persistence::LogWriter>(
+      journal->log_path, schedule_version, journal->sync);
+
+    journal->records = 0;
+    journal->uncommitted = false;
+    journal->batch_open = false;
+    journal->error.clear();
+  }
+
+  /// Encode everything that is needed to recreate the current state of the
+  /// database. The history of the routes is not included.
+  std::string save_snapshot() const
+  {
+    persistence::BinaryWriter snapshot;
+    snapshot.u64(schedule_version);
+    snapshot.time(current_time);
+    snapshot.u64(_next_participant_id);
+
+    // The lowest bit says whether there is a last cull. The next bit says
+    // whether an incremental cull has been started without being finished.
+    snapshot.u8(
+      (last_cull.has_value() ? 1u : 0u) | (cull_pending ? 2u : 0u));
+    if (last_cull)
+    {
+      snapshot.time(last_cull->cull.time());
+      snapshot.u64(last_cull->version);
+    }
+
+    snapshot.u64(states.size());
+    for (const auto& s : states)
+    {
+      const ParticipantState& state = s.second;
+      snapshot.u64(s.first);
+      snapshot.description(*state.description);
+      snapshot.u64(state.initial_schedule_version);
+      snapshot.u64(state.tracker->expected_version());
+      snapshot.u64(state.tracker->last_known_version());
+
+      snapshot.u64(state.active_routes.size());
+      for (const RouteId id : state.active_routes)
+      {
+        const RouteEntry& entry = *state.storage.at(id).entry;
+        snapshot.u64(id);
+        snapshot.u64(entry.schedule_version);
+        snapshot.duration(entry.delay);
+        snapshot.route(*entry.route);
+      }
+    }
+
+    snapshot.u64(remove_participant_version.size());
+    for (const auto& r : remove_participant_version)
+    {
+      snapshot.u64(r.first);
+      snapshot.u64(r.second.id);
+      snapshot.u64(r.second.original_version);
+    }
+
+    snapshot.u64(remove_participant_time.size());
+    for (const auto& r : remove_participant_time)
+    {
+      snapshot.time(r.first);
+      snapshot.u64(r.second);
+    }
+
+    return snapshot.data();
+  }
+
+  /// Recreate the state that was encoded by save_snapshot(). This must only be
+  /// used on a database that is still empty.
+  void restore_snapshot(const std::string& data)
+  {
+    persistence::BinaryReader snapshot(data);
+    schedule_version = snapshot.u64();
+    current_time = snapshot.time();
+    _next_participant_id = snapshot.u64();
+
+    const uint8_t cull_flags = snapshot.u8();
+    cull_pending = cull_flags & 2u;
+    if (cull_flags & 1u)
+    {
+      const Time cull_time = snapshot.time();
+      const Version cull_version = snapshot.u64();
+      last_cull = CullInfo{Change::Cull(cull_time), cull_version};
+    }
+
+    std::vector<RouteEntryPtr> entries;
+    const uint64_t num_participants = snapshot.u64();
+    for (uint64_t i = 0; i < num_participants; ++i)
+    {
+      const ParticipantId id = snapshot.u64();
+      const auto description =
+        std::make_shared<const ParticipantDescription>(snapshot.description());
+      const Version initial_version = snapshot.u64();
+      const ItineraryVersion expected_version = snapshot.u64();
+      const ItineraryVersion last_known_version = snapshot.u64();
+
+      auto tracker = Inconsistencies::Implementation::register_participant(
+        inconsistencies, id);
+      tracker->restore(expected_version, last_known_version);
+
+      ParticipantState& state = states.insert(
+        std::make_pair(
+          id,
+          ParticipantState{
+            {},
+            std::move(tracker),
+            {},
+            description,
+            initial_version
+          })).first->second;
+
+      participant_ids.insert(id);
+      descriptions.insert({id, description});
+      add_participant_version[initial_version] = id;
+
+      const uint64_t num_routes = snapshot.u64();
+      for (uint64_t j = 0; j < num_routes; ++j)
+      {
+        const RouteId route_id = snapshot.u64();
+        const Version version = snapshot.u64();
+        const Duration delay = snapshot.duration();
+        ConstRoutePtr route = snapshot.route();
+
+        RouteStorage& storage = state.storage[route_id];
+        storage.entry = std::make_shared<RouteEntry>(
+          RouteEntry{
+            std::move(route),
+            delay,
+            id,
+            route_id,
+            description,
+            version,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr
+          });
+
+        storage.timeline_handle = timeline.insert(storage.entry);
+        index_expiry(storage.entry);
+        state.active_routes.insert(route_id);
+        entries.push_back(storage.entry);
+      }
+    }
+
+    const uint64_t num_removed = snapshot.u64();
+    for (uint64_t i = 0; i < num_removed; ++i)
+    {
+      const Version version = snapshot.u64();
+      const ParticipantId id = snapshot.u64();
+      const Version original_version = snapshot.u64();
+      remove_participant_version[version] = {id, original_version};
+    }
+
+    const uint64_t num_removed_times = snapshot.u64();
+    for (uint64_t i = 0; i < num_removed_times; ++i)
+    {
+      const Time time = snapshot.time();
+      remove_participant_time[time] = snapshot.u64();
+    }
+
+    if (!snapshot.done())
+    {
+      // *INDENT-OFF*
+      throw std::runtime_error(
+        "[Database] Unexpected data at the end of the schedule snapshot");
+      // *INDENT-ON*
+    }
+
+    // The change log needs the entries to be grouped by version, from oldest
+    // to newest
+    std::sort(entries.begin(), entries.end(),
+      [](const RouteEntryPtr& a, const RouteEntryPtr& b)
+      {
+        return rmf_utils::modular(a->schedule_version)
+        .less_than(b->schedule_version);
+      });
+
+    for (const auto& entry : entries)
+    {
+      if (!change_log || change_log->version != entry->schedule_version)
+      {
+        change_log = std::make_shared<ChangeLogRecord>(
+          ChangeLogRecord{entry->schedule_version, {}, std::move(change_log)});
+      }
+
+      change_log->entries.push_back(entry);
+    }
+
+    change_log_size = entries.size();
+    change_log_compacted_size = change_log_size;
+  }
+
+  /// Apply the changes of a write-ahead log to the database, in the same way
+  /// that they were originally applied.
+  static void replay(
+    Database& database,
+    const std::vector<std::string>& records)
+  {
+    const auto type_of = [&](const std::size_t i)
+      {
+        persistence::BinaryReader record(records[i]);
+        return static_cast<JournalRecord>(record.u8());
+      };
+
+    std::size_t i = 0;
+    while (i < records.size())
+    {
+      if (type_of(i) != JournalRecord::BatchBegin)
+      {
+        apply_record(database, records[i]);
+        ++i;
+        continue;
+      }
+
+      std::size_t end = i + 1;
+      while (end < records.size() && type_of(end) != JournalRecord::BatchEnd)
+        ++end;
+
+      // If the batch never ended, then the database was interrupted before
+      // it could commit the batch, so none of its changes were ever seen.
+      if (end == records.size())
+        return;
+
+      database.batch(
+        [&](Database& db)
+        {
+          for (std::size_t j = i + 1; j < end; ++j)
+            apply_record(db, records[j]);
+        });
+
+      i = end + 1;
+    }
+  }
+
+  static void apply_record(Database& database, const std::string& data)
+  {
+    persistence::BinaryReader record(data);
+    const auto type = static_cast<JournalRecord>(record.u8());
+    switch (type)
+    {
+      case JournalRecord::Register:
+      {
+        database.register_participant(record.description());
+        break;
+      }
+      case JournalRecord::Unregister:
+      {
+        const ParticipantId participant = record.u64();
+        database.set_current_time(record.time());
+        database.unregister_participant(participant);
+        break;
+      }
+      case JournalRecord::Set:
+      {
+        const ParticipantId participant = record.u64();
+        const ItineraryVersion version = record.u64();
+        database.set(participant, read_input(record), version);
+        break;
+      }
+      case JournalRecord::Extend:
+      {
+        const ParticipantId participant = record.u64();
+        const ItineraryVersion version = record.u64();
+        database.extend(participant, read_input(record), version);
+        break;
+      }
+      case JournalRecord::Delay:
+      {
+        const ParticipantId participant = record.u64();
+        const ItineraryVersion version = record.u64();
+        database.delay(participant, record.duration(), version);
+        break;
+      }
+      case JournalRecord::EraseAll:
+      {
+        const ParticipantId participant = record.u64();
+        const ItineraryVersion version = record.u64();
+        database.erase(participant, version);
+        break;
+      }
+      case JournalRecord::EraseRoutes:
+      {
+        const ParticipantId participant = record.u64();
+        const ItineraryVersion version = record.u64();
+        std::vector<RouteId> routes(record.u64());
+        for (auto& route : routes)
+          route = record.u64();
+
+        database.erase(participant, routes, version);
+        break;
+      }
+      case JournalRecord::Cull:
+      {
+        database.cull(record.time());
+        break;
+      }
+      case JournalRecord::CullPart:
+      {
+        const Time time = record.time();
+        const bool finished = record.u8();
+        std::vector<ExpiredRoute> routes(record.u64());
+        for (auto& route : routes)
+        {
+          route.participant = record.u64();
+          route.route_id = record.u64();
+        }
+
+        Implementation::WriteGuard guard(*database._pimpl);
+        database._pimpl->cull_part(time, std::move(routes), finished);
+        break;
+      }
+      default:
+      {
+        // *INDENT-OFF*
+        throw std::runtime_error(
+          "[Database] Unexpected record type ["
+          + std::to_string(static_cast<int>(type))
+          + "] in the write-ahead log");
+        // *INDENT-ON*
+      }
+    }
+  }
+
+  /// Recover the state that was saved in the directory of the options, and
+  /// then begin logging into it.
+  void recover(Database& database, const PersistenceOptions& options)
+  {
+    persistence::make_directory(options.directory());
+
+    auto new_journal = std::make_unique<Journal>();
+    new_journal->snapshot_path = options.directory() + "/schedule.snapshot";
+    new_journal->log_path = options.directory() + "/schedule.log";
+    new_journal->sync = options.sync();
+    new_journal->checkpoint_interval = options.checkpoint_interval();
+
+    if (const auto snapshot =
+      persistence::read_snapshot(new_journal->snapshot_path))
+    {
+      restore_snapshot(*snapshot);
+    }
+
+    const auto log = persistence::read_log(new_journal->log_path);
+    if (log && log->base_version == schedule_version)
+      replay(database, log->records);
+
+    // Start over with a fresh snapshot so that the next recovery does not need
+    // to replay the same log again, and so the log does not keep any partial
+    // record that was left at its end.
+    journal = std::move(new_journal);
+    checkpoint();
+  }
+
   /// This function verifies that the route IDs specified in the input are not
   /// already being used. If that ever happens, it is indicative of a bug or a
   /// malformed input into the database.
@@ -237,15 +1005,20 @@ public:
       entry_storage.entry = std::make_unique<RouteEntry>(
         RouteEntry{
           item.route,
+          Duration(0),
           participant,
           route_id,
           state.description,
           schedule_version,
           nullptr,
-          RouteEntryPtr()
+          nullptr,
+          nullptr,
+          nullptr
         });
 
       entry_storage.timeline_handle = timeline.insert(entry_storage.entry);
+      log_change(entry_storage.entry);
+      index_expiry(entry_storage.entry);
     }
   }
 
@@ -259,42 +1032,60 @@ public:
     {
       assert(storage.find(id) != storage.end());
       auto& entry_storage = storage.at(id);
-      const Trajectory& old_trajectory =
-        entry_storage.entry->route->trajectory();
+      assert(entry_storage.entry->route);
 
-      assert(old_trajectory.start_time());
+      // NOTE: The delayed entry shares its route with its predecessor. The
+      // delayed trajectory only gets created if something asks for it.
+      ConstRoutePtr route = entry_storage.entry->route;
+      const Duration total_delay = entry_storage.entry->delay + delay;
 
-      auto delayed = schedule::apply_delay(old_trajectory, delay);
-      if (!delayed)
-        continue;
-
-      auto new_route = std::make_shared<Route>(
-        entry_storage.entry->route->map(), std::move(*delayed));
+      TransitionPtr transition;
+      RouteEntry& current = *entry_storage.entry;
+      if (current.schedule_version == schedule_version
+        && current.transition && current.transition->delay)
+      {
+        // This route was already delayed by an earlier change in the same
+        // batch. A patch cannot tell apart two delays that have the same
+        // version, so we fold this delay into the earlier one. The earlier
+        // entry will be replaced below.
+        transition = std::move(current.transition);
+        transition->delay->duration += delay;
+      }
+      else
+      {
+        transition = std::make_unique<Transition>(
+          Transition{
+            Change::Delay::Implementation{delay},
+            std::move(entry_storage)
+          });
 
-      auto transition = std::make_unique<Transition>(
-        Transition{
-          Change::Delay::Implementation{delay},
-          std::move(entry_storage)
-        });
+        keep_timeline_handles(entry_storage, transition->predecessor);
+      }
 
       // NOTE(MXG): The previous contents of entry have been moved into the
       // predecessor field of transition, so we are free to refill entry with
       // the newly created data.
       entry_storage.entry = std::make_unique<RouteEntry>(
         RouteEntry{
-          std::move(new_route),
+          std::move(route),
+          total_delay,
           participant,
           id,
           state.description,
           schedule_version,
           std::move(transition),
-          RouteEntryPtr()
+          nullptr,
+          nullptr,
+          nullptr
         });
 
-      entry_storage.entry->transition->predecessor.entry->successor =
-        entry_storage.entry;
+      set_successor(
+        *entry_storage.entry->transition->predecessor.entry,
+        entry_storage.entry);
 
       entry_storage.timeline_handle = timeline.insert(entry_storage.entry);
+      log_change(entry_storage.entry);
+      index_expiry(entry_storage.entry);
     }
   }
 
@@ -315,21 +1106,28 @@ public:
           std::move(entry_storage)
         });
 
+      keep_timeline_handles(entry_storage, transition->predecessor);
+
       entry_storage.entry = std::make_unique<RouteEntry>(
         RouteEntry{
           nullptr,
+          Duration(0),
           participant,
           id,
           state.description,
           schedule_version,
           std::move(transition),
-          RouteEntryPtr()
+          nullptr,
+          nullptr,
+          nullptr
         });
 
-      entry_storage.entry->transition->predecessor.entry->successor =
-        entry_storage.entry;
+      set_successor(
+        *entry_storage.entry->transition->predecessor.entry,
+        entry_storage.entry);
 
       entry_storage.timeline_handle = timeline.insert(entry_storage.entry);
+      log_change(entry_storage.entry);
     }
 
     // TODO(MXG): Consider erasing the routes from the active_routes field of
@@ -337,6 +1135,289 @@ public:
     // argument is sometimes a reference to the active_routes field.
   }
 
+  /// An item in the expiry index
+  struct Expiry
+  {
+    Time finish_time;
+    ParticipantId participant;
+    RouteId route_id;
+    std::weak_ptr<const RouteEntry> entry;
+  };
+
+  /// This orders the expiry index so that the earliest finish time is on top.
+  /// Routes that finish together are ordered by participant and then by route
+  /// so that the order does not depend on how the index was built.
+  static bool expires_later(const Expiry& a, const Expiry& b)
+  {
+    if (a.finish_time != b.finish_time)
+      return b.finish_time < a.finish_time;
+
+    if (a.participant != b.participant)
+      return b.participant < a.participant;
+
+    return b.route_id < a.route_id;
+  }
+
+  /// A heap of the finish times of the route entries, so that cull() can find
+  /// the routes that have expired without searching the timeline. Every entry
+  /// with a route gets added when it is created. An item goes stale once its
+  /// route is changed again or removed, and stale items are thrown away when
+  /// they reach the top of the heap.
+  std::vector<Expiry> expiry_index;
+
+  /// The size of the expiry index the last time its stale items were removed
+  std::size_t expiry_index_compacted_size = 0;
+
+  /// Check whether the entry of an expiry item is the latest entry of its route
+  /// that has a trajectory. Erased routes still get culled according to the
+  /// trajectory that they had before they were erased.
+  bool is_current(const Expiry& item) const
+  {
+    const auto state_it = states.find(item.participant);
+    if (state_it == states.end())
+      return false;
+
+    const auto& storage = state_it->second.storage;
+    const auto route_it = storage.find(item.route_id);
+    if (route_it == storage.end())
+      return false;
+
+    const RouteEntryPtr* latest = &route_it->second.entry;
+    if (*latest && !(*latest)->route)
+      latest = &(*latest)->transition->predecessor.entry;
+
+    // Comparing owners avoids locking the weak pointer
+    return *latest
+      && !latest->owner_before(item.entry)
+      && !item.entry.owner_before(*latest);
+  }
+
+  void index_expiry(const std::shared_ptr<const RouteEntry>& entry)
+  {
+    if (!entry->route->trajectory().finish_time())
+      return;
+
+    expiry_index.push_back(
+      Expiry{
+        get_finish_time(*entry),
+        entry->participant,
+        entry->route_id,
+        entry
+      });
+    std::push_heap(expiry_index.begin(), expiry_index.end(), expires_later);
+
+    // Delays leave stale items behind, so the stale items get swept out each
+    // time the index doubles in size.
+    if (expiry_index.size() > 2*expiry_index_compacted_size + 1024)
+    {
+      expiry_index.erase(
+        std::remove_if(expiry_index.begin(), expiry_index.end(),
+        [&](const Expiry& item) { return !is_current(item); }),
+        expiry_index.end());
+
+      std::make_heap(expiry_index.begin(), expiry_index.end(), expires_later);
+      expiry_index_compacted_size = expiry_index.size();
+    }
+  }
+
+  struct ExpiredRoute
+  {
+    ParticipantId participant;
+    RouteId route_id;
+    std::shared_ptr<const RouteEntry> entry;
+  };
+
+  struct ExpiredRoutes
+  {
+    std::vector<ExpiredRoute> routes;
+
+    // True if more routes have expired than the ones that were popped
+    bool more;
+  };
+
+  /// Take the routes which finished before the given time out of the expiry
+  /// index, up to the maximum number of routes if one is given.
+  ExpiredRoutes pop_expired_routes(
+    const Time time,
+    const rmf_utils::optional<std::size_t> max_routes)
+  {
+    ExpiredRoutes expired;
+    while (!expiry_index.empty() && expiry_index.front().finish_time < time)
+    {
+      const Expiry& top = expiry_index.front();
+      const bool current = is_current(top);
+      if (current && max_routes && expired.routes.size() >= *max_routes)
+        break;
+
+      if (current)
+      {
+        expired.routes.push_back(
+          ExpiredRoute{top.participant, top.route_id, top.entry.lock()});
+      }
+
+      std::pop_heap(expiry_index.begin(), expiry_index.end(), expires_later);
+      expiry_index.pop_back();
+    }
+
+    expired.more =
+      !expiry_index.empty() && expiry_index.front().finish_time < time;
+
+    return expired;
+  }
+
+  /// Remove the storage of routes that are being culled. The routes are
+  /// grouped by participant so that each participant only gets looked up once.
+  void remove_routes(std::vector<ExpiredRoute> routes, const Version version)
+  {
+    std::sort(routes.begin(), routes.end(),
+      [](const ExpiredRoute& a, const ExpiredRoute& b)
+      {
+        return a.participant < b.participant;
+      });
+
+    auto state_it = states.end();
+    for (const auto& route : routes)
+    {
+      if (state_it == states.end() || state_it->first != route.participant)
+      {
+        state_it = states.find(route.participant);
+        if (state_it == states.end())
+          continue;
+      }
+
+      ParticipantState& state = state_it->second;
+      const auto r_it = state.storage.find(route.route_id);
+      if (r_it == state.storage.end())
+        continue;
+
+      set_removed(*r_it->second.entry, version);
+      state.storage.erase(r_it);
+      state.active_routes.erase(route.route_id);
+    }
+  }
+
+  /// Remove one part of the routes for an incremental cull. When the last part
+  /// has been removed, the cull gets finished.
+  rmf_utils::optional<Version> cull_part(
+    const Time time,
+    std::vector<ExpiredRoute> routes,
+    const bool finished)
+  {
+    const Version version = next_unique_version();
+    remove_routes(std::move(routes), version);
+    if (!finished)
+    {
+      cull_pending = true;
+      return rmf_utils::nullopt;
+    }
+
+    finish_cull(time, version);
+    return version;
+  }
+
+  /// Check whether an incremental cull would have anything to do, given that
+  /// no routes have expired by the cull time.
+  bool needs_cull(const Time time) const
+  {
+    if (cull_pending)
+      return true;
+
+    // Participants that were removed before the cull time still need to be
+    // forgotten
+    return !remove_participant_time.empty()
+      && remove_participant_time.begin()->first <= time;
+  }
+
+  /// Forget about the entries of the change log that no longer exist.
+  /// Published states may be sharing the records of the change log, so a
+  /// record that needs to change gets replaced along with every record that
+  /// comes after it.
+  void compact_change_log()
+  {
+    std::vector<ConstChangeLogRecordPtr> records;
+    for (ConstChangeLogRecordPtr record = change_log; record;
+      record = record->previous)
+    {
+      records.push_back(record);
+    }
+
+    change_log_size = 0;
+    ConstChangeLogRecordPtr kept;
+    std::shared_ptr<ChangeLogRecord> rebuilt;
+    for (auto record_it = records.rbegin(); record_it != records.rend();
+      ++record_it)
+    {
+      const ChangeLogRecord& record = **record_it;
+      std::vector<std::weak_ptr<const RouteEntry>> entries;
+      entries.reserve(record.entries.size());
+      for (const auto& entry : record.entries)
+      {
+        if (!entry.expired())
+          entries.push_back(entry);
+      }
+
+      change_log_size += entries.size();
+      if (entries.empty())
+        continue;
+
+      if (entries.size() == record.entries.size() && record.previous == kept)
+      {
+        kept = *record_it;
+        continue;
+      }
+
+      rebuilt = std::make_shared<ChangeLogRecord>();
+      rebuilt->version = record.version;
+      rebuilt->entries = std::move(entries);
+      rebuilt->previous = std::move(kept);
+      kept = rebuilt;
+    }
+
+    if (!kept)
+      change_log = nullptr;
+    else if (kept == rebuilt)
+      change_log = std::move(rebuilt);
+    else if (kept != change_log)
+      change_log = std::make_shared<ChangeLogRecord>(*kept);
+
+    change_log_compacted_size = change_log_size;
+  }
+
+  /// Clean up after the expired routes have been removed, and record the cull
+  /// so that mirrors will perform it too.
+  void finish_cull(const Time time, const Version version)
+  {
+    timeline.cull(time);
+
+    // Removing the entries that no longer exist from the change log means
+    // rebuilding the records that come after them, so it is only done once the
+    // log has grown to twice the size it had after it was last compacted.
+    if (change_log_size > 2*change_log_compacted_size + 1024)
+      compact_change_log();
+
+    // Erase all trace of participants that were removed before the culling
+    // time.
+    const auto p_cull_begin = remove_participant_time.begin();
+    const auto p_cull_end = remove_participant_time.upper_bound(time);
+    for (auto p_cull_it = p_cull_begin; p_cull_it != p_cull_end; ++p_cull_it)
+    {
+      const auto remove_it = remove_participant_version.find(p_cull_it->second);
+      assert(remove_it != remove_participant_version.end());
+
+      remove_participant_version.erase(remove_it);
+    }
+
+    if (p_cull_begin != p_cull_end)
+    {
+      remove_participant_time.erase(p_cull_begin, p_cull_end);
+      published_participants = nullptr;
+    }
+
+    // Record the occurrence of this cull
+    last_cull = CullInfo{Change::Cull(time), version};
+    cull_pending = false;
+  }
+
   ParticipantId get_next_participant_id()
   {
     // This will cycle through the set of currently active participant IDs until
@@ -398,7 +1479,8 @@ rmf_utils::optional<Writer::Input> Database::Debug::get_itinerary(
   Writer::Input itinerary;
   itinerary.reserve(state.active_routes.size());
   for (const RouteId route : state.active_routes)
-    itinerary.push_back({route, state.storage.at(route).entry->route});
+    itinerary.push_back(
+      {route, get_delayed_route(*state.storage.at(route).entry)});
 
   return itinerary;
 }
@@ -409,6 +1491,7 @@ void Database::set(
   const Input& input,
   ItineraryVersion version)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   auto itinerary = deep_copy_input(input);
 
   const auto p_it = _pimpl->states.find(participant);
@@ -440,7 +1523,16 @@ void Database::set(
     _pimpl->check_route_ids(state, itinerary);
 
   //======== All validation is complete ===========
-  ++_pimpl->schedule_version;
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::Set);
+    record.u64(participant);
+    record.u64(version);
+    write_input(record, input);
+    _pimpl->finish_record();
+  }
+
+  _pimpl->next_change_version();
 
   // Erase the routes that are currently active
   _pimpl->erase_routes(participant, state, state.active_routes);
@@ -458,6 +1550,7 @@ void Database::extend(
   const Input& input,
   ItineraryVersion version)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   auto routes = deep_copy_input(input);
 
   const auto p_it = _pimpl->states.find(participant);
@@ -493,7 +1586,16 @@ void Database::extend(
     _pimpl->check_route_ids(state, routes);
 
   //======== All validation is complete ===========
-  ++_pimpl->schedule_version;
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::Extend);
+    record.u64(participant);
+    record.u64(version);
+    write_input(record, input);
+    _pimpl->finish_record();
+  }
+
+  _pimpl->next_change_version();
 
   _pimpl->insert_items(participant, state, entries, input);
 }
@@ -504,6 +1606,7 @@ void Database::delay(
   Duration delay,
   ItineraryVersion version)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   const auto p_it = _pimpl->states.find(participant);
   if (p_it == _pimpl->states.end())
   {
@@ -531,7 +1634,16 @@ void Database::delay(
   }
 
   //======== All validation is complete ===========
-  ++_pimpl->schedule_version;
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::Delay);
+    record.u64(participant);
+    record.u64(version);
+    record.duration(delay);
+    _pimpl->finish_record();
+  }
+
+  _pimpl->next_change_version();
   _pimpl->apply_delay(participant, state, delay);
 }
 
@@ -540,6 +1652,7 @@ void Database::erase(
   ParticipantId participant,
   ItineraryVersion version)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   const auto p_it = _pimpl->states.find(participant);
   if (p_it == _pimpl->states.end())
   {
@@ -567,7 +1680,15 @@ void Database::erase(
   }
 
   //======== All validation is complete ===========
-  ++_pimpl->schedule_version;
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::EraseAll);
+    record.u64(participant);
+    record.u64(version);
+    _pimpl->finish_record();
+  }
+
+  _pimpl->next_change_version();
   _pimpl->erase_routes(participant, state, state.active_routes);
   state.active_routes.clear();
 }
@@ -578,6 +1699,7 @@ void Database::erase(
   const std::vector<RouteId>& routes,
   ItineraryVersion version)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   const auto p_it = _pimpl->states.find(participant);
   if (p_it == _pimpl->states.end())
   {
@@ -621,7 +1743,19 @@ void Database::erase(
   }
 
   //======== All validation is complete ===========
-  ++_pimpl->schedule_version;
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::EraseRoutes);
+    record.u64(participant);
+    record.u64(version);
+    record.u64(routes.size());
+    for (const RouteId id : routes)
+      record.u64(id);
+
+    _pimpl->finish_record();
+  }
+
+  _pimpl->next_change_version();
   _pimpl->erase_routes(participant, state, route_set);
   for (const RouteId id : routes)
     state.active_routes.erase(id);
@@ -631,11 +1765,21 @@ void Database::erase(
 ParticipantId Database::register_participant(
   ParticipantDescription description)
 {
+  Implementation::WriteGuard guard(*_pimpl);
+  if (_pimpl->journal)
+  {
+    // The ID does not need to be logged, because replaying the registrations
+    // in the same order will give the same IDs.
+    auto& record = _pimpl->start_record(JournalRecord::Register);
+    record.description(description);
+    _pimpl->finish_record();
+  }
+
   const ParticipantId id = _pimpl->get_next_participant_id();
   auto tracker = Inconsistencies::Implementation::register_participant(
     _pimpl->inconsistencies, id);
 
-  const Version version = ++_pimpl->schedule_version;
+  const Version version = _pimpl->next_unique_version();
 
   const auto description_ptr =
     std::make_shared<ParticipantDescription>(std::move(description));
@@ -654,6 +1798,7 @@ ParticipantId Database::register_participant(
   _pimpl->descriptions.insert({id, description_ptr});
 
   _pimpl->add_participant_version[version] = id;
+  _pimpl->published_participants = nullptr;
   return id;
 }
 
@@ -661,6 +1806,7 @@ ParticipantId Database::register_participant(
 void Database::unregister_participant(
   ParticipantId participant)
 {
+  Implementation::WriteGuard guard(*_pimpl);
   const auto id_it = _pimpl->participant_ids.find(participant);
   const auto state_it = _pimpl->states.find(participant);
 
@@ -686,8 +1832,23 @@ void Database::unregister_participant(
     // *INDENT-ON*
   }
 
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::Unregister);
+    record.u64(participant);
+    record.time(_pimpl->current_time);
+    _pimpl->finish_record();
+  }
+
   _pimpl->inconsistencies._pimpl->unregister_participant(participant);
 
+  const Version version = _pimpl->next_unique_version();
+  for (const auto& route : state_it->second.storage)
+  {
+    if (route.second.entry)
+      Implementation::set_removed(*route.second.entry, version);
+  }
+
   const Version initial_version = state_it->second.initial_schedule_version;
   _pimpl->add_participant_version.erase(initial_version);
 
@@ -695,9 +1856,9 @@ void Database::unregister_participant(
   _pimpl->states.erase(state_it);
   _pimpl->descriptions.erase(participant);
 
-  const Version version = ++_pimpl->schedule_version;
   _pimpl->remove_participant_version[version] = {participant, initial_version};
   _pimpl->remove_participant_time[_pimpl->current_time] = version;
+  _pimpl->published_participants = nullptr;
 }
 
 //==============================================================================
@@ -708,10 +1869,91 @@ const Database::Implementation::RouteEntry* get_most_recent(
   const Database::Implementation::RouteEntry* from)
 {
   assert(from);
-  while (const auto successor = from->successor.lock())
+  using Implementation = Database::Implementation;
+  while (const auto successor = Implementation::get_successor(*from))
     from = successor.get();
 
-  return from;
+  return from;
+}
+
+//==============================================================================
+/// Get the most recent version of the entry that existed as of the given
+/// schedule version.
+const Database::Implementation::RouteEntry* get_most_recent(
+  const Database::Implementation::RouteEntry* from,
+  const Version as_of)
+{
+  assert(from);
+  using Implementation = Database::Implementation;
+  while (const auto successor = Implementation::get_successor(*from))
+  {
+    if (rmf_utils::modular(as_of).less_than(successor->schedule_version))
+      break;
+
+    from = successor.get();
+  }
+
+  return from;
+}
+
+//==============================================================================
+/// Get the most recent version (as of the given version) of each route that
+/// has changed after the given version and was still being stored by the
+/// database at that time.
+///
+/// The returned entries might not be held by anything else, so they must stay
+/// in this vector for as long as they are being used.
+std::vector<std::shared_ptr<const Database::Implementation::RouteEntry>>
+get_changed_routes(
+  const Database::Implementation::ConstChangeLogRecordPtr& log,
+  const Version after,
+  const Version as_of)
+{
+  using Implementation = Database::Implementation;
+  using RouteEntry = Implementation::RouteEntry;
+  using Record = Implementation::ChangeLogRecord;
+
+  std::vector<const Record*> records;
+  for (const Record* record = log.get();
+    record && rmf_utils::modular(after).less_than(record->version);
+    record = record->previous.get())
+  {
+    records.push_back(record);
+  }
+
+  std::vector<std::shared_ptr<const RouteEntry>> routes;
+  std::unordered_set<const RouteEntry*> seen;
+  for (auto record_it = records.rbegin(); record_it != records.rend();
+    ++record_it)
+  {
+    for (const auto& weak_entry : (*record_it)->entries)
+    {
+      std::shared_ptr<const RouteEntry> newest = weak_entry.lock();
+      if (!newest)
+        continue;
+
+      // NOTE: We hold onto each successor while we follow it, because
+      // the database might stop storing it at any moment.
+      while (auto successor = Implementation::get_successor(*newest))
+      {
+        if (rmf_utils::modular(as_of).less_than(successor->schedule_version))
+          break;
+
+        newest = std::move(successor);
+      }
+
+      if (!seen.insert(newest.get()).second)
+        continue;
+
+      // Skip routes that the database was no longer storing at this version
+      if (Implementation::is_removed(*newest, as_of))
+        continue;
+
+      routes.emplace_back(std::move(newest));
+    }
+  }
+
+  return routes;
 }
 
 //==============================================================================
@@ -734,8 +1976,9 @@ class PatchRelevanceInspector
 {
 public:
 
-  PatchRelevanceInspector(Version after)
-  : _after(after)
+  PatchRelevanceInspector(Version after, Version as_of)
+  : _after(after),
+    _as_of(as_of)
   {
     // Do nothing
   }
@@ -755,15 +1998,7 @@ public:
         return nullptr;
     }
 
-    while (const auto successor = from->successor.lock())
-    {
-      if (rmf_utils::modular(_after).less_than(successor->schedule_version))
-        break;
-
-      from = successor.get();
-    }
-
-    return from;
+    return get_most_recent(from, _after);
   }
 
   void inspect(
@@ -771,7 +2006,7 @@ public:
     const std::function<bool(const RouteEntry&)>& relevant) final
   {
     const RouteEntry* const last = get_last_known_ancestor(entry);
-    const RouteEntry* const newest = get_most_recent(entry);
+    const RouteEntry* const newest = get_most_recent(entry, _as_of);
 
     if (last == newest)
     {
@@ -832,7 +2067,7 @@ public:
         changes[newest->participant].additions.emplace_back(
           Change::Add::Item{
             newest->route_id,
-            newest->route
+            get_delayed_route(*newest)
           });
       }
       else
@@ -844,6 +2079,7 @@ public:
 
 private:
   const Version _after;
+  const Version _as_of;
 };
 
 //==============================================================================
@@ -852,6 +2088,12 @@ class FirstPatchRelevanceInspector
 {
 public:
 
+  FirstPatchRelevanceInspector(Version as_of)
+  : _as_of(as_of)
+  {
+    // Do nothing
+  }
+
   using RouteEntry = Database::Implementation::RouteEntry;
 
   std::unordered_map<ParticipantId, ParticipantChanges> changes;
@@ -860,16 +2102,19 @@ public:
     const RouteEntry* entry,
     const std::function<bool(const RouteEntry&)>& relevant) final
   {
-    const RouteEntry* const newest = get_most_recent(entry);
+    const RouteEntry* const newest = get_most_recent(entry, _as_of);
     if (newest->route && relevant(*newest))
     {
       changes[newest->participant].additions.emplace_back(
         Change::Add::Item{
           newest->route_id,
-          newest->route
+          get_delayed_route(*newest)
         });
     }
   }
+
+private:
+  const Version _as_of;
 };
 
 //==============================================================================
@@ -883,22 +2128,36 @@ public:
 
   std::vector<Storage> routes;
 
+  ViewRelevanceInspector() = default;
+
+  /// Use this constructor to view the routes as they were at the specified
+  /// schedule version. This is used by published states, which share their
+  /// route entries with the database.
+  ViewRelevanceInspector(Version as_of)
+  : _as_of(as_of)
+  {
+    // Do nothing
+  }
+
   void inspect(
     const RouteEntry* entry,
     const std::function<bool(const RouteEntry&)>& relevant) final
   {
-    entry = get_most_recent(entry);
+    entry = _as_of ? get_most_recent(entry, *_as_of) : get_most_recent(entry);
     if (entry->route && relevant(*entry))
     {
       routes.emplace_back(
         Storage{
           entry->participant,
           entry->route_id,
-          entry->route,
+          get_delayed_route(*entry),
           entry->description
         });
     }
   }
+
+private:
+  rmf_utils::optional<Version> _as_of;
 };
 
 //==============================================================================
@@ -913,9 +2172,11 @@ public:
   std::vector<Storage> routes;
 
   const Version after;
+  const Version as_of;
 
-  ViewerAfterRelevanceInspector(Version _after)
-  : after(_after)
+  ViewerAfterRelevanceInspector(Version _after, Version _as_of)
+  : after(_after),
+    as_of(_as_of)
   {
     // Do nothing
   }
@@ -924,7 +2185,7 @@ public:
     const RouteEntry* entry,
     const std::function<bool(const RouteEntry&)>& relevant) final
   {
-    entry = get_most_recent(entry);
+    entry = get_most_recent(entry, as_of);
     if (rmf_utils::modular(after).less_than(entry->schedule_version)
       && entry->route && relevant(*entry))
     {
@@ -932,161 +2193,125 @@ public:
         Storage{
           entry->participant,
           entry->route_id,
-          entry->route,
+          get_delayed_route(*entry),
           entry->description
         });
     }
   }
 };
 
+} // anonymous namespace
+
 //==============================================================================
-class CullRelevanceInspector
-  : public TimelineInspector<Database::Implementation::RouteEntry>
+class Database::Published::Implementation
 {
 public:
 
-  CullRelevanceInspector(Time cull_time)
-  : _cull_time(cull_time)
-  {
-    // Do nothing
-  }
-
-  using RouteEntry = Database::Implementation::RouteEntry;
-
-  struct Info
-  {
-    ParticipantId participant;
-    RouteId route_id;
-  };
+  using DatabaseImpl = Database::Implementation;
+  using RouteEntry = DatabaseImpl::RouteEntry;
 
-  std::vector<Info> routes;
+  std::shared_ptr<const TimelineView<const RouteEntry>> timeline;
+  std::shared_ptr<const DatabaseImpl::PublishedParticipants> participants;
+  DatabaseImpl::ConstChangeLogRecordPtr change_log;
+  rmf_utils::optional<DatabaseImpl::CullInfo> last_cull;
+  Version version;
 
-  void inspect(
-    const RouteEntry* entry,
-    const std::function<bool(const RouteEntry&)>& /*relevant*/) final
+  static std::shared_ptr<const Published> make(Implementation impl)
   {
-    while (const auto successor = entry->successor.lock())
-    {
-      if (!successor->route)
-        break;
-
-      entry = successor.get();
-    }
-
-    assert(entry->route->trajectory().finish_time());
-    if (*entry->route->trajectory().finish_time() < _cull_time)
-    {
-      routes.emplace_back(Info{entry->participant, entry->route_id});
-    }
+    std::shared_ptr<Published> published(new Published);
+    published->_pimpl = rmf_utils::make_impl<Implementation>(std::move(impl));
+    return published;
   }
-
-private:
-  Time _cull_time;
 };
 
-} // anonymous namespace
+//==============================================================================
+auto Database::Implementation::make_published() const
+-> std::shared_ptr<const Published>
+{
+  return Published::Implementation::make(
+    Published::Implementation{
+      timeline.snapshot(),
+      get_published_participants(),
+      change_log,
+      last_cull,
+      schedule_version
+    });
+}
 
 //==============================================================================
-Viewer::View Database::query(const Query& parameters) const
+Viewer::View Database::Published::query(const Query& parameters) const
 {
   return query(parameters.spacetime(), parameters.participants());
 }
 
 //==============================================================================
-Viewer::View Database::query(
+Viewer::View Database::Published::query(
   const Query::Spacetime& spacetime,
   const Query::Participants& participants) const
 {
-  ViewRelevanceInspector inspector;
-  _pimpl->timeline.inspect(spacetime, participants, inspector);
+  ViewRelevanceInspector inspector(_pimpl->version);
+  _pimpl->timeline->inspect(spacetime, participants, inspector);
   return Viewer::View::Implementation::make_view(std::move(inspector.routes));
 }
 
 //==============================================================================
-const std::unordered_set<ParticipantId>& Database::participant_ids() const
+const std::unordered_set<ParticipantId>&
+Database::Published::participant_ids() const
 {
-  return _pimpl->participant_ids;
+  return _pimpl->participants->ids;
 }
 
 //==============================================================================
-std::shared_ptr<const ParticipantDescription> Database::get_participant(
-  std::size_t participant_id) const
+std::shared_ptr<const ParticipantDescription>
+Database::Published::get_participant(std::size_t participant_id) const
 {
-  const auto state_it = _pimpl->descriptions.find(participant_id);
-  if (state_it == _pimpl->descriptions.end())
+  const auto& descriptions = _pimpl->participants->descriptions;
+  const auto it = descriptions.find(participant_id);
+  if (it == descriptions.end())
     return nullptr;
 
-  return state_it->second;
-}
-
-//==============================================================================
-rmf_utils::optional<Itinerary> Database::get_itinerary(
-  std::size_t participant_id) const
-{
-  const auto state_it = _pimpl->states.find(participant_id);
-  if (state_it == _pimpl->states.end())
-    return rmf_utils::nullopt;
-
-  const Implementation::ParticipantState& state = state_it->second;
-
-  Itinerary itinerary;
-  itinerary.reserve(state.active_routes.size());
-  for (const RouteId route : state.active_routes)
-    itinerary.push_back(state.storage.at(route).entry->route);
-
-  return itinerary;
-}
-
-//==============================================================================
-Version Database::latest_version() const
-{
-  return _pimpl->schedule_version;
-}
-
-//==============================================================================
-std::shared_ptr<const Snapshot> Database::snapshot() const
-{
-  using SnapshotType =
-    SnapshotImplementation<Implementation::RouteEntry, ViewRelevanceInspector>;
-
-  return std::make_shared<SnapshotType>(
-    _pimpl->timeline.snapshot(),
-    _pimpl->participant_ids,
-    _pimpl->descriptions,
-    _pimpl->schedule_version);
-}
-
-//==============================================================================
-Database::Database()
-: _pimpl(rmf_utils::make_unique_impl<Implementation>())
-{
-  // Do nothing
+  return it->second;
 }
 
 //==============================================================================
-const Inconsistencies& Database::inconsistencies() const
+Version Database::Published::latest_version() const
 {
-  return _pimpl->inconsistencies;
+  return _pimpl->version;
 }
 
 //==============================================================================
-auto Database::changes(
+auto Database::Published::changes(
   const Query& parameters,
   rmf_utils::optional<Version> after) const -> Patch
 {
+  const auto& participants = *_pimpl->participants;
+  const Version version = _pimpl->version;
+
   std::unordered_map<ParticipantId, ParticipantChanges> changes;
   if (after)
   {
-    PatchRelevanceInspector inspector(*after);
-    _pimpl->timeline.inspect(
-      parameters.spacetime(), parameters.participants(), inspector);
+    // Only the routes that changed after this version can have anything new to
+    // tell the mirror, so we use the change log to find them instead of
+    // searching the whole timeline.
+    const auto changed_routes =
+      get_changed_routes(_pimpl->change_log, *after, version);
+
+    std::vector<const Implementation::RouteEntry*> candidates;
+    candidates.reserve(changed_routes.size());
+    for (const auto& route : changed_routes)
+      candidates.push_back(route.get());
+
+    PatchRelevanceInspector inspector(*after, version);
+    Timeline<Implementation::RouteEntry>::inspect_candidates(
+      parameters.spacetime(), parameters.participants(),
+      candidates, inspector);
 
     changes = inspector.changes;
   }
   else
   {
-    FirstPatchRelevanceInspector inspector;
-    _pimpl->timeline.inspect(
+    FirstPatchRelevanceInspector inspector(version);
+    _pimpl->timeline->inspect(
       parameters.spacetime(), parameters.participants(), inspector);
 
     changes = inspector.changes;
@@ -1119,16 +2344,18 @@ auto Database::changes(
   {
     const Version after_v = *after;
 
-    auto add_it = _pimpl->add_participant_version.upper_bound(after_v);
-    for (; add_it != _pimpl->add_participant_version.end(); ++add_it)
+    auto add_it = participants.add_participant_version.upper_bound(after_v);
+    for (; add_it != participants.add_participant_version.end(); ++add_it)
     {
-      const auto p_it = _pimpl->states.find(add_it->second);
-      assert(p_it != _pimpl->states.end());
-      registered.emplace_back(p_it->first, *p_it->second.description);
+      const auto p_it = participants.descriptions.find(add_it->second);
+      assert(p_it != participants.descriptions.end());
+      registered.emplace_back(p_it->first, *p_it->second);
     }
 
-    auto remove_it = _pimpl->remove_participant_version.upper_bound(after_v);
-    for (; remove_it != _pimpl->remove_participant_version.end(); ++remove_it)
+    auto remove_it =
+      participants.remove_participant_version.upper_bound(after_v);
+    for (; remove_it != participants.remove_participant_version.end();
+      ++remove_it)
     {
       // We should only unregister this if it was registered before the last
       // update to this mirror
@@ -1140,16 +2367,17 @@ auto Database::changes(
   {
     // If this is a mirror's first pull from the database, then we should send
     // all the participant information.
-    for (const auto& p : _pimpl->states)
-      registered.emplace_back(p.first, *p.second.description);
+    for (const auto& p : participants.descriptions)
+      registered.emplace_back(p.first, *p.second);
 
     // We do not need to mention any participants that have unregistered.
   }
 
   rmf_utils::optional<Change::Cull> cull;
-  if (_pimpl->last_cull && after && *after < _pimpl->last_cull->version)
+  const auto& last_cull = _pimpl->last_cull;
+  if (last_cull && after && *after < last_cull->version)
   {
-    cull = _pimpl->last_cull->cull;
+    cull = last_cull->cull;
   }
 
   return Patch(
@@ -1157,70 +2385,193 @@ auto Database::changes(
     std::move(registered),
     std::move(part_patches),
     cull,
-    _pimpl->schedule_version);
+    version);
 }
 
 //==============================================================================
-Viewer::View Database::query(const Query& parameters, const Version after) const
+Viewer::View Database::Published::query(
+  const Query& parameters,
+  const Version after) const
 {
-  ViewerAfterRelevanceInspector inspector{after};
-  _pimpl->timeline.inspect(
+  ViewerAfterRelevanceInspector inspector{after, _pimpl->version};
+  _pimpl->timeline->inspect(
     parameters.spacetime(), parameters.participants(), inspector);
 
   return Viewer::View::Implementation::make_view(std::move(inspector.routes));
 }
 
 //==============================================================================
-Version Database::cull(Time time)
+Database::Published::Published()
 {
-  Query::Spacetime spacetime;
-  spacetime.query_timespan().set_upper_time_bound(time);
+  // Do nothing
+}
 
-  CullRelevanceInspector inspector(time);
-  _pimpl->timeline.inspect(
-    spacetime, Query::Participants::make_all(), inspector);
+//==============================================================================
+Viewer::View Database::query(const Query& parameters) const
+{
+  return query(parameters.spacetime(), parameters.participants());
+}
 
-  // TODO(MXG) This iterating could probably be made more efficient by grouping
-  // together the culls of each participant.
-  for (const auto& route : inspector.routes)
-  {
-    auto p_it = _pimpl->states.find(route.participant);
-    assert(p_it != _pimpl->states.end());
+//==============================================================================
+Viewer::View Database::query(
+  const Query::Spacetime& spacetime,
+  const Query::Participants& participants) const
+{
+  ViewRelevanceInspector inspector;
+  _pimpl->timeline.inspect(spacetime, participants, inspector);
+  return Viewer::View::Implementation::make_view(std::move(inspector.routes));
+}
+
+//==============================================================================
+const std::unordered_set<ParticipantId>& Database::participant_ids() const
+{
+  return _pimpl->participant_ids;
+}
+
+//==============================================================================
+std::shared_ptr<const ParticipantDescription> Database::get_participant(
+  std::size_t participant_id) const
+{
+  const auto state_it = _pimpl->descriptions.find(participant_id);
+  if (state_it == _pimpl->descriptions.end())
+    return nullptr;
+
+  return state_it->second;
+}
+
+//==============================================================================
+rmf_utils::optional<Itinerary> Database::get_itinerary(
+  std::size_t participant_id) const
+{
+  const auto state_it = _pimpl->states.find(participant_id);
+  if (state_it == _pimpl->states.end())
+    return rmf_utils::nullopt;
+
+  const Implementation::ParticipantState& state = state_it->second;
+
+  Itinerary itinerary;
+  itinerary.reserve(state.active_routes.size());
+  for (const RouteId route : state.active_routes)
+    itinerary.push_back(get_delayed_route(*state.storage.at(route).entry));
+
+  return itinerary;
+}
+
+//==============================================================================
+Version Database::latest_version() const
+{
+  return _pimpl->schedule_version;
+}
+
+//==============================================================================
+std::shared_ptr<const Snapshot> Database::snapshot() const
+{
+  return _pimpl->current_published();
+}
+
+//==============================================================================
+Database::Database(const BucketOptions& bucket_options)
+: _pimpl(rmf_utils::make_unique_impl<Implementation>(bucket_options))
+{
+  // Do nothing
+}
+
+//==============================================================================
+Database::Database(
+  const PersistenceOptions& persistence,
+  const BucketOptions& bucket_options)
+: _pimpl(rmf_utils::make_unique_impl<Implementation>(bucket_options))
+{
+  _pimpl->recover(*this, persistence);
+}
+
+//==============================================================================
+const Inconsistencies& Database::inconsistencies() const
+{
+  return _pimpl->inconsistencies;
+}
+
+//==============================================================================
+auto Database::changes(
+  const Query& parameters,
+  rmf_utils::optional<Version> after) const -> Patch
+{
+  return _pimpl->current_published()->changes(parameters, after);
+}
 
-    auto& storage = p_it->second.storage;
-    const auto r_it = storage.find(route.route_id);
-    assert(r_it != storage.end());
+//==============================================================================
+Viewer::View Database::query(const Query& parameters, const Version after) const
+{
+  return _pimpl->current_published()->query(parameters, after);
+}
 
-    storage.erase(r_it);
+//==============================================================================
+Version Database::cull(Time time)
+{
+  Implementation::WriteGuard guard(*_pimpl);
+  if (_pimpl->journal)
+  {
+    auto& record = _pimpl->start_record(JournalRecord::Cull);
+    record.time(time);
+    _pimpl->finish_record();
   }
 
-  _pimpl->timeline.cull(time);
+  const Version version = _pimpl->next_unique_version();
+  auto expired = _pimpl->pop_expired_routes(time, rmf_utils::nullopt);
+  _pimpl->remove_routes(std::move(expired.routes), version);
+  _pimpl->finish_cull(time, version);
+  return version;
+}
 
-  // Erase all trace of participants that were removed before the culling time.
-  const auto p_cull_begin = _pimpl->remove_participant_time.begin();
-  const auto p_cull_end = _pimpl->remove_participant_time.upper_bound(time);
-  for (auto p_cull_it = p_cull_begin; p_cull_it != p_cull_end; ++p_cull_it)
+//==============================================================================
+rmf_utils::optional<Version> Database::cull(
+  Time time,
+  std::size_t max_routes)
+{
+  if (max_routes == 0)
   {
-    const auto remove_it =
-      _pimpl->remove_participant_version.find(p_cull_it->second);
-    assert(remove_it != _pimpl->remove_participant_version.end());
+    // *INDENT-OFF*
+    throw std::invalid_argument(
+      "[Database::cull] max_routes must be at least 1, or else the cull "
+      "could never be finished");
+    // *INDENT-ON*
+  }
 
-    _pimpl->remove_participant_version.erase(remove_it);
+  Implementation::WriteGuard guard(*_pimpl);
+  auto expired = _pimpl->pop_expired_routes(time, max_routes);
+  if (expired.routes.empty()
+    && (expired.more || !_pimpl->needs_cull(time)))
+  {
+    return rmf_utils::nullopt;
   }
 
-  if (p_cull_begin != p_cull_end)
-    _pimpl->remove_participant_time.erase(p_cull_begin, p_cull_end);
+  if (_pimpl->journal)
+  {
+    try
+    {
+      auto& record = _pimpl->start_record(JournalRecord::CullPart);
+      record.time(time);
+      record.u8(!expired.more);
+      record.u64(expired.routes.size());
+      for (const auto& route : expired.routes)
+      {
+        record.u64(route.participant);
+        record.u64(route.route_id);
+      }
 
-  // Update the version of the schedule
-  ++_pimpl->schedule_version;
+      _pimpl->finish_record();
+    }
+    catch (...)
+    {
+      // The routes will not be removed, so they need to stay in the index
+      for (const auto& route : expired.routes)
+        _pimpl->index_expiry(route.entry);
 
-  // Record the occurrence of this cull
-  _pimpl->last_cull = Implementation::CullInfo{
-    Change::Cull(time),
-    _pimpl->schedule_version
-  };
+      throw;
+    }
+  }
 
-  return _pimpl->schedule_version;
+  return _pimpl->cull_part(time, std::move(expired.routes), !expired.more);
 }
 
 //==============================================================================
@@ -1229,6 +2580,37 @@ void Database::set_current_time(Time time)
   _pimpl->current_time = time;
 }
 
+//==============================================================================
+Version Database::batch(const std::function<void(Database&)>& changes)
+{
+  Implementation::WriteGuard write_guard(*_pimpl);
+
+  // A batch inside of another batch simply becomes part of the outer batch
+  if (_pimpl->batching)
+  {
+    changes(*this);
+    return _pimpl->schedule_version;
+  }
+
+  struct BatchGuard
+  {
+    Implementation& impl;
+
+    ~BatchGuard()
+    {
+      impl.batching = false;
+      impl.batch_has_version = false;
+    }
+  };
+
+  _pimpl->batching = true;
+  _pimpl->batch_has_version = false;
+  BatchGuard guard{*_pimpl};
+
+  changes(*this);
+  return _pimpl->schedule_version;
+}
+
 //==============================================================================
 ItineraryVersion Database::itinerary_version(ParticipantId participant) const
 {
@@ -1245,5 +2627,46 @@ ItineraryVersion Database::itinerary_version(ParticipantId participant) const
   return p_it->second.tracker->last_known_version();
 }
 
+//==============================================================================
+void Database::enable_publishing()
+{
+  if (_pimpl->publishing)
+    return;
+
+  _pimpl->publishing = true;
+  _pimpl->unpublished = nullptr;
+  std::atomic_store(&_pimpl->published, _pimpl->make_published());
+}
+
+//==============================================================================
+std::shared_ptr<const Database::Published> Database::published() const
+{
+  return std::atomic_load(&_pimpl->published);
+}
+
+//==============================================================================
+void Database::checkpoint()
+{
+  if (!_pimpl->journal)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[Database::checkpoint] This database was not given any "
+      "PersistenceOptions");
+    // *INDENT-ON*
+  }
+
+  if (_pimpl->write_depth > 0)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[Database::checkpoint] A checkpoint cannot be taken while a change is "
+      "being applied");
+    // *INDENT-ON*
+  }
+
+  _pimpl->checkpoint();
+}
+
 } // namespace schedule
 } // namespace rmf_traffic
@@ -67,6 +67,16 @@ InconsistencyTracker::Ticket::~Ticket()
   }
 }
 
+//==============================================================================
+void InconsistencyTracker::restore(
+  const ItineraryVersion expected_version,
+  const ItineraryVersion last_known_version)
+{
+  assert(_changes.empty());
+  _expected_version = expected_version;
+  _last_known_version = last_known_version;
+}
+
 //==============================================================================
 auto InconsistencyTracker::check(
   const ItineraryVersion version,
@@ -125,6 +125,14 @@ public:
     return _last_known_version;
   }
 
+  /// Restore the versions of a participant when its database is being
+  /// recovered from a snapshot. Changes that were waiting for a missing version
+  /// are not saved in snapshots, so this may only be used before any changes
+  /// have been checked.
+  void restore(
+    ItineraryVersion expected_version,
+    ItineraryVersion last_known_version);
+
 private:
 
   void _apply_changes();
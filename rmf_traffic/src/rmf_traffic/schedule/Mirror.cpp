@@ -32,10 +32,16 @@ public:
 
   struct RouteEntry
   {
+    // The trajectory of this entry is the trajectory of route, delayed by the
+    // delay value. Use get_delayed_route() to get the actual route.
     ConstRoutePtr route;
+    Duration delay;
     ParticipantId participant;
     RouteId route_id;
     std::shared_ptr<const ParticipantDescription> description;
+
+    // A cache used by get_delayed_route()
+    mutable ConstRoutePtr delayed_route;
   };
   using ConstRouteEntryPtr = std::shared_ptr<const RouteEntry>;
 
@@ -47,6 +53,12 @@ public:
 
   Timeline<const RouteEntry> timeline;
 
+  Implementation(const BucketOptions& bucket_options)
+  : timeline(bucket_options)
+  {
+    // Do nothing
+  }
+
   struct ParticipantState
   {
     std::unordered_map<RouteId, RouteStorage> storage;
@@ -97,18 +109,21 @@ public:
       RouteStorage& entry_storage = s.second;
       assert(entry_storage.entry);
       assert(entry_storage.entry->route);
-      auto delayed = schedule::apply_delay(
-        entry_storage.entry->route->trajectory(), delay.duration());
 
-      if (!delayed)
-        continue;
-
-      auto new_route = std::make_shared<Route>(
-        entry_storage.entry->route->map(), std::move(*delayed));
+      // We create a new entry because the old one might be shared with a
+      // snapshot. The new entry shares its route with the old one, and the
+      // delayed route will only be created if something asks for it.
+      const RouteEntry& old_entry = *entry_storage.entry;
+      auto new_entry = std::make_shared<RouteEntry>(
+        RouteEntry{
+          old_entry.route,
+          old_entry.delay + delay.duration(),
+          old_entry.participant,
+          old_entry.route_id,
+          old_entry.description,
+          nullptr
+        });
 
-      // We create a new entry because
-      auto new_entry = std::make_shared<RouteEntry>(*entry_storage.entry);
-      new_entry->route = std::move(new_route);
       entry_storage.entry = new_entry;
       entry_storage.timeline_handle = timeline.insert(new_entry);
     }
@@ -140,9 +155,11 @@ public:
       entry_storage.entry = std::make_shared<RouteEntry>(
         RouteEntry{
           std::move(route),
+          Duration(0),
           participant,
           route_id,
-          state.description
+          state.description,
+          nullptr
         });
 
       entry_storage.timeline_handle = timeline.insert(entry_storage.entry);
@@ -162,6 +179,15 @@ public:
 
   std::vector<Storage> routes;
 
+  MirrorViewRelevanceInspector() = default;
+
+  // The entries of a Mirror are never modified after they are created, so
+  // there is no need to filter them by version when viewing a snapshot.
+  MirrorViewRelevanceInspector(Version)
+  {
+    // Do nothing
+  }
+
   void inspect(
     const RouteEntry* entry,
     const std::function<bool(const RouteEntry&)>& relevant) final
@@ -174,7 +200,7 @@ public:
         Storage{
           entry->participant,
           entry->route_id,
-          entry->route,
+          get_delayed_route(*entry),
           entry->description
         });
     }
@@ -188,6 +214,12 @@ class MirrorCullRelevanceInspector
 {
 public:
 
+  MirrorCullRelevanceInspector(Time cull_time)
+  : _cull_time(cull_time)
+  {
+    // Do nothing
+  }
+
   using RouteEntry = Mirror::Implementation::RouteEntry;
   struct Info
   {
@@ -203,10 +235,16 @@ public:
   {
     assert(entry);
     assert(entry->route);
-    if (relevant(*entry))
+
+    // The database only culls the routes that finish before the cull time, so
+    // the routes that are still running at that time must be kept.
+    if (relevant(*entry) && get_finish_time(*entry) < _cull_time)
       info.emplace_back(Info{entry->participant, entry->route_id});
   }
 
+private:
+  Time _cull_time;
+
 };
 
 } // anonymous namespace
@@ -256,7 +294,7 @@ rmf_utils::optional<Itinerary> Mirror::get_itinerary(
   Itinerary itinerary;
   itinerary.reserve(state.storage.size());
   for (const auto& s : state.storage)
-    itinerary.push_back(s.second.entry->route);
+    itinerary.push_back(get_delayed_route(*s.second.entry));
 
   return itinerary;
 }
@@ -283,8 +321,8 @@ std::shared_ptr<const Snapshot> Mirror::snapshot() const
 }
 
 //==============================================================================
-Mirror::Mirror()
-: _pimpl(rmf_utils::make_unique_impl<Implementation>())
+Mirror::Mirror(const BucketOptions& bucket_options)
+: _pimpl(rmf_utils::make_unique_impl<Implementation>(bucket_options))
 {
   // Do nothing
 }
@@ -354,7 +392,7 @@ Version Mirror::update(const Patch& patch)
     Query query = query_all();
     query.spacetime().query_timespan().set_upper_time_bound(time);
 
-    MirrorCullRelevanceInspector inspector;
+    MirrorCullRelevanceInspector inspector(time);
     _pimpl->timeline.inspect(
       query.spacetime(), query.participants(), inspector);
 
@@ -116,6 +116,10 @@ struct NegotiationData
 struct RouteEntry
 {
   ConstRoutePtr route;
+
+  // Proposals never get delayed, but the Timeline needs this field
+  Duration delay;
+
   ParticipantId participant;
   RouteId route_id;
   std::shared_ptr<const ParticipantDescription> description;
@@ -293,6 +297,7 @@ public:
         auto entry = std::make_shared<RouteEntry>(
           RouteEntry{
             route,
+            Duration(0),
             participant,
             i,
             description
@@ -461,8 +466,11 @@ public:
 
     for (const auto& alternative : alternatives)
     {
-      Timeline<RouteEntry> timeline;
+      // NOTE: The handles are declared before the timeline so that the
+      // timeline gets destroyed first. That way the handles do not need to
+      // clean up any entries after the snapshot has been taken.
       std::vector<std::shared_ptr<void>> handles;
+      Timeline<RouteEntry> timeline;
 
       std::size_t id = 0;
       for (const auto& route : alternative)
@@ -470,6 +478,7 @@ public:
         auto entry = std::make_shared<RouteEntry>(
           RouteEntry{
             route,
+            Duration(0),
             participant,
             id,
             description
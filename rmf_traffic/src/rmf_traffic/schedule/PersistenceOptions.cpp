@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <rmf_traffic/schedule/PersistenceOptions.hpp>
+
+namespace rmf_traffic {
+namespace schedule {
+
+//==============================================================================
+class PersistenceOptions::Implementation
+{
+public:
+
+  std::string directory;
+  bool sync;
+  rmf_utils::optional<std::size_t> checkpoint_interval;
+
+};
+
+//==============================================================================
+PersistenceOptions::PersistenceOptions(std::string directory)
+: _pimpl(rmf_utils::make_impl<Implementation>(
+      Implementation{
+        std::move(directory),
+        true,
+        DefaultCheckpointInterval
+      }))
+{
+  // Do nothing
+}
+
+//==============================================================================
+PersistenceOptions& PersistenceOptions::directory(std::string value)
+{
+  _pimpl->directory = std::move(value);
+  return *this;
+}
+
+//==============================================================================
+const std::string& PersistenceOptions::directory() const
+{
+  return _pimpl->directory;
+}
+
+//==============================================================================
+PersistenceOptions& PersistenceOptions::sync(bool value)
+{
+  _pimpl->sync = value;
+  return *this;
+}
+
+//==============================================================================
+bool PersistenceOptions::sync() const
+{
+  return _pimpl->sync;
+}
+
+//==============================================================================
+PersistenceOptions& PersistenceOptions::checkpoint_interval(
+  rmf_utils::optional<std::size_t> value)
+{
+  _pimpl->checkpoint_interval = value;
+  return *this;
+}
+
+//==============================================================================
+rmf_utils::optional<std::size_t> PersistenceOptions::checkpoint_interval() const
+{
+  return _pimpl->checkpoint_interval;
+}
+
+} // namespace schedule
+} // namespace rmf_traffic
@@ -19,29 +19,20 @@
 #define SRC__RMF_TRAFFIC__SCHEDULE__TIMELINE_HPP
 
 #include "../DetectConflictInternal.hpp"
+#include "ChangeInternal.hpp"
 
+#include <rmf_traffic/schedule/BucketOptions.hpp>
 #include <rmf_traffic/schedule/Query.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <unordered_map>
 
 namespace rmf_traffic {
 namespace schedule {
 
-namespace {
-
-// TODO(MXG): Consider allowing these values to be configured
-
-// Each Timeline Bucket spans a range of 1 minute.
-const Duration BucketDuration = std::chrono::minutes(1);
-
-// This constant is used during the creation of the first bucket for a timeline.
-// It's a very minor optimization that avoids making a bucket that will
-// potentially not be very useful.
-const Duration PartialBucketDuration = std::chrono::seconds(50);
-
-} // anonymous namespace
-
 //==============================================================================
 struct ParticipantFilter
 {
@@ -105,6 +96,274 @@ struct ParticipantFilter
 template<typename Entry>
 class TimelineInspector;
 
+//==============================================================================
+// NOTE: Delays are applied to timeline entries lazily. When an entry gets
+// delayed, the new entry shares the route of the old one, and its delay field
+// says how much later than its route it really happens. These functions should
+// be used instead of reading the times of an entry's route directly.
+
+//==============================================================================
+template<typename Entry>
+Time get_start_time(const Entry& entry)
+{
+  return *entry.route->trajectory().start_time() + entry.delay;
+}
+
+//==============================================================================
+template<typename Entry>
+Time get_finish_time(const Entry& entry)
+{
+  return *entry.route->trajectory().finish_time() + entry.delay;
+}
+
+//==============================================================================
+/// Check whether the trajectory of an entry, after its delay, conflicts with
+/// a region of spacetime.
+template<typename Entry>
+bool detect_conflicts(
+  const Entry& entry,
+  const rmf_traffic::internal::Spacetime& region)
+{
+  const Trajectory& trajectory = entry.route->trajectory();
+  const Profile& profile = entry.description->profile();
+  if (entry.delay == Duration(0))
+    return rmf_traffic::internal::detect_conflicts(profile, trajectory, region);
+
+  // Instead of delaying the trajectory, we move the time bounds of the region
+  // back by the same amount.
+  Time lower;
+  Time upper;
+  rmf_traffic::internal::Spacetime shifted = region;
+  if (region.lower_time_bound)
+  {
+    lower = *region.lower_time_bound - entry.delay;
+    shifted.lower_time_bound = &lower;
+  }
+
+  if (region.upper_time_bound)
+  {
+    upper = *region.upper_time_bound - entry.delay;
+    shifted.upper_time_bound = &upper;
+  }
+
+  return rmf_traffic::internal::detect_conflicts(profile, trajectory, shifted);
+}
+
+//==============================================================================
+/// Get the route of an entry with its delay applied. The delayed route is only
+/// created the first time that it is needed, and then it gets cached inside of
+/// the entry's delayed_route field.
+template<typename Entry>
+ConstRoutePtr get_delayed_route(const Entry& entry)
+{
+  if (!entry.route || entry.delay == Duration(0))
+    return entry.route;
+
+  // NOTE: Entries can be shared with snapshots that are being read by
+  // other threads, so the cache is accessed atomically. If two threads race
+  // to fill the cache, they will both create equivalent routes.
+  if (auto cached = std::atomic_load(&entry.delayed_route))
+    return cached;
+
+  auto trajectory = apply_delay(entry.route->trajectory(), entry.delay);
+  assert(trajectory);
+
+  ConstRoutePtr delayed =
+    std::make_shared<Route>(entry.route->map(), std::move(*trajectory));
+  std::atomic_store(&entry.delayed_route, delayed);
+  return delayed;
+}
+
+//==============================================================================
+/// Keeps track of where an entry is stored inside of each bucket that holds it,
+/// so that the entry can be removed from its buckets without searching them.
+struct TimelinePlacement
+{
+  using Slot = std::pair<Time, std::size_t>;
+
+  /// The key of each bucket that holds the entry, paired with the index of the
+  /// entry inside of that bucket. These are sorted by key.
+  std::vector<Slot> slots;
+
+  std::vector<Slot>::iterator lower_bound(const Time key)
+  {
+    return std::lower_bound(
+      slots.begin(), slots.end(), key,
+      [](const Slot& slot, const Time t) { return slot.first < t; });
+  }
+
+  void insert(const Time key, const std::size_t index)
+  {
+    slots.insert(lower_bound(key), Slot{key, index});
+  }
+
+  void set(const Time key, const std::size_t index)
+  {
+    const auto it = lower_bound(key);
+    assert(it != slots.end() && it->first == key);
+    it->second = index;
+  }
+
+  void erase(const Time key)
+  {
+    const auto it = lower_bound(key);
+    if (it != slots.end() && it->first == key)
+      slots.erase(it);
+  }
+};
+
+//==============================================================================
+/// Keeps track of which routes have already been inspected by a query, so that
+/// a route which is stored in several buckets will only be inspected once.
+///
+/// Each route in a timeline has a dense index. Every thread keeps one vector of
+/// stamps indexed by route, and each query uses a new stamp value, so queries
+/// do not need to allocate or clear anything to begin with an empty set.
+class TimelineChecked
+{
+public:
+
+  TimelineChecked()
+  {
+    Stamps& stamps = _thread_stamps();
+    if (stamps.in_use)
+    {
+      // NOTE: A query is being run from inside of another query on the
+      // same thread, so this query needs its own stamps to avoid clobbering
+      // the stamps of the outer query.
+      _local = std::make_unique<Stamps>();
+      _stamps = _local.get();
+    }
+    else
+    {
+      _stamps = &stamps;
+    }
+
+    _stamps->in_use = true;
+    if (++_stamps->current == 0)
+    {
+      // The stamp values have wrapped around, so old stamps might look like
+      // they belong to this query.
+      std::fill(_stamps->values.begin(), _stamps->values.end(), 0);
+      _stamps->current = 1;
+    }
+  }
+
+  TimelineChecked(const TimelineChecked&) = delete;
+  TimelineChecked& operator=(const TimelineChecked&) = delete;
+
+  ~TimelineChecked()
+  {
+    _stamps->in_use = false;
+  }
+
+  /// Returns true if this route was not checked yet. The route will be marked
+  /// as checked after this is called.
+  bool insert(const std::size_t route)
+  {
+    std::vector<uint32_t>& values = _stamps->values;
+    if (values.size() <= route)
+      values.resize(std::max(route + 1, 2*values.size()), 0);
+
+    if (values[route] == _stamps->current)
+      return false;
+
+    values[route] = _stamps->current;
+    return true;
+  }
+
+private:
+
+  struct Stamps
+  {
+    std::vector<uint32_t> values;
+    uint32_t current = 0;
+    bool in_use = false;
+  };
+
+  static Stamps& _thread_stamps()
+  {
+    thread_local Stamps stamps;
+    return stamps;
+  }
+
+  Stamps* _stamps;
+  std::unique_ptr<Stamps> _local;
+};
+
+//==============================================================================
+/// A fixed-size piece of a TimelineBucket.
+///
+/// Each chunk keeps a bounding box for each of its entries, stored at the same
+/// index as the entry. Region queries use these boxes as a broad-phase check so
+/// that they only run the expensive narrow-phase collision check on entries
+/// whose swept area comes near the region.
+///
+/// The route index of each entry (see TimelineChecked) and the placement of
+/// each entry are also stored at the same index as the entry. The placement is
+/// used to keep track of the entry when it gets moved to a new index.
+template<typename Entry>
+struct TimelineBucketChunk
+{
+  static constexpr std::size_t Capacity = 32;
+
+  std::vector<std::shared_ptr<Entry>> entries;
+  std::vector<rmf_traffic::internal::BoundingBox> boxes;
+  std::vector<std::size_t> routes;
+
+  // NOTE: These placements are only used by the Timeline that owns the
+  // bucket. A chunk that is held only by snapshots may contain placements
+  // whose handles no longer exist, but snapshots never look at them.
+  std::vector<TimelinePlacement*> placements;
+};
+
+//==============================================================================
+/// The entries of a bucket are split into chunks, and each chunk is shared with
+/// snapshots the same way as the bucket itself. When the timeline changes an
+/// entry of a bucket that a snapshot is holding, it only copies the list of
+/// chunks and the chunks that it touches, so the cost of the copy does not grow
+/// with the number of entries in the bucket.
+///
+/// The entry at index i of the bucket is stored at index i % Capacity of chunk
+/// i / Capacity. Every chunk except the last one is full.
+template<typename Entry>
+struct TimelineBucket
+{
+  using Chunk = TimelineBucketChunk<Entry>;
+  using ChunkPtr = std::shared_ptr<Chunk>;
+  static constexpr std::size_t Capacity = Chunk::Capacity;
+
+  std::vector<ChunkPtr> chunks;
+
+  std::size_t size() const
+  {
+    if (chunks.empty())
+      return 0;
+
+    return (chunks.size() - 1) * Capacity + chunks.back()->entries.size();
+  }
+
+  const std::shared_ptr<Entry>& entry(const std::size_t i) const
+  {
+    return chunks[i / Capacity]->entries[i % Capacity];
+  }
+
+  const rmf_traffic::internal::BoundingBox& box(const std::size_t i) const
+  {
+    return chunks[i / Capacity]->boxes[i % Capacity];
+  }
+
+  std::size_t route(const std::size_t i) const
+  {
+    return chunks[i / Capacity]->routes[i % Capacity];
+  }
+
+  TimelinePlacement* placement(const std::size_t i) const
+  {
+    return chunks[i / Capacity]->placements[i % Capacity];
+  }
+};
+
 //==============================================================================
 template<typename Entry>
 class Timeline;
@@ -113,27 +372,34 @@ class Timeline;
 template<typename Entry>
 class TimelineView
 {
-public:
 public:
 
   using ConstEntryPtr = std::shared_ptr<const Entry>;
-  using Bucket = std::vector<ConstEntryPtr>;
-
-  // We use a shared_ptr for BucketPtr so that the Handle class can hold a
-  // weak_ptr to the bucket that contains its entry. If the bucket is ever
-  // deleted (e.g. because of a culling) that won't have a negative impact on
-  // the Handle's cleanup.
+  using BoundingBox = rmf_traffic::internal::BoundingBox;
+
+  // NOTE: We always use const Entry here so that a TimelineView<Entry>
+  // and a TimelineView<const Entry> can share the same buckets.
+  using Bucket = TimelineBucket<const Entry>;
+
+  // Every layer of the timeline (the buckets, the per-map Entries of buckets,
+  // and the map of maps) is held by a shared_ptr so that snapshots can share
+  // the structure with the live Timeline instead of copying it. A layer that is
+  // shared is never modified in place. When the live Timeline needs to change a
+  // shared layer, it first replaces its own pointer with a copy of that layer,
+  // so the snapshots that are holding the original remain unchanged.
   using BucketPtr = std::shared_ptr<Bucket>;
-  using Checked =
-    std::unordered_map<ParticipantId, std::unordered_set<RouteId>>;
+  using Checked = TimelineChecked;
 
   // TODO(MXG): Come up with a better name for this data structure than Entries
   using Entries = std::map<Time, BucketPtr>;
-  using MapNameToEntries = std::unordered_map<std::string, Entries>;
+  using EntriesPtr = std::shared_ptr<Entries>;
+  using MapNameToEntries = std::unordered_map<std::string, EntriesPtr>;
+  using MapNameToEntriesPtr = std::shared_ptr<MapNameToEntries>;
 
   /// Constructor
   TimelineView()
-  : _all_bucket(std::make_shared<Bucket>())
+  : _timelines(std::make_shared<MapNameToEntries>()),
+    _unplaced(std::make_shared<Bucket>())
   {
     // Do nothing
   }
@@ -144,29 +410,126 @@ public:
     const Query::Spacetime& spacetime,
     const Query::Participants& participants,
     Inspector& inspector) const
+  {
+    apply_participant_filter(
+      participants,
+      [&](const auto& participant_filter)
+      {
+        inspect_spacetime(spacetime, participant_filter, inspector);
+      });
+  }
+
+  /// Inspect a set of candidate entries instead of searching the buckets of
+  /// the timeline. Each candidate whose participant matches the query will be
+  /// passed to the inspector. The relevance function that gets passed along
+  /// with it will accept any entry that overlaps some part of the spacetime of
+  /// the query.
+  ///
+  /// This is meant for callers that already know which few entries they are
+  /// interested in, so that their cost does not grow with the timeline.
+  template<typename Inspector>
+  static void inspect_candidates(
+    const Query::Spacetime& spacetime,
+    const Query::Participants& participants,
+    const std::vector<const Entry*>& candidates,
+    Inspector& inspector)
+  {
+    const std::function<bool(const Entry&)> relevant =
+      [&spacetime](const Entry& entry) -> bool
+      {
+        return overlaps(spacetime, entry);
+      };
+
+    apply_participant_filter(
+      participants,
+      [&](const auto& participant_filter)
+      {
+        for (const Entry* entry : candidates)
+        {
+          if (participant_filter.ignore(entry->participant))
+            continue;
+
+          inspector.inspect(entry, relevant);
+        }
+      });
+  }
+
+  /// Check whether the route of an entry overlaps any part of the spacetime.
+  static bool overlaps(const Query::Spacetime& spacetime, const Entry& entry)
+  {
+    if (!entry.route)
+      return false;
+
+    if (!entry.route->trajectory().start_time())
+      return false;
+
+    const Query::Spacetime::Mode mode = spacetime.get_mode();
+    if (Query::Spacetime::Mode::All == mode)
+      return true;
+
+    if (Query::Spacetime::Mode::Timespan == mode)
+    {
+      const auto& timespan = *spacetime.timespan();
+      const std::string& map = entry.route->map();
+      if (!timespan.all_maps() && timespan.maps().count(map) == 0)
+        return false;
+
+      const Time* const lower = timespan.get_lower_time_bound();
+      if (lower && get_finish_time(entry) < *lower)
+        return false;
+
+      const Time* const upper = timespan.get_upper_time_bound();
+      if (upper && *upper < get_start_time(entry))
+        return false;
+
+      return true;
+    }
+
+    if (Query::Spacetime::Mode::Regions == mode)
+    {
+      rmf_traffic::internal::Spacetime spacetime_data;
+      for (const Region& region : *spacetime.regions())
+      {
+        if (region.get_map() != entry.route->map())
+          continue;
+
+        spacetime_data.lower_time_bound = region.get_lower_time_bound();
+        spacetime_data.upper_time_bound = region.get_upper_time_bound();
+        for (const auto& space : region)
+        {
+          spacetime_data.pose = space.get_pose();
+          spacetime_data.shape = space.get_shape();
+          if (detect_conflicts(entry, spacetime_data))
+            return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  template<typename> friend class Timeline;
+
+protected:
+
+  template<typename Callback>
+  static void apply_participant_filter(
+    const Query::Participants& participants,
+    const Callback& callback)
   {
     const Query::Participants::Mode mode = participants.get_mode();
 
     if (Query::Participants::Mode::All == mode)
     {
-      inspect_spacetime(
-        spacetime,
-        ParticipantFilter::AllowAll(),
-        inspector);
+      callback(ParticipantFilter::AllowAll());
     }
     else if (Query::Participants::Mode::Include == mode)
     {
-      inspect_spacetime(
-        spacetime,
-        ParticipantFilter::Include(participants.include()->get_ids()),
-        inspector);
+      callback(ParticipantFilter::Include(participants.include()->get_ids()));
     }
     else if (Query::Participants::Mode::Exclude == mode)
     {
-      inspect_spacetime(
-        spacetime,
-        ParticipantFilter::Exclude(participants.exclude()->get_ids()),
-        inspector);
+      callback(ParticipantFilter::Exclude(participants.exclude()->get_ids()));
     }
     else
     {
@@ -178,10 +541,6 @@ public:
     }
   }
 
-  template<typename> friend class Timeline;
-
-protected:
-
   template<typename Inspector, typename ParticipantFilter>
   void inspect_spacetime(
     const Query::Spacetime& spacetime,
@@ -213,16 +572,19 @@ protected:
   {
     Checked checked;
 
+    // Every entry in the timeline has a route with at least two waypoints, so
+    // every entry can be found in at least one bucket of its map.
     const auto relevant = [](const Entry&) -> bool { return true; };
-    for (const auto& entry : *_all_bucket)
+    for (const auto& timeline_it : *_timelines)
     {
-      if (participant_filter.ignore(entry->participant))
-        continue;
-
-      if (!checked[entry->participant].insert(entry->route_id).second)
-        continue;
-
-      inspector.inspect(entry.get(), relevant);
+      const Entries& timeline = *timeline_it.second;
+      inspect_entries(
+        relevant,
+        participant_filter,
+        inspector,
+        timeline.begin(),
+        timeline.end(),
+        checked);
     }
   }
 
@@ -238,20 +600,17 @@ protected:
     const auto relevant =
       [&spacetime_data](const Entry& entry) -> bool
       {
-        return rmf_traffic::internal::detect_conflicts(
-          entry.description->profile(),
-          entry.route->trajectory(),
-          spacetime_data);
+        return detect_conflicts(entry, spacetime_data);
       };
 
     for (const Region& region : regions)
     {
       const std::string& map = region.get_map();
-      const auto map_it = _timelines.find(map);
-      if (map_it == _timelines.end())
+      const auto map_it = _timelines->find(map);
+      if (map_it == _timelines->end())
         continue;
 
-      const Entries& timeline = map_it->second;
+      const Entries& timeline = *map_it->second;
       const Time* const lower_time_bound = region.get_lower_time_bound();
       const Time* const upper_time_bound = region.get_upper_time_bound();
 
@@ -276,13 +635,17 @@ protected:
         spacetime_data.pose = space_it->get_pose();
         spacetime_data.shape = space_it->get_shape();
 
+        const BoundingBox region_box =
+          rmf_traffic::internal::get_region_bounding_box(spacetime_data);
+
         inspect_entries(
           relevant,
           participant_filter,
           inspector,
           timeline_begin,
           timeline_end,
-          checked);
+          checked,
+          &region_box);
       }
     }
   }
@@ -301,12 +664,11 @@ protected:
     const auto relevant = [&lower_time_bound, &upper_time_bound](
       const Entry& entry) -> bool
       {
-        const Trajectory& trajectory = entry.route->trajectory();
-        assert(trajectory.start_time());
-        if (lower_time_bound && *trajectory.finish_time() < *lower_time_bound)
+        assert(entry.route->trajectory().start_time());
+        if (lower_time_bound && get_finish_time(entry) < *lower_time_bound)
           return false;
 
-        if (upper_time_bound && *upper_time_bound < *trajectory.start_time())
+        if (upper_time_bound && *upper_time_bound < get_start_time(entry))
           return false;
 
         return true;
@@ -314,9 +676,9 @@ protected:
 
     if (timespan.all_maps())
     {
-      for (const auto& timeline_it : _timelines)
+      for (const auto& timeline_it : *_timelines)
       {
-        const Entries& timeline = timeline_it.second;
+        const Entries& timeline = *timeline_it.second;
         inspect_entries(
           relevant,
           participant_filter,
@@ -331,11 +693,11 @@ protected:
       const auto& maps = timespan.maps();
       for (const std::string& map : maps)
       {
-        const auto map_it = _timelines.find(map);
-        if (map_it == _timelines.end())
+        const auto map_it = _timelines->find(map);
+        if (map_it == _timelines->end())
           continue;
 
-        const Entries& timeline = map_it->second;
+        const Entries& timeline = *map_it->second;
         inspect_entries(
           relevant,
           participant_filter,
@@ -354,25 +716,35 @@ protected:
     Inspector& inspector,
     const typename Entries::const_iterator& timeline_begin,
     const typename Entries::const_iterator& timeline_end,
-    Checked& checked) const
+    Checked& checked,
+    const BoundingBox* broad_phase = nullptr) const
   {
     auto timeline_it = timeline_begin;
     for (; timeline_it != timeline_end; ++timeline_it)
     {
-      const Bucket& bucket = *timeline_it->second;
-
-      auto entry_it = bucket.begin();
-      for (; entry_it != bucket.end(); ++entry_it)
+      for (const auto& chunk : timeline_it->second->chunks)
       {
-        const Entry* entry = entry_it->get();
-
-        if (participant_filter.ignore(entry->participant))
-          continue;
-
-        if (!checked[entry->participant].insert(entry->route_id).second)
-          continue;
-
-        inspector.inspect(entry, relevant);
+        for (std::size_t i = 0; i < chunk->entries.size(); ++i)
+        {
+          // NOTE: An entry is only skipped by the broad-phase before it gets
+          // marked as checked, so it can still be inspected for a different
+          // space that it does overlap with. Delays never change the path of a
+          // route, so the box of an entry also bounds every other version of
+          // its route.
+          if (broad_phase
+            && !rmf_traffic::internal::overlap(*broad_phase, chunk->boxes[i]))
+            continue;
+
+          const Entry* entry = chunk->entries[i].get();
+
+          if (participant_filter.ignore(entry->participant))
+            continue;
+
+          if (!checked.insert(chunk->routes[i]))
+            continue;
+
+          inspector.inspect(entry, relevant);
+        }
       }
     }
   }
@@ -399,8 +771,20 @@ protected:
     return ++end;
   }
 
-  MapNameToEntries _timelines;
-  BucketPtr _all_bucket;
+  TimelineView(MapNameToEntriesPtr timelines, BucketPtr unplaced)
+  : _timelines(std::move(timelines)),
+    _unplaced(std::move(unplaced))
+  {
+    // Do nothing
+  }
+
+  MapNameToEntriesPtr _timelines;
+
+  // Entries that do not have a route (e.g. erasures) cannot be placed in any
+  // bucket, so they are kept here instead. They are never inspected directly,
+  // but a snapshot needs to keep them alive so that following the history of an
+  // entry will give the same result for as long as the snapshot exists.
+  BucketPtr _unplaced;
 };
 
 //==============================================================================
@@ -413,47 +797,86 @@ public:
   using Bucket = typename TimelineView<Entry>::Bucket;
   using BucketPtr = typename TimelineView<Entry>::BucketPtr;
   using Entries = typename TimelineView<Entry>::Entries;
+  using EntriesPtr = typename TimelineView<Entry>::EntriesPtr;
+  using MapNameToEntries = typename TimelineView<Entry>::MapNameToEntries;
+  using BoundingBox = typename TimelineView<Entry>::BoundingBox;
 
   /// This Timeline::Handle class allows us to use RAII so that when an Entry is
   /// deleted it will automatically be removed from any of its timeline buckets.
   struct Handle
   {
     Handle(
-      ConstEntryPtr entry,
-      std::vector<std::weak_ptr<Bucket>> buckets)
-    : _entry(std::move(entry)),
-      _buckets(std::move(buckets))
+      std::weak_ptr<Timeline*> timeline,
+      ConstEntryPtr entry)
+    : _timeline(std::move(timeline)),
+      _entry(std::move(entry))
     {
       // Do nothing
     }
 
+    // The buckets refer to the placement of this handle, so it must stay in
+    // place
+    Handle(const Handle&) = delete;
+    Handle& operator=(const Handle&) = delete;
+
     ~Handle()
     {
-      for (const auto& b : _buckets)
-      {
-        BucketPtr bucket = b.lock();
-        if (!bucket)
-          continue;
+      // If the timeline has already been destroyed, then there is nothing for
+      // us to clean up.
+      const auto timeline = _timeline.lock();
+      if (!timeline)
+        return;
 
-        const auto it = std::find(bucket->begin(), bucket->end(), _entry);
-        if (it != bucket->end())
-          bucket->erase(it);
-      }
+      (*timeline)->_remove(_entry, _placement);
     }
 
   private:
+    friend class Timeline;
+    std::weak_ptr<Timeline*> _timeline;
     ConstEntryPtr _entry;
-    std::vector<std::weak_ptr<Bucket>> _buckets;
+    TimelinePlacement _placement;
   };
 
+  Timeline(const BucketOptions& options = BucketOptions())
+  : _bucket_duration(options.duration()),
+    // This is used during the creation of the first bucket for a timeline.
+    // It's a very minor optimization that avoids making a bucket that will
+    // potentially not be very useful.
+    _partial_bucket_duration(options.duration() * 5 / 6),
+    _split_threshold(options.split_threshold()),
+    _min_bucket_duration(options.min_duration()),
+    _merge_threshold(options.merge_threshold()),
+    _max_bucket_duration(options.max_duration()),
+    _anchor(std::make_shared<Timeline*>(this))
+  {
+    // *INDENT-OFF*
+    if (_bucket_duration <= Duration(0))
+    {
+      throw std::runtime_error(
+        "[rmf_traffic::schedule::Timeline] Bucket duration must be positive, "
+        "but a value of [" + std::to_string(_bucket_duration.count())
+        + "ns] was given");
+    }
+
+    if (_split_threshold && _merge_threshold
+        && *_split_threshold <= *_merge_threshold)
+    {
+      throw std::runtime_error(
+        "[rmf_traffic::schedule::Timeline] The merge threshold ["
+        + std::to_string(*_merge_threshold) + "] must be less than the split "
+        "threshold [" + std::to_string(*_split_threshold) + "]");
+    }
+    // *INDENT-ON*
+  }
+
+  // The handles refer back to this Timeline, so it must stay in place
+  Timeline(const Timeline&) = delete;
+  Timeline& operator=(const Timeline&) = delete;
+
   /// Insert a new entry into the timeline
   std::shared_ptr<Handle> insert(
     const std::shared_ptr<Entry>& entry)
   {
-    std::vector<std::weak_ptr<Bucket>> buckets;
-    this->_all_bucket->push_back(entry);
-    buckets.emplace_back(this->_all_bucket);
-
     if (entry->route && entry->route->trajectory().size() < 2)
     {
       throw std::runtime_error(
@@ -462,88 +885,466 @@ public:
         + std::to_string(entry->route->trajectory().size()) + "] is illegal!");
     }
 
+    auto handle = std::make_shared<Handle>(_anchor, entry);
+    TimelinePlacement* const placement = &handle->_placement;
+
+    if (!entry->route)
+    {
+      // The key, box, and route index of an unplaced entry are never used
+      _push_back(
+        _modify(this->_unplaced), Time(), entry, BoundingBox(), 0, placement);
+    }
+
     if (entry->route && entry->route->trajectory().start_time())
     {
 
-      const Time start_time = *entry->route->trajectory().start_time();
-      const Time finish_time = *entry->route->trajectory().finish_time();
+      const Time start_time = get_start_time(*entry);
+      const Time finish_time = get_finish_time(*entry);
       const std::string& map_name = entry->route->map();
 
-      const auto map_it = this->_timelines.insert(
-        std::make_pair(map_name, Entries())).first;
+      MapNameToEntries& timelines = _modify(this->_timelines);
+      const auto map_it = timelines.insert(
+        std::make_pair(map_name, EntriesPtr())).first;
 
-      Entries& timeline = map_it->second;
+      if (!map_it->second)
+        map_it->second = std::make_shared<Entries>();
+
+      Entries& timeline = _modify(map_it->second);
 
       const auto start_it = get_timeline_iterator(timeline, start_time);
       const auto end_it = ++get_timeline_iterator(timeline, finish_time);
 
+      // Delays do not change the path of a route, so we can use the route's
+      // own trajectory for the box.
+      const BoundingBox box =
+        rmf_traffic::internal::get_vicinity_bounding_box(
+        entry->description->profile(), entry->route->trajectory());
+
+      const std::size_t route = _acquire_route_index(entry);
+
       for (auto it = start_it; it != end_it; ++it)
       {
-        it->second->push_back(entry);
-        buckets.emplace_back(it->second);
+        _push_back(
+          _modify(it->second), it->first, entry, box, route, placement);
       }
+
+      if (_split_threshold)
+      {
+        for (auto it = start_it; it != end_it; ++it)
+          _split_bucket(timeline, it);
+      }
+
+      _merge_buckets(timeline, start_time, finish_time);
     }
 
-    return std::make_shared<Handle>(entry, std::move(buckets));
+    return handle;
   }
 
   void cull(const Time time)
   {
-    for (auto& pair : this->_timelines)
+    MapNameToEntries& timelines = _modify(this->_timelines);
+    for (auto& pair : timelines)
     {
-      auto& timeline = pair.second;
-
       // NOTE(MXG): It is not an error that we are using get_timeline_begin() to
       // find the ending iterator. We want to stop just before the first bucket
       // that contains the cull time, because we only want to erase times that
       // come before it.
       const auto end_it =
-        TimelineView<Entry>::get_timeline_begin(timeline, &time);
+        TimelineView<Entry>::get_timeline_begin(*pair.second, &time);
+
+      if (end_it != pair.second->begin())
+      {
+        Entries& timeline = _modify(pair.second);
+        const auto cull_end =
+          TimelineView<Entry>::get_timeline_begin(timeline, &time);
 
-      if (end_it != timeline.begin())
-        timeline.erase(timeline.begin(), end_it);
+        for (auto it = timeline.begin(); it != cull_end; ++it)
+          _erase_placements(*it->second, it->first);
+
+        timeline.erase(timeline.begin(), cull_end);
+      }
     }
   }
 
   /// Create an immutable snapshot of the current timeline. A single instance of
   /// the snapshot can be safely used by multiple threads simultaneously.
+  ///
+  /// The snapshot shares all of its data with this timeline, so creating it
+  /// costs O(1). Whenever this timeline gets modified afterwards, only the
+  /// parts of the data that are being changed will be copied.
   std::shared_ptr<const TimelineView<const Entry>> snapshot() const
   {
-    // TODO(MXG): Consider whether we could use plain std::vector<Bucket>
-    // instances instead of std::vector<std::shared_ptr<Bucket>> in the snapshot
-    // to reduce how many heap allocations are needed, and to lessen the cache
-    // misses. The tricky part is this may cost us more when copying the maps.
+    return std::shared_ptr<const TimelineView<const Entry>>(
+      new TimelineView<const Entry>(this->_timelines, this->_unplaced));
+  }
 
-    // TODO(MXG): Consider whether there's a safe way to cache a snapshot. The
-    // main problem I see is that we don't have a good way of knowing when an
-    // entry gets removed right now, so we wouldn't know to update the snapshot
-    // when an entry gets taken out.
+private:
 
-    std::shared_ptr<TimelineView<const Entry>> result =
-      std::make_shared<TimelineView<const Entry>>();
+  //============================================================================
+  /// Get a version of the data pointed to by ptr which is safe to modify. If
+  /// any snapshot is currently sharing the data, then ptr will be replaced by a
+  /// copy of the data. The copy is shallow, so the layers beneath it will
+  /// remain shared until they get modified.
+  template<typename T>
+  static T& _modify(std::shared_ptr<T>& ptr)
+  {
+    // NOTE: Snapshots can only be created by this timeline, and only the
+    // thread that is modifying this timeline is allowed to create snapshots. So
+    // if the use count is 1, nothing else can begin sharing this data while we
+    // are modifying it. If a snapshot gets released by another thread while we
+    // are checking, then the worst case is that we make an unnecessary copy.
+    if (ptr.use_count() > 1)
+    {
+      ptr = std::make_shared<T>(*ptr);
+      return *ptr;
+    }
 
-    // Make a deep copy of the buckets so that adding/removing entries from the
-    // source bucket does not impact the snapshot
-    result->_timelines = this->_timelines;
-    for (auto& map_scope : result->_timelines)
+    // use_count() is a relaxed load, so seeing 1 does not order us after the
+    // reads that another thread made through the snapshot it just released.
+    // The acquire fence pairs with the release done by that thread's
+    // decrement, so our writes cannot race with its last reads.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return *ptr;
+  }
+
+  //============================================================================
+  void _remove(const ConstEntryPtr& entry, TimelinePlacement& placement)
+  {
+    if (entry->route)
+      _release_route_index(entry);
+
+    if (placement.slots.empty())
+      return;
+
+    if (!entry->route)
     {
-      for (auto& time_scope : map_scope.second)
+      const auto& slot = placement.slots.front();
+      _erase_slot(this->_unplaced, slot.first, slot.second);
+      placement.slots.clear();
+      return;
+    }
+
+    const auto map_it = this->_timelines->find(entry->route->map());
+    assert(map_it != this->_timelines->end());
+    if (map_it == this->_timelines->end())
+      return;
+
+    MapNameToEntries& timelines = _modify(this->_timelines);
+    Entries& timeline = _modify(timelines.at(map_it->first));
+
+    const Time lower = placement.slots.front().first;
+    const Time upper = placement.slots.back().first;
+
+    // The buckets of an entry are always next to each other, so we can step
+    // through them instead of looking up each one.
+    auto it = timeline.find(lower);
+    for (const auto& slot : placement.slots)
+    {
+      while (it->first < slot.first)
+        ++it;
+
+      assert(it != timeline.end() && it->first == slot.first);
+      _erase_slot(it->second, slot.first, slot.second);
+    }
+
+    placement.slots.clear();
+    _merge_buckets(timeline, lower, upper);
+  }
+
+  //============================================================================
+  /// Get the route index for this entry. Every version of a route shares the
+  /// same index, so that queries only inspect the route once.
+  std::size_t _acquire_route_index(const ConstEntryPtr& entry)
+  {
+    RouteIndex& route =
+      _route_indices[entry->participant][entry->route_id];
+
+    if (route.count++ > 0)
+      return route.index;
+
+    if (_free_route_indices.empty())
+    {
+      route.index = _next_route_index++;
+    }
+    else
+    {
+      route.index = _free_route_indices.back();
+      _free_route_indices.pop_back();
+    }
+
+    return route.index;
+  }
+
+  //============================================================================
+  void _release_route_index(const ConstEntryPtr& entry)
+  {
+    const auto p_it = _route_indices.find(entry->participant);
+    assert(p_it != _route_indices.end());
+    if (p_it == _route_indices.end())
+      return;
+
+    auto& routes = p_it->second;
+    const auto r_it = routes.find(entry->route_id);
+    assert(r_it != routes.end());
+    if (r_it == routes.end())
+      return;
+
+    // NOTE: The index only gets recycled once every version of the route
+    // has been removed from the buckets of this timeline. Any snapshot that
+    // still holds an old version of the route was created before the new owner
+    // of the index could be inserted, so a snapshot never contains two routes
+    // with the same index.
+    if (--r_it->second.count > 0)
+      return;
+
+    _free_route_indices.push_back(r_it->second.index);
+    routes.erase(r_it);
+    if (routes.empty())
+      _route_indices.erase(p_it);
+  }
+
+  //============================================================================
+  /// Add an entry to the end of the bucket without recording its placement.
+  ///
+  /// \return the index of the entry in the bucket
+  static std::size_t _append(
+    Bucket& bucket,
+    const ConstEntryPtr& entry,
+    const BoundingBox& box,
+    const std::size_t route,
+    TimelinePlacement* placement)
+  {
+    const std::size_t index = bucket.size();
+    if (index % Bucket::Capacity == 0)
+    {
+      auto chunk = std::make_shared<typename Bucket::Chunk>();
+      chunk->entries.reserve(Bucket::Capacity);
+      chunk->boxes.reserve(Bucket::Capacity);
+      chunk->routes.reserve(Bucket::Capacity);
+      chunk->placements.reserve(Bucket::Capacity);
+      bucket.chunks.push_back(std::move(chunk));
+    }
+
+    auto& chunk = _modify(bucket.chunks.back());
+    chunk.entries.push_back(entry);
+    chunk.boxes.push_back(box);
+    chunk.routes.push_back(route);
+    chunk.placements.push_back(placement);
+    return index;
+  }
+
+  //============================================================================
+  static void _push_back(
+    Bucket& bucket,
+    const Time key,
+    const ConstEntryPtr& entry,
+    const BoundingBox& box,
+    const std::size_t route,
+    TimelinePlacement* placement)
+  {
+    placement->insert(key, _append(bucket, entry, box, route, placement));
+  }
+
+  //============================================================================
+  /// Remove the entry at the index of the bucket by moving the last entry of
+  /// the bucket into its place. Only the chunks of those two entries get
+  /// modified.
+  static void _erase_slot(
+    BucketPtr& bucket_ptr,
+    const Time key,
+    const std::size_t index)
+  {
+    Bucket& bucket = _modify(bucket_ptr);
+    assert(index < bucket.size());
+
+    const std::size_t last = bucket.size() - 1;
+    auto& last_chunk = _modify(bucket.chunks.back());
+    if (index != last)
+    {
+      auto& chunk = _modify(bucket.chunks[index / Bucket::Capacity]);
+      const std::size_t i = index % Bucket::Capacity;
+      const std::size_t j = last % Bucket::Capacity;
+      chunk.entries[i] = std::move(last_chunk.entries[j]);
+      chunk.boxes[i] = last_chunk.boxes[j];
+      chunk.routes[i] = last_chunk.routes[j];
+      chunk.placements[i] = last_chunk.placements[j];
+      chunk.placements[i]->set(key, index);
+    }
+
+    last_chunk.entries.pop_back();
+    last_chunk.boxes.pop_back();
+    last_chunk.routes.pop_back();
+    last_chunk.placements.pop_back();
+    if (last_chunk.entries.empty())
+      bucket.chunks.pop_back();
+  }
+
+  //============================================================================
+  /// Forget the placements of every entry in a bucket that is being removed
+  /// from the timeline.
+  static void _erase_placements(const Bucket& bucket, const Time key)
+  {
+    for (const auto& chunk : bucket.chunks)
+    {
+      for (TimelinePlacement* const placement : chunk->placements)
+        placement->erase(key);
+    }
+  }
+
+  //============================================================================
+  /// Get the time where the range of the bucket begins. The range of a bucket
+  /// ends at its key.
+  Time _get_bucket_begin(
+    const Entries& timeline,
+    const typename Entries::const_iterator& it) const
+  {
+    if (it == timeline.begin())
+      return it->first - _bucket_duration;
+
+    return std::prev(it)->first;
+  }
+
+  //============================================================================
+  /// Split the bucket in half if it has grown past the split threshold.
+  void _split_bucket(Entries& timeline, const typename Entries::iterator& it)
+  {
+    const Bucket& original = *it->second;
+    if (original.size() <= *_split_threshold)
+      return;
+
+    const Time begin = _get_bucket_begin(timeline, it);
+    const Time end = it->first;
+    if (end - begin < 2 * _min_bucket_duration)
+      return;
+
+    const Time middle = begin + (end - begin) / 2;
+    const auto in_lower = [middle](const ConstEntryPtr& entry)
       {
-        auto& bucket = time_scope.second;
-        bucket = std::make_shared<Bucket>(*bucket);
-      }
+        return get_start_time(*entry) <= middle;
+      };
+
+    const auto in_upper = [middle](const ConstEntryPtr& entry)
+      {
+        return middle < get_finish_time(*entry);
+      };
+
+    // If every entry spans the whole bucket, then splitting will not help
+    const auto spans = [&](const ConstEntryPtr& entry)
+      {
+        return in_lower(entry) && in_upper(entry);
+      };
+
+    const std::size_t N = original.size();
+    bool all_span = true;
+    for (std::size_t i = 0; i < N && all_span; ++i)
+      all_span = spans(original.entry(i));
+
+    if (all_span)
+      return;
+
+    Bucket lower;
+    Bucket upper;
+    for (std::size_t i = 0; i < N; ++i)
+    {
+      const auto& entry = original.entry(i);
+      const BoundingBox& box = original.box(i);
+      TimelinePlacement* const placement = original.placement(i);
+      const std::size_t route = original.route(i);
+      if (in_lower(entry))
+        _push_back(lower, middle, entry, box, route, placement);
+
+      if (in_upper(entry))
+        placement->set(end, _append(upper, entry, box, route, placement));
+      else
+        placement->erase(end);
     }
 
-    result->_all_bucket = std::make_shared<Bucket>(*result->_all_bucket);
+    timeline.insert(
+      it, std::make_pair(middle, std::make_shared<Bucket>(std::move(lower))));
 
-    return result;
+    // The original bucket might be shared by a snapshot, so we replace it
+    // instead of modifying it.
+    it->second = std::make_shared<Bucket>(std::move(upper));
   }
 
-private:
+  //============================================================================
+  /// Merge any neighboring buckets around the range [lower, upper] which fall
+  /// under the merge threshold.
+  void _merge_buckets(Entries& timeline, const Time lower, const Time upper)
+  {
+    if (!_merge_threshold)
+      return;
+
+    auto it = timeline.lower_bound(lower);
+    if (it != timeline.begin())
+      --it;
+
+    while (it != timeline.end())
+    {
+      const auto next = std::next(it);
+      if (next == timeline.end())
+        return;
+
+      // This is the last bucket whose range overlaps [lower, upper]
+      const bool last = upper <= it->first;
+
+      // If the buckets get merged, then it will be erased and next will hold
+      // the merged bucket, which may be able to merge with its own successor.
+      _merge_bucket_into_next(timeline, it, next);
+      if (last)
+        return;
+
+      it = next;
+    }
+  }
 
   //============================================================================
-  static typename Entries::iterator get_timeline_iterator(
-    Entries& timeline, const Time time)
+  void _merge_bucket_into_next(
+    Entries& timeline,
+    const typename Entries::iterator& it,
+    const typename Entries::iterator& next)
+  {
+    // NOTE: We never merge away the first bucket. New buckets get added in
+    // front of the first bucket under the assumption that its range spans no
+    // more than one bucket duration, so the first bucket must not grow.
+    if (it == timeline.begin())
+      return;
+
+    if (_max_bucket_duration < next->first - std::prev(it)->first)
+      return;
+
+    if (*_merge_threshold < next->second->size())
+      return;
+
+    // Entries of this bucket which finish after its key will also be in the
+    // next bucket, so we only need to move the rest of them.
+    const Bucket& bucket = *it->second;
+    std::vector<std::size_t> moving;
+    for (std::size_t i = 0; i < bucket.size(); ++i)
+    {
+      if (get_finish_time(*bucket.entry(i)) <= it->first)
+        moving.push_back(i);
+    }
+
+    if (*_merge_threshold < next->second->size() + moving.size())
+      return;
+
+    _erase_placements(bucket, it->first);
+
+    Bucket& merged = _modify(next->second);
+    for (const std::size_t i : moving)
+    {
+      _push_back(
+        merged, next->first, bucket.entry(i), bucket.box(i),
+        bucket.route(i), bucket.placement(i));
+    }
+
+    timeline.erase(it);
+  }
+
+  //============================================================================
+  typename Entries::iterator get_timeline_iterator(
+    Entries& timeline, const Time time) const
   {
     auto start_it = timeline.lower_bound(time);
 
@@ -556,7 +1357,7 @@ private:
         return timeline.insert(
           timeline.end(),
           std::make_pair(
-            time + PartialBucketDuration,
+            time + _partial_bucket_duration,
             std::make_shared<Bucket>()));
       }
 
@@ -566,24 +1367,53 @@ private:
         last_it = timeline.insert(
           timeline.end(),
           std::make_pair(
-            last_it->first + BucketDuration,
+            last_it->first + _bucket_duration,
             std::make_shared<Bucket>()));
       }
 
       return last_it;
     }
 
-    while (time + BucketDuration < start_it->first)
+    // If this is not the first bucket, then the bucket before it ends before
+    // this time, so the range of this bucket already includes this time.
+    if (start_it != timeline.begin())
+      return start_it;
+
+    while (time + _bucket_duration < start_it->first)
     {
       start_it = timeline.insert(
         start_it,
         std::make_pair(
-          start_it->first - BucketDuration,
+          start_it->first - _bucket_duration,
           std::make_shared<Bucket>()));
     }
 
     return start_it;
   }
+
+  Duration _bucket_duration;
+  Duration _partial_bucket_duration;
+  rmf_utils::optional<std::size_t> _split_threshold;
+  Duration _min_bucket_duration;
+  rmf_utils::optional<std::size_t> _merge_threshold;
+  Duration _max_bucket_duration;
+
+  struct RouteIndex
+  {
+    std::size_t index = 0;
+
+    // The number of entries in this timeline that belong to the route
+    std::size_t count = 0;
+  };
+
+  std::unordered_map<ParticipantId, std::unordered_map<RouteId, RouteIndex>>
+  _route_indices;
+  std::vector<std::size_t> _free_route_indices;
+  std::size_t _next_route_index = 0;
+
+  // Handles hold a weak reference to this anchor so that they can safely
+  // outlive the timeline that created them.
+  std::shared_ptr<Timeline*> _anchor;
 };
 
 //==============================================================================
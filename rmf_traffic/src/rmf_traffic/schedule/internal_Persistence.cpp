@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "internal_Persistence.hpp"
+
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rmf_traffic {
+namespace schedule {
+namespace persistence {
+
+namespace {
+
+//==============================================================================
+constexpr char LogMagic[] = "RMFTLOG1";
+constexpr char SnapshotMagic[] = "RMFTSNP1";
+constexpr std::size_t MagicSize = sizeof(LogMagic) - 1;
+
+//==============================================================================
+enum class ShapeType : uint8_t
+{
+  None = 0,
+  Circle = 1
+};
+
+//==============================================================================
+[[noreturn]] void throw_file_error(
+  const std::string& action,
+  const std::string& path)
+{
+  // *INDENT-OFF*
+  throw std::runtime_error(
+    "[rmf_traffic::schedule::persistence] Failed to " + action + " ["
+    + path + "]: " + std::strerror(errno));
+  // *INDENT-ON*
+}
+
+//==============================================================================
+rmf_utils::optional<std::string> read_file(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return rmf_utils::nullopt;
+
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+//==============================================================================
+void flush_file(std::FILE* file, const std::string& path, const bool sync)
+{
+  if (std::fflush(file) != 0)
+    throw_file_error("write", path);
+
+  if (sync && ::fsync(::fileno(file)) != 0)
+    throw_file_error("sync", path);
+}
+
+//==============================================================================
+void sync_parent_directory(const std::string& path)
+{
+  const auto slash = path.find_last_of('/');
+  const std::string directory =
+    slash == std::string::npos ? "." : path.substr(0, slash + 1);
+
+  const int fd = ::open(directory.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw_file_error("open", directory);
+
+  const int result = ::fsync(fd);
+  ::close(fd);
+  if (result != 0)
+    throw_file_error("sync", directory);
+}
+
+//==============================================================================
+/// Write a new file next to the path and then move it over the path, so that
+/// readers will either see the old file or the complete new one.
+///
+/// Each call writes to its own uniquely named temporary file, so two writers,
+/// or a temporary file left behind by a crash, can never clobber the contents
+/// before they are moved into place. mkstemp only lets the owner read and write
+/// the new file, which is what we want for the schedule's own records.
+void replace_file(
+  const std::string& path,
+  const std::string& contents,
+  const bool sync)
+{
+  std::string temp_template = path + ".tmp.XXXXXX";
+  const int fd = ::mkstemp(&temp_template[0]);
+  if (fd < 0)
+    throw_file_error("create a temporary file for", path);
+
+  const std::string temp_path = temp_template;
+  std::FILE* file = ::fdopen(fd, "wb");
+  if (!file)
+  {
+    ::close(fd);
+    std::remove(temp_path.c_str());
+    throw_file_error("open", temp_path);
+  }
+
+  const bool written =
+    std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  const bool flushed = written && std::fflush(file) == 0
+    && (!sync || ::fsync(::fileno(file)) == 0);
+  const bool closed = std::fclose(file) == 0;
+
+  if (!flushed || !closed)
+  {
+    const int error = errno;
+    std::remove(temp_path.c_str());
+    errno = error;
+    throw_file_error("write", temp_path);
+  }
+
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+  {
+    const int error = errno;
+    std::remove(temp_path.c_str());
+    errno = error;
+    throw_file_error("rename", temp_path);
+  }
+
+  if (sync)
+    sync_parent_directory(path);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+void BinaryWriter::u8(const uint8_t value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::u16(const uint16_t value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::u32(const uint32_t value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::u64(const uint64_t value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::i64(const int64_t value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::f64(const double value)
+{
+  _raw(&value, sizeof(value));
+}
+
+//==============================================================================
+void BinaryWriter::string(const std::string& value)
+{
+  u64(value.size());
+  _data.append(value);
+}
+
+//==============================================================================
+void BinaryWriter::time(const Time value)
+{
+  duration(value.time_since_epoch());
+}
+
+//==============================================================================
+void BinaryWriter::duration(const Duration value)
+{
+  i64(value.count());
+}
+
+//==============================================================================
+void BinaryWriter::trajectory(const Trajectory& value)
+{
+  u64(value.size());
+  for (const auto& waypoint : value)
+  {
+    time(waypoint.time());
+
+    const Eigen::Vector3d p = waypoint.position();
+    const Eigen::Vector3d v = waypoint.velocity();
+    for (int i = 0; i < 3; ++i)
+      f64(p[i]);
+
+    for (int i = 0; i < 3; ++i)
+      f64(v[i]);
+  }
+}
+
+//==============================================================================
+void BinaryWriter::route(const Route& value)
+{
+  string(value.map());
+  trajectory(value.trajectory());
+}
+
+//==============================================================================
+void BinaryWriter::description(const ParticipantDescription& value)
+{
+  string(value.name());
+  string(value.owner());
+  u16(static_cast<uint16_t>(value.responsiveness()));
+  _shape(value.profile().footprint());
+  _shape(value.profile().vicinity());
+}
+
+//==============================================================================
+const std::string& BinaryWriter::data() const
+{
+  return _data;
+}
+
+//==============================================================================
+void BinaryWriter::clear()
+{
+  _data.clear();
+}
+
+//==============================================================================
+void BinaryWriter::_raw(const void* value, const std::size_t size)
+{
+  _data.append(static_cast<const char*>(value), size);
+}
+
+//==============================================================================
+void BinaryWriter::_shape(const geometry::ConstFinalConvexShapePtr& shape)
+{
+  if (!shape)
+  {
+    u8(static_cast<uint8_t>(ShapeType::None));
+    return;
+  }
+
+  // NOTE: Circles are the only shapes that are fully supported right now,
+  // so they are the only ones that we know how to save.
+  const auto* circle =
+    dynamic_cast<const geometry::Circle*>(&shape->source());
+  if (!circle)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[rmf_traffic::schedule::persistence] Only circle shapes can be saved "
+      "in a participant profile");
+    // *INDENT-ON*
+  }
+
+  u8(static_cast<uint8_t>(ShapeType::Circle));
+  f64(circle->get_radius());
+}
+
+//==============================================================================
+BinaryReader::BinaryReader(const std::string& data)
+: _data(data)
+{
+  // Do nothing
+}
+
+//==============================================================================
+uint8_t BinaryReader::u8()
+{
+  uint8_t value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+uint16_t BinaryReader::u16()
+{
+  uint16_t value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+uint32_t BinaryReader::u32()
+{
+  uint32_t value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+uint64_t BinaryReader::u64()
+{
+  uint64_t value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+int64_t BinaryReader::i64()
+{
+  int64_t value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+double BinaryReader::f64()
+{
+  double value;
+  _raw(&value, sizeof(value));
+  return value;
+}
+
+//==============================================================================
+std::string BinaryReader::string()
+{
+  const uint64_t size = u64();
+  if (_data.size() - _position < size)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[rmf_traffic::schedule::persistence] Unexpected end of data");
+    // *INDENT-ON*
+  }
+
+  std::string value = _data.substr(_position, size);
+  _position += size;
+  return value;
+}
+
+//==============================================================================
+Time BinaryReader::time()
+{
+  return Time(duration());
+}
+
+//==============================================================================
+Duration BinaryReader::duration()
+{
+  return Duration(i64());
+}
+
+//==============================================================================
+Trajectory BinaryReader::trajectory()
+{
+  Trajectory value;
+  const uint64_t size = u64();
+  value.reserve(size);
+  for (uint64_t i = 0; i < size; ++i)
+  {
+    const Time t = time();
+
+    Eigen::Vector3d p;
+    Eigen::Vector3d v;
+    for (int j = 0; j < 3; ++j)
+      p[j] = f64();
+
+    for (int j = 0; j < 3; ++j)
+      v[j] = f64();
+
+    value.insert(t, p, v);
+  }
+
+  return value;
+}
+
+//==============================================================================
+ConstRoutePtr BinaryReader::route()
+{
+  std::string map = string();
+  return std::make_shared<Route>(std::move(map), trajectory());
+}
+
+//==============================================================================
+ParticipantDescription BinaryReader::description()
+{
+  std::string name = string();
+  std::string owner = string();
+  const auto responsiveness =
+    static_cast<ParticipantDescription::Rx>(u16());
+  auto footprint = _shape();
+  auto vicinity = _shape();
+
+  return ParticipantDescription{
+    std::move(name),
+    std::move(owner),
+    responsiveness,
+    Profile{std::move(footprint), std::move(vicinity)}
+  };
+}
+
+//==============================================================================
+bool BinaryReader::done() const
+{
+  return _position == _data.size();
+}
+
+//==============================================================================
+void BinaryReader::_raw(void* value, const std::size_t size)
+{
+  if (_data.size() - _position < size)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[rmf_traffic::schedule::persistence] Unexpected end of data");
+    // *INDENT-ON*
+  }
+
+  std::memcpy(value, _data.data() + _position, size);
+  _position += size;
+}
+
+//==============================================================================
+geometry::ConstFinalConvexShapePtr BinaryReader::_shape()
+{
+  const auto type = static_cast<ShapeType>(u8());
+  if (type == ShapeType::None)
+    return nullptr;
+
+  if (type == ShapeType::Circle)
+    return geometry::make_final_convex<geometry::Circle>(f64());
+
+  // *INDENT-OFF*
+  throw std::runtime_error(
+    "[rmf_traffic::schedule::persistence] Unrecognized shape type ["
+    + std::to_string(static_cast<int>(type)) + "]");
+  // *INDENT-ON*
+}
+
+//==============================================================================
+uint32_t checksum(const char* data, const std::size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+//==============================================================================
+LogWriter::LogWriter(std::string path, const Version base_version, bool sync)
+: _path(std::move(path)),
+  _file(nullptr),
+  _sync(sync)
+{
+  BinaryWriter header;
+  for (std::size_t i = 0; i < MagicSize; ++i)
+    header.u8(static_cast<uint8_t>(LogMagic[i]));
+  header.u64(base_version);
+
+  replace_file(_path, header.data(), _sync);
+
+  _file = std::fopen(_path.c_str(), "ab");
+  if (!_file)
+    throw_file_error("open", _path);
+}
+
+//==============================================================================
+LogWriter::~LogWriter()
+{
+  std::fclose(_file);
+}
+
+//==============================================================================
+void LogWriter::append(const std::string& record)
+{
+  const uint32_t header[2] = {
+    static_cast<uint32_t>(record.size()),
+    checksum(record.data(), record.size())
+  };
+
+  if (std::fwrite(header, sizeof(header), 1, _file) != 1
+    || std::fwrite(record.data(), 1, record.size(), _file) != record.size())
+  {
+    throw_file_error("write", _path);
+  }
+}
+
+//==============================================================================
+void LogWriter::commit()
+{
+  flush_file(_file, _path, _sync);
+}
+
+//==============================================================================
+rmf_utils::optional<LogContents> read_log(const std::string& path)
+{
+  const auto data = read_file(path);
+  if (!data)
+    return rmf_utils::nullopt;
+
+  const std::size_t header_size = MagicSize + sizeof(uint64_t);
+  if (data->size() < header_size
+    || data->compare(0, MagicSize, LogMagic) != 0)
+  {
+    return rmf_utils::nullopt;
+  }
+
+  LogContents contents;
+  std::memcpy(&contents.base_version, data->data() + MagicSize,
+    sizeof(uint64_t));
+
+  std::size_t position = header_size;
+  while (data->size() - position >= 2*sizeof(uint32_t))
+  {
+    uint32_t header[2];
+    std::memcpy(header, data->data() + position, sizeof(header));
+    position += sizeof(header);
+
+    const std::size_t size = header[0];
+    if (data->size() - position < size)
+      break;
+
+    const char* record = data->data() + position;
+    if (checksum(record, size) != header[1])
+      break;
+
+    contents.records.emplace_back(record, size);
+    position += size;
+  }
+
+  return contents;
+}
+
+//==============================================================================
+void write_snapshot(
+  const std::string& path,
+  const std::string& contents,
+  const bool sync)
+{
+  BinaryWriter file;
+  for (std::size_t i = 0; i < MagicSize; ++i)
+    file.u8(static_cast<uint8_t>(SnapshotMagic[i]));
+  file.string(contents);
+  file.u32(checksum(contents.data(), contents.size()));
+
+  replace_file(path, file.data(), sync);
+}
+
+//==============================================================================
+rmf_utils::optional<std::string> read_snapshot(const std::string& path)
+{
+  const auto data = read_file(path);
+  if (!data)
+    return rmf_utils::nullopt;
+
+  if (data->size() < MagicSize
+    || data->compare(0, MagicSize, SnapshotMagic) != 0)
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[rmf_traffic::schedule::persistence] The file [" + path
+      + "] is not a schedule snapshot");
+    // *INDENT-ON*
+  }
+
+  const std::string file = data->substr(MagicSize);
+  BinaryReader reader(file);
+  std::string contents = reader.string();
+  if (reader.u32() != checksum(contents.data(), contents.size()))
+  {
+    // *INDENT-OFF*
+    throw std::runtime_error(
+      "[rmf_traffic::schedule::persistence] The schedule snapshot [" + path
+      + "] is damaged");
+    // *INDENT-ON*
+  }
+
+  return contents;
+}
+
+//==============================================================================
+void make_directory(const std::string& path)
+{
+  if (::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    throw_file_error("create the directory", path);
+}
+
+} // namespace persistence
+} // namespace schedule
+} // namespace rmf_traffic
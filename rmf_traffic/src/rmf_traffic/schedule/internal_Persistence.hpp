@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_TRAFFIC__SCHEDULE__INTERNAL_PERSISTENCE_HPP
+#define SRC__RMF_TRAFFIC__SCHEDULE__INTERNAL_PERSISTENCE_HPP
+
+#include <rmf_traffic/Route.hpp>
+#include <rmf_traffic/schedule/ParticipantDescription.hpp>
+#include <rmf_traffic/schedule/Version.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace rmf_traffic {
+namespace schedule {
+namespace persistence {
+
+//==============================================================================
+/// Encodes values into a compact binary buffer. Values are written with the
+/// byte order of the machine, since the files that these buffers end up in can
+/// only be used on the machine that wrote them anyway (see PersistenceOptions).
+class BinaryWriter
+{
+public:
+
+  void u8(uint8_t value);
+  void u16(uint16_t value);
+  void u32(uint32_t value);
+  void u64(uint64_t value);
+  void i64(int64_t value);
+  void f64(double value);
+  void string(const std::string& value);
+  void time(Time value);
+  void duration(Duration value);
+  void trajectory(const Trajectory& value);
+  void route(const Route& value);
+  void description(const ParticipantDescription& value);
+
+  const std::string& data() const;
+
+  void clear();
+
+private:
+  void _raw(const void* value, std::size_t size);
+  void _shape(const geometry::ConstFinalConvexShapePtr& shape);
+
+  std::string _data;
+};
+
+//==============================================================================
+/// Decodes the values that were encoded by a BinaryWriter. An exception is
+/// thrown if the buffer ends before a value is complete.
+class BinaryReader
+{
+public:
+
+  BinaryReader(const std::string& data);
+
+  uint8_t u8();
+  uint16_t u16();
+  uint32_t u32();
+  uint64_t u64();
+  int64_t i64();
+  double f64();
+  std::string string();
+  Time time();
+  Duration duration();
+  Trajectory trajectory();
+  ConstRoutePtr route();
+  ParticipantDescription description();
+
+  /// True if every value in the buffer has been read
+  bool done() const;
+
+private:
+  void _raw(void* value, std::size_t size);
+  geometry::ConstFinalConvexShapePtr _shape();
+
+  const std::string& _data;
+  std::size_t _position = 0;
+};
+
+//==============================================================================
+/// A 32-bit FNV-1a hash, used to notice records that were only partly written.
+uint32_t checksum(const char* data, std::size_t size);
+
+//==============================================================================
+/// Appends records to a write-ahead log file. Each record is written as its
+/// size, its checksum, and then its contents.
+class LogWriter
+{
+public:
+
+  /// Start a new log file that follows the snapshot of the given version. Any
+  /// log that was already at this path gets replaced.
+  LogWriter(std::string path, Version base_version, bool sync);
+
+  LogWriter(const LogWriter&) = delete;
+  LogWriter& operator=(const LogWriter&) = delete;
+
+  ~LogWriter();
+
+  /// Append a record to the log. It might not reach the file until commit() is
+  /// called.
+  void append(const std::string& record);
+
+  /// Make sure that every record which was appended has reached the file, and
+  /// also the disk if syncing was requested.
+  void commit();
+
+private:
+  std::string _path;
+  std::FILE* _file;
+  bool _sync;
+};
+
+//==============================================================================
+struct LogContents
+{
+  /// The version of the snapshot that this log follows
+  Version base_version;
+
+  /// The contents of every complete record in the log
+  std::vector<std::string> records;
+};
+
+//==============================================================================
+/// Read the records of a log file. Reading stops at the first record that is
+/// incomplete or does not match its checksum, because that is where the writer
+/// of the log was interrupted.
+///
+/// \return nullopt if there is no log file at the path, or if the log file was
+/// interrupted before its header was written.
+rmf_utils::optional<LogContents> read_log(const std::string& path);
+
+//==============================================================================
+/// Write the contents of a snapshot file. The file is replaced atomically, so
+/// an interruption will leave the previous snapshot intact.
+void write_snapshot(const std::string& path, const std::string& contents,
+  bool sync);
+
+//==============================================================================
+/// Read the contents of a snapshot file.
+///
+/// \return nullopt if there is no snapshot file at the path. An exception is
+/// thrown if the file exists but is damaged.
+rmf_utils::optional<std::string> read_snapshot(const std::string& path);
+
+//==============================================================================
+/// Create a directory if it does not exist yet. Its parent must exist.
+void make_directory(const std::string& path);
+
+} // namespace persistence
+} // namespace schedule
+} // namespace rmf_traffic
+
+#endif // SRC__RMF_TRAFFIC__SCHEDULE__INTERNAL_PERSISTENCE_HPP
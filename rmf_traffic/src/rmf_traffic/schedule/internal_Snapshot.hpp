@@ -47,7 +47,7 @@ public:
     const Query::Spacetime& spacetime,
     const Query::Participants& participants) const final
   {
-    QueryInspector inspector;
+    QueryInspector inspector(_version);
     _timeline->inspect(spacetime, participants, inspector);
     return Viewer::View::Implementation::make_view(std::move(inspector.routes));
   }
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <rmf_traffic/DetectConflict.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include "src/rmf_traffic/Spline.hpp"
+#include "src/rmf_traffic/geometry/Box.hpp"
+
+#include <rmf_utils/catch.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+//==============================================================================
+/// The number of times that each check gets repeated to measure its latency
+const std::size_t Repetitions = 200;
+
+//==============================================================================
+/// Run a function many times and get the average time that each call took, in
+/// microseconds. The function gets called once before the timing begins, so
+/// the caches of the trajectories are already filled in.
+template<typename F>
+double time_per_call(F&& f)
+{
+  f();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < Repetitions; ++i)
+    f();
+  const auto finish = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::micro>(finish - start).count()
+    / static_cast<double>(Repetitions);
+}
+
+//==============================================================================
+enum class Motion
+{
+  Straight,
+  Curved,
+  Rotating,
+  Stationary
+};
+
+//==============================================================================
+const char* name(const Motion motion)
+{
+  switch (motion)
+  {
+    case Motion::Straight: return "straight";
+    case Motion::Curved: return "curved";
+    case Motion::Rotating: return "rotating";
+    case Motion::Stationary: return "stationary";
+  }
+
+  return "unknown";
+}
+
+//==============================================================================
+/// Make a trajectory that is at the origin five seconds after the start time.
+/// Every motion except Stationary drives along the x axis at 1 m/s.
+rmf_traffic::Trajectory make_trajectory(
+  const rmf_traffic::Time start_time,
+  const Motion motion)
+{
+  using namespace std::chrono_literals;
+  rmf_traffic::Trajectory trajectory;
+  switch (motion)
+  {
+    case Motion::Straight:
+    {
+      trajectory.insert(start_time, {-5.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+      trajectory.insert(start_time + 5s, {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+      trajectory.insert(start_time + 10s, {5.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+      break;
+    }
+    case Motion::Curved:
+    {
+      trajectory.insert(start_time, {-5.0, 0.0, 0.0}, {1.0, 0.5, 0.0});
+      trajectory.insert(start_time + 5s, {0.0, 0.0, 0.0}, {1.0, -0.5, 0.0});
+      trajectory.insert(start_time + 10s, {5.0, 0.0, 0.0}, {1.0, 0.5, 0.0});
+      break;
+    }
+    case Motion::Rotating:
+    {
+      const double w = M_PI/5.0;
+      trajectory.insert(start_time, {-5.0, 0.0, 0.0}, {1.0, 0.0, w});
+      trajectory.insert(start_time + 5s, {0.0, 0.0, M_PI}, {1.0, 0.0, w});
+      trajectory.insert(start_time + 10s, {5.0, 0.0, 2*M_PI}, {1.0, 0.0, w});
+      break;
+    }
+    case Motion::Stationary:
+    {
+      trajectory.insert(start_time, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+      trajectory.insert(start_time + 10s, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+      break;
+    }
+  }
+
+  return trajectory;
+}
+
+//==============================================================================
+/// Make a trajectory that drives along the y axis at 1 m/s and crosses the x
+/// axis at x five seconds after the start time.
+rmf_traffic::Trajectory make_crossing(
+  const rmf_traffic::Time start_time,
+  const double x)
+{
+  using namespace std::chrono_literals;
+  rmf_traffic::Trajectory trajectory;
+  trajectory.insert(start_time, {x, -5.0, M_PI/2.0}, {0.0, 1.0, 0.0});
+  trajectory.insert(start_time + 10s, {x, 5.0, M_PI/2.0}, {0.0, 1.0, 0.0});
+  return trajectory;
+}
+
+//==============================================================================
+struct NamedProfile
+{
+  std::string name;
+  rmf_traffic::Profile profile;
+};
+
+//==============================================================================
+std::vector<NamedProfile> make_profiles()
+{
+  using rmf_traffic::geometry::Box;
+  using rmf_traffic::geometry::Circle;
+  using rmf_traffic::geometry::make_final_convex;
+
+  const auto circle = make_final_convex<Circle>(0.5);
+  const auto big_circle = make_final_convex<Circle>(1.0);
+  const auto box = make_final_convex<Box>(1.0, 0.6);
+  const auto big_box = make_final_convex<Box>(2.0, 2.0);
+
+  return {
+    {"circle", rmf_traffic::Profile{circle}},
+    {"circle+vicinity", rmf_traffic::Profile{circle, big_circle}},
+    {"box", rmf_traffic::Profile{box}},
+    {"box+vicinity", rmf_traffic::Profile{box, big_box}}
+  };
+}
+
+} // anonymous namespace
+
+//==============================================================================
+TEST_CASE("Conflict detection latency", "[benchmark]")
+{
+  // Each motion gets checked against a robot that crosses its path. In the hit
+  // cases the robots meet at the origin. In the miss cases the other robot
+  // crosses three meters ahead of the motion, and the motion will not get there
+  // until the other robot is gone, so the narrow phase still needs to run. A
+  // stationary robot never gets there, so the broad phase rules out its misses.
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto profiles = make_profiles();
+
+  const rmf_traffic::Trajectory hit = make_crossing(start_time, 0.0);
+  const rmf_traffic::Trajectory miss = make_crossing(start_time, 3.0);
+
+  std::printf("\n%-11s %-16s %-16s %-5s %12s\n",
+    "motion", "profile", "other profile", "case", "us per check");
+
+  for (const auto motion :
+    {Motion::Straight, Motion::Curved, Motion::Rotating, Motion::Stationary})
+  {
+    const auto trajectory = make_trajectory(start_time, motion);
+    for (const auto& a : profiles)
+    {
+      for (const auto& b : profiles)
+      {
+        for (const bool expect_hit : {true, false})
+        {
+          const auto& other = expect_hit ? hit : miss;
+          bool conflict = false;
+          const double us = time_per_call(
+            [&]()
+            {
+              conflict = rmf_traffic::DetectConflict::between(
+                a.profile, trajectory, b.profile, other).has_value();
+            });
+
+          std::printf("%-11s %-16s %-16s %-5s %12.2f\n",
+            name(motion), a.name.c_str(), b.name.c_str(),
+            expect_hit ? "hit" : "miss", us);
+
+          CHECK(conflict == expect_hit);
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+TEST_CASE("Spline latency", "[benchmark]")
+{
+  // The building blocks that every conflict check relies on
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  std::printf("\n%-11s %-28s %12s\n", "motion", "operation", "us per call");
+
+  const rmf_traffic::Trajectory other = make_crossing(start_time, 0.0);
+  const rmf_traffic::Spline other_spline(++other.begin());
+
+  for (const auto motion :
+    {Motion::Straight, Motion::Curved, Motion::Rotating, Motion::Stationary})
+  {
+    const auto trajectory = make_trajectory(start_time, motion);
+    const auto it = ++trajectory.begin();
+    const rmf_traffic::Spline spline(it);
+    const auto t_mid = spline.start_time()
+      + (spline.finish_time() - spline.start_time())/2;
+
+    const auto print = [&](const char* operation, const double us)
+      {
+        std::printf("%-11s %-28s %12.2f\n", name(motion), operation, us);
+      };
+
+    print("construct", time_per_call(
+        [&]()
+        {
+          const rmf_traffic::Spline s(it);
+          (void)(s);
+        }));
+
+    Eigen::Vector3d p = Eigen::Vector3d::Zero();
+    print("compute_position", time_per_call(
+        [&]()
+        {
+          p += spline.compute_position(t_mid);
+        }));
+
+    print("to_fcl", time_per_call(
+        [&]()
+        {
+          const auto fcl_motion = spline.to_fcl(
+            spline.start_time(), spline.finish_time());
+          (void)(fcl_motion);
+        }));
+
+    const rmf_traffic::DistanceDifferential D(spline, other_spline);
+    print("construct differential", time_per_call(
+        [&]()
+        {
+          const rmf_traffic::DistanceDifferential d(spline, other_spline);
+          (void)(d);
+        }));
+
+    std::size_t approaches = 0;
+    print("approach_times", time_per_call(
+        [&]()
+        {
+          approaches += D.approach_times().size();
+        }));
+
+    bool contact = false;
+    print("first_contact", time_per_call(
+        [&]()
+        {
+          contact = D.first_contact(1.0).has_value();
+        }));
+
+    // Both robots are at the origin when the splines finish
+    CHECK(contact);
+    CHECK(p.allFinite());
+  }
+}
@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+
+#include <rmf_traffic/DetectConflict.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <cstdio>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+//==============================================================================
+struct Setting
+{
+  std::string name;
+  rmf_traffic::schedule::BucketOptions options;
+};
+
+//==============================================================================
+std::vector<Setting> make_settings()
+{
+  using rmf_traffic::schedule::BucketOptions;
+  return {
+    {"10s buckets", BucketOptions(10s)},
+    {"1min buckets", BucketOptions(1min)},
+    {"5min buckets", BucketOptions(5min)},
+    {"split only", BucketOptions(30s).split_threshold(64).min_duration(5s)},
+    {"merge only", BucketOptions(30s).merge_threshold(16).max_duration(30min)},
+    {
+      "adaptive buckets",
+      BucketOptions(30s)
+      .split_threshold(64)
+      .min_duration(5s)
+      .merge_threshold(16)
+      .max_duration(30min)
+    }
+  };
+}
+
+//==============================================================================
+/// Each participant publishes a dense itinerary of short routes, and every
+/// tenth participant also has a docking route that lasts for hours.
+void populate(
+  rmf_traffic::schedule::Database& db,
+  const rmf_traffic::Time start_time,
+  const std::size_t num_participants)
+{
+  using namespace rmf_traffic::schedule;
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  for (std::size_t i = 0; i < num_participants; ++i)
+  {
+    const auto p = db.register_participant(
+      ParticipantDescription{
+        "participant_" + std::to_string(i),
+        "benchmark",
+        ParticipantDescription::Rx::Responsive,
+        profile
+      });
+
+    const double y = static_cast<double>(i);
+    Writer::Input input;
+    rmf_traffic::Time t = start_time + std::chrono::seconds(i % 30);
+    for (rmf_traffic::RouteId r = 0; r < 40; ++r)
+    {
+      // Routes last between 10s and 30s
+      const auto duration = std::chrono::seconds(10 + (7*r + i) % 21);
+      const double x = static_cast<double>(r % 10);
+
+      rmf_traffic::Trajectory trajectory;
+      trajectory.insert(t, {x, y, 0.0}, Eigen::Vector3d::Zero());
+      trajectory.insert(
+        t + duration, {x + 1.0, y, 0.0}, Eigen::Vector3d::Zero());
+
+      auto route =
+        std::make_shared<rmf_traffic::Route>("L1", std::move(trajectory));
+      input.push_back({r, std::move(route)});
+
+      t += duration;
+    }
+
+    if (i % 10 == 0)
+    {
+      rmf_traffic::Trajectory docking;
+      docking.insert(start_time, {-1.0, y, 0.0}, Eigen::Vector3d::Zero());
+      docking.insert(
+        start_time + 4h, {-1.0, y, 0.0}, Eigen::Vector3d::Zero());
+      auto route =
+        std::make_shared<rmf_traffic::Route>("L1", std::move(docking));
+      input.push_back({40, std::move(route)});
+    }
+
+    db.set(p, input, 0);
+  }
+}
+
+//==============================================================================
+std::vector<rmf_traffic::schedule::ParticipantId> register_participants(
+  rmf_traffic::schedule::Database& db,
+  const std::size_t num_participants)
+{
+  using namespace rmf_traffic::schedule;
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  std::vector<ParticipantId> participants;
+  for (std::size_t i = 0; i < num_participants; ++i)
+  {
+    participants.push_back(
+      db.register_participant(
+        ParticipantDescription{
+          "participant_" + std::to_string(i),
+          "benchmark",
+          ParticipantDescription::Rx::Responsive,
+          profile
+        }));
+  }
+
+  return participants;
+}
+
+//==============================================================================
+/// Every participant replaces its whole itinerary with two new routes, the way
+/// a fleet adapter does each time it refreshes its plan.
+void replan(
+  rmf_traffic::schedule::Database& db,
+  const std::vector<rmf_traffic::schedule::ParticipantId>& participants,
+  const rmf_traffic::Time now,
+  const std::size_t tick)
+{
+  for (std::size_t i = 0; i < participants.size(); ++i)
+  {
+    const double y = static_cast<double>(i);
+    const double x = 0.1*static_cast<double>(tick);
+
+    rmf_traffic::schedule::Writer::Input input;
+    rmf_traffic::Time t = now;
+    for (std::size_t r = 0; r < 2; ++r)
+    {
+      rmf_traffic::Trajectory trajectory;
+      trajectory.insert(t, {x, y, 0.0}, Eigen::Vector3d::Zero());
+      trajectory.insert(t + 30s, {x + 1.0, y, 0.0}, Eigen::Vector3d::Zero());
+
+      auto route =
+        std::make_shared<rmf_traffic::Route>("L1", std::move(trajectory));
+      input.push_back(
+        {static_cast<rmf_traffic::RouteId>(2*tick + r), std::move(route)});
+
+      t += 30s;
+    }
+
+    db.set(
+      participants[i], input,
+      static_cast<rmf_traffic::schedule::ItineraryVersion>(tick));
+  }
+}
+
+//==============================================================================
+/// A robot that patrols back and forth along its own lane, with a waypoint
+/// every five seconds.
+rmf_traffic::Trajectory make_patrol(
+  const rmf_traffic::Time start_time,
+  const std::size_t lane,
+  const std::size_t num_waypoints)
+{
+  const double y = static_cast<double>(lane);
+  rmf_traffic::Trajectory trajectory;
+  for (std::size_t i = 0; i < num_waypoints; ++i)
+  {
+    const double x = (i/10) % 2 == 0 ?
+      static_cast<double>(i % 10) : static_cast<double>(10 - i % 10);
+    const double v = (i/10) % 2 == 0 ? 0.2 : -0.2;
+    trajectory.insert(
+      start_time + std::chrono::seconds(5*i), {x, y, 0.0}, {v, 0.0, 0.0});
+  }
+
+  return trajectory;
+}
+
+//==============================================================================
+/// A directory for the files of a persistent Database, which gets deleted when
+/// the benchmark is finished.
+class TemporaryDirectory
+{
+public:
+
+  TemporaryDirectory()
+  {
+    char path[] = "/tmp/rmf_traffic_benchmark_XXXXXX";
+    REQUIRE(mkdtemp(path));
+    _path = path;
+  }
+
+  ~TemporaryDirectory()
+  {
+    std::remove((_path + "/schedule.log").c_str());
+    std::remove((_path + "/schedule.snapshot").c_str());
+    rmdir(_path.c_str());
+  }
+
+  const std::string& path() const
+  {
+    return _path;
+  }
+
+private:
+  std::string _path;
+};
+
+} // anonymous namespace
+
+//==============================================================================
+TEST_CASE("Schedule bucket options", "[benchmark]")
+{
+  const std::size_t N = 200;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  for (const auto& setting : make_settings())
+  {
+    BENCHMARK("Insert itineraries with " + setting.name)
+    {
+      rmf_traffic::schedule::Database db(setting.options);
+      populate(db, start_time, N);
+    }
+
+    rmf_traffic::schedule::Database db(setting.options);
+    populate(db, start_time, N);
+
+    BENCHMARK("Timespan queries with " + setting.name)
+    {
+      for (std::size_t i = 0; i < 100; ++i)
+      {
+        const rmf_traffic::Time lower = start_time + std::chrono::seconds(6*i);
+        const rmf_traffic::Time upper = lower + 15s;
+        const auto view = db.query(
+          rmf_traffic::schedule::make_query({"L1"}, &lower, &upper));
+        CHECK(view.size() > 0);
+      }
+    }
+
+    const auto circle = rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(2.0);
+
+    BENCHMARK("Region queries with " + setting.name)
+    {
+      for (std::size_t i = 0; i < 100; ++i)
+      {
+        const rmf_traffic::Time lower = start_time + std::chrono::seconds(6*i);
+        Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+        tf.translate(
+          Eigen::Vector2d{static_cast<double>(i % 10), static_cast<double>(i)});
+
+        rmf_traffic::Region region(
+          "L1", lower, lower + 15s, {rmf_traffic::geometry::Space(circle, tf)});
+
+        db.query(rmf_traffic::schedule::make_query({region}));
+      }
+    }
+  }
+}
+
+//==============================================================================
+TEST_CASE("Schedule churn", "[benchmark]")
+{
+  // 1000 participants replan at 10Hz for one second
+  const std::size_t N = 1000;
+  const std::size_t ticks = 10;
+  const auto period = 100ms;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto query_all = rmf_traffic::schedule::query_all();
+
+  for (const auto& setting : make_settings())
+  {
+    BENCHMARK("Replan and mirror with " + setting.name)
+    {
+      rmf_traffic::schedule::Database db(setting.options);
+      rmf_traffic::schedule::Mirror mirror(setting.options);
+      const auto participants = register_participants(db, N);
+      mirror.update(db.changes(query_all, rmf_utils::nullopt));
+
+      for (std::size_t tick = 0; tick < ticks; ++tick)
+      {
+        replan(db, participants, start_time + tick*period, tick);
+        mirror.update(db.changes(query_all, mirror.latest_version()));
+      }
+    }
+
+    rmf_traffic::schedule::Database db(setting.options);
+    const auto participants = register_participants(db, N);
+    for (std::size_t tick = 0; tick < ticks; ++tick)
+      replan(db, participants, start_time + tick*period, tick);
+
+    BENCHMARK("Cull churned schedule with " + setting.name)
+    {
+      db.cull(start_time + 10min);
+    }
+
+    rmf_traffic::schedule::Database sliced(setting.options);
+    const auto sliced_participants = register_participants(sliced, N);
+    for (std::size_t tick = 0; tick < ticks; ++tick)
+      replan(sliced, sliced_participants, start_time + tick*period, tick);
+
+    // An incremental cull only holds up the writers for one slice at a time
+    BENCHMARK("Cull 1000 routes with " + setting.name)
+    {
+      sliced.cull(start_time + 10min, 1000);
+    }
+  }
+}
+
+//==============================================================================
+TEST_CASE("Incremental patches", "[benchmark]")
+{
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const auto query_all = rmf_traffic::schedule::query_all();
+
+  for (const std::size_t N : {20, 200, 2000})
+  {
+    rmf_traffic::schedule::Database db;
+    populate(db, start_time, N);
+
+    rmf_traffic::schedule::Mirror mirror;
+    mirror.update(db.changes(query_all, rmf_utils::nullopt));
+
+    // Each update only delays one participant, so the cost of an update should
+    // not depend on how many participants are in the schedule.
+    BENCHMARK("Mirror 100 delays with " + std::to_string(N) + " participants")
+    {
+      for (std::size_t i = 0; i < 100; ++i)
+      {
+        const auto p = static_cast<rmf_traffic::schedule::ParticipantId>(i % N);
+        db.delay(p, 1s, db.itinerary_version(p) + 1);
+        mirror.update(db.changes(query_all, mirror.latest_version()));
+      }
+    }
+  }
+}
+
+//==============================================================================
+TEST_CASE("Schedule persistence", "[benchmark]")
+{
+  using rmf_traffic::schedule::Database;
+  using rmf_traffic::schedule::PersistenceOptions;
+
+  // 500 participants replan at 10Hz for one second
+  const std::size_t N = 500;
+  const std::size_t ticks = 10;
+  const auto period = 100ms;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  const auto churn = [&](Database& db, const bool batched)
+    {
+      const auto participants = register_participants(db, N);
+      for (std::size_t tick = 0; tick < ticks; ++tick)
+      {
+        const rmf_traffic::Time now = start_time + tick*period;
+        if (batched)
+          db.batch([&](Database& b) { replan(b, participants, now, tick); });
+        else
+          replan(db, participants, now, tick);
+      }
+    };
+
+  BENCHMARK("Replan without a log")
+  {
+    Database db;
+    churn(db, false);
+  }
+
+  {
+    TemporaryDirectory directory;
+    BENCHMARK("Replan with an unsynced log")
+    {
+      Database db(PersistenceOptions(directory.path()).sync(false));
+      churn(db, false);
+    }
+  }
+
+  {
+    TemporaryDirectory directory;
+    BENCHMARK("Replan with a synced log")
+    {
+      Database db{PersistenceOptions(directory.path())};
+      churn(db, false);
+    }
+  }
+
+  {
+    TemporaryDirectory directory;
+    BENCHMARK("Replan in batches with a synced log")
+    {
+      Database db{PersistenceOptions(directory.path())};
+      churn(db, true);
+    }
+  }
+
+  TemporaryDirectory directory;
+  {
+    // Every change stays in the log until the database gets recovered
+    Database db(
+      PersistenceOptions(directory.path())
+      .sync(false)
+      .checkpoint_interval(rmf_utils::nullopt));
+
+    populate(db, start_time, N);
+    for (std::size_t tick = 0; tick < ticks; ++tick)
+    {
+      for (const auto p : db.participant_ids())
+        db.delay(p, 1s, db.itinerary_version(p) + 1);
+    }
+  }
+
+  rmf_traffic::schedule::Version replayed_version = 0;
+  BENCHMARK("Recover " + std::to_string(N) + " participants from a log")
+  {
+    Database db{PersistenceOptions(directory.path())};
+    replayed_version = db.latest_version();
+  }
+
+  BENCHMARK("Recover " + std::to_string(N) + " participants from a snapshot")
+  {
+    Database db{PersistenceOptions(directory.path())};
+    CHECK(db.latest_version() == replayed_version);
+    CHECK(db.participant_ids().size() == N);
+  }
+}
+
+//==============================================================================
+TEST_CASE("Repeated conflict checks", "[benchmark]")
+{
+  // The schedule holds the routes of 200 robots, and each candidate route of a
+  // planner or validator gets checked against all of them.
+  const std::size_t N = 200;
+  const std::size_t num_waypoints = 60;
+  const std::size_t num_candidates = 20;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  std::vector<rmf_traffic::Trajectory> scheduled;
+  scheduled.reserve(N);
+  for (std::size_t i = 0; i < N; ++i)
+    scheduled.push_back(make_patrol(start_time, i, num_waypoints));
+
+  // Each candidate patrols between two of the scheduled lanes, so it never
+  // gets close enough to conflict with either of them.
+  std::vector<rmf_traffic::Trajectory> candidates;
+  for (std::size_t i = 0; i < num_candidates; ++i)
+  {
+    rmf_traffic::Trajectory candidate;
+    const double y = static_cast<double>(10*i) + 0.5;
+    for (const auto& wp : make_patrol(start_time, 0, num_waypoints))
+    {
+      const Eigen::Vector3d p = wp.position();
+      candidate.insert(wp.time(), {p[0], y, p[2]}, wp.velocity());
+    }
+
+    candidates.push_back(std::move(candidate));
+  }
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.2)
+  };
+
+  std::size_t conflicts = 0;
+  for (std::size_t pass = 0; pass < 2; ++pass)
+  {
+    BENCHMARK("Check " + std::to_string(num_candidates) + " candidates against "
+      + std::to_string(N) + " routes, pass " + std::to_string(pass+1))
+    {
+      for (const auto& candidate : candidates)
+      {
+        for (const auto& trajectory : scheduled)
+        {
+          if (rmf_traffic::DetectConflict::between(
+              profile, candidate, profile, trajectory))
+            ++conflicts;
+        }
+      }
+    }
+  }
+
+  CHECK(conflicts == 0);
+}
+
+//==============================================================================
+TEST_CASE("Long trajectories", "[benchmark]")
+{
+  // Pairs of robots that each patrol for more than an hour on lanes that are
+  // far apart. In the second case, one robot of each pair visits the lane of
+  // the other for a few seconds near the end of its patrol.
+  const std::size_t num_pairs = 20;
+  const std::size_t num_waypoints = 1000;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+  const rmf_traffic::Time visit_time =
+    start_time + std::chrono::seconds(5*(num_waypoints-5));
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.2)
+  };
+
+  for (const bool visit : {false, true})
+  {
+    std::vector<std::array<rmf_traffic::Trajectory, 2>> pairs;
+    for (std::size_t i = 0; i < num_pairs; ++i)
+    {
+      const std::size_t lane = 20*i;
+      rmf_traffic::Trajectory visitor;
+      for (const auto& wp : make_patrol(start_time, lane + 10, num_waypoints))
+      {
+        Eigen::Vector3d p = wp.position();
+        if (visit && wp.time() == visit_time)
+          p[1] = static_cast<double>(lane);
+
+        visitor.insert(wp.time(), p, wp.velocity());
+      }
+
+      pairs.push_back({make_patrol(start_time, lane, num_waypoints), visitor});
+    }
+
+    std::size_t conflicts = 0;
+    for (std::size_t pass = 0; pass < 2; ++pass)
+    {
+      BENCHMARK("Check " + std::to_string(num_pairs) + " pairs "
+        + (visit ? "with a visit" : "far apart") + ", pass "
+        + std::to_string(pass+1))
+      {
+        for (const auto& pair : pairs)
+        {
+          if (rmf_traffic::DetectConflict::between(
+              profile, pair[0], profile, pair[1]))
+            ++conflicts;
+        }
+      }
+    }
+
+    CHECK(conflicts == (visit ? 2*num_pairs : 0));
+  }
+}
+
+//==============================================================================
+TEST_CASE("Batch conflict checks", "[benchmark]")
+{
+  // Each candidate gets checked against the routes of 200 robots, first one
+  // pair at a time and then in batches. Every other candidate visits one of the
+  // scheduled lanes halfway through its patrol, so it has exactly one conflict.
+  const std::size_t N = 200;
+  const std::size_t num_waypoints = 60;
+  const std::size_t num_candidates = 20;
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  std::vector<rmf_traffic::Trajectory> scheduled;
+  scheduled.reserve(N);
+  for (std::size_t i = 0; i < N; ++i)
+    scheduled.push_back(make_patrol(start_time, i, num_waypoints));
+
+  std::vector<rmf_traffic::Trajectory> candidates;
+  for (std::size_t i = 0; i < num_candidates; ++i)
+  {
+    rmf_traffic::Trajectory candidate;
+    const bool visit = i % 2 == 1;
+    const double y = static_cast<double>(10*i);
+    const rmf_traffic::Time visit_time =
+      start_time + std::chrono::seconds(5*(num_waypoints/2));
+    for (const auto& wp : make_patrol(start_time, 0, num_waypoints))
+    {
+      const Eigen::Vector3d p = wp.position();
+      const double offset = visit && wp.time() == visit_time ? 0.0 : 0.5;
+      candidate.insert(wp.time(), {p[0], y + offset, p[2]}, wp.velocity());
+    }
+
+    candidates.push_back(std::move(candidate));
+  }
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.2)
+  };
+
+  std::vector<rmf_traffic::DetectConflict::Other> others;
+  for (const auto& trajectory : scheduled)
+    others.push_back({profile, trajectory});
+
+  // Fill in the caches of every trajectory so that every benchmark sees the
+  // same conditions
+  for (const auto& candidate : candidates)
+    rmf_traffic::DetectConflict::between(profile, candidate, others);
+
+  const std::string name = std::to_string(num_candidates)
+    + " candidates against " + std::to_string(N) + " routes";
+
+  std::size_t pairwise_conflicts = 0;
+  BENCHMARK("Check " + name + " one pair at a time")
+  {
+    for (const auto& candidate : candidates)
+    {
+      for (const auto& trajectory : scheduled)
+      {
+        if (rmf_traffic::DetectConflict::between(
+            profile, candidate, profile, trajectory))
+          ++pairwise_conflicts;
+      }
+    }
+  }
+
+  std::size_t batch_conflicts = 0;
+  BENCHMARK("Check " + name + " in batches")
+  {
+    for (const auto& candidate : candidates)
+    {
+      batch_conflicts +=
+        rmf_traffic::DetectConflict::between(profile, candidate, others).size();
+    }
+  }
+
+  std::size_t first_conflicts = 0;
+  BENCHMARK("Check " + name + " in batches until the first conflict")
+  {
+    for (const auto& candidate : candidates)
+    {
+      first_conflicts += rmf_traffic::DetectConflict::between(
+        profile, candidate, others, true).size();
+    }
+  }
+
+  CHECK(pairwise_conflicts == num_candidates/2);
+  CHECK(batch_conflicts == num_candidates/2);
+  CHECK(first_conflicts == num_candidates/2);
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/agv/debug/Planner.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <cstdio>
+
+#include <sys/resource.h>
+
+namespace {
+
+//==============================================================================
+/// The number of times that each plan gets repeated to measure how long it
+/// takes
+const std::size_t Repetitions = 20;
+
+//==============================================================================
+/// The peak resident memory of this process so far, in kilobytes
+long peak_rss_kb()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+//==============================================================================
+/// Make a square grid of waypoints that are two meters apart, with lanes going
+/// both ways between each neighbor.
+rmf_traffic::agv::Graph make_grid(const std::string& map, const std::size_t w)
+{
+  rmf_traffic::agv::Graph graph;
+  for (std::size_t i = 0; i < w; ++i)
+  {
+    for (std::size_t j = 0; j < w; ++j)
+      graph.add_waypoint(map, {2.0*j, 2.0*i});
+  }
+
+  for (std::size_t i = 0; i < w; ++i)
+  {
+    for (std::size_t j = 0; j < w; ++j)
+    {
+      const std::size_t k = i*w + j;
+      if (j+1 < w)
+      {
+        graph.add_lane(k, k+1);
+        graph.add_lane(k+1, k);
+      }
+
+      if (i+1 < w)
+      {
+        graph.add_lane(k, k+w);
+        graph.add_lane(k+w, k);
+      }
+    }
+  }
+
+  return graph;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+TEST_CASE("Planner search rate", "[benchmark]")
+{
+  // Each plan crosses a grid along a row where another robot is parked, so the
+  // search has to consider waiting for it as well as every way around it.
+  using namespace std::chrono_literals;
+
+  const std::string map = "test_map";
+  const std::size_t W = 8;
+  const auto graph = make_grid(map, W);
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  const rmf_traffic::agv::VehicleTraits traits{
+    {0.7, 0.3},
+    {1.0, 0.45},
+    profile
+  };
+
+  const rmf_traffic::Time start_time = std::chrono::steady_clock::now();
+
+  rmf_traffic::schedule::Database database;
+  const auto obstacle = database.register_participant(
+    rmf_traffic::schedule::ParticipantDescription{
+      "obstacle",
+      "benchmark_Planner",
+      rmf_traffic::schedule::ParticipantDescription::Rx::Unresponsive,
+      profile
+    });
+
+  const std::size_t row = W/2;
+  const Eigen::Vector3d parked{2.0*(W/2), 2.0*row, 0.0};
+  rmf_traffic::Trajectory parked_trajectory;
+  parked_trajectory.insert(start_time, parked, Eigen::Vector3d::Zero());
+  parked_trajectory.insert(start_time + 60s, parked, Eigen::Vector3d::Zero());
+  database.extend(
+    obstacle,
+    {{0, std::make_shared<rmf_traffic::Route>(map, parked_trajectory)}},
+    0);
+
+  const rmf_traffic::agv::Planner::Options options{
+    rmf_utils::make_clone<rmf_traffic::agv::ScheduleRouteValidator>(
+      database,
+      std::numeric_limits<rmf_traffic::schedule::ParticipantId>::max(),
+      profile)
+  };
+
+  const rmf_traffic::agv::Planner planner{{graph, traits}, options};
+  const rmf_traffic::agv::Planner::Debug debug{planner};
+
+  std::printf("\n%-6s %-6s %10s %10s %16s\n",
+    "start", "goal", "expanded", "ms/plan", "expansions/s");
+
+  std::size_t total_expanded = 0;
+  double total_seconds = 0.0;
+  for (std::size_t offset = 0; offset < 3; ++offset)
+  {
+    const std::size_t start = (row - 1 + offset)*W;
+    const std::size_t goal = row*W + W - 1;
+    const rmf_traffic::agv::Planner::Start s{start_time, start, 0.0};
+
+    // Count the expansions with the debugger, which is too slow to time
+    auto progress = debug.begin({s}, goal, options);
+    rmf_utils::optional<rmf_traffic::agv::Plan> debug_plan;
+    while (!debug_plan && progress)
+      debug_plan = progress.step();
+
+    REQUIRE(debug_plan);
+    const std::size_t expanded = progress.expanded_nodes().size();
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < Repetitions; ++i)
+      REQUIRE(planner.plan(s, goal));
+    const auto finish = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(finish - begin)
+      .count() / static_cast<double>(Repetitions);
+
+    std::printf("%-6zu %-6zu %10zu %10.2f %16.0f\n",
+      start, goal, expanded, 1000.0*seconds,
+      static_cast<double>(expanded)/seconds);
+
+    total_expanded += expanded;
+    total_seconds += seconds;
+  }
+
+  std::printf("total expansions/s: %.0f, peak RSS: %ld kB\n",
+    static_cast<double>(total_expanded)/total_seconds, peak_rss_kb());
+}
@@ -16,6 +16,7 @@
 */
 
 #include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/agv/debug/Planner.hpp>
 #include <rmf_traffic/schedule/Database.hpp>
 
 #include <rmf_traffic/DetectConflict.hpp>
@@ -25,9 +26,20 @@
 
 #include "../utils_Trajectory.hpp"
 
+#include "src/rmf_traffic/agv/internal_Planner.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <iomanip>
+#include <set>
 #include <thread>
+#include <tuple>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // TODO(MXG): Move performance testing content into a performance test folder
 const bool test_performance = false;
@@ -56,6 +68,58 @@ make_test_schedule_validator(
     std::move(profile));
 }
 
+//==============================================================================
+/// Make a graph with width*width waypoints laid out in a grid, with lanes going
+/// both ways between neighboring waypoints. Any pair of neighbors where
+/// skip(w0, w1) returns true is left without lanes.
+rmf_traffic::agv::Graph create_test_grid(
+  const std::string& map_name,
+  const std::size_t width,
+  const double spacing,
+  const std::function<bool(std::size_t, std::size_t)>& skip = nullptr)
+{
+  rmf_traffic::agv::Graph graph;
+  for (std::size_t i = 0; i < width; ++i)
+  {
+    for (std::size_t j = 0; j < width; ++j)
+      graph.add_waypoint(map_name, {spacing*j, spacing*i});
+  }
+
+  const auto add_bidir_lane = [&](const std::size_t w0, const std::size_t w1)
+    {
+      if (skip && skip(w0, w1))
+        return;
+
+      graph.add_lane(w0, w1);
+      graph.add_lane(w1, w0);
+    };
+
+  for (std::size_t i = 0; i < width; ++i)
+  {
+    for (std::size_t j = 0; j < width; ++j)
+    {
+      const std::size_t w = i*width + j;
+      if (j+1 < width)
+        add_bidir_lane(w, w+1);
+
+      if (i+1 < width)
+        add_bidir_lane(w, w+width);
+    }
+  }
+
+  return graph;
+}
+
+//==============================================================================
+rmf_traffic::agv::VehicleTraits create_test_traits()
+{
+  return {
+    {0.7, 0.3},
+    {1.0, 0.45},
+    create_test_profile(UnitCircle)
+  };
+}
+
 void display_path(const rmf_traffic::agv::Plan::Result& plan)
 {
   std::vector<std::size_t> plan_indices;
@@ -766,7 +830,7 @@ SCENARIO("Test planning")
     CHECK(plan->get_itinerary().size() == 1);
     REQUIRE(plan->get_itinerary().front().trajectory().size() > 0);
     const auto t = plan->get_itinerary().front().trajectory();
-    const auto final_p = t.front().position().block<2, 1>(0, 0);
+    const Eigen::Vector2d final_p = t.front().position().block<2, 1>(0, 0);
     const auto err = (final_p - Eigen::Vector2d(10, -5)).norm();
     CHECK(err == Approx(0.0) );
     CHECK(t.back().position()[2] - goal_orientation == Approx(0));
@@ -1859,6 +1923,15 @@ SCENARIO("DP1 Graph")
         result->resume(new_interrupt_flag);
         CHECK(*result);
       }
+
+      THEN("A copy of the result can resume after the original is gone")
+      {
+        auto copy = *result;
+        result = rmf_utils::nullopt;
+
+        copy.resume(std::make_shared<bool>(false));
+        CHECK(copy);
+      }
     }
 
     WHEN("Obstacle 28->2")
@@ -3082,3 +3155,364 @@ SCENARIO("Close start", "[close_start]")
   CHECK(visited_wps.count(5));
   CHECK(visited_wps.count(4));
 }
+
+SCENARIO("Precomputed heuristic tables")
+{
+  using namespace std::chrono_literals;
+  using rmf_traffic::agv::Graph;
+  using Event = Graph::Lane::Event;
+  using DoorOpen = Graph::Lane::DoorOpen;
+  using DoorClose = Graph::Lane::DoorClose;
+
+  const std::string test_map_name = "test_map";
+
+  /*
+   *   12---13---14---15
+   *   |    |    |    |
+   *   8----9----10---11
+   *   |    |         |
+   *   4----5====6----7
+   *   |    |    |    |
+   *   0----1----2----3
+   *
+   * The lanes between 5 and 6 go through a door. Waypoint 9 is a passthrough
+   * point.
+   */
+  const std::size_t N = 4;
+  Graph graph = create_test_grid(
+    test_map_name, N, 3.0,
+    [](const std::size_t w0, const std::size_t w1)
+    {
+      return (w0 == 5 && w1 == 6) || (w0 == 9 && w1 == 10)
+      || (w0 == 6 && w1 == 10);
+    });
+  graph.get_waypoint(9).set_passthrough_point(true);
+
+  graph.add_lane(
+    {5, Event::make(DoorOpen("door", 4s))},
+    {6, Event::make(DoorClose("door", 4s))});
+  graph.add_lane(
+    {6, Event::make(DoorOpen("door", 4s))},
+    {5, Event::make(DoorClose("door", 4s))});
+
+  const rmf_traffic::agv::VehicleTraits traits = create_test_traits();
+
+  rmf_traffic::agv::Planner::Configuration lazy_config{graph, traits};
+  CHECK_FALSE(lazy_config.heuristic_table_budget());
+
+  const rmf_traffic::agv::Plan::Options options{nullptr};
+  const rmf_traffic::agv::Planner lazy_planner{lazy_config, options};
+  const auto time = std::chrono::steady_clock::now();
+
+  GIVEN("A budget that fits every table")
+  {
+    auto config = lazy_config;
+    config.heuristic_table_budget(N*N*N*N*sizeof(double));
+    REQUIRE(config.heuristic_table_budget());
+    CHECK(*config.heuristic_table_budget() == N*N*N*N*sizeof(double));
+
+    const rmf_traffic::agv::Planner planner{config, options};
+
+    // The lazy heuristic follows the shortest path to the goal, which is not
+    // always the fastest one when that path has more turns, so it can lead the
+    // planner to a slower plan. The tables account for turning, so their plans
+    // should never be any slower.
+    THEN("No plan costs more than a plan with lazy heuristics")
+    {
+      for (std::size_t goal = 0; goal < N*N; ++goal)
+      {
+        if (goal == 9)
+          continue;
+
+        for (std::size_t start = 0; start < N*N; ++start)
+        {
+          for (const double yaw : {0.0, M_PI/2.0})
+          {
+            const rmf_traffic::agv::Plan::Start s{time, start, yaw};
+            const auto expected = lazy_planner.plan(s, goal);
+            const auto actual = planner.plan(s, goal);
+            REQUIRE(expected);
+            REQUIRE(actual);
+            CHECK(actual->get_cost() <= expected->get_cost() + 1e-6);
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("A budget that only fits some of the tables")
+  {
+    auto config = lazy_config;
+    config.heuristic_table_budget(3*N*N*sizeof(double));
+    const rmf_traffic::agv::Planner planner{config, options};
+
+    THEN("Goals without a table still get planned for")
+    {
+      const rmf_traffic::agv::Plan::Start s{time, 0, 0.0};
+      for (const std::size_t goal : {1u, 7u, 15u})
+      {
+        const auto expected = lazy_planner.plan(s, goal);
+        const auto actual = planner.plan(s, goal);
+        REQUIRE(expected);
+        REQUIRE(actual);
+        CHECK(actual->get_cost() <= expected->get_cost() + 1e-6);
+      }
+    }
+  }
+}
+
+SCENARIO("Heuristic tables are saved to a file")
+{
+  const std::string test_map_name = "test_map";
+  const std::size_t W = 4;
+  const rmf_traffic::agv::Graph graph =
+    create_test_grid(test_map_name, W, 2.0);
+
+  char directory_template[] = "/tmp/rmf_traffic_test_Planner_XXXXXX";
+  REQUIRE(mkdtemp(directory_template));
+  const std::string directory = directory_template;
+  const std::string path = directory + "/heuristics.bin";
+
+  // Saving the file replaces it with a new one, so its inode tells us whether
+  // a planner reused the file or wrote it again.
+  const auto inode = [&]() -> ino_t
+    {
+      struct stat info;
+      REQUIRE(stat(path.c_str(), &info) == 0);
+      return info.st_ino;
+    };
+
+  const rmf_traffic::agv::VehicleTraits traits = create_test_traits();
+
+  rmf_traffic::agv::Planner::Configuration config{graph, traits};
+  CHECK_FALSE(config.heuristic_table_file());
+  config.heuristic_table_budget(W*W*W*W*sizeof(double));
+  config.heuristic_table_file(path);
+  REQUIRE(config.heuristic_table_file());
+  CHECK(*config.heuristic_table_file() == path);
+
+  const rmf_traffic::agv::Plan::Options options{nullptr};
+  const auto time = std::chrono::steady_clock::now();
+
+  const auto plan_costs = [&](const rmf_traffic::agv::Planner& planner)
+    {
+      std::vector<double> costs;
+      for (std::size_t goal = 0; goal < W*W; goal += 3)
+      {
+        for (std::size_t start = 0; start < W*W; start += 2)
+        {
+          const auto plan = planner.plan({time, start, 0.0}, goal);
+          REQUIRE(plan);
+          costs.push_back(plan->get_cost());
+        }
+      }
+
+      return costs;
+    };
+
+  const rmf_traffic::agv::Planner first_planner{config, options};
+  const ino_t first_inode = inode();
+
+  {
+    // The file keeps the owner-only permissions that it was created with
+    struct stat info;
+    REQUIRE(stat(path.c_str(), &info) == 0);
+    CHECK((info.st_mode & (S_IRWXG | S_IRWXO)) == 0);
+  }
+  const auto expected_costs = plan_costs(first_planner);
+
+  WHEN("Another planner is made with the same configuration")
+  {
+    const rmf_traffic::agv::Planner planner{config, options};
+
+    THEN("The file is reused")
+    {
+      CHECK(inode() == first_inode);
+      const auto costs = plan_costs(planner);
+      REQUIRE(costs.size() == expected_costs.size());
+      for (std::size_t i = 0; i < costs.size(); ++i)
+        CHECK(costs[i] == Approx(expected_costs[i]));
+    }
+  }
+
+  WHEN("The vehicle traits change")
+  {
+    auto other_config = config;
+    other_config.vehicle_traits().linear().set_nominal_velocity(1.0);
+    const rmf_traffic::agv::Planner planner{other_config, options};
+
+    THEN("The file is written again")
+    {
+      CHECK(inode() != first_inode);
+    }
+  }
+
+  WHEN("The budget changes")
+  {
+    auto other_config = config;
+    other_config.heuristic_table_budget(2*W*W*sizeof(double));
+    const rmf_traffic::agv::Planner planner{other_config, options};
+
+    THEN("The file is written again")
+    {
+      CHECK(inode() != first_inode);
+    }
+  }
+
+  WHEN("The file is damaged")
+  {
+    // The first planner still has the file mapped, so the damaged file must
+    // replace it instead of overwriting it in place.
+    const std::string damaged_path = path + ".damaged";
+    {
+      std::ofstream file(damaged_path, std::ios::binary | std::ios::trunc);
+      file << "not a table of heuristics";
+    }
+    REQUIRE(std::rename(damaged_path.c_str(), path.c_str()) == 0);
+    const ino_t damaged_inode = inode();
+
+    const rmf_traffic::agv::Planner planner{config, options};
+
+    THEN("The file is ignored and written again")
+    {
+      CHECK(inode() != damaged_inode);
+      const auto costs = plan_costs(planner);
+      REQUIRE(costs.size() == expected_costs.size());
+      for (std::size_t i = 0; i < costs.size(); ++i)
+        CHECK(costs[i] == Approx(expected_costs[i]));
+    }
+  }
+
+  std::remove(path.c_str());
+  rmdir(directory.c_str());
+}
+
+SCENARIO("Duplicate search states are only expanded once")
+{
+  using namespace std::chrono_literals;
+
+  const std::string test_map_name = "test_map";
+  const std::size_t W = 4;
+  const rmf_traffic::agv::Graph graph =
+    create_test_grid(test_map_name, W, 2.0);
+
+  const rmf_traffic::agv::VehicleTraits traits = create_test_traits();
+  const rmf_traffic::Profile profile = traits.profile();
+
+  const auto time = std::chrono::steady_clock::now();
+
+  // Park a robot in the middle of the row that the plan wants to use, so the
+  // search needs to consider holding and going around it.
+  rmf_traffic::schedule::Database database;
+  const auto obstacle = database.register_participant(
+    rmf_traffic::schedule::ParticipantDescription{
+      "obstacle",
+      "test_Planner",
+      rmf_traffic::schedule::ParticipantDescription::Rx::Unresponsive,
+      profile
+    });
+
+  rmf_traffic::Trajectory parked;
+  parked.insert(time, {4.0, 2.0, 0.0}, Eigen::Vector3d::Zero());
+  parked.insert(time + 30s, {4.0, 2.0, 0.0}, Eigen::Vector3d::Zero());
+  database.extend(
+    obstacle,
+    {{0, std::make_shared<rmf_traffic::Route>(test_map_name, parked)}},
+    0);
+
+  const rmf_traffic::agv::Planner::Options options{
+    make_test_schedule_validator(database, profile)};
+
+  const rmf_traffic::agv::Planner planner{{graph, traits}, options};
+  const rmf_traffic::agv::Planner::Debug debug{planner};
+
+  const rmf_traffic::agv::Planner::Start start{time, W, 0.0};
+  const std::size_t goal = 2*W - 1;
+
+  auto progress = debug.begin({start}, goal, options);
+  rmf_utils::optional<rmf_traffic::agv::Plan> plan;
+  while (!plan && progress)
+    plan = progress.step();
+
+  REQUIRE(plan);
+
+  const auto planned = planner.plan(start, goal);
+  REQUIRE(planned);
+  CHECK(planned->get_cost() == Approx(plan->get_cost()));
+
+  // Every node that got expanded into new nodes must have been in a different
+  // state from all the others. Some nodes are parents without having been
+  // expanded, like the rotations that lead into a lane, so we only look at the
+  // parents that were expanded.
+  using ConstNodePtr = rmf_traffic::agv::Planner::Debug::ConstNodePtr;
+  const std::set<ConstNodePtr> expanded(
+    progress.expanded_nodes().begin(), progress.expanded_nodes().end());
+
+  std::set<ConstNodePtr> parents;
+  const auto add_ancestors = [&](ConstNodePtr node)
+    {
+      while (node)
+      {
+        if (expanded.count(node))
+          parents.insert(node);
+
+        node = node->parent;
+      }
+    };
+
+  for (const auto& node : progress.expanded_nodes())
+    add_ancestors(node->parent);
+
+  auto queue = progress.queue();
+  while (!queue.empty())
+  {
+    add_ancestors(queue.top()->parent);
+    queue.pop();
+  }
+
+  std::set<std::tuple<std::size_t, double, rmf_traffic::Time>> states;
+  std::size_t num_parents_with_waypoints = 0;
+  for (const auto& parent : parents)
+  {
+    if (!parent->waypoint)
+      continue;
+
+    ++num_parents_with_waypoints;
+    states.insert(
+      {
+        *parent->waypoint,
+        parent->orientation,
+        *parent->route_from_parent.trajectory().finish_time()
+      });
+  }
+
+  CHECK(num_parents_with_waypoints > 0);
+  CHECK(states.size() == num_parents_with_waypoints);
+
+  // These options turn pruning off for only the searches that use them
+  auto no_pruning = planner.get_default_options();
+  rmf_traffic::agv::Planner::Options::Implementation::get(no_pruning)
+  .prune_duplicate_states = false;
+
+  // Pruning must never make a plan more expensive than a full search would.
+  for (const std::size_t g : {2u, 7u, 13u})
+  {
+    for (std::size_t s = 0; s < W*W; ++s)
+    {
+      for (const double yaw : {0.0, M_PI/2.0})
+      {
+        const rmf_traffic::agv::Planner::Start st{time, s, yaw};
+        const auto pruned = planner.plan(st, g);
+
+        const auto full = planner.plan(st, g, no_pruning);
+
+        CAPTURE(s);
+        CAPTURE(g);
+        CAPTURE(yaw);
+        CHECK(pruned.success() == full.success());
+        if (pruned && full)
+          CHECK(pruned->get_cost() == Approx(full->get_cost()));
+      }
+    }
+  }
+}
@@ -17,6 +17,7 @@
 
 #include "utils_Database.hpp"
 #include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Mirror.hpp>
 
 //#include <rmf_traffic/geometry/Box.hpp>
 #include <src/rmf_traffic/geometry/Box.hpp>
@@ -26,6 +27,20 @@
 
 #include <rmf_utils/catch.hpp>
 
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std::chrono_literals;
 
 SCENARIO("Test Database Conflicts")
@@ -301,3 +316,1099 @@ SCENARIO("Test Database Conflicts")
     }
   }
 }
+
+SCENARIO("Database snapshots are not affected by later changes")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(1.0)
+  };
+
+  const auto p1 = db.register_participant(
+    ParticipantDescription{
+      "p1",
+      "test_Database",
+      ParticipantDescription::Rx::Responsive,
+      profile
+    });
+
+  rmf_traffic::Trajectory t1;
+  t1.insert(time, Eigen::Vector3d{-5, 0, 0}, Eigen::Vector3d{0, 0, 0});
+  t1.insert(time + 10min, Eigen::Vector3d{5, 0, 0}, Eigen::Vector3d{0, 0, 0});
+
+  rmf_traffic::Trajectory t2;
+  t2.insert(time, Eigen::Vector3d{0, -5, 0}, Eigen::Vector3d{0, 0, 0});
+  t2.insert(time + 20min, Eigen::Vector3d{0, 5, 0}, Eigen::Vector3d{0, 0, 0});
+
+  ItineraryVersion iv = 0;
+  db.set(p1, create_test_input(0, t1), iv++);
+
+  const auto snapshot_0 = db.snapshot();
+  CHECK(snapshot_0->latest_version() == db.latest_version());
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, 1, 1);
+
+  db.extend(p1, create_test_input(1, t2), iv++);
+  CHECK_TRAJECTORY_COUNT(db, 1, 2);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, 1, 1);
+
+  const auto snapshot_1 = db.snapshot();
+  CHECK_TRAJECTORY_COUNT(*snapshot_1, 1, 2);
+
+  db.delay(p1, 30s, iv++);
+  db.erase(p1, {0}, iv++);
+  CHECK_TRAJECTORY_COUNT(db, 1, 1);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, 1, 1);
+  CHECK_TRAJECTORY_COUNT(*snapshot_1, 1, 2);
+
+  const auto view_1 = snapshot_1->query(query_all());
+  for (const auto& v : view_1)
+    CHECK(*v.route.trajectory().start_time() == time);
+
+  db.cull(time + 15min);
+  CHECK_TRAJECTORY_COUNT(db, 1, 1);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, 1, 1);
+  CHECK_TRAJECTORY_COUNT(*snapshot_1, 1, 2);
+
+  db.erase(p1, iv++);
+  CHECK_TRAJECTORY_COUNT(db, 1, 0);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, 1, 1);
+  CHECK_TRAJECTORY_COUNT(*snapshot_1, 1, 2);
+
+  const auto snapshot_2 = db.snapshot();
+  CHECK_TRAJECTORY_COUNT(*snapshot_2, 1, 0);
+}
+
+SCENARIO("Database snapshots of crowded buckets are not affected by changes")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(1.0)
+  };
+
+  // Enough routes to fill several chunks of the same bucket
+  const std::size_t N = 100;
+  std::vector<ParticipantId> participants;
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    const auto p = db.register_participant(
+      ParticipantDescription{
+        "p" + std::to_string(i),
+        "test_Database",
+        ParticipantDescription::Rx::Responsive,
+        profile
+      });
+
+    const double x = static_cast<double>(i);
+    rmf_traffic::Trajectory t;
+    t.insert(time, Eigen::Vector3d{x, 0, 0}, Eigen::Vector3d{0, 0, 0});
+    t.insert(time + 1min, Eigen::Vector3d{x, 5, 0}, Eigen::Vector3d{0, 0, 0});
+    db.set(p, create_test_input(0, t), 0);
+    participants.push_back(p);
+  }
+
+  const auto snapshot_0 = db.snapshot();
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, N, N);
+
+  // Nothing has changed, so the same snapshot gets reused
+  CHECK(db.snapshot() == snapshot_0);
+
+  // Erasing routes from the front of the bucket moves routes from the back of
+  // the bucket into their places.
+  std::size_t remaining = N;
+  for (std::size_t i = 0; i < N; i += 3)
+  {
+    db.erase(participants[i], 1);
+    --remaining;
+  }
+
+  CHECK(db.snapshot() != snapshot_0);
+  CHECK_TRAJECTORY_COUNT(db, N, remaining);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, N, N);
+
+  std::set<ParticipantId> found;
+  for (const auto& element : db.query(query_all()))
+    found.insert(element.participant);
+
+  for (std::size_t i = 0; i < N; ++i)
+    CHECK((found.count(participants[i]) > 0) == (i % 3 != 0));
+
+  db.cull(time + 2min);
+  CHECK_TRAJECTORY_COUNT(db, N, 0);
+  CHECK_TRAJECTORY_COUNT(*snapshot_0, N, N);
+}
+
+SCENARIO("Database bucket options do not change query results")
+{
+  using namespace rmf_traffic::schedule;
+  using RouteKey = std::pair<ParticipantId, rmf_traffic::RouteId>;
+
+  const auto adaptive = BucketOptions(10s)
+    .split_threshold(4)
+    .min_duration(1s)
+    .merge_threshold(2)
+    .max_duration(5min);
+
+  std::vector<std::unique_ptr<Database>> databases;
+  databases.emplace_back(std::make_unique<Database>());
+  databases.emplace_back(std::make_unique<Database>(BucketOptions(1h)));
+  databases.emplace_back(std::make_unique<Database>(adaptive));
+
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(1.0)
+  };
+
+  const std::size_t N = 10;
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    for (auto& db : databases)
+    {
+      const auto p = db->register_participant(
+        ParticipantDescription{
+          "p" + std::to_string(i),
+          "test_Database",
+          ParticipantDescription::Rx::Responsive,
+          profile
+        });
+      CHECK(p == i);
+    }
+
+    // Each participant has several short routes and one very long route
+    Writer::Input input;
+    for (std::size_t j = 0; j < 5; ++j)
+    {
+      const rmf_traffic::Time start =
+        time + std::chrono::seconds(7*i + 23*j);
+
+      rmf_traffic::Trajectory t;
+      t.insert(start, Eigen::Vector3d{0, 0, 0}, Eigen::Vector3d::Zero());
+      t.insert(start + 15s, Eigen::Vector3d{10, 0, 0}, Eigen::Vector3d::Zero());
+      input.push_back(
+        {j, std::make_shared<rmf_traffic::Route>("test_map", t)});
+    }
+
+    rmf_traffic::Trajectory docking;
+    docking.insert(time, Eigen::Vector3d{0, 5, 0}, Eigen::Vector3d::Zero());
+    docking.insert(
+      time + 2h, Eigen::Vector3d{0, 5, 0}, Eigen::Vector3d::Zero());
+    input.push_back(
+      {5, std::make_shared<rmf_traffic::Route>("test_map", docking)});
+
+    for (auto& db : databases)
+      db->set(i, input, 0);
+  }
+
+  // Remove some of the routes so that buckets get a chance to merge
+  for (std::size_t i = 0; i < N; i += 2)
+  {
+    for (auto& db : databases)
+      db->erase(i, {1, 2, 3}, 1);
+  }
+
+  for (std::size_t i = 1; i < N; i += 3)
+  {
+    for (auto& db : databases)
+      db->delay(i, 30s, 2);
+  }
+
+  const auto get_routes = [](const Viewer& viewer, const Query& query)
+    {
+      std::set<RouteKey> routes;
+      for (const auto& element : viewer.query(query))
+        routes.insert({element.participant, element.route_id});
+
+      return routes;
+    };
+
+  const std::vector<std::pair<rmf_traffic::Duration, rmf_traffic::Duration>>
+  ranges = {
+    {0s, 10s}, {25s, 40s}, {1min, 1min + 1s}, {90s, 3min}, {1h, 2h}, {0s, 3h}
+  };
+
+  for (const auto& range : ranges)
+  {
+    const rmf_traffic::Time lower = time + range.first;
+    const rmf_traffic::Time upper = time + range.second;
+    const auto query = make_query({"test_map"}, &lower, &upper);
+
+    const auto expected = get_routes(*databases.front(), query);
+    CHECK_FALSE(expected.empty());
+    for (std::size_t i = 1; i < databases.size(); ++i)
+    {
+      CHECK(get_routes(*databases[i], query) == expected);
+      CHECK(get_routes(*databases[i]->snapshot(), query) == expected);
+    }
+  }
+
+  GIVEN("Mirrors that follow the databases while routes are replaced")
+  {
+    const auto query_all = rmf_traffic::schedule::query_all();
+    std::vector<Mirror> mirrors;
+    mirrors.emplace_back();
+    mirrors.emplace_back(BucketOptions(1h));
+    mirrors.emplace_back(adaptive);
+
+    for (std::size_t k = 0; k < databases.size(); ++k)
+      mirrors[k].update(databases[k]->changes(query_all, rmf_utils::nullopt));
+
+    // Each replacement removes the previous routes of the participant from
+    // every bucket of the mirror
+    for (std::size_t round = 0; round < 3; ++round)
+    {
+      for (std::size_t i = 0; i < N; ++i)
+      {
+        const rmf_traffic::Time start =
+          time + std::chrono::seconds(5*i + 11*round);
+
+        rmf_traffic::Trajectory t;
+        t.insert(start, Eigen::Vector3d{0, 0, 0}, Eigen::Vector3d::Zero());
+        t.insert(
+          start + 40s, Eigen::Vector3d{10, 0, 0}, Eigen::Vector3d::Zero());
+
+        const rmf_traffic::RouteId route_id = 10 + round;
+        for (auto& db : databases)
+        {
+          auto route = std::make_shared<rmf_traffic::Route>("test_map", t);
+          db->set(i, {{route_id, route}}, db->itinerary_version(i) + 1);
+        }
+      }
+
+      for (std::size_t k = 0; k < databases.size(); ++k)
+      {
+        mirrors[k].update(
+          databases[k]->changes(query_all, mirrors[k].latest_version()));
+      }
+    }
+
+    for (const auto& range : ranges)
+    {
+      const rmf_traffic::Time lower = time + range.first;
+      const rmf_traffic::Time upper = time + range.second;
+      const auto query = make_query({"test_map"}, &lower, &upper);
+
+      const auto expected = get_routes(*databases.front(), query);
+      for (std::size_t k = 0; k < databases.size(); ++k)
+      {
+        const auto routes = get_routes(mirrors[k], query);
+        CHECK(routes == expected);
+        for (const auto& route : routes)
+          CHECK(route.second == 12);
+      }
+    }
+
+    THEN("Culling removes every route from the mirrors")
+    {
+      for (std::size_t k = 0; k < databases.size(); ++k)
+      {
+        databases[k]->cull(time + 3h);
+        mirrors[k].update(
+          databases[k]->changes(query_all, mirrors[k].latest_version()));
+        CHECK(mirrors[k].query(query_all).size() == 0);
+      }
+    }
+  }
+
+  GIVEN("A merge threshold that is not below the split threshold")
+  {
+    CHECK_THROWS(
+      Database(BucketOptions().split_threshold(3).merge_threshold(3)));
+  }
+
+  GIVEN("A bucket duration that is not positive")
+  {
+    CHECK_THROWS(Mirror(BucketOptions(0s)));
+  }
+}
+
+//==============================================================================
+SCENARIO("Database patches only describe what changed after a version")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const auto make_input = [&](
+    const rmf_traffic::RouteId id,
+    const std::string& map,
+    const rmf_traffic::Duration offset)
+    {
+      return Writer::Input{
+        {
+          id,
+          std::make_shared<rmf_traffic::Route>(
+            map, create_test_trajectory(time + offset))
+        }
+      };
+    };
+
+  const std::size_t N = 10;
+  const auto participants = register_test_participants(db, N);
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    const std::string map = i < N/2 ? "L1" : "L2";
+    db.set(participants[i], make_input(0, map, std::chrono::seconds(i)), 0);
+  }
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+  Mirror mirror;
+  mirror.update(db.changes(query_all, rmf_utils::nullopt));
+
+  Mirror l1_mirror;
+  const auto query_l1 = make_query({"L1"}, nullptr, nullptr);
+  l1_mirror.update(db.changes(query_l1, rmf_utils::nullopt));
+
+  const Version after = db.latest_version();
+  CHECK(db.changes(query_all, after).size() == 0);
+
+  // Participant 0 gets delayed, participant 1 gets erased, participant 2 moves
+  // from L1 to L2, and participant 7 moves from L2 to L1.
+  db.delay(0, 5s, 1);
+  db.erase(1, 1);
+  db.set(2, make_input(1, "L2", 0s), 1);
+  db.set(7, make_input(1, "L1", 0s), 1);
+
+  const auto patch = db.changes(query_all, after);
+  CHECK(patch.size() == 4);
+  for (const auto& p : patch)
+  {
+    if (p.participant_id() == 0)
+    {
+      CHECK(p.delays().size() == 1);
+      CHECK(p.additions().items().empty());
+      CHECK(p.erasures().ids().empty());
+    }
+    else if (p.participant_id() == 1)
+    {
+      CHECK(p.delays().empty());
+      CHECK(p.erasures().ids().size() == 1);
+    }
+    else
+    {
+      CHECK((p.participant_id() == 2 || p.participant_id() == 7));
+      CHECK(p.erasures().ids().size() == 1);
+      CHECK(p.additions().items().size() == 1);
+    }
+  }
+
+  const auto l1_patch = db.changes(query_l1, after);
+  for (const auto& p : l1_patch)
+  {
+    if (p.participant_id() == 2)
+    {
+      // The new route of participant 2 is not relevant to this query
+      CHECK(p.erasures().ids().size() == 1);
+      CHECK(p.additions().items().empty());
+    }
+    else if (p.participant_id() == 7)
+    {
+      // The old route of participant 7 was never relevant to this query
+      CHECK(p.erasures().ids().empty());
+      CHECK(p.additions().items().size() == 1);
+    }
+  }
+
+  mirror.update(patch);
+  l1_mirror.update(l1_patch);
+  CHECK(mirror.query(query_all).size() == db.query(query_all).size());
+  CHECK(l1_mirror.query(query_all).size() == db.query(query_l1).size());
+  CHECK(db.query(query_l1).size() == N/2 - 1);
+
+  WHEN("The database is culled while a snapshot holds on to old routes")
+  {
+    const auto snapshot = db.snapshot();
+    const Version before_cull = db.latest_version();
+    db.cull(time + 1h);
+
+    const auto cull_patch = db.changes(query_all, before_cull);
+    CHECK(cull_patch.cull());
+    CHECK(cull_patch.size() == 0);
+
+    mirror.update(cull_patch);
+    CHECK(mirror.query(query_all).size() == 0);
+    CHECK(snapshot->query(query_all).size() == N - 1);
+  }
+}
+
+//==============================================================================
+SCENARIO("Delayed routes are found at their delayed times")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const auto p = db.register_participant(create_test_description("p"));
+  db.set(p, create_test_input(0, create_test_trajectory(time)), 0);
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+  Mirror mirror;
+  mirror.update(db.changes(query_all, rmf_utils::nullopt));
+
+  // The route gets delayed many times in small increments, the way it would be
+  // while a robot is blocked.
+  for (std::size_t i = 0; i < 30; ++i)
+    db.delay(p, 2s, i + 1);
+
+  const auto snapshot = db.snapshot();
+  mirror.update(db.changes(query_all, mirror.latest_version()));
+
+  const auto check_viewer = [&](const Viewer& viewer)
+    {
+      const auto view = viewer.query(query_all);
+      REQUIRE(view.size() == 1);
+      const auto& trajectory = view.begin()->route.trajectory();
+      CHECK(*trajectory.start_time() == time + 60s);
+      CHECK(*trajectory.finish_time() == time + 70s);
+
+      const rmf_traffic::Time before = time + 59s;
+      const rmf_traffic::Time after = time + 71s;
+      CHECK(viewer.query(make_query({"test_map"}, nullptr, &before)).size()
+        == 0);
+      CHECK(viewer.query(make_query({"test_map"}, &after, nullptr)).size()
+        == 0);
+      CHECK(viewer.query(make_query({"test_map"}, &before, &after)).size()
+        == 1);
+
+      const auto circle = rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Circle>(0.5);
+      Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+      tf.translate(Eigen::Vector2d{5, 0});
+      const rmf_traffic::geometry::Space space{circle, tf};
+
+      // The route only passes through x=5 around 65s after the start
+      const rmf_traffic::Region early{"test_map", time, time + 20s, {space}};
+      CHECK(viewer.query(make_query({early})).size() == 0);
+
+      const rmf_traffic::Region late{
+        "test_map", time + 60s, time + 70s, {space}};
+      CHECK(viewer.query(make_query({late})).size() == 1);
+    };
+
+  check_viewer(db);
+  check_viewer(*snapshot);
+  check_viewer(mirror);
+
+  // The delayed route only gets created once
+  const auto first = db.query(query_all);
+  const auto second = db.query(query_all);
+  CHECK(&first.begin()->route == &second.begin()->route);
+}
+
+//==============================================================================
+SCENARIO("Batched changes share one schedule version")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const std::size_t N = 5;
+  for (const auto p : register_test_participants(db, N))
+    db.set(p, create_test_input(0, create_test_trajectory(time)), 0);
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+  Mirror mirror;
+  mirror.update(db.changes(query_all, rmf_utils::nullopt));
+
+  const Version before = db.latest_version();
+  CHECK(db.batch([](Database&) {}) == before);
+
+  const Version after = db.batch(
+    [&](Database& batch)
+    {
+      batch.set(0, create_test_input(1, create_test_trajectory(time + 5s)), 1);
+      batch.delay(1, 3s, 1);
+      batch.delay(1, 4s, 2);
+      batch.erase(2, 1);
+      batch.extend(
+        3, create_test_input(1, create_test_trajectory(time + 20s)), 1);
+      batch.set(4, create_test_input(1, create_test_trajectory(time)), 1);
+      batch.delay(4, 2s, 2);
+    });
+
+  CHECK(after == before + 1);
+  CHECK(db.latest_version() == after);
+
+  const auto patch = db.changes(query_all, before);
+  CHECK(patch.latest_version() == after);
+  CHECK(patch.size() == N);
+  for (const auto& p : patch)
+  {
+    if (p.participant_id() == 1)
+    {
+      // Both delays of the batch get folded into one
+      REQUIRE(p.delays().size() == 1);
+      CHECK(p.delays().front().duration() == 7s);
+    }
+    else if (p.participant_id() == 4)
+    {
+      // The delay applies to a route that was added in the same batch, so the
+      // mirror only needs to see the delayed route
+      CHECK(p.delays().empty());
+      CHECK(p.additions().items().size() == 1);
+    }
+  }
+
+  mirror.update(patch);
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    const auto expected = db.get_itinerary(i);
+    const auto actual = mirror.get_itinerary(i);
+    REQUIRE(expected);
+    REQUIRE(actual);
+    REQUIRE(expected->size() == actual->size());
+
+    std::set<rmf_traffic::Time> expected_starts;
+    std::set<rmf_traffic::Time> actual_starts;
+    for (std::size_t j = 0; j < expected->size(); ++j)
+    {
+      expected_starts.insert(*(*expected)[j]->trajectory().start_time());
+      actual_starts.insert(*(*actual)[j]->trajectory().start_time());
+    }
+
+    CHECK(expected_starts == actual_starts);
+  }
+
+  CHECK(*(*db.get_itinerary(1)).front()->trajectory().start_time()
+    == time + 7s);
+
+  WHEN("A participant registers in the middle of a batch")
+  {
+    Version registration = 0;
+    const Version last = db.batch(
+      [&](Database& batch)
+      {
+        batch.delay(0, 1s, 2);
+        batch.register_participant(create_test_description("late"));
+        registration = batch.latest_version();
+        batch.delay(1, 1s, 3);
+      });
+
+    CHECK(registration == after + 2);
+    CHECK(last == after + 3);
+  }
+}
+
+//==============================================================================
+SCENARIO("Published database states can be read while the database changes")
+{
+  using namespace rmf_traffic::schedule;
+
+  Database db;
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const std::size_t N = 5;
+  std::vector<ItineraryVersion> versions;
+  for (const auto p : register_test_participants(db, N))
+  {
+    db.set(p, create_test_input(0, create_test_trajectory(time)), 0);
+    versions.push_back(1);
+  }
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+
+  CHECK_FALSE(db.published());
+  db.enable_publishing();
+
+  const auto published = db.published();
+  REQUIRE(published);
+  CHECK(published->latest_version() == db.latest_version());
+  CHECK(published->participant_ids().size() == N);
+  CHECK(published->query(query_all).size() == N);
+
+  WHEN("The database changes after being published")
+  {
+    const Version before = published->latest_version();
+    db.batch(
+      [&](Database& batch)
+      {
+        batch.delay(0, 5s, versions[0]++);
+
+        // The changes of a batch are only published after the whole batch
+        CHECK(db.published() == published);
+      });
+
+    db.erase(1, versions[1]++);
+    db.unregister_participant(2);
+
+    const auto latest = db.published();
+    CHECK(latest->latest_version() == db.latest_version());
+    CHECK(latest->query(query_all).size() == N - 2);
+
+    // The state that was published earlier remains the same
+    CHECK(published->latest_version() == before);
+    CHECK(published->participant_ids().size() == N);
+    CHECK(published->query(query_all).size() == N);
+    CHECK(published->changes(query_all, before).size() == 0);
+
+    Mirror mirror;
+    mirror.update(published->changes(query_all, rmf_utils::nullopt));
+    CHECK(mirror.query(query_all).size() == N);
+
+    mirror.update(latest->changes(query_all, before));
+    CHECK(mirror.latest_version() == latest->latest_version());
+    CHECK(mirror.query(query_all).size() == N - 2);
+    CHECK(*(*mirror.get_itinerary(0)).front()->trajectory().start_time()
+      == time + 5s);
+  }
+
+  WHEN("Another thread reads the published states while the database changes")
+  {
+    std::atomic_bool finished(false);
+    std::size_t regressions = 0;
+    std::size_t failures = 0;
+
+    Mirror reader_mirror;
+    rmf_utils::optional<Version> reader_version;
+    std::thread reader(
+      [&]()
+      {
+        while (!finished)
+        {
+          const auto state = db.published();
+          const Version v = state->latest_version();
+          if (reader_version && v < *reader_version)
+            ++regressions;
+
+          if (reader_version && v == *reader_version)
+            continue;
+
+          try
+          {
+            const auto patch = state->changes(query_all, reader_version);
+            reader_mirror.update(patch);
+            reader_version = patch.latest_version();
+          }
+          catch (const std::exception&)
+          {
+            ++failures;
+          }
+        }
+      });
+
+    rmf_traffic::RouteId next_route = 1;
+    for (std::size_t k = 0; k < 200; ++k)
+    {
+      if (k % 10 == 0)
+      {
+        db.batch(
+          [&](Database& batch)
+          {
+            for (ParticipantId p = 0; p < N; ++p)
+            {
+              batch.set(
+                p,
+                create_test_input(
+                  next_route, create_test_trajectory(time + 1s * k)),
+                versions[p]++);
+            }
+          });
+
+        ++next_route;
+      }
+      else
+      {
+        for (ParticipantId p = 0; p < N; ++p)
+          db.delay(p, 100ms, versions[p]++);
+      }
+
+      if (k % 50 == 49)
+        db.cull(time - 1h);
+    }
+
+    finished = true;
+    reader.join();
+
+    CHECK(regressions == 0);
+    CHECK(failures == 0);
+
+    reader_mirror.update(db.published()->changes(query_all, reader_version));
+    CHECK(reader_mirror.latest_version() == db.latest_version());
+    for (ParticipantId p = 0; p < N; ++p)
+    {
+      const auto expected = db.get_itinerary(p);
+      const auto actual = reader_mirror.get_itinerary(p);
+      REQUIRE(expected);
+      REQUIRE(actual);
+      REQUIRE(expected->size() == 1);
+      REQUIRE(actual->size() == 1);
+      CHECK(*expected->front()->trajectory().start_time()
+        == *actual->front()->trajectory().start_time());
+    }
+  }
+}
+
+//==============================================================================
+SCENARIO("Database state is recovered from the disk")
+{
+  using namespace rmf_traffic::schedule;
+
+  char directory_template[] = "/tmp/rmf_traffic_test_Database_XXXXXX";
+  REQUIRE(mkdtemp(directory_template));
+  const std::string directory = directory_template;
+  const std::string log_path = directory + "/schedule.log";
+  const std::string snapshot_path = directory + "/schedule.snapshot";
+
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  const auto check_same = [](const Database& expected, const Database& actual)
+    {
+      CHECK(actual.latest_version() == expected.latest_version());
+      REQUIRE(actual.participant_ids() == expected.participant_ids());
+      for (const ParticipantId p : expected.participant_ids())
+      {
+        CHECK(actual.itinerary_version(p) == expected.itinerary_version(p));
+        CHECK(actual.get_participant(p)->name()
+          == expected.get_participant(p)->name());
+
+        using Span = std::tuple<rmf_traffic::Time, rmf_traffic::Time>;
+        const auto get_spans = [](const Database& db, const ParticipantId p)
+          {
+            const auto itinerary = Database::Debug::get_itinerary(db, p);
+            REQUIRE(itinerary);
+
+            std::map<rmf_traffic::RouteId, Span> spans;
+            for (const auto& item : *itinerary)
+            {
+              spans[item.id] = Span{
+                *item.route->trajectory().start_time(),
+                *item.route->trajectory().finish_time()
+              };
+            }
+
+            return spans;
+          };
+
+        CHECK(get_spans(actual, p) == get_spans(expected, p));
+      }
+    };
+
+  // Every change gets applied to a Database without persistence too, so we
+  // know what the recovered state should be.
+  Database expected;
+  auto persistent = std::make_unique<Database>(PersistenceOptions(directory));
+
+  const auto apply = [&](const std::function<void(Database&)>& change)
+    {
+      change(expected);
+      change(*persistent);
+    };
+
+  apply(
+    [&](Database& db)
+    {
+      for (const auto p : register_test_participants(db, 3))
+        db.set(p, create_test_input(0, create_test_trajectory(time)), 0);
+    });
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+  Mirror mirror;
+  mirror.update(persistent->changes(query_all, rmf_utils::nullopt));
+  const Version mirror_version = mirror.latest_version();
+
+  apply(
+    [&](Database& db)
+    {
+      db.batch(
+        [&](Database& batch)
+        {
+          batch.set(
+            0, create_test_input(1, create_test_trajectory(time + 5s)), 1);
+          batch.delay(1, 3s, 1);
+          batch.extend(
+            1, create_test_input(1, create_test_trajectory(time + 30s)), 2);
+          batch.erase(1, {0}, 3);
+        });
+
+      db.set_current_time(time);
+      db.unregister_participant(2);
+      db.delay(0, 2s, 2);
+      db.register_participant(create_test_description("late"));
+      db.cull(time - 1h);
+
+      // This removes the route that participant 1 erased
+      while (!db.cull(time + 14s, 1))
+      {
+        // Keep culling
+      }
+    });
+
+  check_same(expected, *persistent);
+
+  WHEN("The database is recovered")
+  {
+    persistent.reset();
+    Database recovered{PersistenceOptions(directory)};
+    check_same(expected, recovered);
+
+    THEN("Mirrors that were up to date with the snapshot can keep updating")
+    {
+      mirror.update(recovered.changes(query_all, mirror_version));
+      CHECK(mirror.latest_version() == recovered.latest_version());
+      for (const ParticipantId p : recovered.participant_ids())
+      {
+        const auto expected_itinerary = recovered.get_itinerary(p);
+        const auto mirror_itinerary = mirror.get_itinerary(p);
+        REQUIRE(expected_itinerary);
+        REQUIRE(mirror_itinerary);
+        CHECK(mirror_itinerary->size() == expected_itinerary->size());
+      }
+    }
+
+    THEN("The recovered database keeps its versions going")
+    {
+      const Version before = recovered.latest_version();
+      recovered.delay(0, 1s, 3);
+      expected.delay(0, 1s, 3);
+      CHECK(recovered.latest_version() == before + 1);
+
+      // Participant IDs do not get reused
+      CHECK(recovered.register_participant(create_test_description("new"))
+        == expected.register_participant(create_test_description("new")));
+
+      recovered.checkpoint();
+      recovered.erase(0, 4);
+      expected.erase(0, 4);
+      check_same(expected, recovered);
+    }
+  }
+
+  WHEN("The log was interrupted in the middle of a record")
+  {
+    persistent.reset();
+    {
+      // The size of this record says that it should be longer than it is
+      const std::string torn("\x20\x00\x00\x00\x01\x02\x03\x04torn", 12);
+      std::ofstream log(log_path, std::ios::binary | std::ios::app);
+      log.write(torn.data(), torn.size());
+    }
+
+    Database recovered{PersistenceOptions(directory)};
+    check_same(expected, recovered);
+  }
+
+  WHEN("Snapshots are taken automatically")
+  {
+    persistent.reset();
+    persistent = std::make_unique<Database>(
+      PersistenceOptions(directory).checkpoint_interval(2));
+    check_same(expected, *persistent);
+
+    rmf_traffic::RouteId route = 10;
+    for (std::size_t i = 0; i < 5; ++i)
+    {
+      apply(
+        [&](Database& db)
+        {
+          db.set(
+            1,
+            create_test_input(route, create_test_trajectory(time + 1s * i)),
+            4 + i);
+          db.delay(0, 1s, 3 + i);
+        });
+
+      ++route;
+    }
+
+    persistent.reset();
+    Database recovered{PersistenceOptions(directory)};
+    check_same(expected, recovered);
+  }
+
+  WHEN("The database is recovered without any log")
+  {
+    persistent->checkpoint();
+    persistent.reset();
+    CHECK(std::remove(log_path.c_str()) == 0);
+
+    Database recovered{PersistenceOptions(directory)};
+    check_same(expected, recovered);
+  }
+
+  WHEN("Something is in the way of a fixed temporary file name")
+  {
+    // This could be left behind by a crash, or be in use by another writer
+    const std::string blocker = snapshot_path + ".tmp";
+    REQUIRE(mkdir(blocker.c_str(), 0700) == 0);
+
+    CHECK_NOTHROW(persistent->checkpoint());
+    persistent.reset();
+
+    std::vector<std::string> entries;
+    DIR* const dir = opendir(directory.c_str());
+    REQUIRE(dir);
+    while (const dirent* entry = readdir(dir))
+      entries.push_back(entry->d_name);
+    closedir(dir);
+
+    // Besides "." and "..", only the log, the snapshot and the blocker are in
+    // the directory, so no temporary files were left behind.
+    CHECK(entries.size() == 5);
+
+    Database recovered{PersistenceOptions(directory)};
+    check_same(expected, recovered);
+    CHECK(rmdir(blocker.c_str()) == 0);
+  }
+
+  persistent.reset();
+  std::remove(log_path.c_str());
+  std::remove(snapshot_path.c_str());
+  rmdir(directory.c_str());
+}
+
+//==============================================================================
+SCENARIO("Culls can be spread across many calls")
+{
+  using namespace rmf_traffic::schedule;
+
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+
+  // Each participant has routes that finish at 10s, 20s, ..., 100s
+  const auto fill = [&](Database& db)
+    {
+      for (const auto p : register_test_participants(db, 4))
+      {
+        Writer::Input input;
+        for (rmf_traffic::RouteId r = 0; r < 10; ++r)
+        {
+          input.push_back(
+            {
+              r,
+              std::make_shared<rmf_traffic::Route>(
+                "L1", create_test_trajectory(time + 10s*r))
+            });
+        }
+
+        db.set(p, input, 0);
+      }
+    };
+
+  Database full;
+  fill(full);
+  Database incremental;
+  fill(incremental);
+
+  const auto query_all = rmf_traffic::schedule::query_all();
+  Mirror mirror;
+  mirror.update(incremental.changes(query_all, rmf_utils::nullopt));
+
+  // Participant 0 delays its routes, so they expire 15s later than the others
+  full.delay(0, 15s, 1);
+  incremental.delay(0, 15s, 1);
+
+  // Participant 1 erases a route, but it still needs to be culled
+  full.erase(1, {9}, 1);
+  incremental.erase(1, {9}, 1);
+
+  const rmf_traffic::Time cull_time = time + 55s;
+  full.cull(cull_time);
+
+  std::size_t calls = 1;
+  rmf_utils::optional<Version> finished = incremental.cull(cull_time, 3);
+  while (!finished)
+  {
+    // Until the cull is finished, mirrors are not told to cull anything
+    mirror.update(incremental.changes(query_all, mirror.latest_version()));
+    CHECK(mirror.query(query_all).size() == 39);
+
+    finished = incremental.cull(cull_time, 3);
+    ++calls;
+  }
+
+  // 18 routes expired: 3 for participant 0, and 5 for each of the others
+  CHECK(calls == 6);
+  CHECK(*finished == incremental.latest_version());
+
+  for (const ParticipantId p : full.participant_ids())
+  {
+    const auto expected = Database::Debug::get_itinerary(full, p);
+    const auto actual = Database::Debug::get_itinerary(incremental, p);
+    REQUIRE(expected);
+    REQUIRE(actual);
+
+    std::set<rmf_traffic::RouteId> expected_routes;
+    for (const auto& item : *expected)
+      expected_routes.insert(item.id);
+
+    std::set<rmf_traffic::RouteId> actual_routes;
+    for (const auto& item : *actual)
+      actual_routes.insert(item.id);
+
+    CHECK(actual_routes == expected_routes);
+  }
+
+  CHECK(Database::Debug::current_entry_history_count(incremental)
+    == Database::Debug::current_entry_history_count(full));
+
+  const auto patch = incremental.changes(query_all, mirror.latest_version());
+  REQUIRE(patch.cull());
+  CHECK(patch.cull()->time() == cull_time);
+  mirror.update(patch);
+  CHECK(mirror.query(query_all).size() == full.query(query_all).size());
+
+  // Culled routes are no longer active, so the participants can keep changing
+  // their itineraries
+  CHECK_NOTHROW(incremental.delay(1, 1s, 2));
+  CHECK_NOTHROW(full.delay(1, 1s, 2));
+  CHECK(incremental.get_itinerary(1)->size() == 4);
+
+  WHEN("No routes are allowed to be removed")
+  {
+    const Version before = incremental.latest_version();
+
+    THEN("The call is rejected instead of never finishing")
+    {
+      CHECK_THROWS_AS(
+        incremental.cull(time + 100s, 0), std::invalid_argument);
+      CHECK(incremental.latest_version() == before);
+    }
+  }
+
+  WHEN("Nothing has expired")
+  {
+    const Version before = incremental.latest_version();
+    const auto version = incremental.cull(time - 1h, 3);
+
+    THEN("Nothing happens")
+    {
+      CHECK_FALSE(version);
+      CHECK(incremental.latest_version() == before);
+
+      const auto idle_patch = incremental.changes(query_all, before);
+      CHECK_FALSE(idle_patch.cull());
+      CHECK(idle_patch.size() == 0);
+    }
+  }
+
+  WHEN("A participant was removed before the cull time")
+  {
+    incremental.set_current_time(time);
+    incremental.unregister_participant(2);
+    const std::size_t removed =
+      Database::Debug::current_removed_participant_count(incremental);
+    REQUIRE(removed > 0);
+
+    THEN("The cull still gets finished so the participant is forgotten")
+    {
+      // The routes of the participant are removed as soon as it unregisters,
+      // so no routes expire during this cull.
+      const auto version = incremental.cull(time + 1s, 3);
+      REQUIRE(version);
+      CHECK(*version == incremental.latest_version());
+      CHECK(Database::Debug::current_removed_participant_count(incremental)
+        == removed - 1);
+    }
+  }
+}
@@ -344,6 +344,44 @@ SCENARIO("Testing specialized mirrors")
     CHECK(changes.begin()->additions().items().begin()->id == 1);
   }
 
+  GIVEN("Query patch with a region whose spaces overlap with t1 and t2")
+  {
+    auto time = std::chrono::steady_clock::now();
+    auto query = rmf_traffic::schedule::make_query({});
+    REQUIRE(query.spacetime().regions() != nullptr);
+
+    const auto box = rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Box>(10.0, 1.0);
+
+    // The first space only overlaps with t1, and the second space only
+    // overlaps with t2. Each route should be found by the space that overlaps
+    // with it, regardless of the order that the spaces are checked in.
+    Eigen::Isometry2d tf_1 = Eigen::Isometry2d::Identity();
+    Eigen::Isometry2d tf_2 = Eigen::Isometry2d::Identity();
+    tf_2.translate(Eigen::Vector2d{0.0, 10.0});
+
+    std::vector<rmf_traffic::geometry::Space> spaces;
+    spaces.emplace_back(box, tf_1);
+    spaces.emplace_back(box, tf_2);
+
+    rmf_traffic::Region region("test_map", time, time+10s, spaces);
+    query.spacetime().regions()->push_back(region);
+
+    rmf_traffic::schedule::Patch changes =
+      db.changes(query, rmf_utils::nullopt);
+
+    REQUIRE(changes.size() == 1);
+    CHECK(changes.begin()->participant_id() == p1);
+
+    std::unordered_set<rmf_traffic::RouteId> ids;
+    for (const auto& item : changes.begin()->additions().items())
+      ids.insert(item.id);
+
+    CHECK(ids.size() == 2);
+    CHECK(ids.count(0) == 1);
+    CHECK(ids.count(1) == 1);
+  }
+
 //  // COMMENTED DUE TO NON-DETERMINISTIC BEHAVIOR OF FCL
 
 //  GIVEN("Query patch with rotated spacetime region overlapping with t1")
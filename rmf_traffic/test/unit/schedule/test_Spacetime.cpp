@@ -1513,3 +1513,87 @@ SCENARIO("Testing multi-waypoint trajectories with various spacetimes")
     // Eigen::Isometry2d tf= Eigen::Isometry2d::Identity();
   }
 }
+
+SCENARIO("Bounding boxes of trajectories and spacetime regions")
+{
+  using namespace std::chrono_literals;
+  auto time = std::chrono::steady_clock::now();
+
+  const auto circle_shape = rmf_traffic::geometry::make_final_convex<
+    rmf_traffic::geometry::Circle>(1.0);
+  rmf_traffic::Profile circle{circle_shape};
+
+  rmf_traffic::Trajectory t1;
+  t1.insert(time, {-5, 0, 0}, {1, 0, 0});
+  t1.insert(time+10s, {0, -5, 0}, {0, -1, 0});
+  t1.insert(time+20s, {5, -5, 0}, {1, 0, 0});
+
+  const auto trajectory_box =
+    rmf_traffic::internal::get_vicinity_bounding_box(circle, t1);
+
+  CHECK(trajectory_box.min.x() <= -6.0);
+  CHECK(trajectory_box.max.x() >= 6.0);
+  CHECK(trajectory_box.min.y() <= -6.0);
+  CHECK(trajectory_box.max.y() >= 1.0);
+
+  const auto region_box_shape = rmf_traffic::geometry::make_final_convex<
+    rmf_traffic::geometry::Box>(2.0, 2.0);
+
+  std::chrono::_V2::steady_clock::time_point lower_time_bound = time;
+  std::chrono::_V2::steady_clock::time_point upper_time_bound = time+20s;
+
+  GIVEN("A region that intersects the trajectory")
+  {
+    Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+    tf.translate(Eigen::Vector2d{2.5, -5.0});
+
+    rmf_traffic::internal::Spacetime region = {
+      &lower_time_bound,
+      &upper_time_bound,
+      tf,
+      region_box_shape
+    };
+
+    CHECK(rmf_traffic::internal::detect_conflicts(circle, t1, region));
+    CHECK(rmf_traffic::internal::overlap(
+        trajectory_box,
+        rmf_traffic::internal::get_region_bounding_box(region)));
+  }
+
+  GIVEN("A region that is far away from the trajectory")
+  {
+    Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+    tf.translate(Eigen::Vector2d{0.0, 10.0});
+
+    rmf_traffic::internal::Spacetime region = {
+      &lower_time_bound,
+      &upper_time_bound,
+      tf,
+      region_box_shape
+    };
+
+    CHECK_FALSE(rmf_traffic::internal::detect_conflicts(circle, t1, region));
+    CHECK_FALSE(rmf_traffic::internal::overlap(
+        trajectory_box,
+        rmf_traffic::internal::get_region_bounding_box(region)));
+  }
+
+  GIVEN("A profile without a vicinity")
+  {
+    const rmf_traffic::Profile empty{nullptr};
+    const auto empty_box =
+      rmf_traffic::internal::get_vicinity_bounding_box(empty, t1);
+
+    Eigen::Isometry2d tf = Eigen::Isometry2d::Identity();
+    rmf_traffic::internal::Spacetime region = {
+      &lower_time_bound,
+      &upper_time_bound,
+      tf,
+      region_box_shape
+    };
+
+    CHECK_FALSE(rmf_traffic::internal::overlap(
+        empty_box,
+        rmf_traffic::internal::get_region_bounding_box(region)));
+  }
+}
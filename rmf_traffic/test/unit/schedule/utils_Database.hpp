@@ -18,6 +18,8 @@
 #ifndef RMF_TRAFFIC__TEST__UNIT__SCHEDULE__UTILS_TRAJECTORY_HPP
 #define RMF_TRAFFIC__TEST__UNIT__SCHEDULE__UTILS_TRAJECTORY_HPP
 
+#include "../utils_Trajectory.hpp"
+
 #include <rmf_traffic/DetectConflict.hpp>
 #include <rmf_traffic/Trajectory.hpp>
 
@@ -82,5 +84,47 @@ inline rmf_traffic::schedule::Writer::Input create_test_input(
   };
 }
 
+//==============================================================================
+/// A trajectory that moves from (0, 0) to (10, 0) over 10 seconds, beginning
+/// at start_time.
+inline rmf_traffic::Trajectory create_test_trajectory(
+  rmf_traffic::Time start_time)
+{
+  rmf_traffic::Trajectory t;
+  t.insert(start_time, {0, 0, 0}, Eigen::Vector3d::Zero());
+  t.insert(
+    start_time + std::chrono::seconds(10), {10, 0, 0}, Eigen::Vector3d::Zero());
+  return t;
+}
+
+//==============================================================================
+inline rmf_traffic::schedule::ParticipantDescription create_test_description(
+  const std::string& name)
+{
+  return rmf_traffic::schedule::ParticipantDescription{
+    name,
+    "test_Database",
+    rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
+    create_test_profile(UnitCircle)
+  };
+}
+
+//==============================================================================
+/// Register N participants named p0, p1, ... and get back their IDs.
+inline std::vector<rmf_traffic::schedule::ParticipantId>
+register_test_participants(
+  rmf_traffic::schedule::Database& db,
+  const std::size_t N)
+{
+  std::vector<rmf_traffic::schedule::ParticipantId> participants;
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    const std::string name = "p" + std::to_string(i);
+    participants.push_back(
+      db.register_participant(create_test_description(name)));
+  }
+
+  return participants;
+}
 
 #endif //RMF_TRAFFIC__TEST__UNIT__SCHEDULE__UTILS_TRAJECTORY_HPP
@@ -532,4 +532,225 @@ SCENARIO("DetectConflict unit tests")
   }
 }
 
+SCENARIO("Cached splines follow changes to the trajectory")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  rmf_traffic::Trajectory t1;
+  t1.insert(time, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+  t1.insert(time + 10s, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+
+  rmf_traffic::Trajectory t2;
+  t2.insert(time, {5.0, 5.0, 0.0}, {0.0, 0.0, 0.0});
+  t2.insert(time + 10s, {5.0, 5.0, 0.0}, {0.0, 0.0, 0.0});
+
+  // Checking the trajectories fills in their caches
+  CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+
+  const rmf_traffic::Trajectory copy = t2;
+
+  WHEN("A waypoint is moved into the path of the other trajectory")
+  {
+    t2.back().position({0.0, 0.0, 0.0});
+    CHECK(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+    CHECK_FALSE(
+      rmf_traffic::DetectConflict::between(profile, t1, profile, copy));
+  }
+
+  WHEN("A waypoint is inserted into the path of the other trajectory")
+  {
+    t2.insert(time + 5s, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+    CHECK(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+    CHECK_FALSE(
+      rmf_traffic::DetectConflict::between(profile, t1, profile, copy));
+  }
+
+  WHEN("The times of the other trajectory are shifted away")
+  {
+    t1.front().adjust_times(20s);
+    CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+
+    t2.back().position({0.0, 0.0, 0.0});
+    CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+  }
+}
+
+SCENARIO("Conflicts at the end of long trajectories that are far apart")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  // Two robots pace back and forth on lanes that are 10m apart
+  const std::size_t N = 300;
+  rmf_traffic::Trajectory t1;
+  rmf_traffic::Trajectory t2;
+  for (std::size_t i = 0; i < N; ++i)
+  {
+    const double x = static_cast<double>(i % 2);
+    const auto t = time + std::chrono::seconds(i);
+    t1.insert(t, {x, 0.0, 0.0}, {0.0, 0.0, 0.0});
+    t2.insert(t + 500ms, {x, 10.0, 0.0}, {0.0, 0.0, 0.0});
+  }
+
+  CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+
+  WHEN("One robot visits the lane of the other near the end")
+  {
+    const auto visit_time = time + std::chrono::seconds(N-10) + 500ms;
+    t2.find(visit_time)->position({0.0, 0.0, 0.0});
+
+    const auto conflict =
+      rmf_traffic::DetectConflict::between(profile, t1, profile, t2);
+    REQUIRE(conflict);
+    CHECK(visit_time - 1s < *conflict);
+    CHECK(*conflict <= visit_time);
+
+    const auto reverse =
+      rmf_traffic::DetectConflict::between(profile, t2, profile, t1);
+    REQUIRE(reverse);
+    CHECK(visit_time - 1s < *reverse);
+    CHECK(*reverse <= visit_time);
+  }
+}
+
+SCENARIO("Far apart trajectories whose waypoint times line up")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  // The waypoints of both robots are on the same whole seconds, so the segments
+  // of one trajectory always finish at the same time as a segment of the other.
+  const auto make_pacing = [&](
+    const std::size_t first, const std::size_t last, const double y)
+    {
+      rmf_traffic::Trajectory t;
+      for (std::size_t i = first; i < last; ++i)
+      {
+        const double x = static_cast<double>(i % 2);
+        t.insert(time + std::chrono::seconds(i), {x, y, 0.0}, {0.0, 0.0, 0.0});
+      }
+
+      return t;
+    };
+
+  const std::size_t N = 100;
+  for (const std::size_t offset : {0, 1, 2, 7, 50})
+  {
+    // The later trajectory begins exactly on a waypoint of the earlier one
+    const rmf_traffic::Trajectory t1 = make_pacing(0, N, 0.0);
+    rmf_traffic::Trajectory t2 = make_pacing(offset, N + offset, 10.0);
+
+    CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t1, profile, t2));
+    CHECK_FALSE(rmf_traffic::DetectConflict::between(profile, t2, profile, t1));
+
+    const auto visit_time = time + std::chrono::seconds(N - 5);
+    t2.find(visit_time)->position({1.0, 0.0, 0.0});
+
+    const auto conflict =
+      rmf_traffic::DetectConflict::between(profile, t1, profile, t2);
+    REQUIRE(conflict);
+    CHECK(visit_time - 1s < *conflict);
+    CHECK(*conflict <= visit_time);
+
+    const auto reverse =
+      rmf_traffic::DetectConflict::between(profile, t2, profile, t1);
+    REQUIRE(reverse);
+    CHECK(visit_time - 1s < *reverse);
+    CHECK(*reverse <= visit_time);
+  }
+}
+
 // A useful website for playing with 2D cubic splines: https://www.desmos.com/calculator/
+
+SCENARIO("Batch conflict checks match pairwise checks")
+{
+  const rmf_traffic::Time time = std::chrono::steady_clock::now();
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  // The candidate drives along the x axis
+  rmf_traffic::Trajectory candidate;
+  candidate.insert(time, {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+  candidate.insert(time + 10s, {10.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+  candidate.insert(time + 20s, {20.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+
+  // Each of these waits at a spot on or near the path of the candidate, some of
+  // them before or after the candidate passes by.
+  const std::vector<std::pair<Eigen::Vector3d, rmf_traffic::Duration>> spots = {
+    {{5.0, 10.0, 0.0}, 0s},
+    {{5.0, 0.0, 0.0}, 0s},
+    {{15.0, 0.0, 0.0}, 30s},
+    {{8.0, 0.3, 0.0}, 0s},
+    {{-20.0, 0.0, 0.0}, 0s},
+    {{18.0, 0.0, 0.0}, -15s}
+  };
+
+  std::vector<rmf_traffic::Trajectory> trajectories;
+  for (const auto& spot : spots)
+  {
+    rmf_traffic::Trajectory t;
+    t.insert(time + spot.second, spot.first, Eigen::Vector3d::Zero());
+    t.insert(time + spot.second + 10s, spot.first, Eigen::Vector3d::Zero());
+    trajectories.push_back(std::move(t));
+  }
+
+  std::vector<rmf_traffic::DetectConflict::Other> others;
+  for (const auto& t : trajectories)
+    others.push_back({profile, t});
+
+  std::vector<rmf_traffic::DetectConflict::Hit> expected;
+  for (std::size_t i = 0; i < trajectories.size(); ++i)
+  {
+    if (const auto t = rmf_traffic::DetectConflict::between(
+        profile, candidate, profile, trajectories[i]))
+      expected.push_back({i, *t});
+  }
+
+  REQUIRE(expected.size() == 2);
+  CHECK(expected[0].index == 1);
+  CHECK(expected[1].index == 3);
+
+  WHEN("Checking every other trajectory")
+  {
+    const auto hits =
+      rmf_traffic::DetectConflict::between(profile, candidate, others);
+
+    REQUIRE(hits.size() == expected.size());
+    for (std::size_t i = 0; i < hits.size(); ++i)
+    {
+      CHECK(hits[i].index == expected[i].index);
+      CHECK(hits[i].time == expected[i].time);
+    }
+  }
+
+  WHEN("Stopping at the first conflict")
+  {
+    const auto hits =
+      rmf_traffic::DetectConflict::between(profile, candidate, others, true);
+
+    REQUIRE(hits.size() == 1);
+    CHECK(hits.front().index == expected.front().index);
+    CHECK(hits.front().time == expected.front().time);
+  }
+
+  WHEN("One of the other trajectories is invalid")
+  {
+    const rmf_traffic::Trajectory empty;
+    others.push_back({profile, empty});
+    CHECK_THROWS_AS(
+      rmf_traffic::DetectConflict::between(profile, candidate, others),
+      rmf_traffic::invalid_trajectory_error);
+  }
+}
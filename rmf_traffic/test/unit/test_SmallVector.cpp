@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <src/rmf_traffic/SmallVector.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+using SmallVector = rmf_traffic::internal::SmallVector<std::string, 3>;
+
+//==============================================================================
+std::vector<std::string> contents(const SmallVector& v)
+{
+  return std::vector<std::string>(v.begin(), v.end());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Small vector storage")
+{
+  SmallVector v;
+  CHECK(v.empty());
+  CHECK(v.is_inline());
+
+  v.push_back("b");
+  v.emplace(v.begin(), "a");
+  v.emplace(v.end(), "d");
+  CHECK(v.is_inline());
+  CHECK(contents(v) == std::vector<std::string>{"a", "b", "d"});
+
+  WHEN("Growing beyond the inline capacity")
+  {
+    v.emplace(v.begin() + 2, "c");
+    v.emplace_back("e");
+    CHECK_FALSE(v.is_inline());
+    CHECK(contents(v) == std::vector<std::string>{"a", "b", "c", "d", "e"});
+
+    const SmallVector copy = v;
+    CHECK(contents(copy) == contents(v));
+
+    SmallVector moved = std::move(v);
+    CHECK(contents(moved) == contents(copy));
+    CHECK(v.empty());
+    CHECK(v.is_inline());
+
+    moved.erase(moved.begin() + 1, moved.begin() + 4);
+    CHECK(contents(moved) == std::vector<std::string>{"a", "e"});
+  }
+
+  WHEN("Moving an inline vector")
+  {
+    SmallVector moved = std::move(v);
+    CHECK(moved.is_inline());
+    CHECK(contents(moved) == std::vector<std::string>{"a", "b", "d"});
+    CHECK(v.empty());
+
+    v = moved;
+    v.erase(v.begin());
+    v.pop_back();
+    CHECK(contents(v) == std::vector<std::string>{"b"});
+    CHECK(contents(moved) == std::vector<std::string>{"a", "b", "d"});
+  }
+
+  WHEN("Reserving space")
+  {
+    v.reserve(10);
+    CHECK_FALSE(v.is_inline());
+    CHECK(v.capacity() == 10);
+    CHECK(contents(v) == std::vector<std::string>{"a", "b", "d"});
+  }
+}
+
+namespace {
+
+//==============================================================================
+/// An element whose move might throw, and whose copy throws once the number of
+/// copies left runs out.
+struct Fragile
+{
+  static int copies_left;
+  static int alive;
+
+  int value;
+
+  Fragile(int v)
+  : value(v)
+  {
+    ++alive;
+  }
+
+  Fragile(const Fragile& other)
+  : value(other.value)
+  {
+    if (copies_left == 0)
+      throw std::runtime_error("out of copies");
+
+    --copies_left;
+    ++alive;
+  }
+
+  Fragile(Fragile&& other) noexcept(false)
+  : value(other.value)
+  {
+    other.value = -1;
+    ++alive;
+  }
+
+  ~Fragile()
+  {
+    --alive;
+  }
+};
+
+int Fragile::copies_left = 0;
+int Fragile::alive = 0;
+
+} // anonymous namespace
+
+//==============================================================================
+SCENARIO("Small vector exception safety")
+{
+  static_assert(std::is_nothrow_move_constructible<SmallVector>::value,
+    "Moving a SmallVector of strings should never throw");
+  static_assert(std::is_nothrow_move_assignable<SmallVector>::value,
+    "Moving a SmallVector of strings should never throw");
+
+  using FragileVector = rmf_traffic::internal::SmallVector<Fragile, 2>;
+  static_assert(!std::is_nothrow_move_constructible<FragileVector>::value,
+    "Moving a SmallVector of Fragile elements might throw");
+
+  {
+    FragileVector v;
+    v.emplace_back(1);
+    v.emplace_back(2);
+
+    // The elements get copied into the new buffer because their move might
+    // throw, and the second copy fails.
+    Fragile::copies_left = 1;
+    CHECK_THROWS_AS(v.reserve(10), std::runtime_error);
+
+    CHECK(v.is_inline());
+    REQUIRE(v.size() == 2);
+    CHECK(v[0].value == 1);
+    CHECK(v[1].value == 2);
+    CHECK(Fragile::alive == 2);
+
+    Fragile::copies_left = 2;
+    v.reserve(10);
+    CHECK_FALSE(v.is_inline());
+    CHECK(v[0].value == 1);
+    CHECK(v[1].value == 2);
+    CHECK(Fragile::alive == 2);
+  }
+
+  CHECK(Fragile::alive == 0);
+}
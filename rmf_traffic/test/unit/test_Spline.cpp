@@ -66,3 +66,78 @@ SCENARIO("Test spline")
     CHECK(p[1] == Approx(delta_t.count() - 5.0));
   }
 }
+
+SCENARIO("Find the first contact between two splines")
+{
+  using namespace std::chrono_literals;
+
+  const rmf_traffic::Time begin_time = std::chrono::steady_clock::now();
+
+  GIVEN("Two robots driving straight at each other")
+  {
+    rmf_traffic::Trajectory trajectory_a;
+    trajectory_a.insert(begin_time, {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+    trajectory_a.insert(begin_time + 10s, {10.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+
+    rmf_traffic::Trajectory trajectory_b;
+    trajectory_b.insert(begin_time, {10.0, 0.0, 0.0}, {-1.0, 0.0, 0.0});
+    trajectory_b.insert(begin_time + 10s, {0.0, 0.0, 0.0}, {-1.0, 0.0, 0.0});
+
+    const rmf_traffic::DistanceDifferential D(
+      rmf_traffic::Spline(++trajectory_a.begin()),
+      rmf_traffic::Spline(++trajectory_b.begin()));
+
+    // The distance between them is 10 - 2t
+    const auto contact = D.first_contact(1.0);
+    REQUIRE(contact);
+    CHECK(*contact == Approx(0.45).margin(1e-6));
+
+    const auto already_close = D.first_contact(11.0);
+    REQUIRE(already_close);
+    CHECK(*already_close == 0.0);
+
+    // They pass through each other, so they get arbitrarily close
+    CHECK(D.first_contact(1e-3));
+  }
+
+  GIVEN("Two robots that curve past each other")
+  {
+    rmf_traffic::Trajectory trajectory_a;
+    trajectory_a.insert(begin_time, {0.0, 0.0, 0.0}, {2.0, 1.0, 0.0});
+    trajectory_a.insert(begin_time + 10s, {10.0, 3.0, 0.0}, {0.0, -1.0, 0.0});
+
+    rmf_traffic::Trajectory trajectory_b;
+    trajectory_b.insert(begin_time, {5.0, -3.0, 0.0}, {0.0, 2.0, 0.0});
+    trajectory_b.insert(begin_time + 10s, {4.0, 6.0, 0.0}, {-1.0, 0.0, 0.0});
+
+    const rmf_traffic::Spline spline_a(++trajectory_a.begin());
+    const rmf_traffic::Spline spline_b(++trajectory_b.begin());
+    const rmf_traffic::DistanceDifferential D(spline_a, spline_b);
+
+    // Compare against a dense sampling of the distance between the splines
+    const std::size_t N = 20000;
+    for (const double distance : {0.5, 1.0, 2.0, 4.0})
+    {
+      rmf_utils::optional<double> expected;
+      for (std::size_t i = 0; i <= N; ++i)
+      {
+        const double s = static_cast<double>(i)/static_cast<double>(N);
+        const auto t = begin_time + std::chrono::duration_cast<
+          rmf_traffic::Duration>(s*10s);
+
+        const Eigen::Vector3d p_a = spline_a.compute_position(t);
+        const Eigen::Vector3d p_b = spline_b.compute_position(t);
+        if ((p_a - p_b).block<2, 1>(0, 0).norm() < distance)
+        {
+          expected = s;
+          break;
+        }
+      }
+
+      const auto contact = D.first_contact(distance);
+      REQUIRE(contact.has_value() == expected.has_value());
+      if (contact)
+        CHECK(*contact == Approx(*expected).margin(1e-3));
+    }
+  }
+}
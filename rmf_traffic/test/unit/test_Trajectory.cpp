@@ -877,3 +877,62 @@ SCENARIO("Trajectory and base_iterator unit tests")
     }
   }
 }
+
+SCENARIO("Iterators survive reallocation of the waypoint storage")
+{
+  using namespace std::chrono_literals;
+  const rmf_traffic::Time start = std::chrono::steady_clock::now();
+
+  rmf_traffic::Trajectory trajectory;
+  const auto first = trajectory.insert(
+    start, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}).it;
+  const auto last = trajectory.insert(
+    start + 1000s, {10.0, 0.0, 0.0}, {0.0, 0.0, 0.0}).it;
+
+  std::vector<rmf_traffic::Trajectory::iterator> middle;
+  for (std::size_t i = 999; i > 0; --i)
+  {
+    const double x = static_cast<double>(i)/100.0;
+    middle.push_back(trajectory.insert(
+        start + std::chrono::seconds(i), {x, 0.0, 0.0}, {0.0, 0.0, 0.0}).it);
+  }
+
+  REQUIRE(trajectory.size() == 1001);
+  CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+      trajectory, true));
+
+  CHECK(first == trajectory.begin());
+  CHECK(first->time() == start);
+  CHECK(last->time() == start + 1000s);
+  CHECK(++rmf_traffic::Trajectory::iterator(last) == trajectory.end());
+  for (std::size_t i = 0; i < middle.size(); ++i)
+    CHECK(middle[i]->time() == start + std::chrono::seconds(999 - i));
+
+  WHEN("Erasing waypoints")
+  {
+    const auto next = trajectory.erase(middle[500], middle[10]);
+    CHECK(next == middle[10]);
+    CHECK(trajectory.size() == 1001 - 490);
+    CHECK(middle[600]->time() == start + 399s);
+    CHECK(middle[5]->time() == start + 994s);
+    CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+        trajectory, true));
+
+    const auto copy = trajectory;
+    CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+        copy, true));
+    CHECK(copy.find(start + 994s)->time() == start + 994s);
+  }
+
+  WHEN("Reserving space ahead of time")
+  {
+    rmf_traffic::Trajectory reserved;
+    reserved.reserve(trajectory.size());
+    for (const auto& wp : trajectory)
+      reserved.insert(wp);
+
+    CHECK(reserved.size() == trajectory.size());
+    CHECK(rmf_traffic::Trajectory::Debug::check_iterator_time_consistency(
+        reserved, true));
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <src/rmf_traffic/TrajectoryMotionCache.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+SCENARIO("Trajectory motion caches match their trajectory")
+{
+  using namespace std::chrono_literals;
+
+  const rmf_traffic::Time begin_time = std::chrono::steady_clock::now();
+
+  rmf_traffic::Trajectory trajectory;
+  trajectory.insert(begin_time, {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0});
+  trajectory.insert(begin_time + 10s, {10.0, 0.0, 0.0}, {0.0, 1.0, 0.0});
+  trajectory.insert(begin_time + 20s, {10.0, 10.0, 0.0}, {0.0, 1.0, 0.0});
+  trajectory.insert(begin_time + 30s, {10.0, 20.0, 0.0}, {0.0, 0.0, 0.0});
+
+  const auto motion = rmf_traffic::internal::get_motion_cache(trajectory);
+  REQUIRE(motion);
+  const auto& segments = motion->segments();
+  REQUIRE(segments.size() == trajectory.size() - 1);
+
+  std::size_t index = 0;
+  rmf_traffic::Time previous_time = trajectory.begin()->time();
+  for (auto it = ++trajectory.begin(); it != trajectory.end(); ++it, ++index)
+  {
+    CHECK(segments[index].spline.start_time() == previous_time);
+    CHECK(segments[index].spline.finish_time() == it->time());
+    previous_time = it->time();
+  }
+
+  WHEN("Finding segments by time")
+  {
+    for (const auto t : {0s, 5s, 10s, 15s, 30s})
+    {
+      // The segment that finishes at or after the time ends at the waypoint
+      // that Trajectory::find() gives back.
+      const auto it = trajectory.find(begin_time + t);
+      REQUIRE(it != trajectory.end());
+      const std::size_t i = motion->find_segment(begin_time + t);
+      REQUIRE(i < segments.size());
+      CHECK(segments[i].spline.finish_time() == std::max(
+          it->time(), segments.front().spline.finish_time()));
+    }
+
+    CHECK(motion->find_segment(begin_time + 31s) == segments.size());
+  }
+}
@@ -41,6 +41,7 @@ std::array<double, 3> from_eigen(const Eigen::Vector3d& values)
 rmf_traffic::Trajectory convert(const rmf_traffic_msgs::msg::Trajectory& from)
 {
   rmf_traffic::Trajectory output;
+  output.reserve(from.waypoints.size());
 
   for (const auto& waypoint : from.waypoints)
   {
@@ -35,57 +35,220 @@
 
 #include <rmf_utils/optional.hpp>
 
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 
 namespace rmf_traffic_ros2 {
 namespace schedule {
 
 //==============================================================================
+/// Check one change to the schedule against the routes that the viewer has on
+/// the same map during the same span of time.
 std::vector<ScheduleNode::ConflictSet> get_conflicts(
-  const rmf_traffic::schedule::Viewer::View& view_changes,
-  const rmf_traffic::schedule::ItineraryViewer& viewer)
+  const rmf_traffic::schedule::Viewer::View::Element& change,
+  const rmf_traffic::schedule::Viewer& viewer)
 {
+  // The timeline of the viewer only gives back the routes that could possibly
+  // conflict with the change, so we do not need to test every participant.
+  const auto& trajectory = change.route.trajectory();
+  rmf_traffic::schedule::Query::Spacetime spacetime;
+  spacetime.query_timespan()
+      .all_maps(false)
+      .add_map(change.route.map())
+      .set_lower_time_bound(*trajectory.start_time())
+      .set_upper_time_bound(*trajectory.finish_time());
+
+  // There's no need to check a participant against itself
+  const auto view = viewer.query(
+    spacetime,
+    rmf_traffic::schedule::Query::Participants::make_all_except(
+      {change.participant}));
+
+  std::vector<rmf_traffic::schedule::ParticipantId> participants;
+  std::vector<rmf_traffic::DetectConflict::Other> others;
+  for (const auto& v : view)
+  {
+    if (v.route.trajectory().size() < 2)
+      continue;
+
+    participants.push_back(v.participant);
+    others.push_back({v.description.profile(), v.route.trajectory()});
+  }
+
   std::vector<ScheduleNode::ConflictSet> conflicts;
-  const auto& participants = viewer.participant_ids();
-  for (const auto participant : participants)
+  const auto hits = rmf_traffic::DetectConflict::between(
+    change.description.profile(), trajectory, others);
+
+  for (const auto& hit : hits)
+    conflicts.push_back({participants[hit.index], change.participant});
+
+  return conflicts;
+}
+
+//==============================================================================
+std::vector<ScheduleNode::ConflictSet> get_conflicts(
+  const rmf_traffic::schedule::Viewer::View& view_changes,
+  const rmf_traffic::schedule::Viewer& viewer,
+  ScheduleNode::ConflictCheckWorkers& workers)
+{
+  // Trajectories with fewer than two waypoints cannot be checked for conflicts
+  std::vector<const rmf_traffic::schedule::Viewer::View::Element*> changes;
+  for (const auto& vc : view_changes)
   {
-    const auto itinerary = *viewer.get_itinerary(participant);
-    const auto& description = *viewer.get_participant(participant);
-    for (auto vc = view_changes.begin(); vc != view_changes.end(); ++vc)
+    if (vc.route.trajectory().size() >= 2)
+      changes.push_back(&vc);
+  }
+
+  // The workers take changes off of this shared counter one at a time, since
+  // some changes take much longer to check than others. Each change gets its
+  // own slot for results, so the results get merged in the same order no matter
+  // which worker checked them.
+  std::vector<std::vector<ScheduleNode::ConflictSet>> results(changes.size());
+  std::atomic_size_t next_change(0);
+  const std::function<void()> work = [&]()
     {
-      if (vc->participant == participant)
+      for (std::size_t i = next_change++; i < changes.size();
+        i = next_change++)
       {
-        // There's no need to check a participant against itself
-        continue;
+        results[i] = get_conflicts(*changes[i], viewer);
       }
+    };
 
-      for (const auto& route : itinerary)
-      {
-        assert(route);
-        if (route->map() != vc->route.map())
-          continue;
+  if (changes.size() < 2)
+    work();
+  else
+    workers.run(work);
+
+  std::vector<ScheduleNode::ConflictSet> conflicts;
+  for (auto& result : results)
+  {
+    for (auto& conflict : result)
+      conflicts.push_back(std::move(conflict));
+  }
+
+  return conflicts;
+}
 
-        if (rmf_traffic::DetectConflict::between(
-            vc->description.profile(),
-            vc->route.trajectory(),
-            description.profile(),
-            route->trajectory()))
+//==============================================================================
+ScheduleNode::ConflictCheckWorkers::ConflictCheckWorkers(
+  const std::size_t num_threads)
+{
+  for (std::size_t i = 1; i < num_threads; ++i)
+  {
+    _threads.emplace_back(
+      [this]()
+      {
+        std::size_t last_batch = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
         {
-          conflicts.push_back({participant, vc->participant});
+          _start_cv.wait(lock, [&]()
+          {
+            return _quit || _batch != last_batch;
+          });
+
+          if (_quit)
+            return;
+
+          last_batch = _batch;
+          const auto* work = _work;
+          lock.unlock();
+          (*work)();
+          lock.lock();
+
+          if (--_busy == 0)
+            _finish_cv.notify_all();
         }
-      }
-    }
+      });
   }
+}
 
-  return conflicts;
+//==============================================================================
+ScheduleNode::ConflictCheckWorkers::~ConflictCheckWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+
+  _start_cv.notify_all();
+  for (auto& thread : _threads)
+    thread.join();
+}
+
+//==============================================================================
+void ScheduleNode::ConflictCheckWorkers::run(const std::function<void()>& work)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _work = &work;
+    _busy = _threads.size();
+    ++_batch;
+  }
+
+  _start_cv.notify_all();
+  work();
+
+  // The work must stay alive until every helper thread is finished with it
+  std::unique_lock<std::mutex> lock(_mutex);
+  _finish_cv.wait(lock, [&]() { return _busy == 0; });
 }
 
+//==============================================================================
+namespace {
+
+//==============================================================================
+/// If the persistence_directory parameter is set, the database keeps a copy of
+/// itself in that directory and recovers from it when the node restarts.
+std::shared_ptr<rmf_traffic::schedule::Database> make_database(
+  rclcpp::Node& node)
+{
+  using rmf_traffic::schedule::Database;
+  const std::string directory =
+    node.declare_parameter<std::string>("persistence_directory", "");
+
+  if (directory.empty())
+    return std::make_shared<Database>();
+
+  auto database = std::make_shared<Database>(
+    rmf_traffic::schedule::PersistenceOptions(directory));
+
+  RCLCPP_INFO(
+    node.get_logger(),
+    "Recovered schedule version ["
+    + std::to_string(database->latest_version()) + "] with ["
+    + std::to_string(database->participant_ids().size())
+    + "] participants from [" + directory + "]");
+
+  return database;
+}
+
+} // anonymous namespace
+
 //==============================================================================
 ScheduleNode::ScheduleNode(const rclcpp::NodeOptions& options)
 : Node("rmf_traffic_schedule_node", options),
-  database(std::make_shared<rmf_traffic::schedule::Database>()),
-  active_conflicts(database)
+  database(make_database(*this))
 {
+  // The conflict checking thread and the mirror updates read from the published
+  // states of the database so that they never wait for itinerary changes.
+  database->enable_publishing();
+
+  const double cull_horizon_seconds =
+    declare_parameter<double>("cull_horizon", 3600.0);
+  if (cull_horizon_seconds > 0.0)
+  {
+    cull_horizon = std::chrono::duration_cast<rmf_traffic::Duration>(
+      std::chrono::duration<double>(cull_horizon_seconds));
+  }
+
+  const int64_t threads =
+    declare_parameter<int64_t>("conflict_check_threads", 1);
+  conflict_check_threads = threads > 1 ? static_cast<std::size_t>(threads) : 1;
+  conflict_check_workers =
+    std::make_unique<ConflictCheckWorkers>(conflict_check_threads);
+
   // TODO(MXG): As soon as possible, all of these services should be made
   // multi-threaded so they can be parallel processed.
 
@@ -179,6 +342,17 @@ ScheduleNode::ScheduleNode(const rclcpp::NodeOptions& options)
       this->itinerary_clear(*msg);
     });
 
+  itinerary_batch_timer = create_wall_timer(
+    std::chrono::milliseconds(10),
+    [=]()
+    {
+      // Nothing is waiting to be applied, so this is a good time to cull
+      if (this->pending_itinerary_changes.empty())
+        this->cull_expired_routes();
+      else
+        this->apply_itinerary_changes();
+    });
+
   inconsistency_pub =
     create_publisher<InconsistencyMsg>(
     rmf_traffic_ros2::ScheduleInconsistencyTopicName,
@@ -236,48 +410,50 @@ ScheduleNode::ScheduleNode(const rclcpp::NodeOptions& options)
 
       while (rclcpp::ok(get_node_options().context()) && !conflict_check_quit)
       {
-        rmf_utils::optional<rmf_traffic::schedule::Patch> next_patch;
         rmf_traffic::schedule::Viewer::View view_changes;
 
-        // Use this scope to minimize how long we lock the database for
         {
-          std::unique_lock<std::mutex> lock(database_mutex);
+          std::unique_lock<std::mutex> lock(conflict_check_mutex);
           conflict_check_cv.wait_for(lock, std::chrono::milliseconds(100), [&]()
           {
-            return (database->latest_version() > last_checked_version)
-            && !conflict_check_quit;
+            return (database->published()->latest_version()
+            > last_checked_version) && !conflict_check_quit;
           });
+        }
 
-          if (database->latest_version() == last_checked_version
+        // The published state of the database can be read without waiting for
+        // any of the itinerary changes that are being applied to it.
+        const auto published = database->published();
+        if (published->latest_version() == last_checked_version
           || conflict_check_quit)
-          {
-            // This is a casual wakeup to check if we're supposed to quit yet
-            continue;
-          }
+        {
+          // This is a casual wakeup to check if we're supposed to quit yet
+          continue;
+        }
 
-          next_patch = database->changes(query_all, last_checked_version);
+        try
+        {
+          const auto next_patch =
+            published->changes(query_all, last_checked_version);
 
-          // TODO(MXG): Check whether the database really needs to remain locked
-          // during this update.
-          try
-          {
-            mirror.update(*next_patch);
-            view_changes = database->query(query_all, last_checked_version);
-            last_checked_version = next_patch->latest_version();
-          }
-          catch (const std::exception& e)
-          {
-            RCLCPP_ERROR(get_logger(), e.what());
-            continue;
-          }
+          mirror.update(next_patch);
+          view_changes = published->query(query_all, last_checked_version);
+          last_checked_version = next_patch.latest_version();
+        }
+        catch (const std::exception& e)
+        {
+          RCLCPP_ERROR(get_logger(), e.what());
+          continue;
         }
 
-        const auto conflicts = get_conflicts(view_changes, mirror);
+        const auto conflicts =
+          get_conflicts(view_changes, mirror, *conflict_check_workers);
         std::unordered_map<Version, const Negotiation*> new_negotiations;
         for (const auto& conflict : conflicts)
         {
           std::unique_lock<std::mutex> lock(active_conflicts_mutex);
-          const auto new_negotiation = active_conflicts.insert(conflict);
+          const auto new_negotiation =
+            active_conflicts.insert(conflict, published);
 
           if (new_negotiation)
             new_negotiations[new_negotiation->first] = new_negotiation->second;
@@ -373,6 +549,10 @@ void ScheduleNode::register_participant(
   const RegisterParticipant::Request::SharedPtr& request,
   const RegisterParticipant::Response::SharedPtr& response)
 {
+  // Itinerary changes that arrived before this request must reach the database
+  // first, or else they could land after the registration is changed.
+  apply_itinerary_changes();
+
   std::unique_lock<std::mutex> lock(database_mutex);
 
   // TODO(MXG): Use try on every database operation
@@ -403,6 +583,11 @@ void ScheduleNode::unregister_participant(
   const UnregisterParticipant::Request::SharedPtr& request,
   const UnregisterParticipant::Response::SharedPtr& response)
 {
+  // The participant may still have itinerary changes waiting, like a clear
+  // that it sent right before unregistering. Those need to be applied while the
+  // participant still exists.
+  apply_itinerary_changes();
+
   std::unique_lock<std::mutex> lock(database_mutex);
 
   const auto& p = database->get_participant(request->participant_id);
@@ -425,6 +610,9 @@ void ScheduleNode::unregister_participant(
     const std::string name = p->name();
     const std::string owner = p->owner();
 
+    // The database stamps the unregistration with its current time, and culls
+    // use that stamp to decide when mirrors no longer need to hear about it.
+    database->set_current_time(rmf_traffic_ros2::convert(get_clock()->now()));
     database->unregister_participant(request->participant_id);
     response->confirmation = true;
 
@@ -465,91 +653,175 @@ void ScheduleNode::mirror_update(
   if (!request->initial_request)
     version = request->latest_mirror_version;
 
-  response->patch =
-    rmf_traffic_ros2::convert(database->changes(query_it->second, version));
+  response->patch = rmf_traffic_ros2::convert(
+    database->published()->changes(query_it->second, version));
 }
 
 //==============================================================================
 void ScheduleNode::itinerary_set(const ItinerarySet& set)
 {
-  std::unique_lock<std::mutex> lock(database_mutex);
   assert(!set.itinerary.empty());
-  database->set(
-    set.participant,
-    rmf_traffic_ros2::convert(set.itinerary),
-    set.itinerary_version);
-
-  publish_inconsistencies(set.participant);
-
-  std::lock_guard<std::mutex> lock2(active_conflicts_mutex);
-  active_conflicts.check(set.participant, set.itinerary_version);
-  wakeup_mirrors();
+  const ParticipantId participant = set.participant;
+  const auto itinerary = rmf_traffic_ros2::convert(set.itinerary);
+  const ItineraryVersion version = set.itinerary_version;
+  pending_itinerary_changes.push_back(
+    {
+      participant,
+      [=]()
+      {
+        database->set(participant, itinerary, version);
+        return version;
+      }
+    });
 }
 
 //==============================================================================
 void ScheduleNode::itinerary_extend(const ItineraryExtend& extend)
 {
-  std::unique_lock<std::mutex> lock(database_mutex);
-  database->extend(
-    extend.participant,
-    rmf_traffic_ros2::convert(extend.routes),
-    extend.itinerary_version);
-
-  publish_inconsistencies(extend.participant);
-
-  std::lock_guard<std::mutex> lock2(active_conflicts_mutex);
-  active_conflicts.check(
-    extend.participant, database->itinerary_version(extend.participant));
-  wakeup_mirrors();
+  const ParticipantId participant = extend.participant;
+  const auto routes = rmf_traffic_ros2::convert(extend.routes);
+  const ItineraryVersion version = extend.itinerary_version;
+  pending_itinerary_changes.push_back(
+    {
+      participant,
+      [=]()
+      {
+        database->extend(participant, routes, version);
+        return database->itinerary_version(participant);
+      }
+    });
 }
 
 //==============================================================================
 void ScheduleNode::itinerary_delay(const ItineraryDelay& delay)
 {
-  std::unique_lock<std::mutex> lock(database_mutex);
-  database->delay(
-    delay.participant,
-    rmf_traffic::Duration(delay.delay),
-    delay.itinerary_version);
+  const ParticipantId participant = delay.participant;
+  const rmf_traffic::Duration duration(delay.delay);
+  const ItineraryVersion version = delay.itinerary_version;
+  pending_itinerary_changes.push_back(
+    {
+      participant,
+      [=]()
+      {
+        database->delay(participant, duration, version);
+        return database->itinerary_version(participant);
+      }
+    });
+}
 
-  publish_inconsistencies(delay.participant);
+//==============================================================================
+void ScheduleNode::itinerary_erase(const ItineraryErase& erase)
+{
+  const ParticipantId participant = erase.participant;
+  const std::vector<rmf_traffic::RouteId> routes(
+    erase.routes.begin(), erase.routes.end());
+  const ItineraryVersion version = erase.itinerary_version;
+  pending_itinerary_changes.push_back(
+    {
+      participant,
+      [=]()
+      {
+        database->erase(participant, routes, version);
+        return database->itinerary_version(participant);
+      }
+    });
+}
 
-  std::lock_guard<std::mutex> lock2(active_conflicts_mutex);
-  active_conflicts.check(
-    delay.participant, database->itinerary_version(delay.participant));
-  wakeup_mirrors();
+//==============================================================================
+void ScheduleNode::itinerary_clear(const ItineraryClear& clear)
+{
+  const ParticipantId participant = clear.participant;
+  const ItineraryVersion version = clear.itinerary_version;
+  pending_itinerary_changes.push_back(
+    {
+      participant,
+      [=]()
+      {
+        database->erase(participant, version);
+        return database->itinerary_version(participant);
+      }
+    });
 }
 
 //==============================================================================
-void ScheduleNode::itinerary_erase(const ItineraryErase& erase)
+void ScheduleNode::apply_itinerary_changes()
 {
+  if (pending_itinerary_changes.empty())
+    return;
+
+  std::vector<ItineraryChange> changes;
+  std::swap(changes, pending_itinerary_changes);
+
   std::unique_lock<std::mutex> lock(database_mutex);
-  database->erase(
-    erase.participant,
-    std::vector<rmf_traffic::RouteId>(
-      erase.routes.begin(), erase.routes.end()),
-    erase.itinerary_version);
+  database->set_current_time(rmf_traffic_ros2::convert(get_clock()->now()));
+  std::vector<std::pair<ParticipantId, ItineraryVersion>> checks;
+  checks.reserve(changes.size());
+  database->batch(
+    [&](rmf_traffic::schedule::Database&)
+    {
+      for (const auto& change : changes)
+      {
+        try
+        {
+          checks.emplace_back(change.participant, change.apply());
+        }
+        catch (const std::exception& e)
+        {
+          RCLCPP_ERROR(
+            get_logger(),
+            "[ScheduleNode::apply_itinerary_changes] Failed to apply a change "
+            "for participant [" + std::to_string(change.participant) + "]: "
+            + e.what());
+        }
+      }
+    });
 
-  publish_inconsistencies(erase.participant);
+  std::unordered_set<ParticipantId> participants;
+  for (const auto& check : checks)
+  {
+    if (participants.insert(check.first).second)
+      publish_inconsistencies(check.first);
+  }
 
   std::lock_guard<std::mutex> lock2(active_conflicts_mutex);
-  active_conflicts.check(
-    erase.participant, database->itinerary_version(erase.participant));
+  for (const auto& check : checks)
+    active_conflicts.check(check.first, check.second);
+
   wakeup_mirrors();
 }
 
 //==============================================================================
-void ScheduleNode::itinerary_clear(const ItineraryClear& clear)
+void ScheduleNode::cull_expired_routes()
 {
-  std::unique_lock<std::mutex> lock(database_mutex);
-  database->erase(clear.participant, clear.itinerary_version);
+  // The number of routes to remove each time the node is idle
+  const std::size_t CullSliceSize = 1000;
+
+  if (!cull_horizon)
+    return;
 
-  publish_inconsistencies(clear.participant);
+  const rmf_traffic::Time now = rmf_traffic_ros2::convert(get_clock()->now());
+  if (!cull_in_progress)
+  {
+    if (last_cull_start && now - *last_cull_start < cull_period)
+      return;
 
-  std::lock_guard<std::mutex> lock2(active_conflicts_mutex);
-  active_conflicts.check(
-    clear.participant, database->itinerary_version(clear.participant));
-  wakeup_mirrors();
+    last_cull_start = now;
+    cull_in_progress = now - *cull_horizon;
+  }
+
+  std::unique_lock<std::mutex> lock(database_mutex);
+  database->set_current_time(now);
+  const auto version_before = database->latest_version();
+  if (database->cull(*cull_in_progress, CullSliceSize))
+  {
+    cull_in_progress = rmf_utils::nullopt;
+    wakeup_mirrors();
+  }
+  else if (database->latest_version() == version_before)
+  {
+    // Nothing had expired, so there is no cull to finish
+    cull_in_progress = rmf_utils::nullopt;
+  }
 }
 
 //==============================================================================
@@ -574,6 +846,11 @@ void ScheduleNode::wakeup_mirrors()
   msg.latest_version = database->latest_version();
   mirror_wakeup_publisher->publish(msg);
 
+  // Lock the mutex before notifying so that the conflict checking thread
+  // cannot miss this wakeup while it is checking the latest version.
+  {
+    std::lock_guard<std::mutex> lock(conflict_check_mutex);
+  }
   conflict_check_cv.notify_all();
 }
 
@@ -55,7 +55,11 @@
 
 #include <rmf_utils/Modular.hpp>
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <unordered_map>
 
 namespace rmf_traffic_ros2 {
@@ -157,6 +161,10 @@ public:
 
   void wakeup_mirrors();
 
+  // NOTE: This mutex only needs to be locked to modify the database.
+  // Threads that only read from the database should use database->published()
+  // which never needs to wait for the database_mutex.
+  //
   // TODO(MXG): Consider using libguarded instead of a database_mutex
   std::mutex database_mutex;
   std::shared_ptr<rmf_traffic::schedule::Database> database;
@@ -170,9 +178,44 @@ public:
 
   // TODO(MXG): Make this a separate node
   std::thread conflict_check_thread;
+  std::mutex conflict_check_mutex;
   std::condition_variable conflict_check_cv;
   std::atomic_bool conflict_check_quit;
 
+  // The number of threads that split up the work of checking each new version
+  // of the schedule for conflicts. This comes from the conflict_check_threads
+  // parameter.
+  std::size_t conflict_check_threads = 1;
+
+  // Helper threads that get created once and then share the work of every
+  // conflict check with the conflict checking thread.
+  class ConflictCheckWorkers
+  {
+  public:
+
+    /// Create enough helper threads that num_threads threads work together,
+    /// counting the thread that calls run().
+    ConflictCheckWorkers(std::size_t num_threads);
+
+    ~ConflictCheckWorkers();
+
+    /// Run the work on the calling thread and on every helper thread at the
+    /// same time. This returns once every thread has finished the work.
+    void run(const std::function<void()>& work);
+
+  private:
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _start_cv;
+    std::condition_variable _finish_cv;
+    const std::function<void()>* _work = nullptr;
+    std::size_t _batch = 0;
+    std::size_t _busy = 0;
+    bool _quit = false;
+  };
+
+  std::unique_ptr<ConflictCheckWorkers> conflict_check_workers;
+
   using ConflictAck = rmf_traffic_msgs::msg::NegotiationAck;
   using ConflictAckSub = rclcpp::Subscription<ConflictAck>;
   ConflictAckSub::SharedPtr conflict_ack_sub;
@@ -213,6 +256,35 @@ public:
 
   using Negotiation = rmf_traffic::schedule::Negotiation;
 
+  // Itinerary changes get queued up as they arrive, and then every change that
+  // arrived since the last batch gets applied to the database as a single
+  // transaction. That way a burst of changes only produces one new schedule
+  // version and one mirror wakeup.
+  struct ItineraryChange
+  {
+    ParticipantId participant;
+
+    // Apply the change to the database and return the itinerary version that
+    // the conflict record should check against
+    std::function<ItineraryVersion()> apply;
+  };
+
+  // The participant services apply whatever changes are waiting before they
+  // touch the database, so that changes are never applied out of order with a
+  // registration.
+  std::vector<ItineraryChange> pending_itinerary_changes;
+  rclcpp::TimerBase::SharedPtr itinerary_batch_timer;
+  void apply_itinerary_changes();
+
+  // Routes that finished longer than cull_horizon ago get culled one slice at
+  // a time whenever no itinerary changes are waiting, so that culling never
+  // holds up the changes for long. A new cull begins once per cull_period.
+  rmf_utils::optional<rmf_traffic::Duration> cull_horizon;
+  rmf_traffic::Duration cull_period = std::chrono::minutes(1);
+  rmf_utils::optional<rmf_traffic::Time> cull_in_progress;
+  rmf_utils::optional<rmf_traffic::Time> last_cull_start;
+  void cull_expired_routes();
+
   class ConflictRecord
   {
   public:
@@ -225,14 +297,14 @@ public:
       rmf_utils::optional<ItineraryVersion> itinerary_update_version;
     };
 
-    ConflictRecord(
-      std::shared_ptr<const rmf_traffic::schedule::Snappable> viewer)
-    : _viewer(std::move(viewer))
-    {
-      // Do nothing
-    }
-
-    rmf_utils::optional<Entry> insert(const ConflictSet& conflicts)
+    /// Add a set of conflicting participants to the record. If they need a
+    /// new negotiation, it begins from the given snapshot, which should be the
+    /// published state of the database that the conflict was found in. The
+    /// Database itself must not be used here, because the conflict checking
+    /// thread does not lock the database_mutex.
+    rmf_utils::optional<Entry> insert(
+      const ConflictSet& conflicts,
+      std::shared_ptr<const rmf_traffic::schedule::Snapshot> snapshot)
     {
       ConflictSet add_to_negotiation;
       const Version* existing_negotiation = nullptr;
@@ -278,7 +350,7 @@ public:
       if (!update_negotiation)
       {
         update_negotiation = *rmf_traffic::schedule::Negotiation::make(
-          _viewer->snapshot(), std::vector<ParticipantId>(
+          std::move(snapshot), std::vector<ParticipantId>(
             add_to_negotiation.begin(), add_to_negotiation.end()));
       }
       else
@@ -389,7 +461,6 @@ public:
     std::unordered_map<Version,
       rmf_utils::optional<NegotiationRoom>> _negotiations;
     std::unordered_map<ParticipantId, Wait> _waiting;
-    std::shared_ptr<const rmf_traffic::schedule::Snappable> _viewer;
     Version _next_negotiation_version = 0;
   };
 
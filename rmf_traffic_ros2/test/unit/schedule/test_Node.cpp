@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <src/rmf_traffic_ros2/schedule/internal_Node.hpp>
+
+#include <rmf_traffic_ros2/Time.hpp>
+#include <rmf_traffic_ros2/schedule/ParticipantDescription.hpp>
+#include <rmf_traffic_ros2/schedule/Query.hpp>
+#include <rmf_traffic_ros2/schedule/Writer.hpp>
+
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include <rmf_utils/catch.hpp>
+
+#include <array>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+using ScheduleNode = rmf_traffic_ros2::schedule::ScheduleNode;
+
+//==============================================================================
+rmf_traffic::schedule::ParticipantId register_test_participant(
+  ScheduleNode& node,
+  const std::string& name)
+{
+  const rmf_traffic::schedule::ParticipantDescription description{
+    name,
+    "test_Node",
+    rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
+    rmf_traffic::Profile{
+      rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Circle>(1.0)
+    }
+  };
+
+  const auto request =
+    std::make_shared<ScheduleNode::RegisterParticipant::Request>();
+  request->description = rmf_traffic_ros2::convert(description);
+  const auto response =
+    std::make_shared<ScheduleNode::RegisterParticipant::Response>();
+  node.register_participant(nullptr, request, response);
+  REQUIRE(response->error.empty());
+  return response->participant_id;
+}
+
+//==============================================================================
+ScheduleNode::UnregisterParticipant::Response::SharedPtr
+unregister_test_participant(
+  ScheduleNode& node,
+  const rmf_traffic::schedule::ParticipantId participant)
+{
+  const auto request =
+    std::make_shared<ScheduleNode::UnregisterParticipant::Request>();
+  request->participant_id = participant;
+  const auto response =
+    std::make_shared<ScheduleNode::UnregisterParticipant::Response>();
+  node.unregister_participant(nullptr, request, response);
+  return response;
+}
+
+//==============================================================================
+SCENARIO("Waiting itinerary changes are applied before unregistering")
+{
+  rclcpp::NodeOptions options;
+  const auto context = std::make_shared<rclcpp::Context>();
+  context->init(0, nullptr);
+  options.context(context);
+
+  const auto node = std::make_shared<ScheduleNode>(options);
+
+  const auto participant = register_test_participant(*node, "participant");
+
+  const rmf_traffic::Time now = std::chrono::steady_clock::now();
+  rmf_traffic::Trajectory trajectory;
+  trajectory.insert(now, {0, 0, 0}, {0, 0, 0});
+  trajectory.insert(now + 10s, {10, 0, 0}, {0, 0, 0});
+
+  ScheduleNode::ItinerarySet set;
+  set.participant = participant;
+  set.itinerary = rmf_traffic_ros2::convert(
+    rmf_traffic::schedule::Writer::Input{
+      {0, std::make_shared<rmf_traffic::Route>("test_map", trajectory)}
+    });
+  set.itinerary_version = 0;
+  node->itinerary_set(set);
+  node->apply_itinerary_changes();
+  REQUIRE(node->database->get_itinerary(participant));
+  REQUIRE(node->database->get_itinerary(participant)->size() == 1);
+
+  WHEN("The participant clears its itinerary right before unregistering")
+  {
+    // The clear arrives as a message, so it waits for the batch timer, while
+    // the unregistration is a service that gets handled right away.
+    ScheduleNode::ItineraryClear clear;
+    clear.participant = participant;
+    clear.itinerary_version = 1;
+    node->itinerary_clear(clear);
+    REQUIRE(node->pending_itinerary_changes.size() == 1);
+
+    const auto version_before = node->database->latest_version();
+
+    const auto unregister_response =
+      unregister_test_participant(*node, participant);
+
+    THEN("The clear reaches the database before the participant is removed")
+    {
+      CHECK(unregister_response->confirmation);
+      CHECK(unregister_response->error.empty());
+      CHECK(node->pending_itinerary_changes.empty());
+      CHECK_FALSE(node->database->get_participant(participant));
+
+      // One version for the clear, and one for the unregistration
+      CHECK(node->database->latest_version() == version_before + 2);
+    }
+  }
+
+  context->shutdown("test finished");
+}
+
+//==============================================================================
+SCENARIO("Culling keeps unregistrations that mirrors have not seen yet")
+{
+  rclcpp::NodeOptions options;
+  const auto context = std::make_shared<rclcpp::Context>();
+  context->init(0, nullptr);
+  options.context(context);
+
+  const auto node = std::make_shared<ScheduleNode>(options);
+  REQUIRE(node->cull_horizon);
+
+  const auto leaving = register_test_participant(*node, "leaving");
+  const auto staying = register_test_participant(*node, "staying");
+
+  // Give the cull something to remove, so that it really runs
+  const rmf_traffic::Time now =
+    rmf_traffic_ros2::convert(node->get_clock()->now());
+  const rmf_traffic::Time expired = now - *node->cull_horizon - 1h;
+  rmf_traffic::Trajectory trajectory;
+  trajectory.insert(expired, {0, 0, 0}, {0, 0, 0});
+  trajectory.insert(expired + 10s, {10, 0, 0}, {0, 0, 0});
+
+  ScheduleNode::ItinerarySet set;
+  set.participant = staying;
+  set.itinerary = rmf_traffic_ros2::convert(
+    rmf_traffic::schedule::Writer::Input{
+      {0, std::make_shared<rmf_traffic::Route>("test_map", trajectory)}
+    });
+  set.itinerary_version = 0;
+  node->itinerary_set(set);
+  node->apply_itinerary_changes();
+  REQUIRE(node->database->get_itinerary(staying)->size() == 1);
+
+  const auto query_request =
+    std::make_shared<ScheduleNode::RegisterQuery::Request>();
+  query_request->query =
+    rmf_traffic_ros2::convert(rmf_traffic::schedule::query_all());
+  const auto query_response =
+    std::make_shared<ScheduleNode::RegisterQuery::Response>();
+  node->register_query(nullptr, query_request, query_response);
+  REQUIRE(query_response->error.empty());
+
+  // This mirror has not heard about anything that happens from here on
+  const auto stale_version = node->database->latest_version();
+
+  REQUIRE(unregister_test_participant(*node, leaving)->confirmation);
+
+  const auto version_before_cull = node->database->latest_version();
+  node->cull_expired_routes();
+  REQUIRE(node->database->latest_version() != version_before_cull);
+
+  const auto update_request =
+    std::make_shared<ScheduleNode::MirrorUpdate::Request>();
+  update_request->query_id = query_response->query_id;
+  update_request->initial_request = false;
+  update_request->latest_mirror_version = stale_version;
+  const auto update_response =
+    std::make_shared<ScheduleNode::MirrorUpdate::Response>();
+  node->mirror_update(nullptr, update_request, update_response);
+  REQUIRE(update_response->error.empty());
+
+  const auto& unregistered = update_response->patch.unregister_participants;
+  REQUIRE(unregistered.size() == 1);
+  CHECK(unregistered.front() == leaving);
+  CHECK_FALSE(update_response->patch.cull.empty());
+
+  context->shutdown("test finished");
+}
+
+//==============================================================================
+SCENARIO("Negotiations open while itineraries are changing")
+{
+  rclcpp::NodeOptions options;
+  const auto context = std::make_shared<rclcpp::Context>();
+  context->init(0, nullptr);
+  options.context(context);
+
+  const auto node = std::make_shared<ScheduleNode>(options);
+
+  const auto a = register_test_participant(*node, "a");
+  const auto b = register_test_participant(*node, "b");
+
+  // The two participants cross paths at the origin, so every version of their
+  // itineraries is in conflict.
+  const auto make_set = [&](
+    const rmf_traffic::schedule::ParticipantId participant,
+    const Eigen::Vector3d& direction,
+    const rmf_traffic::Time start,
+    const rmf_traffic::schedule::ItineraryVersion version)
+    {
+      rmf_traffic::Trajectory trajectory;
+      trajectory.insert(start, -10.0*direction, Eigen::Vector3d::Zero());
+      trajectory.insert(start + 20s, 10.0*direction, Eigen::Vector3d::Zero());
+
+      ScheduleNode::ItinerarySet set;
+      set.participant = participant;
+      set.itinerary = rmf_traffic_ros2::convert(
+        rmf_traffic::schedule::Writer::Input{
+          {version,
+            std::make_shared<rmf_traffic::Route>("test_map", trajectory)}
+        });
+      set.itinerary_version = version;
+      return set;
+    };
+
+  const auto count_negotiations = [&]()
+    {
+      std::lock_guard<std::mutex> lock(node->active_conflicts_mutex);
+      return node->active_conflicts._negotiations.size();
+    };
+
+  // The conflict checking thread of the node opens negotiations from the
+  // published states of the database while this thread keeps applying new
+  // itineraries, the same way the itinerary batch timer would.
+  const rmf_traffic::Time now = std::chrono::steady_clock::now();
+  for (rmf_traffic::schedule::ItineraryVersion v = 0; v < 200; ++v)
+  {
+    const auto start = now + std::chrono::milliseconds(10*v);
+    node->itinerary_set(make_set(a, Eigen::Vector3d::UnitX(), start, v));
+    node->itinerary_set(make_set(b, Eigen::Vector3d::UnitY(), start, v));
+    node->apply_itinerary_changes();
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (count_negotiations() == 0 && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(10ms);
+
+  THEN("A negotiation is opened for the participants that are in conflict")
+  {
+    std::lock_guard<std::mutex> lock(node->active_conflicts_mutex);
+    const auto& negotiations = node->active_conflicts._negotiations;
+    REQUIRE(negotiations.size() == 1);
+
+    const auto& room = negotiations.begin()->second;
+    REQUIRE(room);
+    const auto& participants = room->negotiation.participants();
+    CHECK(participants.size() == 2);
+    CHECK(participants.count(a) == 1);
+    CHECK(participants.count(b) == 1);
+  }
+
+  context->shutdown("test finished");
+}
+
+//==============================================================================
+SCENARIO("Conflict check workers find the conflicts of a whole batch")
+{
+  rclcpp::NodeOptions options;
+  const auto context = std::make_shared<rclcpp::Context>();
+  context->init(0, nullptr);
+  options.context(context);
+  options.parameter_overrides({{"conflict_check_threads", 4}});
+
+  const auto node = std::make_shared<ScheduleNode>(options);
+  REQUIRE(node->conflict_check_threads == 4);
+
+  // Each pair of participants crosses paths far away from the other pairs
+  const std::size_t NumPairs = 5;
+  std::vector<std::array<rmf_traffic::schedule::ParticipantId, 2>> pairs;
+  for (std::size_t i = 0; i < NumPairs; ++i)
+  {
+    const auto name = std::to_string(i);
+    pairs.push_back({
+        register_test_participant(*node, "horizontal_" + name),
+        register_test_participant(*node, "vertical_" + name)
+      });
+  }
+
+  const rmf_traffic::Time now = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < NumPairs; ++i)
+  {
+    const Eigen::Vector3d center{100.0*i, 0.0, 0.0};
+    for (std::size_t j = 0; j < 2; ++j)
+    {
+      const Eigen::Vector3d direction =
+        j == 0 ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY();
+
+      rmf_traffic::Trajectory trajectory;
+      trajectory.insert(
+        now, center - 10.0*direction, Eigen::Vector3d::Zero());
+      trajectory.insert(
+        now + 20s, center + 10.0*direction, Eigen::Vector3d::Zero());
+
+      ScheduleNode::ItinerarySet set;
+      set.participant = pairs[i][j];
+      set.itinerary = rmf_traffic_ros2::convert(
+        rmf_traffic::schedule::Writer::Input{
+          {0, std::make_shared<rmf_traffic::Route>("test_map", trajectory)}
+        });
+      set.itinerary_version = 0;
+      node->itinerary_set(set);
+    }
+  }
+
+  // All of the changes reach the conflict checking thread in one batch, so it
+  // splits them between its workers.
+  node->apply_itinerary_changes();
+
+  const auto count_negotiations = [&]()
+    {
+      std::lock_guard<std::mutex> lock(node->active_conflicts_mutex);
+      return node->active_conflicts._negotiations.size();
+    };
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (count_negotiations() < NumPairs
+    && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(10ms);
+
+  THEN("Each pair gets a negotiation of its own")
+  {
+    std::lock_guard<std::mutex> lock(node->active_conflicts_mutex);
+    const auto& negotiations = node->active_conflicts._negotiations;
+    REQUIRE(negotiations.size() == NumPairs);
+
+    for (const auto& pair : pairs)
+    {
+      std::size_t found = 0;
+      for (const auto& n : negotiations)
+      {
+        REQUIRE(n.second);
+        const auto& participants = n.second->negotiation.participants();
+        if (participants.count(pair[0]))
+        {
+          CHECK(participants.size() == 2);
+          CHECK(participants.count(pair[1]) == 1);
+          ++found;
+        }
+      }
+
+      CHECK(found == 1);
+    }
+  }
+
+  context->shutdown("test finished");
+}
+
+//==============================================================================
+SCENARIO("Expired routes are culled a slice at a time")
+{
+  rclcpp::NodeOptions options;
+  const auto context = std::make_shared<rclcpp::Context>();
+  context->init(0, nullptr);
+  options.context(context);
+
+  const auto node = std::make_shared<ScheduleNode>(options);
+  REQUIRE(node->cull_horizon);
+
+  const auto participant = register_test_participant(*node, "participant");
+
+  // More routes than one call of cull_expired_routes will remove
+  const std::size_t NumRoutes = 2500;
+  const rmf_traffic::Time now =
+    rmf_traffic_ros2::convert(node->get_clock()->now());
+  const rmf_traffic::Time expired = now - *node->cull_horizon - 1h;
+
+  rmf_traffic::schedule::Writer::Input input;
+  for (std::size_t i = 0; i < NumRoutes; ++i)
+  {
+    const auto start = expired - std::chrono::seconds(20*(NumRoutes - i));
+    rmf_traffic::Trajectory trajectory;
+    trajectory.insert(start, {0, 0, 0}, {0, 0, 0});
+    trajectory.insert(start + 10s, {10, 0, 0}, {0, 0, 0});
+    input.push_back(
+      {i, std::make_shared<rmf_traffic::Route>("test_map", trajectory)});
+  }
+
+  ScheduleNode::ItinerarySet set;
+  set.participant = participant;
+  set.itinerary = rmf_traffic_ros2::convert(input);
+  set.itinerary_version = 0;
+  node->itinerary_set(set);
+  node->apply_itinerary_changes();
+  REQUIRE(node->database->get_itinerary(participant)->size() == NumRoutes);
+
+  node->cull_expired_routes();
+  REQUIRE(node->cull_in_progress);
+
+  std::size_t calls = 1;
+  while (node->cull_in_progress && calls < 10)
+  {
+    node->cull_expired_routes();
+    ++calls;
+  }
+
+  CHECK_FALSE(node->cull_in_progress);
+  CHECK(calls >= 3);
+  CHECK(node->database->get_itinerary(participant)->empty());
+
+  // The next cull does not begin until the cull period has passed
+  const auto version = node->database->latest_version();
+  node->cull_expired_routes();
+  CHECK_FALSE(node->cull_in_progress);
+  CHECK(node->database->latest_version() == version);
+
+  context->shutdown("test finished");
+}